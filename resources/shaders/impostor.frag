@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec3 atlasCoord0;
+in vec3 atlasCoord1;
+in float yawBlend;
+flat in float fade;
+
+uniform sampler2DArray atlas;
+
+// colour
+out vec4 fragColour;
+
+// 4x4 ordered dither. fading in drops fewer and fewer of these, and the mesh
+// (phong.frag) drops exactly the ones kept here, so impostors cross-fade with
+// the mesh without being sorted or blended
+const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0,
+                                  12.0, 4.0, 14.0, 6.0,
+                                  3.0, 11.0, 1.0, 9.0,
+                                  15.0, 7.0, 13.0, 5.0);
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+
+    vec4 colour = mix(texture(atlas, atlasCoord0), texture(atlas, atlasCoord1), yawBlend);
+    if (colour.a < 0.5 || fade < threshold) {
+        discard;
+    }
+    // the snapshots are on a transparent black background, which filtering blends
+    // in at the edges. dividing by coverage takes it back out
+    fragColour = vec4(colour.rgb / colour.a, 1.0);
+}
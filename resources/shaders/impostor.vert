@@ -0,0 +1,54 @@
+#version 330 core
+
+// from VBO: corner of the quad, in [-1, 1]
+layout(location = 0) in vec2 corner;
+// per instance (see ImpostorRenderer::Instance)
+layout(location = 1) in vec4 centerRadius;     // body centre and bounding radius
+layout(location = 2) in vec4 forwardPhaseFade; // heading (x, z), gait phase, fade
+layout(location = 3) in float layer;           // atlas layer of the spider's rig
+
+// projection * view matrix and camera position
+uniform mat4 projView;
+uniform vec3 cameraPos;
+
+// atlas layout: a row per elevation, and a column per heading within a block per pose
+uniform int yaws;
+uniform int elevations;
+uniform float elevationStep;
+uniform int poses;
+
+// to fragment shader: the snapshots either side of the camera's heading
+out vec3 atlasCoord0;
+out vec3 atlasCoord1;
+out float yawBlend;
+flat out float fade; // flat, so it matches the mesh's exactly
+
+void main() {
+    vec3 center = centerRadius.xyz;
+    float radius = centerRadius.w;
+
+    // face the camera, upright like the snapshots
+    vec3 toCamera = normalize(cameraPos - center);
+    vec3 right = cross(-toCamera, vec3(0.0, 1.0, 0.0));
+    right = length(right) > 1e-4 ? normalize(right) : vec3(1.0, 0.0, 0.0);
+    vec3 up = cross(right, -toCamera);
+    gl_Position = projView * vec4(center + radius * (corner.x * right + corner.y * up), 1.0);
+
+    // where the camera is from the spider: x forward, y up, z to its right
+    vec2 forward = length(forwardPhaseFade.xy) > 1e-4 ? normalize(forwardPhaseFade.xy) : vec2(1.0, 0.0);
+    vec3 local = vec3(dot(toCamera.xz, forward), toCamera.y, dot(toCamera.xz, vec2(-forward.y, forward.x)));
+
+    float yaw = atan(local.z, local.x) / 6.28318531 * float(yaws);
+    yaw = mod(yaw + float(yaws), float(yaws));
+    float yaw0 = floor(yaw);
+    float yaw1 = mod(yaw0 + 1.0, float(yaws));
+    yawBlend = yaw - yaw0;
+    float row = clamp(floor(asin(clamp(local.y, -1.0, 1.0)) / elevationStep + 0.5), 0.0, float(elevations - 1));
+    float pose = mod(floor(forwardPhaseFade.z * float(poses) + 0.5), float(poses));
+
+    vec2 cell = corner * 0.5 + 0.5;
+    float cols = float(yaws * poses);
+    atlasCoord0 = vec3((pose * float(yaws) + yaw0 + cell.x) / cols, (row + cell.y) / float(elevations), layer);
+    atlasCoord1 = vec3((pose * float(yaws) + yaw1 + cell.x) / cols, atlasCoord0.y, layer);
+    fade = forwardPhaseFade.w;
+}
@@ -32,15 +32,24 @@ struct Light {
 // vertex and norm in world space (for phong)
 in vec3 worldSpacePos;
 in vec3 worldSpaceNorm;
+flat in int materialIndex;
 
 // uniforms
 uniform GlobalData globalData;
 uniform int numLights;
 uniform Light lights[16];
-uniform Material objMaterial;
+uniform Material objMaterials[8]; // 0 unless drawing a merged mesh
 
 uniform vec3 cameraPos;
 
+// how far a spider has faded into its impostor (spider/impostors.h). the cells of
+// the dither pattern its impostor fills in are dropped. 0 for everything else
+uniform float fade;
+const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0,
+                                  12.0, 4.0, 14.0, 6.0,
+                                  3.0, 11.0, 1.0, 9.0,
+                                  15.0, 7.0, 13.0, 5.0);
+
 // colour
 out vec4 fragColour;
 
@@ -113,7 +122,13 @@ vec4 getDirToLight(Light light, vec3 worldSpacePos) {
 }
 
 void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    if (fade >= (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0) {
+        discard;
+    }
+
     vec4 normalizedNorm = vec4(normalize(worldSpaceNorm), 0.0);
+    Material objMaterial = objMaterials[materialIndex];
 
     // AMBIENT
     vec4 illumination = globalData.ka * objMaterial.cAmbient;
@@ -144,7 +159,8 @@ void main() {
         }
     }
 
-    // clamp to [0,1]
-    fragColour = clampToColour(illumination);
+    // clamp to [0,1]. opaque, so impostor snapshots (spider/impostors.h) get
+    // their coverage from alpha
+    fragColour = vec4(clampToColour(illumination).rgb, 1.0);
 }
 
@@ -1,8 +1,13 @@
 #version 330 core
 
-// from VBO
-layout(location = 0) in vec3 objSpacePos;
+// from VBO, as floats or packed (utils/geometry_arena.h). packed, the position
+// is quantized with the material index in w, and the normal is octahedral xy
+layout(location = 0) in vec4 objSpacePos;
 layout(location = 1) in vec3 objSpaceNorm;
+// index into objMaterials, for merged meshes (utils/merged_mesh.h). 0 for
+// shapes drawn on their own
+layout(location = 2) in float objMaterialIndex;
+uniform bool packedVertices;
 
 // model matrix for object, and transpose-inverse matrix for converting normals
 uniform mat4 model;
@@ -14,11 +19,30 @@ uniform mat4 projView;
 // to fragment shader (for phong)
 out vec3 worldSpacePos;
 out vec3 worldSpaceNorm;
+flat out int materialIndex;
+
+// undoes GeometryArena's octahedralEncode
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return n;
+}
 
 void main() {
+    vec3 position = objSpacePos.xyz;
+    vec3 normal = objSpaceNorm;
+    materialIndex = int(objMaterialIndex + 0.5);
+    if (packedVertices) {
+        // the model matrix takes the position out of its quantization box
+        normal = octahedralDecode(objSpaceNorm.xy);
+        materialIndex = int(round(objSpacePos.w * 8.0));
+    }
+
     // calculate world space position and normal
-    worldSpacePos = vec3(model * vec4(objSpacePos, 1.0));
-    worldSpaceNorm = normalize(normModel * objSpaceNorm);
+    worldSpacePos = vec3(model * vec4(position, 1.0));
+    worldSpaceNorm = normalize(normModel * normal);
 
     // set gl_Position to the object space position transformed to clip space
     gl_Position = projView * vec4(worldSpacePos, 1.0);
@@ -1,21 +1,65 @@
 #version 330 core
-layout(location = 0) in vec3 vertex;
-layout(location = 1) in vec3 normal;
-layout(location = 2) in vec3 inColor;
-out vec4 vert;
-out vec4 norm;
-out vec3 color;
-out vec3 lightDir;
-
-uniform mat4 projMatrix;
-uniform mat4 mvMatrix;
-uniform vec4 cameraPos;
-
-void main()
-{
-    vert  = mvMatrix * vec4(vertex, 1.0);
-    norm  = transpose(inverse(mvMatrix)) *  vec4(normal, 0.0);
-    color = inColor;
-    lightDir = normalize(vec3(mvMatrix * vec4(1, 0, 1, 0)));
-    gl_Position = projMatrix * mvMatrix * vec4(vertex, 1.0);
+
+// from VBO: grid coordinates of the vertex in the node, in [0, gridCells]
+layout(location = 0) in vec2 gridPos;
+
+// node being drawn
+uniform vec2 nodeOrigin;   // world xz of the node's corner
+uniform float nodeCellSize; // world distance between grid vertices
+uniform vec2 morphRange;   // distance where morphing to the coarser grid starts and ends
+
+// height texture stack. layer i covers a window of textureSize^2 texels spaced
+// layerTexelSize[i] apart, starting at texel layerOrigin[i] (in world texels).
+// texels wrap around the texture, so the window can scroll without moving data
+uniform sampler2DArray heights;
+uniform int numLayers;
+uniform float textureSize;
+uniform float layerTexelSize[8];
+uniform vec2 layerOrigin[8];
+
+// projection * view matrix and camera position
+uniform mat4 projView;
+uniform vec3 cameraPos;
+
+// to fragment shader (for phong)
+out vec3 worldSpacePos;
+out vec3 worldSpaceNorm;
+flat out int materialIndex;
+
+// finest layer whose window holds worldXZ, with room for the normal's neighbours
+int layerAt(vec2 worldXZ) {
+    for (int i = 0; i < numLayers - 1; i++) {
+        vec2 rel = worldXZ / layerTexelSize[i] - layerOrigin[i];
+        if (all(greaterThanEqual(rel, vec2(2.0))) && all(lessThanEqual(rel, vec2(textureSize - 3.0)))) {
+            return i;
+        }
+    }
+    return numLayers - 1;
+}
+
+float heightAt(vec2 texel, int layer) {
+    return texture(heights, vec3((texel + 0.5) / textureSize, float(layer))).r;
+}
+
+void main() {
+    // morph odd vertices onto the grid of the next coarser level as they near the
+    // end of this level's range, so neighbouring levels meet without cracks
+    vec2 worldXZ = nodeOrigin + gridPos * nodeCellSize;
+    float morph = clamp((distance(worldXZ, cameraPos.xz) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    vec2 morphedGrid = gridPos - fract(gridPos * 0.5) * 2.0 * morph;
+    worldXZ = nodeOrigin + morphedGrid * nodeCellSize;
+
+    // displace by the height texture. the layer depends only on position, so
+    // vertices shared by two nodes always get the same height
+    int layer = layerAt(worldXZ);
+    vec2 texel = worldXZ / layerTexelSize[layer];
+    float height = heightAt(texel, layer);
+    float dx = heightAt(texel + vec2(1.0, 0.0), layer) - heightAt(texel - vec2(1.0, 0.0), layer);
+    float dz = heightAt(texel + vec2(0.0, 1.0), layer) - heightAt(texel - vec2(0.0, 1.0), layer);
+
+    worldSpacePos = vec3(worldXZ.x, height, worldXZ.y);
+    worldSpaceNorm = normalize(vec3(-dx, 2.0 * layerTexelSize[layer], -dz));
+    materialIndex = 0;
+
+    gl_Position = projView * vec4(worldSpacePos, 1.0);
 }
@@ -3,8 +3,12 @@
 #include <QCoreApplication>
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <algorithm>
 #include <iostream>
+#include <cmath>
+#include <sstream>
 #include "settings.h"
+#include "utils/frame_arena.h"
 #include "utils/shaderloader.h"
 
 #include <QOpenGLShaderProgram>
@@ -13,8 +17,7 @@
 
 Realtime::Realtime(QWidget *parent)
     : QOpenGLWidget(parent),
-      m_camera(glm::vec3(0), glm::vec3(0), glm::vec3(0), 0, 0, 0, 0, 0),
-      m_spider(0, 0, 0, 0, 0, 0, 0, 0, 0)
+      m_camera(glm::vec3(0), glm::vec3(0), glm::vec3(0), 0, 0, 0, 0, 0)
 {
     m_prev_mouse_pos = glm::vec2(size().width()/2, size().height()/2);
     setMouseTracking(true);
@@ -34,15 +37,23 @@ void Realtime::finish() {
     killTimer(m_timer);
     this->makeCurrent();
 
-    // clean up VBO and VAO memory
-    std::vector<GLuint> vbos{m_cubeVBO, m_cylinderVBO, m_sphereVBO};
-    std::vector<GLuint> vaos{m_cubeVAO, m_cylinderVAO, m_sphereVAO};
-    glDeleteBuffers(3, vbos.data());
-    glDeleteVertexArrays(3, vaos.data());
+    // clean up vertex and index buffers
+    m_geometry.finish();
 
     // delete shader data
     glDeleteProgram(m_phong_shader);
 
+    // delete terrain and impostor GL objects
+    m_terrainRenderer.finish();
+    m_impostors.finish();
+
+    // unmap heightmap and stop terrain workers
+    setHeightSource(nullptr);
+    setObstacles(nullptr);
+    m_terrainEdits.reset();
+    m_heightmap.reset();
+    m_proceduralTerrain.reset();
+
     this->doneCurrent();
 }
 
@@ -84,10 +95,11 @@ void Realtime::initializeGL() {
                       size().width(), size().height(),
                       0.1f, 100.0f);
 
-    // set up shape VBOs
-    initializeVBO(m_cubeBuffer, m_cubeVBO, m_cubeVAO, PrimitiveType::PRIMITIVE_CUBE);
-    initializeVBO(m_cylinderBuffer, m_cylinderVBO, m_cylinderVAO, PrimitiveType::PRIMITIVE_CYLINDER);
-    initializeVBO(m_sphereBuffer, m_sphereVBO, m_sphereVAO, PrimitiveType::PRIMITIVE_SPHERE);
+    // set up shapes. they go in the arena with the meshes below, uploaded once it's all there
+    m_geometry.finish();
+    initializeShape(m_cubeBuffer, m_cubeMesh, PrimitiveType::PRIMITIVE_CUBE);
+    initializeShape(m_cylinderBuffer, m_cylinderMesh, PrimitiveType::PRIMITIVE_CYLINDER);
+    initializeShape(m_sphereBuffer, m_sphereMesh, PrimitiveType::PRIMITIVE_SPHERE);
 
     // sending uniforms to phong shader
     glUseProgram(m_phong_shader);
@@ -95,14 +107,111 @@ void Realtime::initializeGL() {
     sendLightsToShader(m_phong_shader, m_lights);
     glUseProgram(0);
 
-    // setting up spider
-    m_spider = Spider(m_phong_shader,
-                      m_cylinderVAO, m_cylinderBuffer.size() / 6,
-                      m_sphereVAO, m_sphereBuffer.size() / 6,
-                      0.4f, 0.4f, 0.05f,0.2f);
+    // set up terrain renderer, lit the same way
+    m_terrainRenderer.initialize(settings.terrainLodLevels, settings.terrainLeafSize,
+                                 settings.terrainGridCells, settings.terrainTextureSize);
+    glUseProgram(m_terrainRenderer.shader());
+    sendGlobalDataToShader(m_terrainRenderer.shader(), 1.0f, 1.0f, 1.0f);
+    sendLightsToShader(m_terrainRenderer.shader(), m_lights);
+    glUseProgram(0);
+
+    // map the heightmap, if there is one
+    if (!settings.heightmapPath.empty()) {
+        m_heightmap = std::make_unique<TiledHeightmap>(settings.heightmapPath,
+                                                       settings.heightmapMaxResidentTiles);
+        if (m_heightmap->isOpen()) {
+            setHeightSource(m_heightmap.get());
+        } else {
+            m_heightmap.reset();
+        }
+    }
+
+    // otherwise generate the floor, if asked to
+    if (!m_heightmap && settings.proceduralTerrain) {
+        ProceduralTerrain::Params params;
+        params.seed = settings.terrainSeed;
+        params.octaves = settings.terrainOctaves;
+        params.frequency = settings.terrainFrequency;
+        params.amplitude = settings.terrainAmplitude;
+        params.lacunarity = settings.terrainLacunarity;
+        params.gain = settings.terrainGain;
+        params.chunkCells = settings.terrainChunkCells;
+        params.cellSize = settings.terrainCellSize;
+        params.maxChunks = settings.terrainMaxChunks;
+        params.workers = settings.terrainWorkers;
+        params.cacheDir = settings.terrainCacheDir;
+        m_proceduralTerrain = std::make_unique<ProceduralTerrain>(params);
+        setHeightSource(m_proceduralTerrain.get());
+    }
+
+    // edits go on top of whichever floor that left
+    if (settings.terrainEditing) {
+        m_terrainEdits = std::make_unique<EditableTerrain>(getHeightSource(), settings.terrainEditCellSize,
+                                                           settings.terrainEditChunkCells);
+        setHeightSource(m_terrainEdits.get());
+    }
+
+    // obstacles stand on that floor
+    initializeObstacles();
+
+    // every spider's body, whatever its rig
+    m_spiderBodyMesh.clear();
+    Spider::buildBodyMesh(m_sphereBuffer, m_spiderBodyMesh, m_geometry);
+    m_geometry.upload(settings.packedVertices);
+    float triangles = std::max(m_geometry.indexCount() / 3, 1);
+    float vertices = std::max(m_geometry.vertexCount(), 1);
+    std::cout << "Geometry: " << m_geometry.vertexCount() << " vertices (" << m_geometry.vertexBytes() / 1024
+              << " KiB), " << m_geometry.indexCount() / 3 << " triangles, ACMR "
+              << m_geometry.cacheMissesAdded() / triangles << " -> " << m_geometry.cacheMisses() / triangles
+              << ", ATVR " << m_geometry.cacheMissesAdded() / vertices << " -> "
+              << m_geometry.cacheMisses() / vertices << std::endl;
+    glUseProgram(m_phong_shader);
+    glUniform1i(glGetUniformLocation(m_phong_shader, "packedVertices"), m_geometry.packed());
+    glUseProgram(0);
+
+    // the rigs spiders take turns being built from
+    m_rigs.clear();
+    m_nextRig = 0;
+    std::stringstream rigPaths(settings.spiderRigs);
+    std::string rigPath;
+    while (std::getline(rigPaths, rigPath, ';')) {
+        if (!rigPath.empty()) {
+            m_rigs.push_back(Rig::shared(rigPath));
+        }
+    }
+    if (m_rigs.empty()) {
+        m_rigs.push_back(Rig::shared(""));
+    }
+    // IK tables for their segment lengths are built now rather than on the first
+    // frame that needs them. spiders pick them up from IKTable::shared
+    if (settings.ikTable) {
+        for (const std::shared_ptr<const Rig>& rig : m_rigs) {
+            IKTable::shared(rig->segLength1, rig->segLength2, settings.ikTableResolution,
+                            (std::size_t)settings.ikTableBudgetKB * 1024);
+        }
+    }
+    if (settings.impostors) {
+        m_impostors.initialize(m_rigs, m_phong_shader, m_cylinderMesh, m_sphereMesh,
+                               defaultFramebufferObject());
+    }
+
+    // setting up spiders. the player starts at the origin, the rest are laid out
+    // in a grid next to it. there's room for twice as many before the pool grows
+    m_spiders.clear();
+    m_spiders.reserve(2 * settings.numSpiders);
+    int gridSize = (int)std::ceil(std::sqrt((float)settings.numSpiders));
+    for (int i = 0; i < settings.numSpiders; i++) {
+        glm::vec3 startPos(-2.0f * (i % gridSize), 0, -2.0f * (i / gridSize));
+        Pool<Spider>::Handle spider = spawnSpider(startPos);
+        if (i == 0) {
+            m_player = spider;
+        }
+    }
 }
 
 void Realtime::paintGL() {
+    FrameAllocCheck allocCheck("paint");
+
     // clear screen to black
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -110,12 +219,58 @@ void Realtime::paintGL() {
     glUseProgram(m_phong_shader);
     sendCameraDataToShader(m_phong_shader, m_camera);
     glUseProgram(0);
+    m_frustum = Frustum::fromMatrix(m_camera.projMatrix() * m_camera.viewMatrix());
+
+    // stream floor heights in around the camera and the spiders that are moving
+    HeightSource* heightSource = getHeightSource();
+    if (heightSource != nullptr) {
+        heightSource->prefetch(glm::vec2(m_camera.pos.x, m_camera.pos.z), settings.heightmapPrefetchRadius);
+        for (Spider& spider : m_spiders) {
+            if (!spider.resting) {
+                heightSource->prefetch(glm::vec2(spider.pos.x, spider.pos.z), 2.0f);
+            }
+        }
+    }
 
-    // paint the ground
-    paintFloor(0, 20);
+    // keep the floor pyramid around the camera for foot raycasts
+    if (settings.footRaycast) {
+        updateFloorPyramid(glm::vec2(m_camera.pos.x, m_camera.pos.z));
+    }
 
-    // paint spider
-    m_spider.paintSpider();
+    // paint the ground. the flat floor can't show a heightmap or generated terrain;
+    // otherwise it's merged into the scenery painted with the obstacles
+    if (settings.terrainLOD || heightSource != nullptr) {
+        m_terrainRenderer.paint(m_camera);
+    }
+    paintObstacles();
+
+    // pick animation LOD and animate spiders, then paint them
+    bool impostors = settings.impostors && m_impostors.isInitialized();
+    m_lodScheduler.update(m_spiders.live(), m_camera.pos, impostors);
+    // a spider despawned since the tick swaps another into its index
+    bool gridCurrent = m_spiders.size() > 1 && m_spiderGridRevision == m_spiders.revision();
+    Spider::animateAll(m_spiders.live(), gridCurrent ? &m_spiderGrid : nullptr);
+    if (heightSource != nullptr) {
+        heightSource->endFrame();
+    }
+    if (settings.ikTimeSlicing) {
+        m_ikScheduler.update(m_spiders.live(), m_camera);
+    }
+    // off-screen spiders were still animated above, they just aren't painted. far
+    // away ones fade into impostors, drawn together below
+    Spider::cullAll(m_spiders.live(), settings.frustumCulling ? &m_frustum : nullptr,
+                    m_meshSpiders, m_impostorSpiders);
+    for (Spider* spider : m_meshSpiders) {
+        spider->paintSpider(spider->impostorFade);
+    }
+    if (impostors) {
+        // everything else is painted whole
+        glUseProgram(m_phong_shader);
+        glUniform1f(glGetUniformLocation(m_phong_shader, "fade"), 0.0f);
+        glUseProgram(0);
+        m_impostors.add(m_impostorSpiders);
+        m_impostors.paint(m_camera);
+    }
 }
 
 void Realtime::resizeGL(int w, int h) {
@@ -137,6 +292,30 @@ void Realtime::settingsChanged() {
 
 void Realtime::keyPressEvent(QKeyEvent *event) {
     m_keyMap[Qt::Key(event->key())] = true;
+
+    // NAVIGATION, to where the player is
+    Spider* player = m_spiders.get(m_player);
+    if (event->key() == Qt::Key_N && !event->isAutoRepeat() && player != nullptr) {
+        addNavGoal(glm::vec2(player->pos.x, player->pos.z));
+        update(); // asks for a PaintGL() call to occur
+    }
+
+    // SPAWNING, next to the player, and despawning whichever spider is last
+    if (event->key() == Qt::Key_Equal && player != nullptr) {
+        glm::vec3 behind = player->pos - 1.5f * player->spiderLook();
+        spawnSpider(glm::vec3(behind.x, 0, behind.z));
+    }
+    if (event->key() == Qt::Key_Minus && m_spiders.size() > 1) {
+        int last = m_spiders.size() - 1;
+        m_spiders.despawn(m_spiders.handleAt(m_spiders.handleAt(last) == m_player ? last - 1 : last));
+    }
+    if (event->key() == Qt::Key_Equal || event->key() == Qt::Key_Minus) {
+        PoolStats stats = m_spiders.stats();
+        std::cout << "Spiders: " << stats.live << " live of " << stats.capacity << " built, high water "
+                  << stats.highWater << ", " << stats.constructions << " constructed for "
+                  << stats.spawns << " spawns, " << stats.reallocations << " reallocations" << std::endl;
+        update(); // asks for a PaintGL() call to occur
+    }
 }
 
 void Realtime::keyReleaseEvent(QKeyEvent *event) {
@@ -179,6 +358,10 @@ void Realtime::mouseMoveEvent(QMouseEvent *event) {
 }
 
 void Realtime::timerEvent(QTimerEvent *event) {
+    // everything allocated from the frame arenas last frame is done with
+    FrameArena::beginFrame();
+    FrameAllocCheck allocCheck("tick");
+
     int elapsedms   = m_elapsedTimer.elapsed();
     float deltaTime = elapsedms * 0.001f;
     m_elapsedTimer.restart();
@@ -219,25 +402,80 @@ void Realtime::timerEvent(QTimerEvent *event) {
     }
 
     // SPIDER MOVEMENT
-    if (m_keyMap[Qt::Key_Up]) {
-        m_camera.move(m_spider.spiderLook(), deltaTime / 5.0f);
-        m_spider.move(deltaTime, true);
-    }
-    if (m_keyMap[Qt::Key_Down]) {
-        m_camera.move(-m_spider.spiderLook(), deltaTime / 5.0f);
-        m_spider.move(deltaTime, false);
+    if (m_spiders.get(m_player) != nullptr) {
+        Spider& player = *m_spiders.get(m_player);
+        if (m_keyMap[Qt::Key_Up]) {
+            m_camera.move(player.spiderLook(), deltaTime / 5.0f);
+            player.move(deltaTime, true);
+        }
+        if (m_keyMap[Qt::Key_Down]) {
+            m_camera.move(-player.spiderLook(), deltaTime / 5.0f);
+            player.move(deltaTime, false);
+        }
+        if (m_keyMap[Qt::Key_Left]) {
+            player.rotateLook(deltaTime, true);
+        }
+        if (m_keyMap[Qt::Key_Right]) {
+            player.rotateLook(deltaTime, false);
+        }
+
+        // TERRAIN EDITING, under the player
+        if (m_terrainEdits) {
+            glm::vec2 center(player.pos.x, player.pos.z);
+            float radius = settings.terrainBrushRadius;
+            if (m_keyMap[Qt::Key_R]) {
+                m_terrainEdits->raise(center, radius, settings.terrainBrushRate * deltaTime);
+            }
+            if (m_keyMap[Qt::Key_F]) {
+                m_terrainEdits->lower(center, radius, settings.terrainBrushRate * deltaTime);
+            }
+            // towards the height right under the player
+            if (m_keyMap[Qt::Key_G]) {
+                m_terrainEdits->flatten(center, radius, getFloorHeight(center.x, center.y),
+                                        glm::min(1.0f, 4.0f * deltaTime));
+            }
+        }
     }
-    if (m_keyMap[Qt::Key_Left]) {
-        m_spider.rotateLook(deltaTime, true);
+
+    // everyone with a goal walks the way its field points, until they're close
+    if (!m_flowFields.empty()) {
+        for (std::unique_ptr<FlowField>& field : m_flowFields) {
+            field->update();
+        }
+        for (Spider& spider : m_spiders) {
+            if (spider.navGoal < 0 || spider.navGoal >= (int)m_flowFields.size()) {
+                continue;
+            }
+            const FlowField& field = *m_flowFields[spider.navGoal];
+            if (glm::distance(glm::vec2(spider.pos.x, spider.pos.z), field.goal()) > settings.navArriveRadius) {
+                spider.steer(field.direction(spider.pos), deltaTime);
+            }
+        }
     }
-    if (m_keyMap[Qt::Key_Right]) {
-        m_spider.rotateLook(deltaTime, false);
+
+    // keep the crowd from piling up, with neighbours from a fresh grid
+    if (m_spiders.size() > 1) {
+        m_spiderPositions.resize(m_spiders.size());
+        for (int i = 0; i < (int)m_spiders.size(); i++) {
+            m_spiderPositions[i] = m_spiders[i].pos;
+        }
+        m_spiderGrid.build(m_spiderPositions.data(), m_spiderPositions.size(),
+                           glm::max(settings.separationRadius, 0.5f));
+        m_spiderGridRevision = m_spiders.revision();
+        Spider::separateAll(m_spiders.live(), m_spiderGrid, deltaTime);
     }
 
-    // move time forward for all legs
-    for (Leg& leg : m_spider.legs) {
-        leg.tick(deltaTime);
+    // move time forward for all legs. those of spiders that are only impostors
+    // aren't simulated, and pick up where they were once back in range
+    for (Spider& spider : m_spiders) {
+        if (spider.impostorFade >= 1.0f) {
+            continue;
+        }
+        for (Leg& leg : spider.legs) {
+            leg.tick(deltaTime);
+        }
     }
 
+    allocCheck.end();
     update(); // asks for a PaintGL() call to occur
 }
@@ -13,7 +13,23 @@
 #include <QOpenGLWidget>
 #include <QTime>
 #include <QTimer>
+#include "utils/shapedraw.h"
+#include "utils/merged_mesh.h"
+#include "utils/frustum.h"
 #include "spider/spider.h"
+#include "spider/animation_lod.h"
+#include "spider/ik_scheduler.h"
+#include "spider/impostors.h"
+#include "terrain/height_source.h"
+#include "terrain/height_pyramid.h"
+#include "terrain/tiled_heightmap.h"
+#include "terrain/procedural_terrain.h"
+#include "terrain/editable_terrain.h"
+#include "terrain/terrain_renderer.h"
+#include "scene/static_scene.h"
+#include "scene/flow_field.h"
+#include "utils/pool.h"
+#include <memory>
 
 QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram)
 
@@ -29,17 +45,67 @@ public:
     static void sendGlobalDataToShader(GLuint phong_shader, float ka, float kd, float ks);
     static void sendCameraDataToShader(GLuint phong_shader, Camera& camera);
     static void sendLightsToShader(GLuint phong_shader, std::vector<SceneLightData>& lights);
+    // index is which of the shader's objMaterials to set (see utils/merged_mesh.h)
     static void sendMaterialToShader(GLuint phong_shader,
                                      glm::vec4 cAmbient, glm::vec4 cDiffuse, glm::vec4 cSpecular,
-                                     float shininess);
+                                     float shininess, int index = 0);
 
-    // paints a shape
+    // paints a shape. shaderID and the mesh's arena VAO must already be bound, so
+    // a run of shapes (a spider, see Spider::paintSpider) binds them once
     static void paintShape(GLuint shaderID,
-                           int bufferSize, GLuint vao,
-                           SceneMaterial material, glm::mat4 model);
+                           const GeometryArena::Mesh& mesh,
+                           const SceneMaterial& material, glm::mat4 model);
+    // paints a merged mesh, in one draw, with each part's own material. bound as
+    // for paintShape
+    static void paintMergedMesh(GLuint shaderID, const MergedMesh& mesh, glm::mat4 model);
+    // while draws is set, paintShape also appends each call to it. nullptr stops recording
+    static void recordShapes(std::vector<ShapeDraw>* draws);
+    // paints shapes recorded by recordShapes
+    static void paintShapes(GLuint shaderID, const std::vector<ShapeDraw>& draws);
 
     // gets height of floor at certain point. used by spider and legs
     static float getFloorHeight(float x, float z);
+    // upward unit normal of the floor at (x, z)
+    static glm::vec3 getFloorNormal(float x, float z);
+    // the flat floor, used when there's no height source
+    static float getBuiltInFloorHeight(float x, float z);
+    // fills out with floor heights on a grid (see HeightSource::sampleGrid)
+    static void sampleFloorGrid(glm::vec2 origin, float spacing, int countX, int countZ, float* out);
+    // true if sampleFloorGrid may be called off the main thread
+    static bool floorGridIsThreadSafe();
+    // static obstacles feet can stand on, or nullptr for none
+    static void setObstacles(const StaticScene* obstacles);
+    static const StaticScene* getObstacles();
+    // height a foot coming down at (x, z) from fromY lands at: the top of an
+    // obstacle, or else the floor
+    static float getGroundHeight(float x, float z, float fromY);
+    // where getFloorHeight gets heights from. nullptr for the built-in floor
+    static void setHeightSource(HeightSource* source);
+    static HeightSource* getHeightSource();
+    // first hit of a ray (dir normalized) with the floor or an obstacle within
+    // maxDist. rays that stay inside the floor pyramid's window are raycast
+    // through it exactly; others march the floor heights along the ray, about a
+    // pyramid cell at a time, and bisect the crossing (HeightPyramid::march)
+    static RayHit raycastFloor(glm::vec3 origin, glm::vec3 dir, float maxDist);
+    static void raycastFloor(const glm::vec3* origins, int count, glm::vec3 dir,
+                             float maxDist, RayHit* hits);
+    // rebuilds the floor pyramid around center if the floor changed or center
+    // has wandered towards the edge of its window
+    static void updateFloorPyramid(glm::vec2 center);
+    // incremented whenever the floor changes shape, so anything derived from it
+    // (like a resting spider's pose) knows to recompute
+    static unsigned int getTerrainRevision();
+    // the whole floor changed
+    static void terrainChanged();
+    // only the floor inside rect (min x, min z, max x, max z) changed
+    static void terrainChanged(glm::vec4 rect);
+    // appends the rects changed since revision to rects. the last 64 changes come
+    // one rect each, and any before them merged into one bounding box. returns
+    // false if that isn't known (the whole floor changed, or it was thousands of
+    // changes ago), in which case everything should be refreshed
+    static bool getTerrainChanges(unsigned int revision, std::vector<glm::vec4>& rects);
+    // true if the floor may have changed inside rect since revision
+    static bool terrainChangedIn(glm::vec4 rect, unsigned int revision);
 
 public slots:
     void tick(QTimerEvent* event);                      // Called once per tick of m_timer
@@ -74,6 +140,8 @@ private:
 
     // camera
     Camera m_camera;
+    // what it sees this frame, for culling
+    Frustum m_frustum;
 
     // lights
     std::vector<SceneLightData> m_lights;
@@ -82,25 +150,78 @@ private:
     std::vector<float> m_cubeBuffer;
     std::vector<float> m_cylinderBuffer;
     std::vector<float> m_sphereBuffer;
-    // shape VBO program IDs
-    GLuint m_cubeVBO;
-    GLuint m_cylinderVBO;
-    GLuint m_sphereVBO;
-    // shape VAO program IDs
-    GLuint m_cubeVAO;
-    GLuint m_cylinderVAO;
-    GLuint m_sphereVAO;
-
-    // spider object
-    Spider m_spider;
-
-    // paints floor to screen
-    void paintFloor(float y, float size);
+    // every mesh the phong shader draws, in one vertex and index buffer
+    GeometryArena m_geometry;
+    // the shapes' meshes in it
+    GeometryArena::Mesh m_cubeMesh;
+    GeometryArena::Mesh m_cylinderMesh;
+    GeometryArena::Mesh m_sphereMesh;
+
+    // heightmap loaded from settings.heightmapPath, if any
+    std::unique_ptr<TiledHeightmap> m_heightmap;
+    // noise floor, if settings.proceduralTerrain is on and there's no heightmap
+    std::unique_ptr<ProceduralTerrain> m_proceduralTerrain;
+    // runtime edits over whichever floor is in use, if settings.terrainEditing is on
+    std::unique_ptr<EditableTerrain> m_terrainEdits;
+    // draws the floor with LOD
+    TerrainRenderer m_terrainRenderer;
+
+    // obstacles: the bump, a ramp onto it and settings.obstacleProps props
+    StaticScene m_obstacles;
+    // the flat floor (when it's used), the bump and the ramp, in one draw. the
+    // first m_sceneryBoxes obstacle boxes are in it
+    MergedMesh m_sceneryMesh;
+    int m_sceneryBoxes;
+    // the rest of the boxes and the cylinders, each baked into world space in the
+    // arena, so every visible prop goes out in one multi-draw
+    std::vector<GeometryArena::Mesh> m_boxMeshes; // indexed like m_obstacles.boxes()
+    std::vector<GeometryArena::Mesh> m_cylinderMeshes;
+    std::vector<GeometryArena::Mesh> m_visibleMeshes; // scratch for paintObstacles
+    std::vector<int> m_visibleBoxes; // scratch for paintObstacles
+    std::vector<int> m_visibleCylinders;
+
+    // spiders. the player is controlled with the arrow keys; = spawns another
+    // next to it, and - despawns one
+    Pool<Spider> m_spiders;
+    Pool<Spider>::Handle m_player;
+    // rigs from settings.spiderRigs, which spawned spiders take turns being built from
+    std::vector<std::shared_ptr<const Rig>> m_rigs;
+    int m_nextRig = 0;
+    // every spider's body and eyes (Spider::buildBodyMesh)
+    MergedMesh m_spiderBodyMesh;
+    // picks how often each spider's legs are animated
+    AnimationLODScheduler m_lodScheduler;
+    // spreads leg IK solves over frames when settings.ikTimeSlicing is on
+    IKScheduler m_ikScheduler;
+    // paints far spiders as quads, when settings.impostors is on
+    ImpostorRenderer m_impostors;
+    // spiders on screen this frame, to paint as meshes and as impostors (Spider::cullAll)
+    std::vector<Spider*> m_meshSpiders;
+    std::vector<Spider*> m_impostorSpiders;
+    // neighbour grid over the spiders, rebuilt every tick. its indices are only
+    // good for the spiders it was built over, while m_spiders.revision() is this
+    SpatialHash m_spiderGrid;
+    uint64_t m_spiderGridRevision = UINT64_MAX;
+    std::vector<glm::vec3> m_spiderPositions; // scratch for building it
+    // navigation goals, oldest first. spiders with a navGoal follow one
+    std::vector<std::unique_ptr<FlowField>> m_flowFields;
+
+    // fills m_obstacles and adds the scenery and props to the arena
+    void initializeObstacles();
+    // paints the scenery, and props within settings.obstacleDrawDistance of the camera
+    // and in its view
+    void paintObstacles();
+
+    // spawns a spider at startPos (on the floor), built from the next rig in turn
+    Pool<Spider>::Handle spawnSpider(glm::vec3 startPos);
+    // builds a flow field to goal, dropping the oldest beyond settings.navMaxGoals,
+    // and shares the goals out over the spiders other than the player
+    void addNavGoal(glm::vec2 goal);
 
     // paints target point
     void paintTarget(glm::vec3 target);
 
     // helper for initializing the shape VBOs
-    void initializeVBO(std::vector<float>& buffer, GLuint& vbo, GLuint& vao,
-                       PrimitiveType type);
+    void initializeShape(std::vector<float>& buffer, GeometryArena::Mesh& mesh,
+                         PrimitiveType type);
 };
@@ -2,7 +2,10 @@
 #include "utils/scenedata.h"
 #include "settings.h"
 #include <GL/glew.h>
+#include <cfloat>
+#include <cstdio>
 #include <iostream>
+#include <random>
 #include "realtime.h"
 #include "shapes/Cube.cpp"
 #include "shapes/Cylinder.cpp"
@@ -37,56 +40,61 @@ void Realtime::sendLightsToShader(GLuint phong_shader,std::vector<SceneLightData
         numLights = 16;
     }
     glUniform1i(glGetUniformLocation(phong_shader, "numLights"), numLights);
+    char name[64];
     for (int i = 0; i < numLights; i++) {
-        std::string addr = "lights[" + std::to_string(i) + "]";
+        // location of a field of this light, named on the stack
+        auto field = [&](const char* member) {
+            std::snprintf(name, sizeof(name), "lights[%d].%s", i, member);
+            return glGetUniformLocation(phong_shader, name);
+        };
 
         switch(lights[i].type) {
         case LightType::LIGHT_POINT: // 0
             // type
-            glUniform1i(glGetUniformLocation(phong_shader, (addr+".lightType").c_str()),
+            glUniform1i(field("lightType"),
                         0);
             // colour
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".color").c_str()),
+            glUniform4fv(field("color"),
                          1, &lights[i].color[0]);
             // attenuation function
-            glUniform3fv(glGetUniformLocation(phong_shader, (addr+".function").c_str()),
+            glUniform3fv(field("function"),
                          1, &lights[i].function[0]);
             // position
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".pos").c_str()),
+            glUniform4fv(field("pos"),
                         1, &lights[i].pos[0]);
             break;
         case LightType::LIGHT_DIRECTIONAL: // 1
             // type
-            glUniform1i(glGetUniformLocation(phong_shader, (addr+".lightType").c_str()),
+            glUniform1i(field("lightType"),
                         1);
             // colour
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".color").c_str()),
+            glUniform4fv(field("color"),
                          1, &lights[i].color[0]);
             // direction
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".dir").c_str()),
+            glUniform4fv(field("dir"),
                         1, &lights[i].dir[0]);
             break;
         case LightType::LIGHT_SPOT: // 2
             // type
-            glUniform1i(glGetUniformLocation(phong_shader, (addr+".lightType").c_str()),
+            glUniform1i(field("lightType"),
                         2);
             // colour
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".color").c_str()),
+            glUniform4fv(field("color"),
                          1, &lights[i].color[0]);
             // attenuation function
-            glUniform3fv(glGetUniformLocation(phong_shader, (addr+".function").c_str()),
+            glUniform3fv(field("function"),
                          1, &lights[i].function[0]);
             // position
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".pos").c_str()),
+            glUniform4fv(field("pos"),
                         1, &lights[i].pos[0]);
             // direction
-            glUniform4fv(glGetUniformLocation(phong_shader, (addr+".dir").c_str()),
+            glUniform4fv(field("dir"),
                         1, &lights[i].dir[0]);
             // penumbra
-            glUniform1f(glGetUniformLocation(phong_shader, (addr+".spotPenumbra").c_str()),
+            glUniform1f(field("spotPenumbra"),
                         lights[i].penumbra);
             // angle
-            glUniform1f(glGetUniformLocation(phong_shader, (addr+".spotAngle").c_str()),
+            glUniform1f(field("spotAngle"),
                         lights[i].angle);
             break;
         default:
@@ -96,32 +104,38 @@ void Realtime::sendLightsToShader(GLuint phong_shader,std::vector<SceneLightData
 }
 
 /**
- * @brief sends an object's material to phong shader
+ * @brief sends an object's material to phong shader, as objMaterials[index]
  */
 void Realtime::sendMaterialToShader(GLuint phong_shader,
                                     glm::vec4 cAmbient, glm::vec4 cDiffuse, glm::vec4 cSpecular,
-                                    float shininess) {
-    glUniform4fv(glGetUniformLocation(phong_shader, "objMaterial.cAmbient"),
+                                    float shininess, int index) {
+    char name[64];
+    // location of a field of this material, named on the stack
+    auto field = [&](const char* member) {
+        std::snprintf(name, sizeof(name), "objMaterials[%d].%s", index, member);
+        return glGetUniformLocation(phong_shader, name);
+    };
+    glUniform4fv(field("cAmbient"),
                  1, &cAmbient[0]);
-    glUniform4fv(glGetUniformLocation(phong_shader, "objMaterial.cDiffuse"),
+    glUniform4fv(field("cDiffuse"),
                  1, &cDiffuse[0]);
-    glUniform4fv(glGetUniformLocation(phong_shader, "objMaterial.cSpecular"),
+    glUniform4fv(field("cSpecular"),
                  1, &cSpecular[0]);
 
-    glUniform1f(glGetUniformLocation(phong_shader, "objMaterial.shininess"),
+    glUniform1f(field("shininess"),
                 shininess);
 }
 
 /**
- * @brief sets up the VBO for a given primitive type
- * @param bufferData - reference to vector used to store the vertex/normal data
- * @param vbo - VBO ID in shader
- * @param vao - VAO ID in shader
+ * @brief builds a primitive's vertices and adds them to the geometry arena
+ * @param buffer - reference to vector used to store the vertex/normal data
+ * @param mesh - where the primitive ends up in the arena
  * @param type - type of primitive (supports cube, cylinder, sphere)
  */
-void Realtime::initializeVBO(std::vector<float>& buffer, GLuint& vbo, GLuint& vao,
-                             PrimitiveType type) {
+void Realtime::initializeShape(std::vector<float>& buffer, GeometryArena::Mesh& mesh,
+                               PrimitiveType type) {
     // populate buffer data
+    buffer.clear();
     switch(type) {
     case PrimitiveType::PRIMITIVE_CUBE:
         Shapes::Cube::makeCube(25, 25, buffer);
@@ -135,86 +149,507 @@ void Realtime::initializeVBO(std::vector<float>& buffer, GLuint& vbo, GLuint& va
     default:
         break;
     }
-    // generate and bind VBO ID
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    // send buffer data to GPU
-    glBufferData(GL_ARRAY_BUFFER, buffer.size()*sizeof(GLfloat),
-                 buffer.data(), GL_STATIC_DRAW);
-    // generate and bind VAO ID
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    // set attributes
-    glEnableVertexAttribArray(0); // position
-    glEnableVertexAttribArray(1); // normal
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat),
-                          reinterpret_cast<void*>(0));
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat),
-                          reinterpret_cast<void*>(3*sizeof(GLfloat)));
-    // unbind VBO and VAO
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    mesh = m_geometry.add(buffer);
 }
 
-void Realtime::paintShape(GLuint shaderID,
-                          int bufferSize, GLuint vao,
-                          SceneMaterial material, glm::mat4 model) {
-    // bind shader
-    glUseProgram(shaderID);
-    // bind VAO
-    glBindVertexArray(vao);
+// draw list paintShape appends to, if any (see recordShapes)
+static std::vector<ShapeDraw>* s_recordedShapes = nullptr;
+
+// current shape of the floor (see getTerrainRevision)
+static unsigned int s_terrainRevision = 0;
+// the last revision that changed the whole floor, and the rect each later
+// revision changed, indexed by revision modulo the log size
+static const unsigned int TERRAIN_CHANGE_LOG_SIZE = 64;
+static unsigned int s_terrainFullChangeRevision = 0;
+static glm::vec4 s_terrainChangeLog[TERRAIN_CHANGE_LOG_SIZE];
+// bounding box of the rects changed in each block of TERRAIN_CHANGE_LOG_SIZE
+// revisions, for changes that have fallen out of the log. indexed by block
+// modulo the number of blocks, and tagged with block + 1 (0 for never used)
+static const unsigned int TERRAIN_CHANGE_BLOCKS = 64;
+struct TerrainChangeBlock {
+    unsigned int tag;
+    glm::vec4 bounds;
+};
+static TerrainChangeBlock s_terrainChangeBlocks[TERRAIN_CHANGE_BLOCKS];
+
+// where floor heights come from. nullptr for the built-in floor
+static HeightSource* s_heightSource = nullptr;
 
-    // send material uniform to shader
-    Realtime::sendMaterialToShader(shaderID, material.cAmbient, material.cDiffuse,
-                                   material.cSpecular, material.shininess);
-    // send model to vertex shader
+// min/max pyramid for floor raycasts, and the floor revision it was built from
+static HeightPyramid s_floorPyramid;
+static unsigned int s_floorPyramidRevision = 0;
+static std::vector<glm::vec4> s_floorPyramidChanges; // scratch
+
+// static obstacles feet can stand on, if any
+static const StaticScene* s_obstacles = nullptr;
+static std::vector<RayHit> s_obstacleHits; // scratch for batched raycasts
+
+/**
+ * @brief sends a shape's material and matrices to the shader and draws it.
+ *        expects the shader to be bound.
+ */
+static void drawShape(GLuint shaderID, const ShapeDraw& draw) {
+    // send material uniform(s) to shader
+    if (draw.merged != nullptr) {
+        const std::vector<MergedMesh::Material>& materials = draw.merged->materials();
+        for (int i = 0; i < (int)materials.size(); i++) {
+            Realtime::sendMaterialToShader(shaderID, materials[i].cAmbient, materials[i].cDiffuse,
+                                           materials[i].cSpecular, materials[i].shininess, i);
+        }
+    } else {
+        Realtime::sendMaterialToShader(shaderID, draw.cAmbient, draw.cDiffuse,
+                                       draw.cSpecular, draw.shininess);
+    }
+    // send model and normal model matrix to vertex shader. the model matrix
+    // also undoes the arena's quantization, which normals don't go through
+    glm::mat4 model = draw.model * draw.mesh.arena->dequantization(draw.mesh);
     glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, &model[0][0]);
-    // calculate and send normal model matrix (i.e. inverse transpose of 3x3 CTM) to vertex shader
+    glUniformMatrix3fv(glGetUniformLocation(shaderID, "normModel"), 1, GL_FALSE, &draw.normModel[0][0]);
+
+    // draw mesh
+    GeometryArena::draw(draw.mesh);
+}
+
+void Realtime::paintShape(GLuint shaderID,
+                          const GeometryArena::Mesh& mesh,
+                          const SceneMaterial& material, glm::mat4 model) {
+    // calculate normal model matrix (i.e. inverse transpose of 3x3 CTM)
+    glm::mat3 normModel = glm::inverse(glm::transpose(glm::mat3(model)));
+    ShapeDraw draw{mesh,
+                   material.cAmbient, material.cDiffuse, material.cSpecular, material.shininess,
+                   model, normModel};
+    if (s_recordedShapes != nullptr) {
+        s_recordedShapes->push_back(draw);
+    }
+
+    drawShape(shaderID, draw);
+}
+
+void Realtime::paintMergedMesh(GLuint shaderID, const MergedMesh& mesh, glm::mat4 model) {
     glm::mat3 normModel = glm::inverse(glm::transpose(glm::mat3(model)));
-    glUniformMatrix3fv(glGetUniformLocation(shaderID, "normModel"), 1, GL_FALSE, &normModel[0][0]);
+    ShapeDraw draw{mesh.mesh(),
+                   glm::vec4(0), glm::vec4(0), glm::vec4(0), 0.0f,
+                   model, normModel, &mesh};
+    if (s_recordedShapes != nullptr) {
+        s_recordedShapes->push_back(draw);
+    }
+
+    drawShape(shaderID, draw);
+}
+
+void Realtime::recordShapes(std::vector<ShapeDraw>* draws) {
+    s_recordedShapes = draws;
+}
+
+/**
+ * @brief paints previously recorded shapes, binding the shader once and only
+ *        switching VAO when the arena changes.
+ */
+void Realtime::paintShapes(GLuint shaderID, const std::vector<ShapeDraw>& draws) {
+    glUseProgram(shaderID);
+    const GeometryArena* boundArena = nullptr;
+    for (const ShapeDraw& draw : draws) {
+        if (draw.mesh.arena != boundArena) {
+            glBindVertexArray(draw.mesh.arena->vao());
+            boundArena = draw.mesh.arena;
+        }
+        drawShape(shaderID, draw);
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void Realtime::initializeObstacles() {
+    m_obstacles.clear();
+
+    // the bump the built-in floor used to have, and a ramp up onto it
+    m_obstacles.addBox(glm::vec3(3, 0, 3), glm::vec3(1, 0.2f, 1));
+    std::vector<glm::vec3> ramp{glm::vec3(4, 0.2f, 2), glm::vec3(4, 0.2f, 4),
+                                glm::vec3(5.5f, 0, 2), glm::vec3(5.5f, 0, 4),
+                                glm::vec3(4, 0, 2), glm::vec3(4, 0, 4)};
+    m_obstacles.addMesh(ramp, {glm::uvec3(0, 1, 2), glm::uvec3(2, 1, 3), // slope
+                               glm::uvec3(4, 0, 2), glm::uvec3(5, 3, 1)}); // sides
 
-    // draw VAO
-    glDrawArrays(GL_TRIANGLES, 0, bufferSize);
+    // props scattered around, standing on the floor. the same ones every run
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float half = settings.obstacleFieldSize / 2.0f;
+    for (int i = 0; i < settings.obstacleProps; i++) {
+        glm::vec2 xz((unit(rng) * 2.0f - 1.0f) * half, (unit(rng) * 2.0f - 1.0f) * half);
+        // keep clear of where the spiders start
+        if (glm::length(xz) < 3.0f) {
+            continue;
+        }
+        float floorHeight = getFloorHeight(xz.x, xz.y);
+        glm::mat3 rotation = glm::mat3(glm::rotate(unit(rng) * 2.0f * (float)M_PI, glm::vec3(0, 1, 0)));
+        if (i % 2 == 0) {
+            glm::vec3 halfExtents(0.1f + 0.4f * unit(rng), 0.05f + 0.3f * unit(rng), 0.1f + 0.4f * unit(rng));
+            m_obstacles.addBox(glm::vec3(xz.x, floorHeight + halfExtents.y, xz.y), halfExtents, rotation);
+        } else {
+            float radius = 0.1f + 0.3f * unit(rng);
+            float halfHeight = 0.05f + 0.3f * unit(rng);
+            m_obstacles.addCylinder(glm::vec3(xz.x, floorHeight + halfHeight, xz.y), radius, halfHeight, rotation);
+        }
+    }
+    m_obstacles.build();
+    setObstacles(&m_obstacles);
+
+    // the set pieces go in one mesh: the bump (the only box added before the
+    // props), the ramp and, unless the terrain renderer draws the floor, the flat floor
+    m_sceneryMesh.clear();
+    m_sceneryBoxes = 1;
+    SceneMaterial sceneryMaterial(glm::vec3(0),
+                                  glm::vec3(0.5f),
+                                  glm::vec3(0.5f), 10.0f);
+    int material = m_sceneryMesh.addMaterial(sceneryMaterial);
+    if (!settings.terrainLOD && getHeightSource() == nullptr) {
+        glm::mat4 floorModel = glm::translate(glm::vec3(0,-0.05f,0)) // top at y = 0
+                * glm::scale(glm::vec3(20,0.1f,20)); // stretch in XZ and flatten in Y
+        m_sceneryMesh.addShape(m_cubeBuffer, floorModel, material);
+    }
+    for (int b = 0; b < m_sceneryBoxes; b++) {
+        m_sceneryMesh.addShape(m_cubeBuffer, m_obstacles.boxes()[b].model(), material);
+    }
+    m_sceneryMesh.addTriangles(m_obstacles.triangles(), material);
+    // paintObstacles draws the scenery and props together, so they're quantized together
+    int world = m_geometry.newGroup();
+    m_sceneryMesh.addTo(m_geometry, world);
+
+    // props are baked one by one so they can still be culled one by one. they're
+    // flat-faced and small, so coarser shapes than the 25 x 25 ones do: the same
+    // silhouette, a fraction of the vertices
+    std::vector<float> propCube;
+    std::vector<float> propCylinder;
+    Shapes::Cube::makeCube(1, 1, propCube);
+    Shapes::Cylinder::makeCylinder(1, 25, propCylinder);
+    MergedMesh prop;
+    m_boxMeshes.assign(m_obstacles.boxes().size(), GeometryArena::Mesh{nullptr, 0, 0, 0, 0});
+    for (int b = m_sceneryBoxes; b < (int)m_obstacles.boxes().size(); b++) {
+        prop.clear();
+        prop.addShape(propCube, m_obstacles.boxes()[b].model(), 0);
+        prop.addTo(m_geometry, world);
+        m_boxMeshes[b] = prop.mesh();
+    }
+    m_cylinderMeshes.clear();
+    for (const ObstacleCylinder& cylinder : m_obstacles.cylinders()) {
+        prop.clear();
+        prop.addShape(propCylinder, cylinder.model(), 0);
+        prop.addTo(m_geometry, world);
+        m_cylinderMeshes.push_back(prop.mesh());
+    }
+}
+
+void Realtime::paintObstacles() {
+    // only what's within reach of the camera, found through the BVH
+    glm::vec3 reach(settings.obstacleDrawDistance);
+    m_visibleBoxes.clear();
+    m_visibleCylinders.clear();
+    m_obstacles.overlapping(m_camera.pos - reach, m_camera.pos + reach, m_visibleBoxes, m_visibleCylinders);
+
+    m_visibleMeshes.clear();
+    if (m_sceneryMesh.mesh().indexCount > 0 && (!settings.frustumCulling
+            || m_frustum.containsSphere(m_sceneryMesh.boundsCenter(), m_sceneryMesh.boundsRadius()))) {
+        m_visibleMeshes.push_back(m_sceneryMesh.mesh());
+    }
+    for (int b : m_visibleBoxes) {
+        const ObstacleBox& box = m_obstacles.boxes()[b];
+        if (b < m_sceneryBoxes) {
+            continue;
+        }
+        if (settings.frustumCulling && !m_frustum.containsSphere(box.center, glm::length(box.halfExtents))) {
+            continue;
+        }
+        m_visibleMeshes.push_back(m_boxMeshes[b]);
+    }
+    for (int c : m_visibleCylinders) {
+        const ObstacleCylinder& cylinder = m_obstacles.cylinders()[c];
+        float radius = glm::length(glm::vec2(cylinder.radius, cylinder.halfHeight));
+        if (settings.frustumCulling && !m_frustum.containsSphere(cylinder.center, radius)) {
+            continue;
+        }
+        m_visibleMeshes.push_back(m_cylinderMeshes[c]);
+    }
+    if (m_visibleMeshes.empty()) {
+        return;
+    }
 
-    // unbind VAO
+    // everything is in world space with the scenery's one material, so it all
+    // goes out in a single draw
+    const MergedMesh::Material& material = m_sceneryMesh.materials()[0];
+    glm::mat4 model = m_geometry.dequantization(m_visibleMeshes[0]);
+    glm::mat3 normModel(1.0f);
+    glUseProgram(m_phong_shader);
+    glBindVertexArray(m_geometry.vao());
+    sendMaterialToShader(m_phong_shader, material.cAmbient, material.cDiffuse, material.cSpecular, material.shininess);
+    glUniformMatrix4fv(glGetUniformLocation(m_phong_shader, "model"), 1, GL_FALSE, &model[0][0]);
+    glUniformMatrix3fv(glGetUniformLocation(m_phong_shader, "normModel"), 1, GL_FALSE, &normModel[0][0]);
+    m_geometry.drawMany(m_visibleMeshes.data(), m_visibleMeshes.size());
     glBindVertexArray(0);
-    // unbind phong shader
     glUseProgram(0);
 }
 
+Pool<Spider>::Handle Realtime::spawnSpider(glm::vec3 startPos) {
+    startPos.y = getFloorHeight(startPos.x, startPos.z);
+    std::shared_ptr<const Rig> rig = m_rigs[m_nextRig];
+    m_nextRig = (m_nextRig + 1) % m_rigs.size();
+    Pool<Spider>::Handle spider = m_spiders.spawn(m_phong_shader, m_cylinderMesh, m_sphereMesh, rig, startPos);
+    m_spiders.get(spider)->bodyMesh = &m_spiderBodyMesh;
+    return spider;
+}
+
+void Realtime::addNavGoal(glm::vec2 goal) {
+    if (settings.navMaxGoals <= 0) {
+        return;
+    }
+    FlowFieldParams params = {settings.navCellSize, settings.navCells, settings.navMaxStep, settings.navSlopeCost};
+    // one field per goal, however many spiders are headed there
+    auto field = std::make_unique<FlowField>();
+    field->build(goal, params);
+    m_flowFields.push_back(std::move(field));
+    while ((int)m_flowFields.size() > settings.navMaxGoals) {
+        m_flowFields.erase(m_flowFields.begin());
+    }
+    // the player stays on the arrow keys
+    int turn = 0;
+    for (int i = 0; i < m_spiders.size(); i++) {
+        if (m_spiders.handleAt(i) != m_player) {
+            m_spiders[i].navGoal = turn++ % m_flowFields.size();
+        }
+    }
+}
+
+float Realtime::getFloorHeight(float x, float z) {
+    if (s_heightSource != nullptr) {
+        return s_heightSource->height(x, z);
+    }
+    return getBuiltInFloorHeight(x, z);
+}
+
+glm::vec3 Realtime::getFloorNormal(float x, float z) {
+    if (s_heightSource != nullptr) {
+        return s_heightSource->normal(x, z);
+    }
+    return glm::vec3(0, 1, 0);
+}
+
+float Realtime::getBuiltInFloorHeight(float x, float z) {
+    // the bump it used to have is an obstacle now (see initializeObstacles)
+    return 0.0f;
+}
+
+void Realtime::sampleFloorGrid(glm::vec2 origin, float spacing, int countX, int countZ, float* out) {
+    if (s_heightSource != nullptr) {
+        s_heightSource->sampleGrid(origin, spacing, countX, countZ, out);
+        return;
+    }
+    for (int j = 0; j < countZ; j++) {
+        for (int i = 0; i < countX; i++) {
+            *out++ = getBuiltInFloorHeight(origin.x + i * spacing, origin.y + j * spacing);
+        }
+    }
+}
+
+bool Realtime::floorGridIsThreadSafe() {
+    return s_heightSource == nullptr || s_heightSource->sampleGridIsThreadSafe();
+}
+
+void Realtime::setObstacles(const StaticScene* obstacles) {
+    s_obstacles = obstacles;
+}
+
+const StaticScene* Realtime::getObstacles() {
+    return s_obstacles;
+}
+
+float Realtime::getGroundHeight(float x, float z, float fromY) {
+    float floorHeight = getFloorHeight(x, z);
+    if (s_obstacles != nullptr && fromY > floorHeight) {
+        RayHit hit = s_obstacles->raycast(glm::vec3(x, fromY, z), glm::vec3(0, -1, 0), fromY - floorHeight);
+        if (hit.hit) {
+            return hit.pos.y;
+        }
+    }
+    return floorHeight;
+}
+
+void Realtime::setHeightSource(HeightSource* source) {
+    s_heightSource = source;
+    terrainChanged();
+}
+
+HeightSource* Realtime::getHeightSource() {
+    return s_heightSource;
+}
+
 /**
- * @brief paints the floor to the screen
- * @param height - y-coordinate of the floor (top)
- * @param size - x and z dimension
+ * @brief raycasts just the floor, through the pyramid if the ray stays in its
+ *        window, otherwise by marching the floor heights along it.
  */
-void Realtime::paintFloor(float y, float size) {
-    glm::mat4 floorModel = glm::translate(glm::vec3(0,y-0.05f,0)) // move to y
-            * glm::scale(glm::vec3(size,0.1f,size)); // stretch in XZ and flatten in Y
+static RayHit raycastFloorOnly(glm::vec3 origin, glm::vec3 dir, float maxDist) {
+    glm::vec3 end = origin + dir * maxDist;
+    if (s_floorPyramid.covers(origin.x, origin.z) && s_floorPyramid.covers(end.x, end.z)) {
+        return s_floorPyramid.raycast(origin, dir, maxDist);
+    }
+    return HeightPyramid::march(origin, dir, maxDist, settings.floorPyramidCellSize, Realtime::getFloorHeight);
+}
 
-    SceneMaterial floorMaterial(glm::vec3(0),
-                                glm::vec3(0.5f),
-                                glm::vec3(0.5f), 10.0f);
+RayHit Realtime::raycastFloor(glm::vec3 origin, glm::vec3 dir, float maxDist) {
+    RayHit hit = raycastFloorOnly(origin, dir, maxDist);
+    // an obstacle in front of the floor is hit first
+    if (s_obstacles != nullptr) {
+        RayHit obstacleHit = s_obstacles->raycast(origin, dir, hit.t);
+        if (obstacleHit.hit) {
+            hit = obstacleHit;
+        }
+    }
+    return hit;
+}
 
-    paintShape(m_phong_shader,
-               m_cubeBuffer.size() / 6, m_cubeVAO,
-               floorMaterial, floorModel);
+void Realtime::raycastFloor(const glm::vec3* origins, int count, glm::vec3 dir,
+                            float maxDist, RayHit* hits) {
+    // the whole batch goes through the pyramid if it's inside the window
+    bool covered = true;
+    for (int r = 0; r < count; r++) {
+        glm::vec3 end = origins[r] + dir * maxDist;
+        covered = covered && s_floorPyramid.covers(origins[r].x, origins[r].z)
+                && s_floorPyramid.covers(end.x, end.z);
+    }
+    if (covered) {
+        s_floorPyramid.raycastBatch(origins, count, dir, maxDist, hits);
+    } else {
+        for (int r = 0; r < count; r++) {
+            hits[r] = raycastFloorOnly(origins[r], dir, maxDist);
+        }
+    }
+    // and the obstacles, keeping whichever is nearer
+    if (s_obstacles != nullptr) {
+        s_obstacleHits.resize(count);
+        s_obstacles->raycastBatch(origins, count, dir, maxDist, s_obstacleHits.data());
+        for (int r = 0; r < count; r++) {
+            if (s_obstacleHits[r].hit && s_obstacleHits[r].t < hits[r].t) {
+                hits[r] = s_obstacleHits[r];
+            }
+        }
+    }
+}
 
-    glm::mat4 bumpModel = glm::translate(glm::vec3(3,y,3)) // move to y
-            * glm::scale(glm::vec3(size/10.0f,0.4f,size/10.0f));
+void Realtime::updateFloorPyramid(glm::vec2 center) {
+    float extent = settings.floorPyramidCells * settings.floorPyramidCellSize;
+    if (s_floorPyramid.isBuilt() && extent == s_floorPyramid.extent()
+            && glm::distance(center, s_floorPyramid.center()) < extent / 4.0f) {
+        if (s_floorPyramidRevision == s_terrainRevision) {
+            return;
+        }
+        // refresh just what changed, if that's known
+        s_floorPyramidChanges.clear();
+        if (getTerrainChanges(s_floorPyramidRevision, s_floorPyramidChanges)) {
+            for (const glm::vec4& rect : s_floorPyramidChanges) {
+                s_floorPyramid.refresh(rect, getFloorHeight);
+            }
+            s_floorPyramidRevision = s_terrainRevision;
+            return;
+        }
+    }
+    // snap the window to the sample grid, so rebuilding doesn't shift the samples
+    glm::vec2 origin = glm::floor((center - extent / 2.0f) / settings.floorPyramidCellSize)
+            * settings.floorPyramidCellSize;
+    s_floorPyramid.build(origin, settings.floorPyramidCellSize, settings.floorPyramidCells, getFloorHeight);
+    s_floorPyramidRevision = s_terrainRevision;
+}
 
-    paintShape(m_phong_shader,
-               m_cubeBuffer.size() / 6, m_cubeVAO,
-               floorMaterial, bumpModel);
+unsigned int Realtime::getTerrainRevision() {
+    return s_terrainRevision;
 }
 
-float Realtime::getFloorHeight(float x, float z) {
-    if (x >= 2.0f && x <= 4.0f && z >= 2.0f && z <= 4.0f) {
-        return 0.2f;
+void Realtime::terrainChanged() {
+    s_terrainRevision++;
+    s_terrainFullChangeRevision = s_terrainRevision;
+}
+
+void Realtime::terrainChanged(glm::vec4 rect) {
+    s_terrainRevision++;
+    s_terrainChangeLog[s_terrainRevision % TERRAIN_CHANGE_LOG_SIZE] = rect;
+    unsigned int block = s_terrainRevision / TERRAIN_CHANGE_LOG_SIZE;
+    TerrainChangeBlock& bounds = s_terrainChangeBlocks[block % TERRAIN_CHANGE_BLOCKS];
+    if (bounds.tag != block + 1) {
+        bounds.tag = block + 1;
+        bounds.bounds = rect;
     } else {
-        return 0.0f;
+        bounds.bounds = glm::vec4(glm::min(glm::vec2(bounds.bounds), glm::vec2(rect)),
+                                  glm::max(glm::vec2(bounds.bounds.z, bounds.bounds.w), glm::vec2(rect.z, rect.w)));
     }
 }
 
+/**
+ * @brief finds the changes since revision that the log no longer holds
+ * @param revision - floor revision the caller is up to date with
+ * @param bounds - set to the bounding box of the rects changed after revision
+ *        and before the returned one
+ * @return the first revision after revision that's still in the log, or 0 if
+ *         the changes since revision aren't known at all
+ */
+static unsigned int spilledTerrainChanges(unsigned int revision, glm::vec4& bounds) {
+    if (revision < s_terrainFullChangeRevision
+            || s_terrainRevision - revision > TERRAIN_CHANGE_LOG_SIZE * (TERRAIN_CHANGE_BLOCKS - 1)) {
+        return 0;
+    }
+    if (s_terrainRevision - revision <= TERRAIN_CHANGE_LOG_SIZE) {
+        bounds = glm::vec4(0.0f, 0.0f, -1.0f, -1.0f); // nothing spilled
+        return revision + 1;
+    }
+    // the whole of each block the spilled revisions fall in, which may take in
+    // some from before revision or still in the log, but never misses one
+    unsigned int logStart = s_terrainRevision - TERRAIN_CHANGE_LOG_SIZE + 1;
+    bounds = glm::vec4(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (unsigned int block = (revision + 1) / TERRAIN_CHANGE_LOG_SIZE;
+            block <= (logStart - 1) / TERRAIN_CHANGE_LOG_SIZE; block++) {
+        const TerrainChangeBlock& changed = s_terrainChangeBlocks[block % TERRAIN_CHANGE_BLOCKS];
+        if (changed.tag == block + 1) {
+            bounds = glm::vec4(glm::min(glm::vec2(bounds), glm::vec2(changed.bounds)),
+                               glm::max(glm::vec2(bounds.z, bounds.w), glm::vec2(changed.bounds.z, changed.bounds.w)));
+        }
+    }
+    return logStart;
+}
+
+bool Realtime::getTerrainChanges(unsigned int revision, std::vector<glm::vec4>& rects) {
+    glm::vec4 spilled;
+    unsigned int first = spilledTerrainChanges(revision, spilled);
+    if (first == 0) {
+        return false;
+    }
+    if (spilled.x <= spilled.z) {
+        rects.push_back(spilled);
+    }
+    for (unsigned int r = first; r <= s_terrainRevision; r++) {
+        rects.push_back(s_terrainChangeLog[r % TERRAIN_CHANGE_LOG_SIZE]);
+    }
+    return true;
+}
+
+bool Realtime::terrainChangedIn(glm::vec4 rect, unsigned int revision) {
+    if (revision == s_terrainRevision) {
+        return false;
+    }
+    glm::vec4 spilled;
+    unsigned int first = spilledTerrainChanges(revision, spilled);
+    if (first == 0) {
+        return true;
+    }
+    auto overlaps = [&rect](const glm::vec4& changed) {
+        return changed.x <= rect.z && rect.x <= changed.z && changed.y <= rect.w && rect.y <= changed.w;
+    };
+    if (spilled.x <= spilled.z && overlaps(spilled)) {
+        return true;
+    }
+    for (unsigned int r = first; r <= s_terrainRevision; r++) {
+        if (overlaps(s_terrainChangeLog[r % TERRAIN_CHANGE_LOG_SIZE])) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief paints the specified target point to the screen
  * @param target - coordinates of target point
@@ -227,9 +662,13 @@ void Realtime::paintTarget(glm::vec3 target) {
                                  glm::vec3(0.4f,0.4f,1.0f),
                                  glm::vec3(1,1,1), 10.0f);
 
+    glUseProgram(m_phong_shader);
+    glBindVertexArray(m_geometry.vao());
     paintShape(m_phong_shader,
-               m_sphereBuffer.size() / 6, m_sphereVAO,
+               m_sphereMesh,
                targetMaterial, targetModel);
+    glBindVertexArray(0);
+    glUseProgram(0);
 }
 
 
@@ -0,0 +1,518 @@
+#include "flow_field.h"
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include "realtime.h"
+#include "utils/worker_pool.h"
+
+namespace {
+
+const float UNREACHED = std::numeric_limits<float>::infinity();
+// sweeps a tile is given to settle before it's put back in line
+const int MAX_TILE_ROUNDS = 8;
+// set in sweepTile's result when the tile didn't settle
+const int TILE_UNSETTLED = 16;
+// fewest tiles in a batch worth sending to other threads
+const int MIN_PARALLEL_TILES = 8;
+
+// upwind solution of |grad T| = cost at a cell, given the smaller neighbour
+// along each axis (Zhao, 2005)
+float solveCell(float a, float b, float cost) {
+    if (a > b) {
+        std::swap(a, b);
+    }
+    if (b - a >= cost) {
+        return a + cost;
+    }
+    return 0.5f * (a + b + glm::sqrt(2.0f * cost * cost - (a - b) * (a - b)));
+}
+
+}
+
+// a field being built on the builder thread
+struct FlowFieldBuild {
+    std::unique_ptr<FlowField> field; // built in place, then swapped in by update
+    bool heightsSampled; // the floor was sampled on the main thread already
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> done{false};
+    bool running = false; // guarded by the builder's mutex
+};
+
+/**
+ * The thread flow fields are built on, kept for the life of the program like the
+ * terrain workers. Builds run one at a time, in the order they were asked for,
+ * and sweep on the builder thread alone so they never hold up a frame's use of
+ * WorkerPool.
+ */
+class FlowFieldBuilder
+{
+public:
+    static FlowFieldBuilder& shared() {
+        static FlowFieldBuilder builder;
+        return builder;
+    }
+
+    FlowFieldBuilder() {
+        m_stop = false;
+        m_thread = std::thread(&FlowFieldBuilder::loop, this);
+    }
+
+    ~FlowFieldBuilder() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    void queue(std::shared_ptr<FlowFieldBuild> build) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(build));
+        }
+        m_wake.notify_one();
+    }
+
+    // stops a build, waiting for it to give up if it's already running
+    void cancel(FlowFieldBuild& build) {
+        build.cancelled = true;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_finished.wait(lock, [&build] { return !build.running; });
+    }
+
+private:
+    void loop() {
+        while (true) {
+            std::shared_ptr<FlowFieldBuild> build;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_stop) {
+                    return;
+                }
+                build = std::move(m_queue.front());
+                m_queue.pop_front();
+                if (build->cancelled) {
+                    continue;
+                }
+                build->running = true;
+            }
+            build->field->buildNow(build->heightsSampled);
+            build->done = true;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                build->running = false;
+            }
+            m_finished.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished; // a build stopped running
+    std::deque<std::shared_ptr<FlowFieldBuild>> m_queue;
+    bool m_stop;
+    std::thread m_thread;
+};
+
+FlowField::FlowField() {
+    m_params = {1.0f, 0, 0.0f, 0.0f};
+    m_goal = glm::vec2(0);
+    m_origin = glm::vec2(0);
+    m_goalCell = glm::ivec2(0);
+    m_tiles = 0;
+    m_built = false;
+    m_terrainRevision = 0;
+    m_cancelled = nullptr;
+    m_heightsLo = glm::ivec2(0);
+    m_heightsStride = 0;
+    tilesSweptLastSolve = 0;
+}
+
+FlowField::~FlowField() {
+    if (m_build != nullptr) {
+        FlowFieldBuilder::shared().cancel(*m_build);
+    }
+}
+
+float& FlowField::dist(int i, int j) {
+    return m_dist[(std::size_t)j * m_params.cells + i];
+}
+
+float FlowField::dist(int i, int j) const {
+    return m_dist[(std::size_t)j * m_params.cells + i];
+}
+
+void FlowField::place(glm::vec2 goal, const FlowFieldParams& params) {
+    m_params = params;
+    m_goal = goal;
+    int n = m_params.cells;
+    float cellSize = m_params.cellSize;
+    // snap the window to the cell grid, so rebuilding doesn't shift the cells
+    m_origin = glm::floor((goal - n * cellSize / 2.0f) / cellSize) * cellSize;
+    m_goalCell = glm::ivec2(glm::floor((goal - m_origin) / cellSize));
+    m_tiles = (n + TILE - 1) / TILE;
+}
+
+void FlowField::build(glm::vec2 goal, const FlowFieldParams& params) {
+    if (m_build != nullptr) {
+        FlowFieldBuilder::shared().cancel(*m_build);
+    }
+    m_build = std::make_shared<FlowFieldBuild>();
+    m_build->field = std::make_unique<FlowField>();
+    FlowField& field = *m_build->field;
+    field.place(goal, params);
+    field.m_terrainRevision = Realtime::getTerrainRevision();
+    field.m_cancelled = &m_build->cancelled;
+    // the floor is sampled here if it can't be from the builder thread
+    m_build->heightsSampled = !Realtime::floorGridIsThreadSafe();
+    if (m_build->heightsSampled) {
+        field.sampleHeights(glm::ivec2(0), glm::ivec2(params.cells - 1));
+    }
+    if (!m_built) {
+        // so direction heads the right way meanwhile
+        m_goal = goal;
+        m_params = params;
+    }
+    FlowFieldBuilder::shared().queue(m_build);
+}
+
+void FlowField::buildNow(bool heightsSampled) {
+    int n = m_params.cells;
+    if (!heightsSampled) {
+        sampleHeights(glm::ivec2(0), glm::ivec2(n - 1));
+    }
+    m_cost.resize((std::size_t)n * n);
+    costCells(glm::ivec2(0), glm::ivec2(n - 1));
+
+    // everything unreached but the goal, which the sweeps spread out from
+    m_dist.assign((std::size_t)n * n, UNREACHED);
+    m_active.assign((std::size_t)m_tiles * m_tiles, 0);
+    m_tileMax.assign((std::size_t)m_tiles * m_tiles, -1.0f);
+    dist(m_goalCell.x, m_goalCell.y) = 0.0f;
+    m_tileMax[(std::size_t)(m_goalCell.y / TILE) * m_tiles + m_goalCell.x / TILE] = 0.0f;
+    activate(m_goalCell.x / TILE, m_goalCell.y / TILE);
+    solve(false);
+
+    m_cancelled = nullptr;
+    m_built = true;
+}
+
+void FlowField::update() {
+    if (m_build != nullptr) {
+        if (!m_build->done) {
+            return;
+        }
+        // the build's revision comes with it, so changes since are caught up on below
+        std::shared_ptr<FlowFieldBuild> build = std::move(m_build);
+        *this = std::move(*build->field);
+    }
+    unsigned int revision = Realtime::getTerrainRevision();
+    if (!m_built || revision == m_terrainRevision) {
+        return;
+    }
+    m_changes.clear();
+    if (!Realtime::getTerrainChanges(m_terrainRevision, m_changes)) {
+        build(m_goal, m_params);
+        return;
+    }
+    for (const glm::vec4& rect : m_changes) {
+        refresh(rect);
+    }
+    solve(true);
+    m_terrainRevision = revision;
+}
+
+bool FlowField::isBuilt() const {
+    return m_built;
+}
+
+glm::vec2 FlowField::goal() const {
+    return m_goal;
+}
+
+void FlowField::sampleHeights(glm::ivec2 lo, glm::ivec2 hi) {
+    glm::ivec2 count = 2 * (hi - lo + 1) + 1;
+    m_heightsLo = lo;
+    m_heightsStride = count.x;
+    m_heights.resize((std::size_t)count.x * count.y);
+    Realtime::sampleFloorGrid(m_origin + glm::vec2(lo) * m_params.cellSize, m_params.cellSize / 2.0f,
+                              count.x, count.y, m_heights.data());
+}
+
+float FlowField::cellCost(int i, int j) {
+    // steeper is slower
+    int stride = m_heightsStride;
+    const float* h = &m_heights[(std::size_t)(2 * (j - m_heightsLo.y) + 1) * stride + 2 * (i - m_heightsLo.x) + 1];
+    float height = h[0];
+    glm::vec2 slope = glm::vec2(h[1] - h[-1], h[stride] - h[-stride]) / m_params.cellSize;
+
+    // anything sticking up more than a step is walked around. boxes and cylinders
+    // by their bounds over the cell, meshes by their height at its centre
+    float half = m_params.cellSize / 2.0f;
+    glm::vec2 pos = m_origin + (glm::vec2(i, j) + 0.5f) * m_params.cellSize;
+    const StaticScene* obstacles = Realtime::getObstacles();
+    if (obstacles != nullptr) {
+        float top = height + m_params.maxStep;
+        m_nearBoxes.clear();
+        m_nearCylinders.clear();
+        obstacles->overlapping(glm::vec3(pos.x - half, top, pos.y - half),
+                               glm::vec3(pos.x + half, std::numeric_limits<float>::max(), pos.y + half),
+                               m_nearBoxes, m_nearCylinders);
+        if (!m_nearBoxes.empty() || !m_nearCylinders.empty()) {
+            return UNREACHED;
+        }
+        if (!obstacles->triangles().empty()) {
+            float above = 1000.0f;
+            RayHit hit = obstacles->raycast(glm::vec3(pos.x, top + above, pos.y), glm::vec3(0, -1, 0), above);
+            if (hit.hit) {
+                return UNREACHED;
+            }
+        }
+    }
+    return 1.0f + m_params.slopeCost * glm::length(slope);
+}
+
+void FlowField::costCells(glm::ivec2 lo, glm::ivec2 hi) {
+    // the equation is solved in cells, so costs are per cell crossed
+    for (int j = lo.y; j <= hi.y; j++) {
+        if (m_cancelled != nullptr && *m_cancelled) {
+            return;
+        }
+        for (int i = lo.x; i <= hi.x; i++) {
+            m_cost[(std::size_t)j * m_params.cells + i] = cellCost(i, j);
+        }
+    }
+}
+
+void FlowField::activate(int tx, int tz) {
+    if (tx >= 0 && tx < m_tiles && tz >= 0 && tz < m_tiles) {
+        m_active[(std::size_t)tz * m_tiles + tx] = 1;
+    }
+}
+
+void FlowField::refresh(glm::vec4 rect) {
+    int n = m_params.cells;
+    // the cells over rect, and a ring around them whose slope may have changed
+    glm::ivec2 lo = glm::max(glm::ivec2(glm::floor((glm::vec2(rect.x, rect.y) - m_origin) / m_params.cellSize)) - 1,
+                             glm::ivec2(0));
+    glm::ivec2 hi = glm::min(glm::ivec2(glm::floor((glm::vec2(rect.z, rect.w) - m_origin) / m_params.cellSize)) + 1,
+                             glm::ivec2(n - 1));
+    if (lo.x > hi.x || lo.y > hi.y) {
+        return;
+    }
+
+    m_oldCost.clear();
+    for (int j = lo.y; j <= hi.y; j++) {
+        m_oldCost.insert(m_oldCost.end(), &m_cost[(std::size_t)j * n + lo.x], &m_cost[(std::size_t)j * n + hi.x] + 1);
+    }
+    sampleHeights(lo, hi);
+    costCells(lo, hi);
+
+    // cells that got cheaper only ever lower costs, which sweeping finds from what
+    // the cells hold now. but anywhere costing at least as much as the cheapest
+    // cell that got dearer may have got there across it, so starts over
+    bool changed = false;
+    float raisedMin = UNREACHED;
+    const float* oldCost = m_oldCost.data();
+    for (int j = lo.y; j <= hi.y; j++) {
+        for (int i = lo.x; i <= hi.x; i++) {
+            float cost = m_cost[(std::size_t)j * n + i];
+            float old = *oldCost++;
+            changed |= cost != old;
+            if (cost > old) {
+                raisedMin = glm::min(raisedMin, dist(i, j));
+            }
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    if (raisedMin < UNREACHED) {
+        // only tiles reaching that far have any
+        for (int tile = 0; tile < m_tiles * m_tiles; tile++) {
+            if (m_tileMax[tile] < raisedMin) {
+                continue;
+            }
+            int i0 = (tile % m_tiles) * TILE;
+            int j0 = (tile / m_tiles) * TILE;
+            int i1 = glm::min(i0 + TILE, n) - 1;
+            int j1 = glm::min(j0 + TILE, n) - 1;
+            float kept = -1.0f;
+            for (int j = j0; j <= j1; j++) {
+                for (int i = i0; i <= i1; i++) {
+                    float& d = dist(i, j);
+                    if (d >= raisedMin && glm::ivec2(i, j) != m_goalCell) {
+                        d = UNREACHED;
+                    } else if (d < UNREACHED) {
+                        kept = glm::max(kept, d);
+                    }
+                }
+            }
+            m_tileMax[tile] = kept;
+            m_active[tile] = 1;
+        }
+    }
+    // and the changed cells may open new ways through
+    for (int tz = lo.y / TILE; tz <= hi.y / TILE; tz++) {
+        for (int tx = lo.x / TILE; tx <= hi.x / TILE; tx++) {
+            activate(tx, tz);
+        }
+    }
+}
+
+int FlowField::sweepTile(int tile) {
+    int n = m_params.cells;
+    int i0 = (tile % m_tiles) * TILE;
+    int j0 = (tile / m_tiles) * TILE;
+    int i1 = glm::min(i0 + TILE, n) - 1;
+    int j1 = glm::min(j0 + TILE, n) - 1;
+    float cellSize = m_params.cellSize;
+
+    int edges = 0;
+    for (int round = 0; round < MAX_TILE_ROUNDS; round++) {
+        bool changed = false;
+        // the four diagonal orders
+        for (int order = 0; order < 4; order++) {
+            int di = (order & 1) ? -1 : 1;
+            int dj = (order & 2) ? -1 : 1;
+            for (int j = dj > 0 ? j0 : j1; j >= j0 && j <= j1; j += dj) {
+                for (int i = di > 0 ? i0 : i1; i >= i0 && i <= i1; i += di) {
+                    float cost = m_cost[(std::size_t)j * n + i] * cellSize;
+                    if (cost == UNREACHED || (i == m_goalCell.x && j == m_goalCell.y)) {
+                        continue;
+                    }
+                    float a = glm::min(i > 0 ? dist(i - 1, j) : UNREACHED, i < n - 1 ? dist(i + 1, j) : UNREACHED);
+                    float b = glm::min(j > 0 ? dist(i, j - 1) : UNREACHED, j < n - 1 ? dist(i, j + 1) : UNREACHED);
+                    if (a == UNREACHED && b == UNREACHED) {
+                        continue;
+                    }
+                    float solved = solveCell(a, b, cost);
+                    if (solved < dist(i, j)) {
+                        dist(i, j) = solved;
+                        changed = true;
+                        edges |= (i == i0 ? 1 : 0) | (i == i1 ? 2 : 0) | (j == j0 ? 4 : 0) | (j == j1 ? 8 : 0);
+                    }
+                }
+            }
+        }
+        if (!changed) {
+            break;
+        }
+        if (round == MAX_TILE_ROUNDS - 1) {
+            edges |= TILE_UNSETTLED;
+        }
+    }
+
+    float highest = -1.0f;
+    for (int j = j0; j <= j1; j++) {
+        for (int i = i0; i <= i1; i++) {
+            if (dist(i, j) < UNREACHED) {
+                highest = glm::max(highest, dist(i, j));
+            }
+        }
+    }
+    m_tileMax[tile] = highest;
+    return edges;
+}
+
+void FlowField::solve(bool parallel) {
+    tilesSweptLastSolve = 0;
+    while (true) {
+        if (m_cancelled != nullptr && *m_cancelled) {
+            return;
+        }
+        bool swept = false;
+        for (int color = 0; color < 2; color++) {
+            m_batch.clear();
+            for (int t = 0; t < m_tiles * m_tiles; t++) {
+                if (m_active[t] && ((t % m_tiles + t / m_tiles) & 1) == color) {
+                    m_batch.push_back(t);
+                    m_active[t] = 0;
+                }
+            }
+            if (m_batch.empty()) {
+                continue;
+            }
+            swept = true;
+            tilesSweptLastSolve += m_batch.size();
+
+            // tiles of one colour share no edges, so they can be swept at once
+            m_batchEdges.assign(m_batch.size(), 0);
+            auto sweepTask = [this](int k) {
+                m_batchEdges[k] = sweepTile(m_batch[k]);
+            };
+            if (parallel && (int)m_batch.size() >= MIN_PARALLEL_TILES) {
+                WorkerPool::shared().run(m_batch.size(), sweepTask);
+            } else {
+                for (int k = 0; k < (int)m_batch.size(); k++) {
+                    sweepTask(k);
+                }
+            }
+
+            // wake the neighbours across every edge that changed
+            for (int k = 0; k < (int)m_batch.size(); k++) {
+                int tx = m_batch[k] % m_tiles;
+                int tz = m_batch[k] / m_tiles;
+                int edges = m_batchEdges[k];
+                if (edges & 1) activate(tx - 1, tz);
+                if (edges & 2) activate(tx + 1, tz);
+                if (edges & 4) activate(tx, tz - 1);
+                if (edges & 8) activate(tx, tz + 1);
+                if (edges & TILE_UNSETTLED) activate(tx, tz);
+            }
+        }
+        if (!swept) {
+            return;
+        }
+    }
+}
+
+glm::vec2 FlowField::gradient(int i, int j) const {
+    int n = m_params.cells;
+    float center = dist(i, j);
+    if (center == UNREACHED) {
+        return glm::vec2(0);
+    }
+    // upwind differences: towards whichever neighbour is lower, if either is
+    auto axis = [&](float lo, float hi) {
+        if (glm::min(lo, hi) >= center) {
+            return 0.0f;
+        }
+        return lo < hi ? center - lo : hi - center;
+    };
+    return glm::vec2(axis(i > 0 ? dist(i - 1, j) : UNREACHED, i < n - 1 ? dist(i + 1, j) : UNREACHED),
+                     axis(j > 0 ? dist(i, j - 1) : UNREACHED, j < n - 1 ? dist(i, j + 1) : UNREACHED));
+}
+
+glm::vec2 FlowField::direction(glm::vec3 p) const {
+    int n = m_params.cells;
+    glm::vec2 toGoal = m_goal - glm::vec2(p.x, p.z);
+    // relative to cell centres, for blending the four around p
+    glm::vec2 local = (glm::vec2(p.x, p.z) - m_origin) / m_params.cellSize - 0.5f;
+    if (!m_built || local.x < 0.0f || local.y < 0.0f || local.x >= n - 1 || local.y >= n - 1) {
+        return glm::length(toGoal) > 0.0f ? glm::normalize(toGoal) : glm::vec2(0);
+    }
+    glm::ivec2 cell = glm::ivec2(glm::floor(local));
+    glm::vec2 t = local - glm::vec2(cell);
+    glm::vec2 g = (1.0f - t.x) * (1.0f - t.y) * gradient(cell.x, cell.y)
+            + t.x * (1.0f - t.y) * gradient(cell.x + 1, cell.y)
+            + (1.0f - t.x) * t.y * gradient(cell.x, cell.y + 1)
+            + t.x * t.y * gradient(cell.x + 1, cell.y + 1);
+    if (glm::length(g) < 1e-6f) {
+        return glm::vec2(0);
+    }
+    return -glm::normalize(g);
+}
+
+float FlowField::cost(glm::vec3 p) const {
+    int n = m_params.cells;
+    glm::ivec2 cell = glm::ivec2(glm::floor((glm::vec2(p.x, p.z) - m_origin) / m_params.cellSize));
+    if (!m_built || cell.x < 0 || cell.y < 0 || cell.x >= n || cell.y >= n) {
+        return glm::distance(glm::vec2(p.x, p.z), m_goal);
+    }
+    return dist(cell.x, cell.y);
+}
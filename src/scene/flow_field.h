@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct FlowFieldParams {
+    float cellSize;
+    int cells; // per side of the square window around the goal
+    float maxStep; // cells with an obstacle reaching higher than this above the floor are blocked
+    float slopeCost; // extra cost of crossing a cell per unit of floor slope
+};
+
+struct FlowFieldBuild;
+
+/**
+ * Travel cost from every cell of a square window around a goal to the goal, over
+ * the floor (Realtime::getFloorHeight) and around obstacles (Realtime::getObstacles),
+ * so any number of spiders headed for the same goal can look up which way to walk
+ * in O(1), instead of each searching for a path.
+ *
+ * The costs solve the eikonal equation |grad T| = cost, with cost 1 on level
+ * floor, more on slopes and infinite where an obstacle is in the way. They're found
+ * by fast sweeping (Zhao, 2005): Gauss-Seidel passes in the four diagonal orders,
+ * each cell taking the upwind solution from its neighbours. The window is split
+ * into 16 x 16 cell tiles, each swept until it settles; a tile whose edge changes
+ * wakes its neighbours. Tiles are swept in a checkerboard, all the black ones at
+ * once on WorkerPool's threads and then all the white ones, since tiles of one
+ * colour never share an edge.
+ *
+ * build hands the costing and first solve to a background thread, and update
+ * swaps the result in once it's done. The floor is sampled there too if it's safe
+ * to (Realtime::floorGridIsThreadSafe), and otherwise in one grid on the main
+ * thread before handing over. Until the first build lands, direction points
+ * straight at the goal.
+ *
+ * When part of the floor changes, only the cells over it are re-costed. If none
+ * got dearer, their tiles are swept again; otherwise cells whose cost could depend
+ * on them (those costing at least as much as the cheapest that got dearer) are
+ * reset too, looking only in tiles that have any.
+ */
+class FlowField
+{
+public:
+    FlowField();
+    ~FlowField();
+    FlowField(const FlowField&) = delete;
+    FlowField& operator=(const FlowField&) = delete;
+    FlowField(FlowField&&) = default;
+    FlowField& operator=(FlowField&&) = default;
+
+    // starts costing the window around goal and solving it in the background.
+    // needs Realtime's floor and obstacles
+    void build(glm::vec2 goal, const FlowFieldParams& params);
+    // swaps in a finished build, and catches up on floor changes since. called
+    // once per frame
+    void update();
+    bool isBuilt() const;
+    glm::vec2 goal() const;
+
+    // unit xz direction to walk in from p to get to the goal, or zero where the
+    // goal can't be reached. outside the window, or before the first build has
+    // landed, straight at the goal
+    glm::vec2 direction(glm::vec3 p) const;
+    // travel cost from p to the goal, infinite where it can't be reached. outside
+    // the window, or before the first build has landed, the distance
+    float cost(glm::vec3 p) const;
+
+    int tilesSweptLastSolve;
+
+private:
+    friend class FlowFieldBuilder;
+    static constexpr int TILE = 16;
+
+    float& dist(int i, int j);
+    float dist(int i, int j) const;
+    // snaps the window around goal to the cell grid
+    void place(glm::vec2 goal, const FlowFieldParams& params);
+    // costs and solves the whole window. runs on the builder thread
+    void buildNow(bool heightsSampled);
+    // samples the floor at the centres and edge midpoints of cells [lo, hi]
+    void sampleHeights(glm::ivec2 lo, glm::ivec2 hi);
+    // cost of crossing cell (i, j), from the heights sampled over it
+    float cellCost(int i, int j);
+    // re-costs cells [lo, hi] from the heights sampled over them
+    void costCells(glm::ivec2 lo, glm::ivec2 hi);
+    // redoes cells in rect, and everything that could depend on them
+    void refresh(glm::vec4 rect);
+    // sweeps active tiles until none are left, on WorkerPool's threads if parallel
+    void solve(bool parallel);
+    // sweeps a tile until it settles, returning which of its edges changed as bits
+    // (1 = -x, 2 = +x, 4 = -z, 8 = +z). also updates the tile's m_tileMax
+    int sweepTile(int tile);
+    void activate(int tx, int tz);
+    // gradient of the travel cost at cell (i, j), zero if it can't be reached
+    glm::vec2 gradient(int i, int j) const;
+
+    FlowFieldParams m_params;
+    glm::vec2 m_goal;
+    glm::vec2 m_origin; // world xz of the window's corner
+    glm::ivec2 m_goalCell;
+    int m_tiles; // per side
+    bool m_built;
+    unsigned int m_terrainRevision;
+    std::shared_ptr<FlowFieldBuild> m_build; // in the background, nullptr if none
+    const std::atomic<bool>* m_cancelled; // set while building, to give up early
+
+    std::vector<float> m_cost; // per cell, x fastest
+    std::vector<float> m_dist;
+    std::vector<uint8_t> m_active; // per tile
+    std::vector<float> m_tileMax; // highest reached cost per tile, -1 if none are reached
+    // floor samples half a cell apart from the corner of cell m_heightsLo, x fastest
+    std::vector<float> m_heights;
+    glm::ivec2 m_heightsLo;
+    int m_heightsStride;
+    std::vector<float> m_oldCost; // scratch for refresh
+    std::vector<int> m_batch; // scratch for solve
+    std::vector<int> m_batchEdges;
+    std::vector<glm::vec4> m_changes; // scratch for update
+    std::vector<int> m_nearBoxes; // scratch for cellCost
+    std::vector<int> m_nearCylinders;
+};
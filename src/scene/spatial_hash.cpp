@@ -0,0 +1,178 @@
+#include "spatial_hash.h"
+#include <algorithm>
+
+namespace {
+
+// the fewest buckets, so small crowds don't all share a handful
+const uint32_t MIN_BUCKETS = 64;
+
+}
+
+SpatialHash::SpatialHash() {
+    m_cellSize = 1.0f;
+    m_invCellSize = 1.0f;
+    m_bucketMask = 0;
+    m_lo = glm::vec3(0);
+    m_hi = glm::vec3(0);
+}
+
+glm::ivec2 SpatialHash::cellOf(glm::vec3 p) const {
+    return glm::ivec2(glm::floor(glm::vec2(p.x, p.z) * m_invCellSize));
+}
+
+uint32_t SpatialHash::bucketOf(glm::ivec2 cell) const {
+    // primes from Teschner et al. 2003, "Optimized Spatial Hashing for Collision
+    // Detection of Deformable Objects"
+    uint32_t h = ((uint32_t)cell.x * 73856093u) ^ ((uint32_t)cell.y * 83492791u);
+    return h & m_bucketMask;
+}
+
+void SpatialHash::build(const glm::vec3* points, int count, float cellSize) {
+    m_cellSize = cellSize;
+    m_invCellSize = 1.0f / cellSize;
+    uint32_t buckets = MIN_BUCKETS;
+    while (buckets < 2u * (uint32_t)count) {
+        buckets *= 2;
+    }
+    m_bucketMask = buckets - 1;
+
+    // count the points in each bucket
+    m_bucketStart.assign(buckets + 1, 0);
+    m_pointBucket.resize(count);
+    m_lo = count > 0 ? points[0] : glm::vec3(0);
+    m_hi = m_lo;
+    for (int i = 0; i < count; i++) {
+        m_lo = glm::min(m_lo, points[i]);
+        m_hi = glm::max(m_hi, points[i]);
+        m_pointBucket[i] = bucketOf(cellOf(points[i]));
+        m_bucketStart[m_pointBucket[i] + 1]++;
+    }
+    // where each bucket starts
+    for (uint32_t b = 0; b < buckets; b++) {
+        m_bucketStart[b + 1] += m_bucketStart[b];
+    }
+    // scatter, counting each bucket back up from its start
+    m_points.resize(count);
+    m_ids.resize(count);
+    for (int i = 0; i < count; i++) {
+        uint32_t slot = m_bucketStart[m_pointBucket[i]]++;
+        m_points[slot] = points[i];
+        m_ids[slot] = i;
+    }
+    // which leaves each start at the next bucket's start, so shift them back
+    for (uint32_t b = buckets; b > 0; b--) {
+        m_bucketStart[b] = m_bucketStart[b - 1];
+    }
+    m_bucketStart[0] = 0;
+}
+
+int SpatialHash::size() const {
+    return m_ids.size();
+}
+
+float SpatialHash::cellSize() const {
+    return m_cellSize;
+}
+
+const std::vector<int>& SpatialHash::order() const {
+    return m_ids;
+}
+
+template <typename Visit>
+void SpatialHash::forEachNear(glm::vec3 lo, glm::vec3 hi, Visit visit) const {
+    if (m_ids.empty()) {
+        return;
+    }
+    glm::ivec2 cellLo = cellOf(lo);
+    glm::ivec2 cellHi = cellOf(hi);
+    glm::vec2 cells = glm::vec2(cellHi - cellLo) + 1.0f;
+    if (cells.x * cells.y > (float)m_ids.size()) {
+        // more cells than points: cheaper to look at every point
+        for (uint32_t slot = 0; slot < m_ids.size(); slot++) {
+            glm::ivec2 cell = cellOf(m_points[slot]);
+            if (glm::all(glm::greaterThanEqual(cell, cellLo)) && glm::all(glm::lessThanEqual(cell, cellHi))) {
+                visit(slot);
+            }
+        }
+        return;
+    }
+    for (int z = cellLo.y; z <= cellHi.y; z++) {
+        for (int x = cellLo.x; x <= cellHi.x; x++) {
+            glm::ivec2 cell(x, z);
+            uint32_t b = bucketOf(cell);
+            for (uint32_t slot = m_bucketStart[b]; slot < m_bucketStart[b + 1]; slot++) {
+                // other cells hashed to the same bucket are visited as themselves,
+                // or not at all if they're out of the box
+                if (cellOf(m_points[slot]) == cell) {
+                    visit(slot);
+                }
+            }
+        }
+    }
+}
+
+void SpatialHash::queryRadius(glm::vec3 p, float radius, std::vector<int>& out, int skip) const {
+    float radius2 = radius * radius;
+    forEachNear(p - radius, p + radius, [&](uint32_t slot) {
+        glm::vec3 d = m_points[slot] - p;
+        if (glm::dot(d, d) <= radius2 && m_ids[slot] != skip) {
+            out.push_back(m_ids[slot]);
+        }
+    });
+}
+
+void SpatialHash::queryRadius(glm::vec3 p, float radius, std::vector<int>& out, std::vector<glm::vec3>& positions,
+                              int skip) const {
+    float radius2 = radius * radius;
+    forEachNear(p - radius, p + radius, [&](uint32_t slot) {
+        glm::vec3 d = m_points[slot] - p;
+        if (glm::dot(d, d) <= radius2 && m_ids[slot] != skip) {
+            out.push_back(m_ids[slot]);
+            positions.push_back(m_points[slot]);
+        }
+    });
+}
+
+void SpatialHash::queryNearest(glm::vec3 p, int k, float maxRadius, std::vector<int>& out, int skip) const {
+    out.clear();
+    if (k <= 0) {
+        return;
+    }
+    // out holds slots while searching, kept sorted by distance
+    auto distance2 = [&](int slot) {
+        glm::vec3 d = m_points[slot] - p;
+        return glm::dot(d, d);
+    };
+    // no point is further than the far corner of the bounds (a cell's slack for rounding)
+    glm::vec3 farthest = glm::max(glm::abs(p - m_lo), glm::abs(p - m_hi));
+    maxRadius = glm::min(maxRadius, glm::length(farthest) + m_cellSize);
+    // search out a cell at a time, doubling, until there are k points inside the
+    // radius searched (so none outside it can be nearer) or maxRadius is reached
+    float radius = glm::min(m_cellSize, maxRadius);
+    while (true) {
+        out.clear();
+        float radius2 = radius * radius;
+        forEachNear(p - radius, p + radius, [&](uint32_t slot) {
+            float dist2 = distance2(slot);
+            if (dist2 > radius2 || m_ids[slot] == skip) {
+                return;
+            }
+            if ((int)out.size() == k) {
+                if (dist2 >= distance2(out.back())) {
+                    return;
+                }
+                out.pop_back();
+            }
+            auto at = std::upper_bound(out.begin(), out.end(), dist2,
+                                       [&](float d2, int other) { return d2 < distance2(other); });
+            out.insert(at, slot);
+        });
+        if ((int)out.size() == k || radius >= maxRadius) {
+            break;
+        }
+        radius = glm::min(2.0f * radius, maxRadius);
+    }
+    for (int& slot : out) {
+        slot = m_ids[slot];
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * A uniform grid over points (spider positions), hashed into a table about twice
+ * as large as the number of points, for radius and k nearest neighbour queries.
+ * Cells are columns over the xz plane, since spiders spread out over the ground
+ * far more than up it; distances are still measured in 3D.
+ *
+ * build sorts the points by bucket with a counting sort: one pass to count the
+ * points in each bucket, a prefix sum for where each bucket starts, and one pass
+ * to scatter the points there. That's O(n) whatever the spread, so the grid is
+ * simply rebuilt every tick. A query visits the columns its sphere overlaps and
+ * scans their buckets, which hold the points' positions next to each other, so
+ * it costs about the number of points nearby, however many there are in total.
+ *
+ * Queries are const and keep no state between calls, so any number of threads
+ * can query at once, as long as none of them builds.
+ */
+class SpatialHash
+{
+public:
+    SpatialHash();
+
+    // rebuilds the grid over count points. cellSize is best about the usual query radius
+    void build(const glm::vec3* points, int count, float cellSize);
+    int size() const;
+    float cellSize() const;
+    // point indices in the grid's order, which keeps points in the same cell
+    // together. queries made in this order find the cells they need already cached
+    const std::vector<int>& order() const;
+
+    // appends the indices of the points within radius of p, except skip, in no
+    // particular order
+    void queryRadius(glm::vec3 p, float radius, std::vector<int>& out, int skip = -1) const;
+    // same, also appending their positions to positions, which saves looking them up
+    void queryRadius(glm::vec3 p, float radius, std::vector<int>& out, std::vector<glm::vec3>& positions,
+                     int skip = -1) const;
+    // sets out to the indices of the (up to) k points nearest p within maxRadius,
+    // except skip, nearest first. maxRadius may be infinite: the search stops at
+    // the furthest point in the grid
+    void queryNearest(glm::vec3 p, int k, float maxRadius, std::vector<int>& out, int skip = -1) const;
+
+private:
+    glm::ivec2 cellOf(glm::vec3 p) const;
+    uint32_t bucketOf(glm::ivec2 cell) const;
+    // calls visit(slot) for every point in a cell overlapping the box from lo to hi
+    template <typename Visit>
+    void forEachNear(glm::vec3 lo, glm::vec3 hi, Visit visit) const;
+
+    float m_cellSize;
+    float m_invCellSize;
+    uint32_t m_bucketMask; // buckets are a power of two
+    // bounds of the points, which no query has to search past
+    glm::vec3 m_lo;
+    glm::vec3 m_hi;
+
+    // m_bucketStart[b] to m_bucketStart[b + 1] are bucket b's slots
+    std::vector<uint32_t> m_bucketStart;
+    // per slot, sorted by bucket
+    std::vector<glm::vec3> m_points;
+    std::vector<int> m_ids;
+    std::vector<uint32_t> m_pointBucket; // scratch for build, per input point
+};
@@ -0,0 +1,696 @@
+#include "static_scene.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include "glm/gtx/transform.hpp"
+
+static const int SAH_BINS = 16;
+static const uint32_t MAX_LEAF_PRIMS = 4;
+// cost of visiting a node, relative to testing a primitive
+static const float TRAVERSAL_COST = 1.0f;
+// rays traced together by raycastBatch, one bit of the packet mask each
+static const int RAY_PACKET = 32;
+// how far apart rays in one packet may start
+static const float PACKET_SPREAD = 2.0f;
+// traversals push both children of a node after popping it, so they never hold
+// more than depth + 1 nodes. the build stops splitting at MAX_DEPTH to keep that
+// within the stacks, however skewed the scene
+static const int STACK_SIZE = 128;
+static const uint32_t MAX_DEPTH = STACK_SIZE - 1;
+static const float NO_HIT = std::numeric_limits<float>::infinity();
+
+namespace {
+
+// half the surface area of a box, for the SAH
+float halfArea(glm::vec3 lo, glm::vec3 hi) {
+    glm::vec3 d = glm::max(hi - lo, glm::vec3(0.0f));
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// 1 / dir, with zero components nudged so the slab test never sees 0 * inf
+glm::vec3 safeInverse(glm::vec3 dir) {
+    glm::vec3 inv;
+    for (int k = 0; k < 3; k++) {
+        float d = std::abs(dir[k]) > 1e-12f ? dir[k] : std::copysign(1e-12f, dir[k]);
+        inv[k] = 1.0f / d;
+    }
+    return inv;
+}
+
+// where a ray enters a box, or NO_HIT if it misses it within tMax
+float boxEntry(glm::vec3 lo, glm::vec3 hi, glm::vec3 origin, glm::vec3 invDir, float tMax) {
+    glm::vec3 t0 = (lo - origin) * invDir;
+    glm::vec3 t1 = (hi - origin) * invDir;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+    return enter <= exit ? enter : NO_HIT;
+}
+
+float boxDistance2(glm::vec3 lo, glm::vec3 hi, glm::vec3 p) {
+    glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+    return glm::dot(d, d);
+}
+
+// closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5)
+glm::vec3 closestOnTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        return a;
+    }
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        return b;
+    }
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        return a + ab * (d1 / (d1 - d3));
+    }
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        return c;
+    }
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        return a + ac * (d2 / (d2 - d6));
+    }
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+}
+
+glm::mat4 ObstacleBox::model() const {
+    return glm::translate(center) * glm::mat4(rotation) * glm::scale(2.0f * halfExtents);
+}
+
+glm::mat4 ObstacleCylinder::model() const {
+    return glm::translate(center) * glm::mat4(rotation) * glm::scale(glm::vec3(2.0f * radius, 2.0f * halfHeight, 2.0f * radius));
+}
+
+StaticScene::StaticScene() {
+}
+
+uint32_t StaticScene::primRef(PrimitiveKind kind, int index) {
+    return ((uint32_t)kind << 30) | (uint32_t)index;
+}
+
+int StaticScene::addBox(glm::vec3 center, glm::vec3 halfExtents, glm::mat3 rotation) {
+    m_boxes.push_back({center, halfExtents, rotation});
+    return m_boxes.size() - 1;
+}
+
+int StaticScene::addCylinder(glm::vec3 center, float radius, float halfHeight, glm::mat3 rotation) {
+    m_cylinders.push_back({center, radius, halfHeight, rotation});
+    return m_cylinders.size() - 1;
+}
+
+int StaticScene::addMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::uvec3>& triangles) {
+    int first = m_triangles.size() / 3;
+    m_triangles.reserve(m_triangles.size() + triangles.size() * 3);
+    for (const glm::uvec3& triangle : triangles) {
+        m_triangles.push_back(positions[triangle.x]);
+        m_triangles.push_back(positions[triangle.y]);
+        m_triangles.push_back(positions[triangle.z]);
+    }
+    return first;
+}
+
+void StaticScene::clear() {
+    m_boxes.clear();
+    m_cylinders.clear();
+    m_triangles.clear();
+    m_nodes.clear();
+    m_prims.clear();
+}
+
+bool StaticScene::isBuilt() const {
+    return !m_nodes.empty();
+}
+
+bool StaticScene::empty() const {
+    return m_boxes.empty() && m_cylinders.empty() && m_triangles.empty();
+}
+
+const std::vector<ObstacleBox>& StaticScene::boxes() const {
+    return m_boxes;
+}
+
+const std::vector<ObstacleCylinder>& StaticScene::cylinders() const {
+    return m_cylinders;
+}
+
+const std::vector<glm::vec3>& StaticScene::triangles() const {
+    return m_triangles;
+}
+
+int StaticScene::nodeCount() const {
+    return m_nodes.size();
+}
+
+void StaticScene::primBounds(uint32_t prim, glm::vec3& lo, glm::vec3& hi) const {
+    uint32_t index = prim & 0x3fffffffu;
+    switch (prim >> 30) {
+    case PRIM_BOX: {
+        const ObstacleBox& box = m_boxes[index];
+        glm::mat3 absRotation(glm::abs(box.rotation[0]), glm::abs(box.rotation[1]), glm::abs(box.rotation[2]));
+        glm::vec3 extent = absRotation * box.halfExtents;
+        lo = box.center - extent;
+        hi = box.center + extent;
+        break;
+    }
+    case PRIM_CYLINDER: {
+        const ObstacleCylinder& cylinder = m_cylinders[index];
+        glm::vec3 axis = cylinder.rotation[1];
+        glm::vec3 extent = cylinder.halfHeight * glm::abs(axis)
+                + cylinder.radius * glm::sqrt(glm::max(1.0f - axis * axis, glm::vec3(0.0f)));
+        lo = cylinder.center - extent;
+        hi = cylinder.center + extent;
+        break;
+    }
+    default: {
+        const glm::vec3* corners = &m_triangles[(std::size_t)index * 3];
+        lo = glm::min(glm::min(corners[0], corners[1]), corners[2]);
+        hi = glm::max(glm::max(corners[0], corners[1]), corners[2]);
+        break;
+    }
+    }
+}
+
+void StaticScene::build() {
+    std::vector<BuildPrim> prims;
+    prims.reserve(m_boxes.size() + m_cylinders.size() + m_triangles.size() / 3);
+    for (int i = 0; i < (int)m_boxes.size(); i++) {
+        prims.push_back({glm::vec3(0), glm::vec3(0), glm::vec3(0), primRef(PRIM_BOX, i)});
+    }
+    for (int i = 0; i < (int)m_cylinders.size(); i++) {
+        prims.push_back({glm::vec3(0), glm::vec3(0), glm::vec3(0), primRef(PRIM_CYLINDER, i)});
+    }
+    for (int i = 0; i < (int)m_triangles.size() / 3; i++) {
+        prims.push_back({glm::vec3(0), glm::vec3(0), glm::vec3(0), primRef(PRIM_TRIANGLE, i)});
+    }
+    for (BuildPrim& prim : prims) {
+        primBounds(prim.prim, prim.lo, prim.hi);
+        prim.centroid = 0.5f * (prim.lo + prim.hi);
+    }
+
+    m_nodes.clear();
+    m_prims.clear();
+    if (prims.empty()) {
+        return;
+    }
+    // at most 2n - 1 nodes
+    m_nodes.reserve(2 * prims.size());
+    buildNode(prims, 0, prims.size(), 0);
+    m_prims.resize(prims.size());
+    for (std::size_t p = 0; p < prims.size(); p++) {
+        m_prims[p] = prims[p].prim;
+    }
+}
+
+uint32_t StaticScene::buildNode(std::vector<BuildPrim>& prims, uint32_t first, uint32_t count, uint32_t depth) {
+    uint32_t index = m_nodes.size();
+    m_nodes.push_back({});
+
+    glm::vec3 lo(NO_HIT), hi(-NO_HIT);
+    glm::vec3 centroidLo(NO_HIT), centroidHi(-NO_HIT);
+    for (uint32_t p = first; p < first + count; p++) {
+        lo = glm::min(lo, prims[p].lo);
+        hi = glm::max(hi, prims[p].hi);
+        centroidLo = glm::min(centroidLo, prims[p].centroid);
+        centroidHi = glm::max(centroidHi, prims[p].centroid);
+    }
+    Node leaf = {lo, first, hi, count};
+    // at the deepest the stacks allow, whatever is left shares a leaf
+    if (count <= 1 || depth + 1 >= MAX_DEPTH) {
+        m_nodes[index] = leaf;
+        return index;
+    }
+
+    // bin centroids along the axis they spread furthest on
+    glm::vec3 spread = centroidHi - centroidLo;
+    int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+    uint32_t mid = first + count / 2;
+    if (spread[axis] > 0.0f) {
+        struct Bin {
+            glm::vec3 lo = glm::vec3(NO_HIT);
+            glm::vec3 hi = glm::vec3(-NO_HIT);
+            uint32_t count = 0;
+        };
+        Bin bins[SAH_BINS];
+        float scale = SAH_BINS / spread[axis];
+        auto binOf = [&](const BuildPrim& prim) {
+            return glm::min(SAH_BINS - 1, (int)((prim.centroid[axis] - centroidLo[axis]) * scale));
+        };
+        for (uint32_t p = first; p < first + count; p++) {
+            Bin& bin = bins[binOf(prims[p])];
+            bin.lo = glm::min(bin.lo, prims[p].lo);
+            bin.hi = glm::max(bin.hi, prims[p].hi);
+            bin.count++;
+        }
+
+        // cost of splitting after each bin: area times primitives on either side
+        float leftCost[SAH_BINS - 1];
+        Bin left;
+        for (int b = 0; b < SAH_BINS - 1; b++) {
+            left.lo = glm::min(left.lo, bins[b].lo);
+            left.hi = glm::max(left.hi, bins[b].hi);
+            left.count += bins[b].count;
+            leftCost[b] = left.count > 0 ? left.count * halfArea(left.lo, left.hi) : 0.0f;
+        }
+        Bin right;
+        float bestCost = NO_HIT;
+        int bestSplit = 0;
+        for (int b = SAH_BINS - 1; b > 0; b--) {
+            right.lo = glm::min(right.lo, bins[b].lo);
+            right.hi = glm::max(right.hi, bins[b].hi);
+            right.count += bins[b].count;
+            float cost = leftCost[b - 1] + (right.count > 0 ? right.count * halfArea(right.lo, right.hi) : 0.0f);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        // small nodes stay leaves unless splitting is cheaper than testing everything
+        float area = halfArea(lo, hi);
+        if (count <= MAX_LEAF_PRIMS && TRAVERSAL_COST * area + bestCost >= count * area) {
+            m_nodes[index] = leaf;
+            return index;
+        }
+        mid = std::partition(prims.begin() + first, prims.begin() + first + count,
+                             [&](const BuildPrim& prim) { return binOf(prim) < bestSplit; }) - prims.begin();
+    } else if (count <= MAX_LEAF_PRIMS) {
+        m_nodes[index] = leaf;
+        return index;
+    }
+    // everything in one bin (or stacked on one centroid): split down the middle
+    if (mid == first || mid == first + count) {
+        mid = first + count / 2;
+        std::nth_element(prims.begin() + first, prims.begin() + mid, prims.begin() + first + count,
+                         [axis](const BuildPrim& a, const BuildPrim& b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    buildNode(prims, first, mid - first, depth + 1);
+    uint32_t second = buildNode(prims, mid, first + count - mid, depth + 1);
+    m_nodes[index] = {lo, second, hi, 0};
+    return index;
+}
+
+bool StaticScene::intersectPrim(uint32_t prim, glm::vec3 origin, glm::vec3 dir, float tMax, RayHit& hit) const {
+    uint32_t index = prim & 0x3fffffffu;
+    switch (prim >> 30) {
+    case PRIM_BOX: {
+        // slabs in the box's own frame
+        const ObstacleBox& box = m_boxes[index];
+        glm::mat3 toLocal = glm::transpose(box.rotation);
+        glm::vec3 o = toLocal * (origin - box.center);
+        glm::vec3 d = toLocal * dir;
+        float tNear = -NO_HIT;
+        float tFar = NO_HIT;
+        int axis = -1;
+        for (int k = 0; k < 3; k++) {
+            float h = box.halfExtents[k];
+            if (std::abs(d[k]) < 1e-12f) {
+                if (std::abs(o[k]) > h) {
+                    return false;
+                }
+                continue;
+            }
+            float t0 = (-h - o[k]) / d[k];
+            float t1 = (h - o[k]) / d[k];
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            if (t0 > tNear) {
+                tNear = t0;
+                axis = k;
+            }
+            tFar = glm::min(tFar, t1);
+        }
+        if (axis < 0 || tNear > tFar || tNear < 0.0f || tNear > tMax) {
+            return false;
+        }
+        glm::vec3 normal(0.0f);
+        normal[axis] = d[axis] > 0.0f ? -1.0f : 1.0f;
+        hit = {true, tNear, origin + tNear * dir, box.rotation * normal};
+        return true;
+    }
+    case PRIM_CYLINDER: {
+        // the caps' slab and the infinite cylinder, in the cylinder's own frame
+        const ObstacleCylinder& cylinder = m_cylinders[index];
+        glm::mat3 toLocal = glm::transpose(cylinder.rotation);
+        glm::vec3 o = toLocal * (origin - cylinder.center);
+        glm::vec3 d = toLocal * dir;
+        float capNear = -NO_HIT;
+        float capFar = NO_HIT;
+        if (std::abs(d.y) < 1e-12f) {
+            if (std::abs(o.y) > cylinder.halfHeight) {
+                return false;
+            }
+        } else {
+            capNear = (-cylinder.halfHeight - o.y) / d.y;
+            capFar = (cylinder.halfHeight - o.y) / d.y;
+            if (capNear > capFar) {
+                std::swap(capNear, capFar);
+            }
+        }
+        float sideNear = -NO_HIT;
+        float sideFar = NO_HIT;
+        float a = d.x * d.x + d.z * d.z;
+        float c = o.x * o.x + o.z * o.z - cylinder.radius * cylinder.radius;
+        if (a < 1e-12f) {
+            if (c > 0.0f) {
+                return false;
+            }
+        } else {
+            float b = o.x * d.x + o.z * d.z;
+            float disc = b * b - a * c;
+            if (disc < 0.0f) {
+                return false;
+            }
+            float root = glm::sqrt(disc);
+            sideNear = (-b - root) / a;
+            sideFar = (-b + root) / a;
+        }
+        float tNear = glm::max(capNear, sideNear);
+        float tFar = glm::min(capFar, sideFar);
+        if (tNear > tFar || tNear < 0.0f || tNear > tMax) {
+            return false;
+        }
+        glm::vec3 normal;
+        if (capNear >= sideNear) {
+            normal = glm::vec3(0.0f, d.y > 0.0f ? -1.0f : 1.0f, 0.0f);
+        } else {
+            glm::vec3 p = o + tNear * d;
+            normal = glm::normalize(glm::vec3(p.x, 0.0f, p.z));
+        }
+        hit = {true, tNear, origin + tNear * dir, cylinder.rotation * normal};
+        return true;
+    }
+    default: {
+        // Moller-Trumbore
+        const glm::vec3* corners = &m_triangles[(std::size_t)index * 3];
+        glm::vec3 e1 = corners[1] - corners[0];
+        glm::vec3 e2 = corners[2] - corners[0];
+        glm::vec3 p = glm::cross(dir, e2);
+        float det = glm::dot(e1, p);
+        if (std::abs(det) < 1e-12f) {
+            return false;
+        }
+        float invDet = 1.0f / det;
+        glm::vec3 s = origin - corners[0];
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(dir, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f) {
+            return false;
+        }
+        float t = glm::dot(e2, q) * invDet;
+        if (t < 0.0f || t > tMax) {
+            return false;
+        }
+        glm::vec3 normal = glm::normalize(glm::cross(e1, e2));
+        // det > 0 when the ray comes from the side the normal points to
+        hit = {true, t, origin + t * dir, det > 0.0f ? normal : -normal};
+        return true;
+    }
+    }
+}
+
+RayHit StaticScene::raycast(glm::vec3 origin, glm::vec3 dir, float maxDist) const {
+    RayHit best = {false, maxDist, origin + maxDist * dir, glm::vec3(0.0f)};
+    if (m_nodes.empty()) {
+        return best;
+    }
+    glm::vec3 invDir = safeInverse(dir);
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (node.count > 0) {
+            for (uint32_t p = node.first; p < node.first + node.count; p++) {
+                intersectPrim(m_prims[p], origin, dir, best.t, best);
+            }
+            continue;
+        }
+        // nearer child on top of the stack
+        const Node& first = m_nodes[index + 1];
+        const Node& second = m_nodes[node.first];
+        float tFirst = boxEntry(first.boundsMin, first.boundsMax, origin, invDir, best.t);
+        float tSecond = boxEntry(second.boundsMin, second.boundsMax, origin, invDir, best.t);
+        uint32_t nearer = tFirst <= tSecond ? index + 1 : node.first;
+        uint32_t farther = tFirst <= tSecond ? node.first : index + 1;
+        assert(top + 2 <= STACK_SIZE);
+        if (glm::max(tFirst, tSecond) != NO_HIT) {
+            stack[top++] = farther;
+        }
+        if (glm::min(tFirst, tSecond) != NO_HIT) {
+            stack[top++] = nearer;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief traces rays through the hierarchy a packet at a time: a node is visited
+ *        once for the whole packet, and only the rays still hitting its bounds
+ *        go on to its children. rays share a direction, so the children can be
+ *        ordered once for the packet.
+ */
+void StaticScene::raycastBatch(const glm::vec3* origins, int count, glm::vec3 dir,
+                               float maxDist, RayHit* hits) const {
+    for (int r = 0; r < count; r++) {
+        hits[r] = {false, maxDist, origins[r] + maxDist * dir, glm::vec3(0.0f)};
+    }
+    if (m_nodes.empty()) {
+        return;
+    }
+    glm::vec3 invDir = safeInverse(dir);
+    for (int start = 0; start < count; ) {
+        // a packet is a run of rays starting near each other
+        int size = 1;
+        while (size < RAY_PACKET && start + size < count
+               && glm::distance(origins[start + size], origins[start]) < PACKET_SPREAD) {
+            size++;
+        }
+        const glm::vec3* packetOrigins = origins + start;
+        RayHit* packetHits = hits + start;
+
+        // everything the packet can reach, to skip nodes away from all of it at once
+        glm::vec3 packetLo(NO_HIT), packetHi(-NO_HIT);
+        for (int r = 0; r < size; r++) {
+            packetLo = glm::min(packetLo, glm::min(packetOrigins[r], packetOrigins[r] + maxDist * dir));
+            packetHi = glm::max(packetHi, glm::max(packetOrigins[r], packetOrigins[r] + maxDist * dir));
+        }
+
+        std::pair<uint32_t, uint32_t> stack[STACK_SIZE]; // node, rays still in it
+        int top = 0;
+        stack[top++] = {0, size == 32 ? 0xffffffffu : (1u << size) - 1};
+        while (top > 0) {
+            auto [index, incoming] = stack[--top];
+            const Node& node = m_nodes[index];
+            if (glm::any(glm::greaterThan(node.boundsMin, packetHi)) || glm::any(glm::lessThan(node.boundsMax, packetLo))) {
+                continue;
+            }
+            uint32_t active = 0;
+            for (int r = 0; r < size; r++) {
+                if ((incoming >> r & 1u) != 0
+                        && boxEntry(node.boundsMin, node.boundsMax, packetOrigins[r], invDir, packetHits[r].t) != NO_HIT) {
+                    active |= 1u << r;
+                }
+            }
+            if (active == 0) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (uint32_t p = node.first; p < node.first + node.count; p++) {
+                    for (int r = 0; r < size; r++) {
+                        if ((active >> r & 1u) != 0) {
+                            intersectPrim(m_prims[p], packetOrigins[r], dir, packetHits[r].t, packetHits[r]);
+                        }
+                    }
+                }
+                continue;
+            }
+            // the child nearer along dir goes on top
+            const Node& first = m_nodes[index + 1];
+            const Node& second = m_nodes[node.first];
+            float along = glm::dot(first.boundsMin + first.boundsMax - second.boundsMin - second.boundsMax, dir);
+            assert(top + 2 <= STACK_SIZE);
+            if (along > 0.0f) {
+                stack[top++] = {index + 1, active};
+                stack[top++] = {node.first, active};
+            } else {
+                stack[top++] = {node.first, active};
+                stack[top++] = {index + 1, active};
+            }
+        }
+        start += size;
+    }
+}
+
+float StaticScene::closestOnPrim(uint32_t prim, glm::vec3 p, glm::vec3& point, glm::vec3& normal) const {
+    uint32_t index = prim & 0x3fffffffu;
+    switch (prim >> 30) {
+    case PRIM_BOX: {
+        const ObstacleBox& box = m_boxes[index];
+        glm::vec3 local = glm::transpose(box.rotation) * (p - box.center);
+        glm::vec3 h = box.halfExtents;
+        glm::vec3 q = glm::clamp(local, -h, h);
+        glm::vec3 n;
+        float dist2 = glm::dot(local - q, local - q);
+        if (dist2 > 0.0f) {
+            n = (local - q) / glm::sqrt(dist2);
+        } else {
+            // inside: out through the nearest face
+            glm::vec3 gap = h - glm::abs(local);
+            int axis = gap.x < gap.y ? (gap.x < gap.z ? 0 : 2) : (gap.y < gap.z ? 1 : 2);
+            n = glm::vec3(0.0f);
+            n[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+            q[axis] = n[axis] * h[axis];
+        }
+        point = box.center + box.rotation * q;
+        normal = box.rotation * n;
+        return dist2;
+    }
+    case PRIM_CYLINDER: {
+        const ObstacleCylinder& cylinder = m_cylinders[index];
+        glm::vec3 local = glm::transpose(cylinder.rotation) * (p - cylinder.center);
+        glm::vec2 radial(local.x, local.z);
+        float radialLength = glm::length(radial);
+        glm::vec2 outward = radialLength > 0.0f ? radial / radialLength : glm::vec2(1.0f, 0.0f);
+        glm::vec3 q;
+        glm::vec3 n;
+        float dist2;
+        if (radialLength > cylinder.radius || std::abs(local.y) > cylinder.halfHeight) {
+            glm::vec2 qr = radialLength > cylinder.radius ? outward * cylinder.radius : radial;
+            q = glm::vec3(qr.x, glm::clamp(local.y, -cylinder.halfHeight, cylinder.halfHeight), qr.y);
+            dist2 = glm::dot(local - q, local - q);
+            n = (local - q) / glm::sqrt(dist2);
+        } else {
+            // inside: out through the side or a cap, whichever is nearer
+            dist2 = 0.0f;
+            if (cylinder.radius - radialLength < cylinder.halfHeight - std::abs(local.y)) {
+                q = glm::vec3(outward.x * cylinder.radius, local.y, outward.y * cylinder.radius);
+                n = glm::vec3(outward.x, 0.0f, outward.y);
+            } else {
+                float side = local.y < 0.0f ? -1.0f : 1.0f;
+                q = glm::vec3(local.x, side * cylinder.halfHeight, local.z);
+                n = glm::vec3(0.0f, side, 0.0f);
+            }
+        }
+        point = cylinder.center + cylinder.rotation * q;
+        normal = cylinder.rotation * n;
+        return dist2;
+    }
+    default: {
+        const glm::vec3* corners = &m_triangles[(std::size_t)index * 3];
+        point = closestOnTriangle(p, corners[0], corners[1], corners[2]);
+        normal = glm::normalize(glm::cross(corners[1] - corners[0], corners[2] - corners[0]));
+        if (glm::dot(p - point, normal) < 0.0f) {
+            normal = -normal;
+        }
+        return glm::dot(p - point, p - point);
+    }
+    }
+}
+
+bool StaticScene::closestPoint(glm::vec3 p, float maxDist, glm::vec3& point, glm::vec3& normal) const {
+    if (m_nodes.empty()) {
+        return false;
+    }
+    float best2 = maxDist * maxDist;
+    bool found = false;
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (boxDistance2(node.boundsMin, node.boundsMax, p) > best2) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                glm::vec3 primPoint, primNormal;
+                float dist2 = closestOnPrim(m_prims[i], p, primPoint, primNormal);
+                if (dist2 <= best2) {
+                    best2 = dist2;
+                    point = primPoint;
+                    normal = primNormal;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // nearer child on top of the stack
+        const Node& first = m_nodes[index + 1];
+        const Node& second = m_nodes[node.first];
+        assert(top + 2 <= STACK_SIZE);
+        if (boxDistance2(first.boundsMin, first.boundsMax, p) < boxDistance2(second.boundsMin, second.boundsMax, p)) {
+            stack[top++] = node.first;
+            stack[top++] = index + 1;
+        } else {
+            stack[top++] = index + 1;
+            stack[top++] = node.first;
+        }
+    }
+    return found;
+}
+
+void StaticScene::overlapping(glm::vec3 lo, glm::vec3 hi, std::vector<int>& boxes, std::vector<int>& cylinders) const {
+    if (m_nodes.empty()) {
+        return;
+    }
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        uint32_t index = stack[--top];
+        const Node& node = m_nodes[index];
+        if (glm::any(glm::greaterThan(node.boundsMin, hi)) || glm::any(glm::lessThan(node.boundsMax, lo))) {
+            continue;
+        }
+        if (node.count == 0) {
+            assert(top + 2 <= STACK_SIZE);
+            stack[top++] = node.first;
+            stack[top++] = index + 1;
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            uint32_t prim = m_prims[i];
+            if ((prim >> 30) == PRIM_TRIANGLE) {
+                continue;
+            }
+            glm::vec3 primLo, primHi;
+            primBounds(prim, primLo, primHi);
+            if (glm::any(glm::greaterThan(primLo, hi)) || glm::any(glm::lessThan(primHi, lo))) {
+                continue;
+            }
+            if ((prim >> 30) == PRIM_BOX) {
+                boxes.push_back(prim & 0x3fffffffu);
+            } else {
+                cylinders.push_back(prim & 0x3fffffffu);
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "terrain/height_pyramid.h"
+
+// a box, drawn with the Cube shape. the columns of rotation are its axes
+struct ObstacleBox {
+    glm::vec3 center;
+    glm::vec3 halfExtents;
+    glm::mat3 rotation;
+
+    glm::mat4 model() const;
+};
+
+// a capped cylinder, drawn with the Cylinder shape. its axis is rotation's second column
+struct ObstacleCylinder {
+    glm::vec3 center;
+    float radius;
+    float halfHeight;
+    glm::mat3 rotation;
+
+    glm::mat4 model() const;
+};
+
+/**
+ * Static obstacles feet can stand on: boxes, cylinders and triangle meshes,
+ * indexed by a bounding volume hierarchy for ray, closest point and overlap
+ * queries.
+ *
+ * The hierarchy is built top down with the surface area heuristic, binning
+ * primitive centroids into 16 buckets along the widest axis of each node and
+ * splitting where the estimated cost of tracing both halves is lowest. Nodes are
+ * laid out depth first, so a node's first child is the next node, and leaves hold
+ * up to 4 primitives. Every mesh triangle is a primitive of its own.
+ *
+ * Rays entering a box or cylinder from inside it don't hit it. Mesh triangles are
+ * two sided, and hit normals face the ray.
+ */
+class StaticScene
+{
+public:
+    StaticScene();
+
+    // each returns the index of the new obstacle, among boxes or cylinders
+    int addBox(glm::vec3 center, glm::vec3 halfExtents, glm::mat3 rotation = glm::mat3(1));
+    int addCylinder(glm::vec3 center, float radius, float halfHeight, glm::mat3 rotation = glm::mat3(1));
+    // adds a triangle mesh given in world space, returning its first triangle
+    int addMesh(const std::vector<glm::vec3>& positions, const std::vector<glm::uvec3>& triangles);
+    void clear();
+
+    // builds the hierarchy over everything added so far. queries need it built
+    void build();
+    bool isBuilt() const;
+    bool empty() const;
+
+    const std::vector<ObstacleBox>& boxes() const;
+    const std::vector<ObstacleCylinder>& cylinders() const;
+    // mesh triangles, 3 corners each
+    const std::vector<glm::vec3>& triangles() const;
+    int nodeCount() const;
+
+    // first point where the ray (dir normalized) meets an obstacle within maxDist
+    RayHit raycast(glm::vec3 origin, glm::vec3 dir, float maxDist) const;
+    // raycast for count rays in the same direction. rays next to each other in the
+    // array should be close in space (like the legs of one spider), since they're
+    // traced through the hierarchy together in packets
+    void raycastBatch(const glm::vec3* origins, int count, glm::vec3 dir,
+                      float maxDist, RayHit* hits) const;
+    // closest point to p on the surface of any obstacle, if one is within maxDist.
+    // normal points out of the obstacle. points inside an obstacle are at distance 0
+    bool closestPoint(glm::vec3 p, float maxDist, glm::vec3& point, glm::vec3& normal) const;
+    // appends the boxes and cylinders whose bounds overlap the box from lo to hi
+    void overlapping(glm::vec3 lo, glm::vec3 hi, std::vector<int>& boxes, std::vector<int>& cylinders) const;
+
+private:
+    struct Node {
+        glm::vec3 boundsMin;
+        uint32_t first; // leaf: first primitive in m_prims. inner: second child
+        glm::vec3 boundsMax;
+        uint32_t count; // primitives in the leaf, 0 for inner nodes
+    };
+    enum PrimitiveKind : uint32_t { PRIM_BOX = 0, PRIM_CYLINDER = 1, PRIM_TRIANGLE = 2 };
+    // a primitive while the hierarchy is being built
+    struct BuildPrim {
+        glm::vec3 lo;
+        glm::vec3 hi;
+        glm::vec3 centroid;
+        uint32_t prim;
+    };
+
+    // primitives are stored as kind << 30 | index
+    static uint32_t primRef(PrimitiveKind kind, int index);
+    void primBounds(uint32_t prim, glm::vec3& lo, glm::vec3& hi) const;
+    // builds the subtree over prims[first, first + count), depth levels below the
+    // root, returning its root
+    uint32_t buildNode(std::vector<BuildPrim>& prims, uint32_t first, uint32_t count, uint32_t depth);
+
+    bool intersectPrim(uint32_t prim, glm::vec3 origin, glm::vec3 dir, float tMax, RayHit& hit) const;
+    // closest surface point on a primitive and its squared distance (0 inside)
+    float closestOnPrim(uint32_t prim, glm::vec3 p, glm::vec3& point, glm::vec3& normal) const;
+
+    std::vector<ObstacleBox> m_boxes;
+    std::vector<ObstacleCylinder> m_cylinders;
+    std::vector<glm::vec3> m_triangles;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_prims; // leaf contents, in node order
+};
@@ -14,6 +14,120 @@ struct Settings {
 
     float segLength1 = 0;
     float segLength2 = 0;
+
+    // use polynomial trig approximations (utils/fastmath.h) for IK
+    bool fastTrig = false;
+
+    // answer IK from a precomputed table (spider/ik_table.h) instead of solving
+    bool ikTable = false;
+    int ikTableResolution = 64; // samples per axis
+    int ikTableBudgetKB = 4096; // resolution is lowered to fit
+
+    // order legs step in (spider/gait_scheduler.h): 0 tripod, 1 ripple, 2 wave
+    int gaitPattern = 0;
+    // path feet take when stepping (spider/swing_curve.h)
+    int swingShape = 0; // 0 sine (the original arc), 1 cubic Bezier, 2 cubic Hermite
+    float swingLiftHeight = 0.25f;
+    float swingOvershoot = 0.0f; // how far past the landing feet reach, as a fraction of the step
+    int swingCurveSamples = 64;
+    int swingClearanceProbes = 4; // floor samples under each step, to lift feet over what's in between
+
+    // number of spiders in the scene. the first one is controlled with the arrow keys
+    int numSpiders = 1;
+    // rig files (spider/rig.h, e.g. resources/rigs/octopod.rig) the spiders are built
+    // from, separated by ';' and taken in turn. empty for the built-in hexapod
+    std::string spiderRigs = "";
+    // crowds (neighbours found with scene/spatial_hash.h): spiders closer than
+    // separationRadius steer apart, and feet keep footClearance from other spiders' feet
+    float separationRadius = 1.2f; // 0 for no separation
+    float separationSpeed = 1.0f; // when right on top of another spider
+    int separationNeighbours = 6; // only the nearest this many push, 0 for all in range
+    float footClearance = 0.1f; // 0 to let feet land anywhere
+    int footClearanceNeighbours = 4; // only the nearest this many spiders' feet are kept off, 0 for all in reach
+    // navigation (scene/flow_field.h): N drops a goal under the player, and the other
+    // spiders take turns heading for the latest navMaxGoals goals
+    float navCellSize = 0.5f;
+    int navCells = 256; // per side of the window around each goal
+    float navMaxStep = 0.3f; // obstacles taller than this are walked around
+    float navSlopeCost = 4.0f;
+    float navSpeed = 1.0f;
+    float navArriveRadius = 1.0f; // spiders this close to their goal stop
+    int navMaxGoals = 4;
+
+    // animation LOD (spider/animation_lod.h), by distance from the camera
+    float lodMidDistance = 10.0f; // beyond this legs are solved every few frames
+    float lodFarDistance = 25.0f; // beyond this legs play a canned gait
+    int lodMaxInterval = 4; // frames between solves at the far end of mid range
+    int lodIKBudget = 0; // max leg IK solves per frame, 0 for no limit
+
+    // skip painting spiders, props and the flat floor outside the camera's view (utils/frustum.h)
+    bool frustumCulling = true;
+
+    // paint spiders past impostorDistance as one textured quad each (spider/impostors.h),
+    // fading from their meshes over the impostorFadeBand before it. baked at startup
+    bool impostors = true;
+    float impostorDistance = 40.0f;
+    float impostorFadeBand = 8.0f;
+
+    // upload meshes as 12-byte quantized vertices instead of 28-byte float ones
+    // (utils/geometry_arena.h)
+    bool packedVertices = true;
+
+    // spread leg IK solves over frames by priority (spider/ik_scheduler.h)
+    bool ikTimeSlicing = false;
+    int ikSliceMaxSolves = 0; // max solves per frame, 0 for no limit
+    float ikSliceMaxMicros = 2000.0f; // max time spent solving per frame, 0 for no limit
+
+    // tiled heightmap file (terrain/tiled_heightmap.h) to walk on. empty for the built-in floor
+    std::string heightmapPath = "";
+    int heightmapMaxResidentTiles = 64; // tiles kept in memory
+    float heightmapPrefetchRadius = 16.0f; // read ahead this far around the camera
+
+    // endless fBm noise floor (terrain/procedural_terrain.h), used when there's no heightmap
+    bool proceduralTerrain = false;
+    int terrainSeed = 1;
+    int terrainOctaves = 5;
+    float terrainFrequency = 0.05f; // of the first octave, per unit
+    float terrainAmplitude = 1.5f; // of the first octave
+    float terrainLacunarity = 2.0f; // frequency multiplier per octave
+    float terrainGain = 0.5f; // amplitude multiplier per octave
+    int terrainChunkCells = 32; // cells per chunk side
+    float terrainCellSize = 0.25f; // distance between samples
+    int terrainMaxChunks = 256; // baked chunks kept in memory
+    int terrainWorkers = 0; // baking threads, 0 for one less than the number of cores
+    std::string terrainCacheDir = ""; // keep baked chunks here between runs. empty to not
+
+    // LOD floor renderer (terrain/terrain_renderer.h). always on with a heightmap or
+    // procedural terrain, since the flat floor can't show them
+    bool terrainLOD = false; // use it for the built-in floor too
+    int terrainLodLevels = 5; // each level reaches twice as far as the one before (max 8)
+    float terrainLeafSize = 2.0f; // side of the finest nodes
+    int terrainGridCells = 16; // grid cells per node side
+    int terrainTextureSize = 256; // height samples per side, per level
+
+    // runtime floor edits (terrain/editable_terrain.h) over whichever floor is in use.
+    // R raises, F lowers and G flattens the floor under the first spider
+    bool terrainEditing = false;
+    float terrainEditCellSize = 0.1f; // distance between edited samples
+    int terrainEditChunkCells = 32; // cells per side of the chunks edits are rebuilt in
+    float terrainBrushRadius = 1.0f;
+    float terrainBrushRate = 0.5f; // height raised or lowered per second at the brush centre
+
+    // find foot targets by raycasting the floor along the spider's down vector, through
+    // a min/max pyramid (terrain/height_pyramid.h), instead of sampling the height below
+    bool footRaycast = false;
+    float floorPyramidCellSize = 0.05f; // distance between floor samples
+    int floorPyramidCells = 512; // cells per side of the window around the camera
+    // with footRaycast, fit each spider's up to the surfaces its feet stand on, so
+    // spiders climb walls and obstacles instead of staying upright
+    bool surfaceWalking = false;
+    float surfaceAlignRate = 0.2f; // how far up turns towards the feet's normals per frame
+
+    // static obstacles (scene/static_scene.h) feet can stand on. besides the bump
+    // and its ramp, props boxes and cylinders are scattered over the field
+    int obstacleProps = 0;
+    float obstacleFieldSize = 200.0f; // side of the square around the origin they're scattered over
+    float obstacleDrawDistance = 30.0f; // props further than this from the camera aren't drawn
 };
 
 
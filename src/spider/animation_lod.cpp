@@ -0,0 +1,111 @@
+#include "animation_lod.h"
+#include "spider/spider.h"
+#include "spider/impostors.h"
+#include "spider/ik_solver.cpp"
+#include "settings.h"
+#include <algorithm>
+
+std::shared_ptr<const CannedGait> CannedGait::build(const Spider& spider) {
+    auto gait = std::make_shared<CannedGait>();
+    gait->numLegs = spider.legs.size();
+    gait->footPos.resize(gait->numLegs * SAMPLES);
+    gait->angles.resize(gait->numLegs * SAMPLES);
+
+    // the foot slides back by half a stride while planted, then swings forward
+    float halfStep = STRIDE / 4.0f;
+    const std::shared_ptr<const SwingCurve>& swing = SwingCurve::current();
+    for (int i = 0; i < gait->numLegs; i++) {
+        const Leg& leg = spider.legs[i];
+        // alternating tripod: neighbours along and across the body are half a cycle apart
+        float offset = ((i + i/2) % 2) * 0.5f;
+
+        for (int s = 0; s < SAMPLES; s++) {
+            float phase = glm::fract((float)s / SAMPLES + offset);
+            glm::vec3 footPos = leg.targetPosSpider;
+            if (phase < 0.5f) {
+                // stance
+                footPos.x += halfStep - 2.0f * halfStep * (phase / 0.5f);
+            } else {
+                // swing, on the same curve as the legs' steps
+                float t = (phase - 0.5f) / 0.5f;
+                float progress, lift, clear;
+                swing->evaluate(&t, 1, &progress, &lift, &clear);
+                footPos.x += -halfStep + 2.0f * halfStep * progress;
+                footPos.y += lift;
+            }
+
+            auto [theta1, theta2, theta3] = IKSolver::solveAngles(leg.hipPosSpider - footPos,
+                                                                  leg.segLength1, leg.segLength2);
+            gait->footPos[i * SAMPLES + s] = footPos;
+            gait->angles[i * SAMPLES + s] = glm::vec3(theta1, theta2, theta3);
+        }
+    }
+    return gait;
+}
+
+void AnimationLODScheduler::update(std::span<Spider> spiders, glm::vec3 cameraPos, bool impostors) {
+    m_due.clear();
+
+    for (Spider& spider : spiders) {
+        float dist = glm::distance(spider.pos, cameraPos);
+        spider.impostorFade = impostors ? ImpostorRenderer::fade(dist) : 0.0f;
+        // only an impostor, whatever its LOD. picked up again once back in range
+        if (spider.impostorFade >= 1.0f) {
+            continue;
+        }
+        AnimationLOD lod = dist < settings.lodMidDistance ? AnimationLOD::LOD_NEAR
+                         : dist < settings.lodFarDistance ? AnimationLOD::LOD_MID
+                         : AnimationLOD::LOD_FAR;
+
+        // resting spiders stay asleep unless their LOD changes
+        if (spider.resting) {
+            if (lod == spider.lod) {
+                continue;
+            }
+            spider.wake();
+        }
+
+        if (lod == AnimationLOD::LOD_FAR && !spider.cannedGait) {
+            spider.cannedGait = CannedGait::build(spider);
+        }
+        if (spider.lod == AnimationLOD::LOD_FAR && lod != AnimationLOD::LOD_FAR) {
+            spider.leaveCannedGait();
+        }
+        spider.lod = lod;
+        spider.solveThisFrame = false;
+        spider.framesSinceSolve++;
+        if (lod == AnimationLOD::LOD_FAR) {
+            continue;
+        }
+
+        // mid-range interval grows from 2 frames at lodMidDistance to
+        // lodMaxInterval frames at lodFarDistance
+        int interval = 1;
+        if (lod == AnimationLOD::LOD_MID) {
+            float t = (dist - settings.lodMidDistance) / (settings.lodFarDistance - settings.lodMidDistance);
+            interval = glm::clamp(2 + (int)(t * (settings.lodMaxInterval - 1)), 2, glm::max(2, settings.lodMaxInterval));
+        }
+        spider.solveInterval = interval;
+
+        if (spider.framesSinceSolve >= interval) {
+            m_due.push_back({dist, &spider});
+        }
+    }
+
+    // with a budget, nearest spiders get their solves first
+    if (settings.lodIKBudget > 0) {
+        std::sort(m_due.begin(), m_due.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+    }
+
+    solvesLastFrame = 0;
+    for (auto& [dist, spider] : m_due) {
+        int cost = spider->legs.size();
+        if (settings.lodIKBudget > 0 && solvesLastFrame + cost > settings.lodIKBudget) {
+            break;
+        }
+        spider->solveThisFrame = true;
+        spider->framesSinceSolve = 0;
+        solvesLastFrame += cost;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef ANIMATION_LOD_H
+#define ANIMATION_LOD_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+class Spider;
+
+// Animation level of detail, picked per spider from its distance to the camera
+enum class AnimationLOD {
+    LOD_NEAR, // simulate legs and solve IK every frame
+    LOD_MID,  // simulate and solve every few frames, blend joint angles in between
+    LOD_FAR   // play back a canned gait cycle, no leg simulation or IK
+};
+
+/**
+ * One walk cycle for every leg of a spider, sampled at SAMPLES evenly spaced
+ * phases: the foot position in spider space and the joint angles relative to the
+ * spider's heading. Legs are offset in phase by half a cycle in an alternating
+ * tripod, so far away spiders still look like they walk.
+ */
+struct CannedGait {
+    static constexpr int SAMPLES = 32;
+    // how far the body travels per cycle. twice the leg step distance
+    static constexpr float STRIDE = 1.0f;
+
+    int numLegs;
+    std::vector<glm::vec3> footPos; // [leg * SAMPLES + sample], spider space
+    std::vector<glm::vec3> angles;  // [leg * SAMPLES + sample]
+
+    // solves IK for every leg at every sample of the cycle
+    static std::shared_ptr<const CannedGait> build(const Spider& spider);
+};
+
+/**
+ * Picks each spider's AnimationLOD and decides which spiders simulate their legs
+ * this frame. Near spiders are due every frame; mid-range spiders every 2 to
+ * settings.lodMaxInterval frames, further ones less often. With
+ * settings.lodIKBudget > 0 at most that many legs are solved per frame, nearest
+ * spiders first; spiders that miss out hold their last pose and stay due.
+ * With impostors it also sets how far each spider has faded into its impostor,
+ * and spiders that are only impostors are skipped altogether.
+ */
+class AnimationLODScheduler
+{
+public:
+    // call once per frame, before painting the spiders. impostors is whether far
+    // spiders are painted as impostors (ImpostorRenderer)
+    void update(std::span<Spider> spiders, glm::vec3 cameraPos, bool impostors);
+
+    // number of IK solves granted by the last update
+    int solvesLastFrame = 0;
+
+private:
+    // spiders due for a solve this frame with their distance to the camera.
+    // kept between frames to avoid reallocating
+    std::vector<std::pair<float, Spider*>> m_due;
+};
+
+#endif // ANIMATION_LOD_H
@@ -0,0 +1,164 @@
+#include "gait_scheduler.h"
+
+namespace {
+
+// legs whose turn comes round closer than this fraction of their step distance
+// to their target stay put
+const float MIN_STEP_FRACTION = 0.2f;
+
+bool neighbours(int a, int b) {
+    int rowA = a / 2;
+    int rowB = b / 2;
+    // along a side, or across the body
+    return (a % 2 == b % 2 && glm::abs(rowA - rowB) == 1) || (a != b && rowA == rowB);
+}
+
+}
+
+GaitScheduler::GaitScheduler() {
+    pattern = GaitPattern::TRIPOD;
+    phase = 0.0f;
+    m_reach = 0.0f;
+    m_stride = 1.0f;
+    m_motion = 0.0f;
+    m_lastModel = glm::mat4(1);
+    m_hasModel = false;
+    // room for the legs of any rig, so a spider respawned as another doesn't reallocate
+    m_offsets.reserve(Rig::MAX_LEGS);
+    m_checkAt.reserve(Rig::MAX_LEGS);
+    m_turn.reserve(Rig::MAX_LEGS);
+    m_due.reserve(Rig::MAX_LEGS);
+}
+
+void GaitScheduler::reset(GaitPattern pattern, const std::vector<Leg>& legs) {
+    this->pattern = pattern;
+    int numLegs = legs.size();
+    int rows = (numLegs + 1) / 2;
+    m_offsets.resize(numLegs);
+    m_reach = 0.0f;
+    m_stride = 0.0f;
+    for (int i = 0; i < numLegs; i++) {
+        int side = i % 2;
+        int row = i / 2;
+        switch (pattern) {
+        case GaitPattern::RIPPLE:
+            m_offsets[i] = glm::fract((float)row / rows + 0.5f * side);
+            break;
+        case GaitPattern::WAVE:
+            m_offsets[i] = (float)(side * rows + row) / (2 * rows);
+            break;
+        default:
+            // alternating tripod: neighbours along and across the body are half a cycle apart
+            m_offsets[i] = ((i + i/2) % 2) * 0.5f;
+            break;
+        }
+        m_reach = glm::max(m_reach, glm::length(legs[i].targetPosSpider));
+        // body motion per cycle: each leg steps once, from its step distance behind
+        // its target to its overshoot of that in front
+        m_stride = glm::max(m_stride, legs[i].stepDistance * (1.0f + legs[i].overshoot));
+    }
+    m_turn.assign(numLegs, 0);
+    m_motion = 0.0f;
+    m_hasModel = false;
+    checkAll();
+}
+
+void GaitScheduler::checkAll() {
+    m_checkAt.assign(m_offsets.size(), m_motion);
+}
+
+void GaitScheduler::advance(const glm::mat4& spiderModel, const std::vector<Leg>& legs) {
+    if (!m_hasModel) {
+        m_lastModel = spiderModel;
+        m_hasModel = true;
+    }
+    // a target moves at most as far as the body did over the surface, plus the
+    // turn times its distance from the body. targets stay on the surface, so the
+    // body bobbing up and down doesn't move them
+    glm::vec3 up = glm::normalize(glm::vec3(spiderModel[1]));
+    glm::vec3 moved = glm::vec3(spiderModel[3]) - glm::vec3(m_lastModel[3]);
+    moved -= glm::dot(moved, up) * up;
+    glm::mat3 turn = glm::transpose(glm::mat3(m_lastModel)) * glm::mat3(spiderModel);
+    float angle = glm::acos(glm::clamp((turn[0][0] + turn[1][1] + turn[2][2] - 1.0f) / 2.0f, -1.0f, 1.0f));
+    float motion = glm::length(moved) + angle * m_reach;
+    m_lastModel = spiderModel;
+    m_motion += motion;
+    // only differences matter, so keep the numbers small enough to tell apart
+    if (m_motion > 1000.0f) {
+        for (float& checkAt : m_checkAt) {
+            checkAt -= m_motion;
+        }
+        m_motion = 0.0f;
+    }
+
+    // turns that came round as the cycle went past their offsets
+    float cycles = motion / m_stride;
+    float lastPhase = phase;
+    phase = glm::fract(phase + cycles);
+    for (int i = 0; i < (int)m_offsets.size(); i++) {
+        if (cycles >= 1.0f || glm::fract(m_offsets[i] - lastPhase - 1e-6f) < cycles) {
+            m_turn[i] = 1;
+        }
+    }
+
+    m_due.clear();
+    for (int i = 0; i < (int)m_offsets.size(); i++) {
+        if (!legs[i].moveState && (m_turn[i] || m_motion >= m_checkAt[i])) {
+            m_due.push_back(i);
+        }
+    }
+}
+
+const std::vector<int>& GaitScheduler::due() const {
+    return m_due;
+}
+
+bool GaitScheduler::decide(int leg, float drift, const std::vector<Leg>& legs) {
+    float stepDistance = legs[leg].stepDistance;
+    // a foot past its joint limits steps as if its turn had come
+    bool early = m_turn[leg] || legs[leg].beyondLimits;
+    bool wantsStep = early ? drift > MIN_STEP_FRACTION * stepDistance : drift > stepDistance;
+    if (!wantsStep) {
+        m_turn[leg] = 0;
+        m_checkAt[leg] = m_motion + stepDistance - drift;
+        return false;
+    }
+    if (!m_turn[leg]) {
+        // the foot got too far before its turn (the body turned, or the floor
+        // dropped away), so the cycle catches up to it: its turn, and the turn of
+        // every leg stepping with it, come now
+        phase = m_offsets[leg];
+        for (int i = 0; i < (int)m_offsets.size(); i++) {
+            if (m_offsets[i] == phase) {
+                m_turn[i] = 1;
+                m_checkAt[i] = m_motion;
+            }
+        }
+    }
+
+    // keep half the legs down, and never lift two next to each other
+    int stepping = 0;
+    for (int i = 0; i < (int)legs.size(); i++) {
+        if (legs[i].moveState) {
+            stepping++;
+            if (neighbours(leg, i)) {
+                stepping = legs.size();
+                break;
+            }
+        }
+    }
+    if (2 * (stepping + 1) > (int)legs.size()) {
+        // try again next frame
+        m_checkAt[leg] = m_motion;
+        return false;
+    }
+
+    // the landing overshoots the target, so starts out this far from it
+    m_turn[leg] = 0;
+    m_checkAt[leg] = m_motion + stepDistance - legs[leg].overshoot * drift;
+    return true;
+}
+
+void GaitScheduler::defer(int leg) {
+    m_checkAt[leg] = m_motion;
+}
@@ -0,0 +1,70 @@
+#ifndef GAIT_SCHEDULER_H
+#define GAIT_SCHEDULER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "spider/leg.h"
+
+enum class GaitPattern {
+    TRIPOD, // alternating triangles of three legs, two steps a cycle
+    RIPPLE, // a wave from back to front on each side, the sides half a cycle apart
+    WAVE // one leg at a time, back to front on the left and then on the right
+};
+
+/**
+ * Decides which of a spider's legs step when, for any number of legs. Legs are
+ * numbered back to front, alternating left and right (the order rigs list them in).
+ *
+ * The body's motion since the last frame is measured once per spider: how far
+ * it went plus how far it turned, times the legs' reach. That bounds how far
+ * any leg's target can have moved, without looking at the legs. It drives two
+ * kinds of event:
+ *   the gait cycle advances by motion over a stride, and each leg's turn comes
+ *       round when the cycle passes its offset in the pattern
+ *   a planted leg is checked again only once the body has moved far enough that
+ *       its target could be its step distance from its foot, or once its joints
+ *       have gone past their limits
+ * Legs with neither event this frame aren't looked at (no targets, no probes),
+ * and the rest step only if that leaves at least half the legs planted and no
+ * neighbour is stepping, so the feet the body height is averaged over are
+ * always spread out under it.
+ */
+class GaitScheduler
+{
+public:
+    GaitScheduler();
+
+    // sets up the pattern's offsets for the legs, with every leg due a check
+    void reset(GaitPattern pattern, const std::vector<Leg>& legs);
+    // has every leg checked next frame, e.g. after the floor changed or the feet
+    // were moved
+    void checkAll();
+    // measures the motion since the last call and lists the planted legs due
+    // this frame
+    void advance(const glm::mat4& spiderModel, const std::vector<Leg>& legs);
+    // legs due this frame, in order
+    const std::vector<int>& due() const;
+    // decides whether a due leg steps, given how far its foot is from its target
+    // and which legs are stepping now. schedules its next check either way
+    bool decide(int leg, float drift, const std::vector<Leg>& legs);
+    // has a leg checked next frame, e.g. a due leg that couldn't be decided on
+    // (nowhere to step)
+    void defer(int leg);
+
+    GaitPattern pattern;
+    float phase; // position in the cycle, [0,1)
+
+private:
+    std::vector<float> m_offsets; // per leg, where in the cycle it steps
+    std::vector<float> m_checkAt; // per leg, motion at which it's next checked
+    std::vector<uint8_t> m_turn; // per leg, its turn came round and it hasn't stepped yet
+    std::vector<int> m_due;
+    float m_reach; // furthest a foot target is from the body's origin
+    float m_stride; // body motion per cycle
+    float m_motion; // since reset
+    glm::mat4 m_lastModel;
+    bool m_hasModel;
+};
+
+#endif // GAIT_SCHEDULER_H
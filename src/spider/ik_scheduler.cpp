@@ -0,0 +1,54 @@
+#include "ik_scheduler.h"
+#include "spider/spider.h"
+#include "settings.h"
+#include <algorithm>
+#include <chrono>
+
+void IKScheduler::update(std::span<Spider> spiders, Camera& camera) {
+    m_queue.clear();
+
+    // screen size is (leg length / distance) over the half-height of the view at distance 1
+    float invTanHalfFov = 1.0f / glm::tan(camera.heightAngle / 2.0f);
+
+    for (Spider& spider : spiders) {
+        glm::vec3 spiderPos = spider.spiderModel[3];
+        float dist = glm::max(glm::distance(spiderPos, camera.pos), camera.near);
+        float screenSize = (spider.segLength1 + spider.segLength2) / dist * invTanHalfFov;
+
+        for (Leg& leg : spider.legs) {
+            if (!leg.solvePending) {
+                continue;
+            }
+            float priority = screenSize * (leg.moveState ? 4.0f : 1.0f) * (1.0f + leg.framesStale);
+            m_queue.push_back({priority, &leg});
+        }
+    }
+
+    auto lessUrgent = [](const Entry& a, const Entry& b) { return a.priority < b.priority; };
+    std::make_heap(m_queue.begin(), m_queue.end(), lessUrgent);
+
+    // solve the most urgent legs until the count or time budget runs out. the clock
+    // is only read every few solves, since a solve costs about as much as reading it
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    auto timeBudget = std::chrono::duration<float, std::micro>(settings.ikSliceMaxMicros);
+    int maxSolves = settings.ikSliceMaxSolves > 0 ? settings.ikSliceMaxSolves : (int)m_queue.size();
+
+    solvesLastFrame = 0;
+    while (!m_queue.empty() && solvesLastFrame < maxSolves) {
+        if (settings.ikSliceMaxMicros > 0 && solvesLastFrame % 8 == 0 && solvesLastFrame > 0
+                && clock::now() - start > timeBudget) {
+            break;
+        }
+        std::pop_heap(m_queue.begin(), m_queue.end(), lessUrgent);
+        m_queue.back().leg->solve();
+        m_queue.pop_back();
+        solvesLastFrame++;
+    }
+
+    // everything left waits another frame
+    for (Entry& entry : m_queue) {
+        entry.leg->framesStale++;
+    }
+    pendingLastFrame = m_queue.size();
+}
@@ -0,0 +1,39 @@
+#ifndef IK_SCHEDULER_H
+#define IK_SCHEDULER_H
+
+#include <span>
+#include <vector>
+#include "camera.h"
+
+class Spider;
+class Leg;
+
+/**
+ * Spreads leg IK solves over several frames when too many legs want one at once.
+ * Spider::animate marks legs that moved as pending instead of solving them; each
+ * frame this solves pending legs in priority order until it runs out of count or
+ * time budget. Legs left over keep painting with their last solved angles and
+ * get more urgent every frame they wait.
+ *
+ * Priority is the leg's size on screen, times 4 while the leg is mid-step
+ * (moveState), times one plus the number of frames it has been waiting.
+ */
+class IKScheduler
+{
+public:
+    // call once per frame, after Spider::animate and before painting
+    void update(std::span<Spider> spiders, Camera& camera);
+
+    int solvesLastFrame = 0; // legs solved by the last update
+    int pendingLastFrame = 0; // legs still waiting after the last update
+
+private:
+    struct Entry {
+        float priority;
+        Leg* leg;
+    };
+    // pending legs as a max-heap on priority. kept between frames to avoid reallocating
+    std::vector<Entry> m_queue;
+};
+
+#endif // IK_SCHEDULER_H
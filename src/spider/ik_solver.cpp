@@ -1,19 +1,22 @@
 #include <iostream>
 #include <tuple>
 #include <glm/glm.hpp>
+#include "utils/fastmath.h"
 
 namespace IKSolver {
     /**
      * @brief solves the inverse kinematics solution for a leg with two segments.
      *        assume fixed point is at (0,0,0)
+     * @tparam Math - trig backend, FastMath::Libm or FastMath::Approx
      * @param target - the target point (x,y,z) to reach
      * @param segLength1 - the length of the first leg segment (closer to fixed point)
      * @param segLength2 - the length of the second leg segment (closer to target point)
      * @return a tuple containing theta1, theta2, theta3 values of the inverse
      *         kinematics solution.
      */
-    inline std::tuple<float, float, float> solveAngles(glm::vec3 target,
-                                                       float segLength1, float segLength2) {
+    template <typename Math>
+    inline std::tuple<float, float, float> solveAnglesWith(glm::vec3 target,
+                                                           float segLength1, float segLength2) {
         // declare thetas
         float theta1;
         float theta2;
@@ -27,10 +30,10 @@ namespace IKSolver {
         // leg should straighten out and go in that direction.
         if (distToTarget > segLength1 + segLength2) {
             glm::vec3 vecToTarget = glm::normalize(target);
-            theta1 = acos(glm::dot(glm::normalize(glm::vec3(vecToTarget.x, 0, vecToTarget.z)),
-                                   glm::vec3(1,0,0)));
+            theta1 = Math::acos(glm::dot(glm::normalize(glm::vec3(vecToTarget.x, 0, vecToTarget.z)),
+                                         glm::vec3(1,0,0)));
             if (vecToTarget.z>0) {theta1 = 2.0*M_PI - theta1; }
-            theta2 = acos(glm::dot(vecToTarget, glm::vec3(0,1,0)));
+            theta2 = Math::acos(glm::dot(vecToTarget, glm::vec3(0,1,0)));
             theta3 = M_PI;
 
         } else {
@@ -43,20 +46,20 @@ namespace IKSolver {
 
             // calculate angles of triangle
             // alpha: angle at vertex A
-            float cosAlpha = b!=0 ? (pow(b, 2) + pow(c, 2) - pow(a, 2))/(2.0f*b*c) : 0;
-            float alpha = abs(cosAlpha)<=1 ? acos(cosAlpha) : cosAlpha>1 ? 0 : M_PI;
+            float cosAlpha = b!=0 ? (b*b + c*c - a*a)/(2.0f*b*c) : 0;
+            float alpha = abs(cosAlpha)<=1 ? Math::acos(cosAlpha) : cosAlpha>1 ? 0 : M_PI;
             // gamma: angle between first leg segment and XZ-plane
-            float gamma = distToTarget!=0?asin(target.y / distToTarget):0;
+            float gamma = distToTarget!=0?Math::asin(target.y / distToTarget):0;
             // beta: angle at vertex B
-            float cosBeta = (pow(a, 2) + pow(c, 2) - pow(b, 2))/(2.0f*a*c);
-            float beta = abs(cosBeta)<=1 ? acos(cosBeta) : cosBeta>1 ? 0 : M_PI;
+            float cosBeta = (a*a + c*c - b*b)/(2.0f*a*c);
+            float beta = abs(cosBeta)<=1 ? Math::acos(cosBeta) : cosBeta>1 ? 0 : M_PI;
     //        float aPrime = atan2(target.y, glm::length(glm::vec3(target.x, 0, target.z)));
 
 //            std::cout << "alpha: " << alpha << ", "
 //                      << "beta: " << beta << ", "
 //                      << "gamma: " << gamma << std::endl;
 
-            theta1 = -atan2(target.z,target.x);
+            theta1 = -Math::atan2(target.z,target.x);
             theta2 = M_PI/2.0f - alpha - gamma;
             theta3 = 2.0f*M_PI-beta;
         }
@@ -67,4 +70,30 @@ namespace IKSolver {
 
         return std::tuple{theta1, theta2, theta3};
     }
+
+    /**
+     * @brief brings each angle in a within pi of the matching angle in ref, so that
+     *        blending between the two never goes the long way around the circle.
+     */
+    inline glm::vec3 unwrapAngles(glm::vec3 a, glm::vec3 ref) {
+        const float twoPi = 2.0f * M_PI;
+        return a - twoPi * glm::floor((a - ref) / twoPi + 0.5f);
+    }
+
+    /**
+     * @brief solveAngles with libm trig. reference solution.
+     */
+    inline std::tuple<float, float, float> solveAngles(glm::vec3 target,
+                                                       float segLength1, float segLength2) {
+        return solveAnglesWith<FastMath::Libm>(target, segLength1, segLength2);
+    }
+
+    /**
+     * @brief solveAngles with polynomial trig (see utils/fastmath.h). angles are
+     *        within ~1e-6 rad of solveAngles.
+     */
+    inline std::tuple<float, float, float> solveAnglesFast(glm::vec3 target,
+                                                           float segLength1, float segLength2) {
+        return solveAnglesWith<FastMath::Approx>(target, segLength1, segLength2);
+    }
 }
@@ -0,0 +1,87 @@
+#include "ik_table.h"
+#include "spider/ik_solver.cpp"
+#include "settings.h"
+#include <cmath>
+
+IKTable::IKTable(float segLength1, float segLength2, int resolution, std::size_t memoryBudget) {
+    this->segLength1 = segLength1;
+    this->segLength2 = segLength2;
+    this->memoryBudget = memoryBudget;
+
+    this->resolution = fitResolution(resolution, memoryBudget);
+
+    m_reach = segLength1 + segLength2;
+    m_invCellSize = (this->resolution - 1) / (2.0f * m_reach);
+
+    // sample the analytic solution at every grid node
+    int n = this->resolution;
+    float cellSize = 1.0f / m_invCellSize;
+    m_angles.resize((std::size_t)n * n * n);
+    for (int k = 0; k < n; k++) {
+        for (int j = 0; j < n; j++) {
+            for (int i = 0; i < n; i++) {
+                glm::vec3 target = glm::vec3(i, j, k) * cellSize - m_reach;
+                auto [theta1, theta2, theta3] = IKSolver::solveAngles(target, segLength1, segLength2);
+                m_angles[((std::size_t)k * n + j) * n + i] = glm::vec3(theta1, theta2, theta3);
+            }
+        }
+    }
+}
+
+int IKTable::fitResolution(int resolution, std::size_t memoryBudget) {
+    // largest resolution that fits in the budget (at least 2 samples per axis)
+    int maxResolution = (int)std::cbrt((double)memoryBudget / sizeof(glm::vec3));
+    return glm::max(2, glm::min(resolution, maxResolution));
+}
+
+std::shared_ptr<const IKTable> IKTable::shared(float segLength1, float segLength2,
+                                               int resolution, std::size_t memoryBudget) {
+    static std::vector<std::shared_ptr<const IKTable>> cache;
+    for (const auto& table : cache) {
+        if (table->segLength1 == segLength1 && table->segLength2 == segLength2
+                && table->resolution == fitResolution(resolution, memoryBudget)) {
+            return table;
+        }
+    }
+    cache.push_back(std::make_shared<const IKTable>(segLength1, segLength2, resolution, memoryBudget));
+    return cache.back();
+}
+
+std::tuple<float, float, float> IKTable::lookup(glm::vec3 target) const {
+    // theta3 has a square root singularity at full extension, so cells that
+    // touch the reach sphere are solved analytically, as is anything outside the grid.
+    // the corners blended below are up to a cell diagonal (sqrt 3 cells) away
+    float maxDist = m_reach - std::sqrt(3.0f) / m_invCellSize;
+    if (glm::dot(target, target) > maxDist * maxDist) {
+        return settings.fastTrig ? IKSolver::solveAnglesFast(target, segLength1, segLength2)
+                                 : IKSolver::solveAngles(target, segLength1, segLength2);
+    }
+    glm::vec3 g = (target + m_reach) * m_invCellSize;
+
+    // cell index and fractional position inside the cell
+    glm::ivec3 c = glm::min(glm::ivec3(g), glm::ivec3(resolution - 2));
+    glm::vec3 f = g - glm::vec3(c);
+
+    std::size_t n = resolution;
+    std::size_t base = ((std::size_t)c.z * n + c.y) * n + c.x;
+    glm::vec3 a000 = m_angles[base];
+    glm::vec3 a100 = IKSolver::unwrapAngles(m_angles[base + 1], a000);
+    glm::vec3 a010 = IKSolver::unwrapAngles(m_angles[base + n], a000);
+    glm::vec3 a110 = IKSolver::unwrapAngles(m_angles[base + n + 1], a000);
+    glm::vec3 a001 = IKSolver::unwrapAngles(m_angles[base + n * n], a000);
+    glm::vec3 a101 = IKSolver::unwrapAngles(m_angles[base + n * n + 1], a000);
+    glm::vec3 a011 = IKSolver::unwrapAngles(m_angles[base + n * n + n], a000);
+    glm::vec3 a111 = IKSolver::unwrapAngles(m_angles[base + n * n + n + 1], a000);
+
+    glm::vec3 a00 = glm::mix(a000, a100, f.x);
+    glm::vec3 a10 = glm::mix(a010, a110, f.x);
+    glm::vec3 a01 = glm::mix(a001, a101, f.x);
+    glm::vec3 a11 = glm::mix(a011, a111, f.x);
+    glm::vec3 result = glm::mix(glm::mix(a00, a10, f.y), glm::mix(a01, a11, f.y), f.z);
+
+    return std::tuple{result.x, result.y, result.z};
+}
+
+std::size_t IKTable::memoryUsage() const {
+    return m_angles.size() * sizeof(glm::vec3);
+}
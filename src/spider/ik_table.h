@@ -0,0 +1,52 @@
+#ifndef IK_TABLE_H
+#define IK_TABLE_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+/**
+ * Precomputed IK solutions for one pair of segment lengths. The cube
+ * [-reach, reach]^3 around the hip (reach = segLength1 + segLength2) is sampled
+ * on a regular grid, and queries are answered by trilinear interpolation of the
+ * 8 surrounding (theta1, theta2, theta3) samples. Angles are unwrapped relative
+ * to the first corner before blending, so cells that straddle the +-pi seam of
+ * theta1 interpolate correctly. Targets within a cell diagonal of full extension (and
+ * so everything outside the grid) fall back to the analytic solve, with the trig
+ * backend from settings.
+ *
+ * At the default 64^3 (3 MB) the error is below 0.02 rad, with the worst case
+ * within a cell of the vertical axis through the hip, where theta1 is undefined.
+ */
+class IKTable
+{
+public:
+    // builds the table. resolution is samples per axis; it is reduced until the
+    // table fits in memoryBudget bytes.
+    IKTable(float segLength1, float segLength2, int resolution, std::size_t memoryBudget);
+
+    // returns a table shared by every caller asking for the same parameters
+    static std::shared_ptr<const IKTable> shared(float segLength1, float segLength2,
+                                                 int resolution, std::size_t memoryBudget);
+
+    // interpolated (theta1, theta2, theta3) for a target relative to the fixed point
+    std::tuple<float, float, float> lookup(glm::vec3 target) const;
+
+    float segLength1;
+    float segLength2;
+    int resolution; // samples per axis actually used
+    std::size_t memoryBudget; // requested budget in bytes
+
+    std::size_t memoryUsage() const;
+
+private:
+    static int fitResolution(int resolution, std::size_t memoryBudget);
+
+    float m_reach; // half extent of the sampled cube
+    float m_invCellSize; // samples per unit length
+    std::vector<glm::vec3> m_angles; // resolution^3 samples, x fastest
+};
+
+#endif // IK_TABLE_H
@@ -0,0 +1,226 @@
+#include "impostors.h"
+#include "spider/spider.h"
+#include "realtime.h"
+#include "settings.h"
+#include "utils/shaderloader.h"
+#include "glm/gtc/matrix_transform.hpp"
+#include <cstddef>
+#include <iostream>
+
+ImpostorRenderer::ImpostorRenderer() {
+    instancesLastFrame = 0;
+    m_shader = 0;
+    m_atlas = 0;
+    m_quadVBO = 0;
+    m_instanceVBO = 0;
+    m_vao = 0;
+}
+
+void ImpostorRenderer::initialize(const std::vector<std::shared_ptr<const Rig>>& rigs,
+                                  GLuint phong_shader,
+                                  const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere,
+                                  GLuint framebuffer) {
+    m_rigs = rigs;
+    m_radius.clear();
+    int cols = POSES * YAWS;
+    int width = cols * CELL_SIZE;
+    int height = ELEVATIONS * CELL_SIZE;
+
+    glGenTextures(1, &m_atlas);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, m_rigs.size(),
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // snapshots are painted into each layer in turn, over a depth buffer of their own
+    GLuint fbo;
+    GLuint depth;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLfloat clearColour[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColour);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    GLint projViewLoc = glGetUniformLocation(phong_shader, "projView");
+    GLint cameraPosLoc = glGetUniformLocation(phong_shader, "cameraPos");
+
+    // the spiders are painted shape by shape (Realtime::paintShape), bound once
+    glUseProgram(phong_shader);
+    glBindVertexArray(cylinder.arena->vao());
+    bool baked = true;
+    for (int layer = 0; layer < (int)m_rigs.size() && baked; layer++) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_atlas, 0, layer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Failed to set up the framebuffer for impostors" << std::endl;
+            baked = false;
+            break;
+        }
+        glViewport(0, 0, width, height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // a spider of this rig standing at the origin facing +x, walking the canned gait
+        Spider spider(phong_shader, cylinder, sphere, m_rigs[layer]);
+        spider.cannedGait = CannedGait::build(spider);
+        float radius = m_rigs[layer]->boundingRadius();
+        m_radius.push_back(radius);
+        glm::mat4 proj = glm::ortho(-radius, radius, -radius, radius, radius, 5.0f * radius);
+
+        for (int pose = 0; pose < POSES; pose++) {
+            spider.gaitPhase = (float)pose / POSES;
+            for (int yaw = 0; yaw < YAWS; yaw++) {
+                float heading = 2.0f * glm::pi<float>() * yaw / YAWS;
+                for (int row = 0; row < ELEVATIONS; row++) {
+                    float elevation = row * ELEVATION_STEP;
+                    glm::vec3 toCamera(glm::cos(elevation) * glm::cos(heading), glm::sin(elevation),
+                                       glm::cos(elevation) * glm::sin(heading));
+                    glm::vec3 eye = 3.0f * radius * toCamera;
+                    glm::mat4 projView = proj * glm::lookAt(eye, glm::vec3(0), glm::vec3(0,1,0));
+                    glUniformMatrix4fv(projViewLoc, 1, GL_FALSE, &projView[0][0]);
+                    glUniform3fv(cameraPosLoc, 1, &eye[0]);
+
+                    glViewport((pose * YAWS + yaw) * CELL_SIZE, row * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+                    spider.paintCannedGait(glm::mat4(1));
+                    spider.paintBody(glm::mat4(1));
+                }
+            }
+        }
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &depth);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearColor(clearColour[0], clearColour[1], clearColour[2], clearColour[3]);
+    if (!baked) {
+        glDeleteTextures(1, &m_atlas);
+        m_atlas = 0;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    m_shader = ShaderLoader::createShaderProgram(":/resources/shaders/impostor.vert",
+                                                 ":/resources/shaders/impostor.frag");
+
+    // one quad, corners in [-1, 1], drawn as a strip once per instance
+    GLfloat corners[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glGenBuffers(1, &m_quadVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), reinterpret_cast<void*>(0));
+    glGenBuffers(1, &m_instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          reinterpret_cast<void*>(offsetof(Instance, centerRadius)));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          reinterpret_cast<void*>(offsetof(Instance, forwardPhaseFade)));
+    glVertexAttribDivisor(2, 1);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                          reinterpret_cast<void*>(offsetof(Instance, layer)));
+    glVertexAttribDivisor(3, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // uniforms that never change
+    glUseProgram(m_shader);
+    glUniform1i(glGetUniformLocation(m_shader, "atlas"), 0);
+    glUniform1i(glGetUniformLocation(m_shader, "yaws"), YAWS);
+    glUniform1i(glGetUniformLocation(m_shader, "elevations"), ELEVATIONS);
+    glUniform1f(glGetUniformLocation(m_shader, "elevationStep"), ELEVATION_STEP);
+    glUniform1i(glGetUniformLocation(m_shader, "poses"), POSES);
+    glUseProgram(0);
+}
+
+void ImpostorRenderer::finish() {
+    if (!isInitialized()) {
+        return;
+    }
+    glDeleteBuffers(1, &m_quadVBO);
+    glDeleteBuffers(1, &m_instanceVBO);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteTextures(1, &m_atlas);
+    glDeleteProgram(m_shader);
+    m_shader = 0;
+    m_atlas = 0;
+}
+
+bool ImpostorRenderer::isInitialized() const {
+    return m_shader != 0;
+}
+
+float ImpostorRenderer::fade(float distance) {
+    float start = settings.impostorDistance - settings.impostorFadeBand;
+    if (distance <= start) {
+        return 0.0f;
+    }
+    if (distance >= settings.impostorDistance) {
+        return 1.0f;
+    }
+    return (distance - start) / settings.impostorFadeBand;
+}
+
+void ImpostorRenderer::add(const std::vector<Spider*>& spiders) {
+    int layers = m_rigs.size();
+    int layer = 0;
+    for (const Spider* spider : spiders) {
+        // spiders are spawned from the rigs in turn, so the search starts from the
+        // last one's layer
+        int tries = 0;
+        while (tries < layers && m_rigs[layer] != spider->rig) {
+            layer = (layer + 1) % layers;
+            tries++;
+        }
+        if (tries == layers) {
+            continue;
+        }
+        glm::vec3 center = spider->spiderModel[3];
+        m_instances.push_back({glm::vec4(center, m_radius[layer]),
+                               glm::vec4(spider->look.x, spider->look.z, spider->gaitPhase, spider->impostorFade),
+                               (float)layer});
+    }
+}
+
+void ImpostorRenderer::paint(Camera& camera) {
+    instancesLastFrame = m_instances.size();
+    if (m_instances.empty()) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(Instance), m_instances.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_instances.clear();
+
+    glUseProgram(m_shader);
+    Realtime::sendCameraDataToShader(m_shader, camera);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlas);
+    glBindVertexArray(m_vao);
+    // quads face the camera, but which way round they wind is up to the corners
+    glDisable(GL_CULL_FACE);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instancesLastFrame);
+    glEnable(GL_CULL_FACE);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glUseProgram(0);
+}
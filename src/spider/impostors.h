@@ -0,0 +1,94 @@
+#ifndef IMPOSTORS_H
+#define IMPOSTORS_H
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "camera.h"
+#include "spider/rig.h"
+#include "utils/geometry_arena.h"
+
+class Spider;
+
+/**
+ * Draws far away spiders as a single camera-facing quad each, all of them in one
+ * instanced draw, instead of the two dozen or so shapes a spider's mesh takes.
+ *
+ * At startup every rig is painted into an atlas (one layer of a texture array per
+ * rig) with the phong shader and the scene's lights: YAWS headings around the
+ * spider, times ELEVATIONS heights from level up to 60 degrees, times POSES
+ * evenly spaced phases of the canned gait (animation_lod.h). Each snapshot is
+ * an orthographic view of the rig's bounding sphere, so a quad that size
+ * centred on the body lines up with it.
+ *
+ * The vertex shader works out where the camera is in the spider's frame and picks
+ * the snapshots for it: the nearest elevation and gait pose, and the two headings
+ * either side, blended. The snapshots' lighting is baked in as if each spider
+ * faced +x, and spiders walking on walls are drawn upright.
+ *
+ * Between impostorDistance - impostorFadeBand and impostorDistance a spider is
+ * painted both ways, dithered: the impostor keeps a growing share of the cells of
+ * an ordered dither pattern and the mesh (Spider::paintSpider's fade) keeps the
+ * rest, so the two hand over pixel for pixel with nothing sorted or blended.
+ * Past impostorDistance only the impostor is drawn.
+ *
+ * Only needs GL 3.3 (instanced arrays and texture arrays), so it runs on
+ * software GL such as Mesa's llvmpipe.
+ */
+class ImpostorRenderer
+{
+public:
+    static constexpr int CELL_SIZE = 64; // pixels per snapshot side
+    static constexpr int YAWS = 8;
+    static constexpr int ELEVATIONS = 3;
+    static constexpr float ELEVATION_STEP = 0.52359878f; // 30 degrees
+    static constexpr int POSES = 4;
+
+    ImpostorRenderer();
+
+    // bakes an atlas layer for each rig and sets up the quad. needs a current GL
+    // context and phong_shader with its lights sent. framebuffer is the one to
+    // go back to afterwards
+    void initialize(const std::vector<std::shared_ptr<const Rig>>& rigs,
+                    GLuint phong_shader,
+                    const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere,
+                    GLuint framebuffer);
+    // deletes GL objects
+    void finish();
+    bool isInitialized() const;
+
+    // how far into the impostor a spider this far from the camera is: 0 for just
+    // its mesh, 1 for just its impostor
+    static float fade(float distance);
+    // queues the spiders' impostors for paint, each at its impostorFade. spiders
+    // whose rig has no atlas layer are left out
+    void add(const std::vector<Spider*>& spiders);
+    // draws the impostors queued since the last paint
+    void paint(Camera& camera);
+
+    int instancesLastFrame;
+
+private:
+    struct Instance {
+        glm::vec4 centerRadius; // body centre and bounding radius
+        glm::vec4 forwardPhaseFade; // heading (x, z), gait phase and fade
+        float layer; // atlas layer of the spider's rig
+    };
+
+    std::vector<std::shared_ptr<const Rig>> m_rigs; // one per atlas layer
+    std::vector<float> m_radius; // of each rig's snapshots
+    std::vector<Instance> m_instances; // queued by add. kept between frames to avoid reallocating
+
+    GLuint m_shader;
+    GLuint m_atlas;
+    GLuint m_quadVBO;
+    GLuint m_instanceVBO;
+    GLuint m_vao;
+};
+
+#endif // IMPOSTORS_H
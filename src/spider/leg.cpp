@@ -3,76 +3,189 @@
 #include "spider/ik_solver.cpp"
 #include "utils/scenedata.h"
 #include "realtime.h"
+#include "settings.h"
 
-Leg::Leg(glm::vec3 footPosSpider, glm::vec3 hipPosSpider, glm::vec3 targetPosSpider,
-         glm::mat4 spiderModel,
-         float moveTime, float segLength1, float segLength2, float diameter,
+Leg::Leg(const Rig& rig, int index, glm::mat4 spiderModel,
          GLuint phong_shader,
-         GLuint cylinderVAO, int cylinderBufferSize,
-         GLuint sphereVAO, int sphereBufferSize) {
+         const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere) {
     // set GL characteristics
     this->m_phong_shader = phong_shader;
-    this->m_cylinderVAO = cylinderVAO;
-    this->m_cylinderBufferSize = cylinderBufferSize;
-    this->m_sphereVAO = sphereVAO;
-    this->m_sphereBufferSize = sphereBufferSize;
+    this->m_cylinder = cylinder;
+    this->m_sphere = sphere;
 
     // set basic characteristics
-    this->segLength1 = segLength1;
-    this->segLength2 = segLength2;
-    this->diameter = diameter;
+    const RigLeg& rigLeg = rig.legs[index];
+    this->segLength1 = rig.segLength1;
+    this->segLength2 = rig.segLength2;
+    this->diameter = rig.legDiameter;
 
     // set foot positions. initially old = current
-    this->currFootPosWorld = spiderModel * glm::vec4(footPosSpider,1);
+    this->currFootPosWorld = spiderModel * glm::vec4(rigLeg.foot.x, -rig.bodyHeight, rigLeg.foot.y, 1);
     this->oldFootPosWorld = this->currFootPosWorld;
 
     // spider to world model matrix
     this->spiderModel = spiderModel;
+    this->legFrame = tiltTo(glm::normalize(glm::vec3(spiderModel[1])));
+    this->contactNormal = glm::vec3(0,1,0);
+    this->oldTargetNormal = this->contactNormal;
 
     // setting constant position fields
-    this->targetPosSpider = targetPosSpider;//glm::vec3(0, footPosSpider.y, footPosSpider.z);
+    this->targetPosSpider = glm::vec3(rigLeg.target.x, -rig.bodyHeight, rigLeg.target.y);
     this->oldTargetPosWorld = spiderModel * glm::vec4(this->targetPosSpider, 1);
-    this->hipPosSpider = hipPosSpider;
+    this->hipPosSpider = rigLeg.hip;
 
     // set movement fields to default
     this->moveState = false;
     this->timeSinceMove = 0;
-    this->moveTime = moveTime;
+    this->moveTime = rig.moveTime;
+    this->stepDistance = rig.stepDistance;
+    this->overshoot = rig.overshoot;
+    this->maxClimb = rig.maxClimb;
+    this->rigLeg = rigLeg;
+    this->beyondLimits = false;
+    this->hitLimits = false;
+    this->swingCurve = nullptr;
+    this->swingClearance = 0.0f;
+
+    // solve analytically until a table is assigned
+    this->ikTable = nullptr;
+
+    // solve the initial pose, with nothing to blend from
+    this->angles = glm::vec3(0);
+    this->solvedFootPosWorld = this->currFootPosWorld;
+    solve();
+    this->prevAngles = this->angles;
+    this->hitLimits = false;
 }
 
-void Leg::updateSpiderModel(glm::mat4 spiderModel) {
-    // update spider model
-    this->spiderModel = spiderModel;
+glm::vec3 Leg::landingFor(glm::vec3 targetPosWorld, glm::vec3 targetNormal) const {
+    // overshoot along the surface the foot lands on, not into it (e.g. stepping
+    // down, or around a corner onto a wall)
+    glm::vec3 past = overshoot * (targetPosWorld - currFootPosWorld);
+    return targetPosWorld + past - glm::dot(past, targetNormal) * targetNormal;
+}
 
+glm::vec3 Leg::groundTarget(glm::mat4 spiderModel) {
     // calculate new target position
     glm::vec3 targetPosWorld = spiderModel * glm::vec4(targetPosSpider,1);
-    targetPosWorld.y = Realtime::getFloorHeight(targetPosWorld.x, targetPosWorld.z);
+    // the foot comes down from maxClimb above the hip, so it lands on obstacles it can reach
+    float hipHeight = glm::vec3(spiderModel * glm::vec4(hipPosSpider,1)).y;
+    targetPosWorld.y = Realtime::getGroundHeight(targetPosWorld.x, targetPosWorld.z, hipHeight + maxClimb);
+    return targetPosWorld;
+}
 
-    // if foot is too far from target, and not already in movestate, initiate movestate
-    if (!moveState && glm::distance(this->currFootPosWorld, targetPosWorld) > 0.5f) {
-        // save current foot position and current target position
-        oldFootPosWorld = currFootPosWorld;
-        oldTargetPosWorld = targetPosWorld + 0.3f*(targetPosWorld - currFootPosWorld);
+void Leg::updateSpiderModel(glm::mat4 spiderModel) {
+    // update spider model
+    this->spiderModel = spiderModel;
+    this->legFrame = tiltTo(glm::normalize(glm::vec3(spiderModel[1])));
 
-        // initiate movestate
-        moveState = true;
+    // if full move time has elapsed, end movestate and reset. until then
+    // swingFeet moves the foot
+    if (moveState && timeSinceMove >= 1.0f) {
+        this->currFootPosWorld = oldTargetPosWorld;
+        contactNormal = oldTargetNormal;
+        moveState = false;
         timeSinceMove = 0.0f;
     }
+}
 
-    // if currently in movestate
-    if (moveState) {
-        // if full move time has elapsed, end movestate and reset
-        if (timeSinceMove >= 1.0f) {
-            this->currFootPosWorld = oldTargetPosWorld;
-            moveState = false;
-            timeSinceMove = 0.0f;
-        // if still in movestate, move foot to interpolated position
-        } else {
-            // interpolate position between saved foot and target positions
-            this->currFootPosWorld = (1.0f-timeSinceMove) * oldFootPosWorld + timeSinceMove * oldTargetPosWorld;
-            // add sin function to Y value to emulate picking up and putting down foot
-            this->currFootPosWorld.y += sin(timeSinceMove * M_PI) / 4.0f;
+bool Leg::footTarget(glm::vec3& targetPosWorld, glm::vec3 targetNormal) const {
+    const StaticScene* obstacles = Realtime::getObstacles();
+    if (obstacles == nullptr) {
+        return true;
+    }
+    // keep the foot from planting inside the side of an obstacle (side relative to up)
+    glm::vec3 up = legFrame[1];
+    glm::vec3 wallPoint, wallNormal;
+    if (obstacles->closestPoint(targetPosWorld, diameter, wallPoint, wallNormal)
+            && glm::abs(glm::dot(wallNormal, up)) < 0.7f) {
+        glm::vec3 away = glm::normalize(wallNormal - glm::dot(wallNormal, up) * up);
+        targetPosWorld = wallPoint + glm::dot(targetPosWorld - wallPoint, up) * up + diameter * away;
+    }
+    // and from standing on a surface buried inside one (e.g. the floor under a
+    // wall, which is all a probe that started inside the wall finds)
+    return !obstacles->closestPoint(targetPosWorld + diameter * targetNormal, 0.0f, wallPoint, wallNormal);
+}
+
+void Leg::startStep(glm::vec3 targetPosWorld, glm::vec3 targetNormal) {
+    glm::vec3 up = legFrame[1];
+    // save current foot position and current target position
+    oldFootPosWorld = currFootPosWorld;
+    oldTargetPosWorld = landingFor(targetPosWorld, targetNormal);
+    oldTargetNormal = targetNormal;
+
+    // sample the ground under where the step will take the foot, from as high
+    // as it could reach, and lift it enough to clear anything sticking up above
+    // the line between footholds (only upright, since the floor is sampled
+    // straight down)
+    swingClearance = 0.0f;
+    int probes = settings.swingClearanceProbes;
+    if (probes > 0 && up.y > 0.9f) {
+        const SwingCurve* curve = swingCurve != nullptr ? swingCurve : SwingCurve::current().get();
+        float reachHeight = glm::vec3(spiderModel * glm::vec4(hipPosSpider,1)).y + maxClimb;
+        for (int i = 1; i <= probes; i++) {
+            float t = (float)i / (probes + 1);
+            float progress, lift, clear;
+            curve->evaluate(&t, 1, &progress, &lift, &clear);
+            glm::vec3 onLine = glm::mix(oldFootPosWorld, oldTargetPosWorld, progress);
+            float needed = Realtime::getGroundHeight(onLine.x, onLine.z, reachHeight) - onLine.y + diameter;
+            if (needed > lift) {
+                swingClearance = glm::max(swingClearance, needed / clear);
+            }
+        }
+        swingClearance = glm::min(swingClearance, segLength1 + segLength2);
+    }
+
+    // initiate movestate
+    moveState = true;
+    timeSinceMove = 0.0f;
+}
+
+void Leg::placeSwingFoot(float progress, float lift, float clear) {
+    // along the line between saved foot and target positions, lifted along up
+    // to emulate picking up and putting down foot
+    this->currFootPosWorld = glm::mix(oldFootPosWorld, oldTargetPosWorld, progress)
+            + legFrame[1] * glm::max(lift, clear * swingClearance);
+}
+
+// scratch for swingFeet, one entry per stepping leg
+static std::vector<Leg*> s_swingingLegs;
+static std::vector<float> s_swingT;
+static std::vector<float> s_swingProgress;
+static std::vector<float> s_swingLift;
+static std::vector<float> s_swingClear;
+
+void Leg::swingFeet(Leg* const* legs, int count) {
+    s_swingingLegs.clear();
+    s_swingT.clear();
+    for (int i = 0; i < count; i++) {
+        if (legs[i]->moveState) {
+            s_swingingLegs.push_back(legs[i]);
+            s_swingT.push_back(legs[i]->timeSinceMove);
+        }
+    }
+    s_swingProgress.resize(s_swingT.size());
+    s_swingLift.resize(s_swingT.size());
+    s_swingClear.resize(s_swingT.size());
+
+    // a batch per run of legs on the same curve, which is normally all of them
+    std::size_t first = 0;
+    while (first < s_swingingLegs.size()) {
+        const SwingCurve* curve = s_swingingLegs[first]->swingCurve;
+        std::size_t last = first + 1;
+        while (last < s_swingingLegs.size() && s_swingingLegs[last]->swingCurve == curve) {
+            last++;
+        }
+        if (curve == nullptr) {
+            curve = SwingCurve::current().get();
         }
+        curve->evaluate(&s_swingT[first], last - first, &s_swingProgress[first], &s_swingLift[first],
+                        &s_swingClear[first]);
+        first = last;
+    }
+
+    for (std::size_t i = 0; i < s_swingingLegs.size(); i++) {
+        s_swingingLegs[i]->placeSwingFoot(s_swingProgress[i], s_swingLift[i], s_swingClear[i]);
     }
 }
 
@@ -82,19 +195,88 @@ void Leg::tick(float deltaTime) {
     }
 }
 
+/**
+ * @brief solves IK with the lookup table if the leg has one, otherwise
+ *        analytically using the trig backend from settings.
+ * @param hipPosLeg - hip position relative to the foot
+ */
+std::tuple<float, float, float> Leg::solveIK(glm::vec3 hipPosLeg) {
+    if (ikTable != nullptr) {
+        return ikTable->lookup(hipPosLeg);
+    }
+    return settings.fastTrig ? IKSolver::solveAnglesFast(hipPosLeg, segLength1, segLength2)
+                             : IKSolver::solveAngles(hipPosLeg, segLength1, segLength2);
+}
+
+/**
+ * @brief solves inverse kinematics for the current foot position, keeping the
+ *        previous solution around for blending.
+ */
+void Leg::solve() {
+    prevAngles = angles;
+    prevFootPosWorld = solvedFootPosWorld;
+    solvedFootPosWorld = currFootPosWorld;
+    solvePending = false;
+    framesStale = 0;
+
+    // leg space is world space translated to the foot and tilted by legFrame, so the
+    // hip in leg space is the hip in world space minus the foot position, untilted.
+    glm::vec3 hipPosWorld = spiderModel * glm::vec4(hipPosSpider,1);
+    glm::vec3 hipPosLeg = glm::transpose(legFrame) * (hipPosWorld - currFootPosWorld);
+    auto [theta1, theta2, theta3] = solveIK(hipPosLeg);
+    angles = glm::vec3(theta1, theta2, theta3);
+
+    // the limits are in spider space, which the spider model only turns and moves
+    glm::vec3 footFromHip = glm::transpose(glm::mat3(spiderModel)) * (currFootPosWorld - hipPosWorld);
+    bool beyond = !rigLeg.withinLimits(footFromHip, segLength1, segLength2);
+    hitLimits = hitLimits || (beyond && !beyondLimits);
+    beyondLimits = beyond;
+}
+
+glm::mat3 Leg::tiltTo(glm::vec3 up) {
+    glm::vec3 axis = glm::cross(glm::vec3(0,1,0), up);
+    float sinAngle = glm::length(axis);
+    if (sinAngle < 1e-6f) {
+        // level, or upside down (turned over x)
+        return up.y > 0.0f ? glm::mat3(1) : glm::mat3(glm::vec3(1,0,0), glm::vec3(0,-1,0), glm::vec3(0,0,-1));
+    }
+    return glm::mat3(glm::rotate(glm::atan(sinAngle, up.y), axis / sinAngle));
+}
+
+void Leg::resetFoot(glm::vec3 footPosWorld) {
+    currFootPosWorld = footPosWorld;
+    oldFootPosWorld = footPosWorld;
+    solvedFootPosWorld = footPosWorld;
+    prevFootPosWorld = footPosWorld;
+    moveState = false;
+    timeSinceMove = 0.0f;
+}
+
 /**
  * @brief paints the leg to the screen given the current state.
- *        depends on current foot position in world space.
+ *        depends on the foot position at the latest IK solve.
+ * @param blend - how far to go from the previous solve (0) to the latest (1)
  */
-void Leg::paint() {
-    // calculate "leg model" which translates from leg space to world space
-    glm::mat4 legToWorld = glm::translate(currFootPosWorld);
+void Leg::paint(float blend) {
+    if (blend >= 1.0f) {
+        paintPose(solvedFootPosWorld, angles);
+        return;
+    }
+    glm::vec3 footPos = glm::mix(prevFootPosWorld, solvedFootPosWorld, blend);
+    glm::vec3 blendedAngles = glm::mix(IKSolver::unwrapAngles(prevAngles, angles), angles, blend);
+    paintPose(footPos, blendedAngles);
+}
+
+/**
+ * @brief paints the leg with its foot at the given position and the given joint angles
+ */
+void Leg::paintPose(glm::vec3 footPosWorld, glm::vec3 angles) {
+    float theta1 = angles.x;
+    float theta2 = angles.y;
+    float theta3 = angles.z;
 
-    // solve inverse kinematics to get joint angles.
-    // we multiply the hip position by the spider model to get to world space, and then
-    // by the inverse leg matrix to get back to leg space.
-    auto [theta1, theta2, theta3] = IKSolver::solveAngles(glm::inverse(legToWorld)*spiderModel*glm::vec4(hipPosSpider,1),
-                                                          segLength1, segLength2);
+    // calculate "leg model" which translates from leg space to world space
+    glm::mat4 legToWorld = glm::translate(footPosWorld) * glm::mat4(legFrame);
 
     //----SEGMENT 1----//
     // calculate model matrix
@@ -109,7 +291,7 @@ void Leg::paint() {
                                glm::vec3(1,1,1), 5.0f);
 
     Realtime::paintShape(m_phong_shader,
-                         m_cylinderBufferSize, m_cylinderVAO,
+                         m_cylinder,
                          segMaterial1, segModel1);
 
     //----JOINT BALL----//
@@ -127,7 +309,7 @@ void Leg::paint() {
                                     glm::vec3(1,1,1), 5.0f);
 
     Realtime::paintShape(m_phong_shader,
-                         m_sphereBufferSize, m_sphereVAO,
+                         m_sphere,
                          jointBallMaterial, jointBallModel);
 
     //----SEGMENT 2----//
@@ -144,6 +326,6 @@ void Leg::paint() {
                                glm::vec3(1,1,1), 5.0f);
 
     Realtime::paintShape(m_phong_shader,
-                         m_cylinderBufferSize, m_cylinderVAO,
+                         m_cylinder,
                          segMaterial2, segModel2);
 }
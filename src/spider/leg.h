@@ -2,23 +2,24 @@
 #define LEG_H
 #include <glm/glm.hpp>
 #include <GL/glew.h>
+#include <tuple>
+#include "spider/ik_table.h"
+#include "spider/swing_curve.h"
+#include "spider/rig.h"
+#include "utils/geometry_arena.h"
 
 class Leg
 {
 public:
-    // constructor
-    Leg(glm::vec3 footPosSpider, glm::vec3 hipPosSpider, glm::vec3 targetPosSpider, glm::mat4 spiderModel,
-        float moveTime, float segLength1, float segLength2, float diameter,
+    // constructor for leg index of rig, with its foot planted where the rig has it
+    Leg(const Rig& rig, int index, glm::mat4 spiderModel,
         GLuint phong_shader,
-        GLuint cylinderVAO, int cylinderBufferSize,
-        GLuint sphereVAO, int sphereBufferSize);
+        const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere);
 
     // GL-related fields (for painting to screen)
     GLuint m_phong_shader;
-    GLuint m_cylinderVAO;
-    int m_cylinderBufferSize;
-    GLuint m_sphereVAO;
-    int m_sphereBufferSize;
+    GeometryArena::Mesh m_cylinder;
+    GeometryArena::Mesh m_sphere;
 
     // BASIC VISUAL CHARACTERISTICS
     float segLength1; // length of first leg segment (near hip)
@@ -34,6 +35,12 @@ public:
     glm::vec3 currFootPosWorld;
     // spider to world model matrix. updated when spider moves
     glm::mat4 spiderModel;
+    // leg space to world space rotation: world space tilted so y is the spider's up.
+    // the identity on level ground. updated with the spider model
+    glm::mat3 legFrame;
+    // surface normal where the foot is planted, and where the current step lands
+    glm::vec3 contactNormal;
+    glm::vec3 oldTargetNormal;
 
     // FOR MOVEMENT
     // true if leg is currently in movestate.
@@ -47,15 +54,78 @@ public:
     float timeSinceMove;
     // leg movement animation time (i.e. how long it takes to finish the movement)
     float moveTime;
+    // how far the foot gets from its target before it has to step
+    float stepDistance;
+    // steps go overshoot times the step further than the target, along its surface
+    float overshoot;
+    // highest above the hip the foot reaches onto obstacles
+    float maxClimb;
+    // the rig's leg, for its joint limits
+    RigLeg rigLeg;
+    // true if the joints were past their limits at the latest solve
+    bool beyondLimits;
+    // beyondLimits came on since the spider last looked (see Spider::planSteps)
+    bool hitLimits;
+    // path the foot takes while stepping. nullptr for the one in the swing settings.
+    // owned by spider
+    const SwingCurve* swingCurve;
+    // how high above the straight line between footholds the current step has to
+    // lift the foot to clear what's in between, probed when it starts
+    float swingClearance;
+
+    // FOR IK
+    // lookup table to answer IK from. nullptr to solve analytically. owned by spider
+    const IKTable* ikTable;
+
+    // FOR ANIMATION LOD
+    // joint angles (theta1, theta2, theta3) from the most recent IK solve, and from
+    // the solve before it. legs that are solved every few frames blend between them.
+    glm::vec3 angles;
+    glm::vec3 prevAngles;
+    // foot position in world space at the latest and the previous solve
+    glm::vec3 solvedFootPosWorld;
+    glm::vec3 prevFootPosWorld;
+
+    // FOR IK TIME SLICING
+    // true if the leg has moved since it was last solved and is waiting for the IK scheduler
+    bool solvePending;
+    // frames the leg has been waiting
+    int framesStale;
 
 
     // METHODS
-    // paints the leg given the current positional characteristics
-    void paint();
-    // updates the leg's foot position in world space using spider's new model
+    // paints the leg blended between the previous and latest solve (1 = latest)
+    void paint(float blend = 1.0f);
+    // paints the leg with its foot at footPosWorld and the given joint angles
+    void paintPose(glm::vec3 footPosWorld, glm::vec3 angles);
+    // solves IK for the current foot position and spider model
+    void solve();
+    // plants the foot at footPosWorld, cancelling any step in progress
+    void resetFoot(glm::vec3 footPosWorld);
+    // moves the leg with the spider's new model, and plants the foot if its step is done
     void updateSpiderModel(glm::mat4 spiderModel);
+    // the foot target for a spider model, on the ground straight below
+    glm::vec3 groundTarget(glm::mat4 spiderModel);
+    // where a step starting now towards the target would put the foot down
+    glm::vec3 landingFor(glm::vec3 targetPosWorld, glm::vec3 targetNormal) const;
+    // moves a target found on a surface (e.g. by a raycast) out of the side of any
+    // obstacle it's in. false if there's no standing there, under an obstacle
+    bool footTarget(glm::vec3& targetPosWorld, glm::vec3 targetNormal) const;
+    // lifts the foot towards a target from footTarget. GaitScheduler decides when
+    void startStep(glm::vec3 targetPosWorld, glm::vec3 targetNormal = glm::vec3(0,1,0));
     // ticks time forward (only needed while in movestate)
     void tick(float deltaTime);
+    // puts a stepping foot where its swing curve has it: progress of the way between
+    // footholds, lifted by the higher of lift and clear times swingClearance
+    void placeSwingFoot(float progress, float lift, float clear);
+    // places every stepping foot among count legs, evaluating their swing curves
+    // together. updateSpiderModel leaves stepping feet where they were, so call this
+    // before solving
+    static void swingFeet(Leg* const* legs, int count);
+    // solves joint angles for the hip position in leg space with the selected backend
+    std::tuple<float, float, float> solveIK(glm::vec3 hipPosLeg);
+    // smallest rotation taking y to up (normalized)
+    static glm::mat3 tiltTo(glm::vec3 up);
 };
 
 #endif // LEG_H
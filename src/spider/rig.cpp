@@ -0,0 +1,370 @@
+#include "rig.h"
+#include "utils/little_endian.h"
+#include <glm/gtc/constants.hpp>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+static const char RIG_MAGIC[8] = {'I','T','S','Y','R','I','G','\0'};
+static const uint32_t RIG_VERSION = 2; // 1 had no joint limits
+static const char* GAIT_NAMES[] = {"tripod", "ripple", "wave"};
+// fields of the binary form, 4 bytes each
+static const std::size_t RIG_HEADER_SIZE = 8 + 4 + 4 + 32 + 12 * 4;
+static const std::size_t RIG_LEG_SIZE = 11 * 4;
+static const std::size_t RIG_LEG_SIZE_V1 = 7 * 4;
+static const glm::vec2 NO_SWING_LIMITS(-glm::pi<float>(), glm::pi<float>());
+static const glm::vec2 NO_KNEE_LIMITS(0.0f, glm::pi<float>());
+
+bool RigLeg::withinLimits(glm::vec3 footFromHip, float segLength1, float segLength2) const {
+    // swing, from the middle of its range so that ranges can wrap past pi
+    float twoPi = glm::two_pi<float>();
+    if (swingLimits.y - swingLimits.x < twoPi) {
+        float swing = glm::atan(footFromHip.z, footFromHip.x) - 0.5f * (swingLimits.x + swingLimits.y);
+        swing -= twoPi * glm::floor(swing / twoPi + 0.5f);
+        if (glm::abs(swing) > 0.5f * (swingLimits.y - swingLimits.x)) {
+            return false;
+        }
+    }
+    // the knee from the law of cosines, straight if the foot is out of reach. the
+    // cosine falls as the angle grows, so the limits swap
+    if (kneeLimits.x > 0.0f || kneeLimits.y < glm::pi<float>()) {
+        float cosKnee = (segLength1 * segLength1 + segLength2 * segLength2 - glm::dot(footFromHip, footFromHip))
+                / (2.0f * segLength1 * segLength2);
+        cosKnee = glm::clamp(cosKnee, -1.0f, 1.0f);
+        if (cosKnee > glm::cos(kneeLimits.x) || cosKnee < glm::cos(kneeLimits.y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Rig Rig::hexapod() {
+    Rig rig;
+    std::memset(&rig, 0, sizeof(Rig));
+    std::strncpy(rig.name, "hexapod", sizeof(rig.name) - 1);
+    rig.numLegs = 6;
+    rig.bodyHeight = 0.2f;
+    rig.bodySize = glm::vec3(0.65f, 0.25f, 0.4f);
+    rig.legDiameter = 0.05f;
+    rig.segLength1 = 0.4f;
+    rig.segLength2 = 0.4f;
+    rig.gaitPattern = GAIT_FROM_SETTINGS;
+    rig.moveTime = 0.2f;
+    rig.stepDistance = 0.5f;
+    rig.overshoot = 0.3f;
+    rig.maxClimb = 0.4f;
+    rig.legs[0] = {glm::vec3(-0.2f, 0, -0.1f), glm::vec2(-0.4f, -0.25f), glm::vec2(0.0f, -0.25f),
+                   NO_SWING_LIMITS, NO_KNEE_LIMITS}; // back left
+    rig.legs[1] = {glm::vec3(-0.2f, 0, 0.1f), glm::vec2(-0.4f, 0.25f), glm::vec2(-0.3f, 0.25f),
+                   NO_SWING_LIMITS, NO_KNEE_LIMITS}; // back right
+    rig.legs[2] = {glm::vec3(0, 0, -0.15f), glm::vec2(0, -0.4f), glm::vec2(0.3f, -0.4f),
+                   NO_SWING_LIMITS, NO_KNEE_LIMITS}; // middle left
+    rig.legs[3] = {glm::vec3(0, 0, 0.15f), glm::vec2(0, 0.4f), glm::vec2(0.0f, 0.4f),
+                   NO_SWING_LIMITS, NO_KNEE_LIMITS}; // middle right
+    rig.legs[4] = {glm::vec3(0.2f, 0, -0.1f), glm::vec2(0.4f, -0.25f), glm::vec2(0.6f, -0.25f),
+                   NO_SWING_LIMITS, NO_KNEE_LIMITS}; // front left
+    rig.legs[5] = {glm::vec3(0.2f, 0, 0.1f), glm::vec2(0.4f, 0.25f), glm::vec2(0.3f, 0.25f),
+                   NO_SWING_LIMITS, NO_KNEE_LIMITS}; // front right
+    return rig;
+}
+
+bool Rig::validate(std::string& error) const {
+    if (numLegs < 2 || numLegs > MAX_LEGS) {
+        error = "needs 2 to " + std::to_string(MAX_LEGS) + " legs";
+        return false;
+    }
+    if (!(bodyHeight > 0.0f) || !glm::all(glm::greaterThan(bodySize, glm::vec3(0.0f)))
+            || !(legDiameter > 0.0f) || !(segLength1 > 0.0f) || !(segLength2 > 0.0f)) {
+        error = "body height and size, leg diameter and segment lengths must be positive";
+        return false;
+    }
+    if (gaitPattern < GAIT_FROM_SETTINGS || gaitPattern > 2) {
+        error = "unknown gait";
+        return false;
+    }
+    if (!(moveTime > 0.0f) || !(stepDistance > 0.0f) || !(overshoot >= 0.0f) || !(maxClimb >= 0.0f)) {
+        error = "move time and step distance must be positive, overshoot and max climb not negative";
+        return false;
+    }
+    for (int i = 0; i < numLegs; i++) {
+        const RigLeg& leg = legs[i];
+        std::string which = "leg " + std::to_string(i + 1) + ": ";
+        // with some slack for limits given in degrees
+        if (!(leg.swingLimits.x <= leg.swingLimits.y) || !(leg.swingLimits.y - leg.swingLimits.x <= glm::two_pi<float>() + 1e-5f)
+                || !(leg.kneeLimits.x >= 0.0f) || !(leg.kneeLimits.x <= leg.kneeLimits.y)
+                || !(leg.kneeLimits.y <= glm::pi<float>() + 1e-5f)) {
+            error = which + "swing limits must be in order and at most a full turn apart, knee limits in order within 0 to 180";
+            return false;
+        }
+        // standing on level ground, where the rig puts them
+        glm::vec3 foot = glm::vec3(leg.foot.x, -bodyHeight, leg.foot.y) - leg.hip;
+        glm::vec3 target = glm::vec3(leg.target.x, -bodyHeight, leg.target.y) - leg.hip;
+        if (!leg.withinLimits(foot, segLength1, segLength2) || !leg.withinLimits(target, segLength1, segLength2)) {
+            error = which + "planted foot or target outside its joint limits";
+            return false;
+        }
+    }
+    return true;
+}
+
+float Rig::boundingRadius() const {
+    // the body, eyes included
+    float radius = 0.6f * glm::length(bodySize);
+    for (int i = 0; i < numLegs; i++) {
+        // a leg whose foot it reaches lies within its length of the hip
+        radius = glm::max(radius, glm::length(legs[i].hip) + segLength1 + segLength2);
+    }
+    return radius + legDiameter;
+}
+
+bool Rig::parse(const std::string& text, Rig& rig, std::string& error) {
+    std::memset(&rig, 0, sizeof(Rig));
+    // anything left out is the hexapod's
+    Rig defaults = hexapod();
+    std::memcpy(rig.name, defaults.name, sizeof(rig.name));
+    rig.bodyHeight = defaults.bodyHeight;
+    rig.bodySize = defaults.bodySize;
+    rig.legDiameter = defaults.legDiameter;
+    rig.segLength1 = defaults.segLength1;
+    rig.segLength2 = defaults.segLength2;
+    rig.gaitPattern = defaults.gaitPattern;
+    rig.moveTime = defaults.moveTime;
+    rig.stepDistance = defaults.stepDistance;
+    rig.overshoot = defaults.overshoot;
+    rig.maxClimb = -1.0f; // the upper segment's length unless given
+
+    std::istringstream lines(text);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        std::size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream in(line);
+        std::string key;
+        if (!(in >> key)) {
+            continue;
+        }
+
+        bool ok = true;
+        if (key == "name") {
+            std::string name;
+            ok = (bool)(in >> name);
+            std::strncpy(rig.name, name.c_str(), sizeof(rig.name) - 1);
+        } else if (key == "body_height") {
+            ok = (bool)(in >> rig.bodyHeight);
+        } else if (key == "body_size") {
+            ok = (bool)(in >> rig.bodySize.x >> rig.bodySize.y >> rig.bodySize.z);
+        } else if (key == "leg_diameter") {
+            ok = (bool)(in >> rig.legDiameter);
+        } else if (key == "segments") {
+            ok = (bool)(in >> rig.segLength1 >> rig.segLength2);
+        } else if (key == "gait") {
+            std::string gait;
+            ok = (bool)(in >> gait);
+            rig.gaitPattern = -2;
+            if (gait == "settings") {
+                rig.gaitPattern = GAIT_FROM_SETTINGS;
+            }
+            for (int i = 0; i < 3; i++) {
+                if (gait == GAIT_NAMES[i]) {
+                    rig.gaitPattern = i;
+                }
+            }
+            ok = ok && rig.gaitPattern != -2;
+        } else if (key == "move_time") {
+            ok = (bool)(in >> rig.moveTime);
+        } else if (key == "step_distance") {
+            ok = (bool)(in >> rig.stepDistance);
+        } else if (key == "overshoot") {
+            ok = (bool)(in >> rig.overshoot);
+        } else if (key == "max_climb") {
+            ok = (bool)(in >> rig.maxClimb);
+        } else if (key == "leg") {
+            if (rig.numLegs == MAX_LEGS) {
+                error = "line " + std::to_string(lineNumber) + ": more than " + std::to_string(MAX_LEGS) + " legs";
+                return false;
+            }
+            RigLeg& leg = rig.legs[rig.numLegs++];
+            ok = (bool)(in >> leg.hip.x >> leg.hip.y >> leg.hip.z >> leg.foot.x >> leg.foot.y
+                          >> leg.target.x >> leg.target.y);
+            leg.swingLimits = NO_SWING_LIMITS;
+            leg.kneeLimits = NO_KNEE_LIMITS;
+            if (ok && !(in >> std::ws).eof()) {
+                ok = (bool)(in >> leg.swingLimits.x >> leg.swingLimits.y >> leg.kneeLimits.x >> leg.kneeLimits.y);
+                leg.swingLimits = glm::radians(leg.swingLimits);
+                leg.kneeLimits = glm::radians(leg.kneeLimits);
+            }
+        } else {
+            error = "line " + std::to_string(lineNumber) + ": unknown setting " + key;
+            return false;
+        }
+        std::string extra;
+        if (!ok || in >> extra) {
+            error = "line " + std::to_string(lineNumber) + ": bad value for " + key;
+            return false;
+        }
+    }
+    if (rig.maxClimb < 0.0f) {
+        rig.maxClimb = rig.segLength1;
+    }
+    return rig.validate(error);
+}
+
+std::string Rig::toText() const {
+    std::ostringstream out;
+    out << "name " << name << "\n";
+    out << "body_height " << bodyHeight << "\n";
+    out << "body_size " << bodySize.x << " " << bodySize.y << " " << bodySize.z << "\n";
+    out << "leg_diameter " << legDiameter << "\n";
+    out << "segments " << segLength1 << " " << segLength2 << "\n";
+    out << "gait " << (gaitPattern >= 0 && gaitPattern <= 2 ? GAIT_NAMES[gaitPattern] : "settings") << "\n";
+    out << "move_time " << moveTime << "\n";
+    out << "step_distance " << stepDistance << "\n";
+    out << "overshoot " << overshoot << "\n";
+    out << "max_climb " << maxClimb << "\n";
+    out << "# hip x y z, planted foot x z, target x z, and any swing and knee limits in degrees\n";
+    for (int i = 0; i < numLegs; i++) {
+        const RigLeg& leg = legs[i];
+        out << "leg " << leg.hip.x << " " << leg.hip.y << " " << leg.hip.z << "  "
+            << leg.foot.x << " " << leg.foot.y << "  " << leg.target.x << " " << leg.target.y;
+        if (leg.swingLimits != NO_SWING_LIMITS || leg.kneeLimits != NO_KNEE_LIMITS) {
+            glm::vec2 swing = glm::degrees(leg.swingLimits);
+            glm::vec2 knee = glm::degrees(leg.kneeLimits);
+            out << "  " << swing.x << " " << swing.y << "  " << knee.x << " " << knee.y;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+bool Rig::writeText(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file << toText();
+    return (bool)file;
+}
+
+bool Rig::writeBinary(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    // field by field, so the file reads the same on any host
+    std::string out(RIG_MAGIC, 8);
+    LittleEndian::putU32(out, RIG_VERSION);
+    LittleEndian::putU32(out, numLegs);
+    out.append(name, sizeof(name));
+    LittleEndian::putF32(out, bodyHeight);
+    for (int i = 0; i < 3; i++) {
+        LittleEndian::putF32(out, bodySize[i]);
+    }
+    LittleEndian::putF32(out, legDiameter);
+    LittleEndian::putF32(out, segLength1);
+    LittleEndian::putF32(out, segLength2);
+    LittleEndian::putU32(out, (uint32_t)gaitPattern);
+    LittleEndian::putF32(out, moveTime);
+    LittleEndian::putF32(out, stepDistance);
+    LittleEndian::putF32(out, overshoot);
+    LittleEndian::putF32(out, maxClimb);
+    for (int i = 0; i < numLegs; i++) {
+        const RigLeg& leg = legs[i];
+        for (float value : {leg.hip.x, leg.hip.y, leg.hip.z, leg.foot.x, leg.foot.y, leg.target.x, leg.target.y,
+                            leg.swingLimits.x, leg.swingLimits.y, leg.kneeLimits.x, leg.kneeLimits.y}) {
+            LittleEndian::putF32(out, value);
+        }
+    }
+    file.write(out.data(), out.size());
+    return (bool)file;
+}
+
+bool Rig::load(const std::string& path, Rig& rig) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open rig: " << path << std::endl;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::string error;
+    if (data.size() >= 8 && std::memcmp(data.data(), RIG_MAGIC, 8) == 0) {
+        std::memset(&rig, 0, sizeof(Rig));
+        const char* in = data.data() + 8;
+        uint32_t version = 0;
+        uint32_t numLegs = 0;
+        if (data.size() >= RIG_HEADER_SIZE) {
+            version = LittleEndian::getU32(in);
+            numLegs = LittleEndian::getU32(in);
+        }
+        // version 1 legs have no limits
+        std::size_t legSize = version == 1 ? RIG_LEG_SIZE_V1 : RIG_LEG_SIZE;
+        if (data.size() < RIG_HEADER_SIZE) {
+            error = "truncated header";
+        } else if (version != RIG_VERSION && version != 1) {
+            error = "unsupported version " + std::to_string(version);
+        } else if (numLegs > (uint32_t)MAX_LEGS || data.size() < RIG_HEADER_SIZE + numLegs * legSize) {
+            error = "truncated legs";
+        } else {
+            rig.numLegs = numLegs;
+            std::memcpy(rig.name, in, sizeof(rig.name));
+            rig.name[sizeof(rig.name) - 1] = '\0';
+            in += sizeof(rig.name);
+            rig.bodyHeight = LittleEndian::getF32(in);
+            for (int i = 0; i < 3; i++) {
+                rig.bodySize[i] = LittleEndian::getF32(in);
+            }
+            rig.legDiameter = LittleEndian::getF32(in);
+            rig.segLength1 = LittleEndian::getF32(in);
+            rig.segLength2 = LittleEndian::getF32(in);
+            rig.gaitPattern = (int32_t)LittleEndian::getU32(in);
+            rig.moveTime = LittleEndian::getF32(in);
+            rig.stepDistance = LittleEndian::getF32(in);
+            rig.overshoot = LittleEndian::getF32(in);
+            rig.maxClimb = LittleEndian::getF32(in);
+            for (int i = 0; i < rig.numLegs; i++) {
+                RigLeg& leg = rig.legs[i];
+                for (float* value : {&leg.hip.x, &leg.hip.y, &leg.hip.z, &leg.foot.x, &leg.foot.y,
+                                     &leg.target.x, &leg.target.y}) {
+                    *value = LittleEndian::getF32(in);
+                }
+                leg.swingLimits = NO_SWING_LIMITS;
+                leg.kneeLimits = NO_KNEE_LIMITS;
+                if (version != 1) {
+                    for (float* value : {&leg.swingLimits.x, &leg.swingLimits.y, &leg.kneeLimits.x, &leg.kneeLimits.y}) {
+                        *value = LittleEndian::getF32(in);
+                    }
+                }
+            }
+            rig.validate(error);
+        }
+    } else {
+        parse(data, rig, error);
+    }
+    if (!error.empty()) {
+        std::cerr << "Not a valid rig: " << path << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const Rig> Rig::shared(const std::string& path) {
+    static std::vector<std::pair<std::string, std::shared_ptr<const Rig>>> cache;
+    for (const auto& [cachedPath, rig] : cache) {
+        if (cachedPath == path) {
+            return rig;
+        }
+    }
+    auto rig = std::make_shared<Rig>(hexapod());
+    if (!path.empty() && !load(path, *rig)) {
+        *rig = hexapod();
+    }
+    cache.emplace_back(path, rig);
+    return rig;
+}
@@ -0,0 +1,105 @@
+#ifndef RIG_H
+#define RIG_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// one leg of a rig, in spider space. feet and targets sit bodyHeight below the body
+struct RigLeg {
+    glm::vec3 hip;
+    glm::vec2 foot; // where the foot is planted when the spider is built (x, z)
+    glm::vec2 target; // where the foot steps to when the spider stands still (x, z)
+    // joint limits, in radians. swing is the direction from the hip to the foot seen
+    // from above, from forward (+x) towards the right (+z), and may wrap past pi.
+    // knee is the angle between the segments, pi when the leg is straight
+    glm::vec2 swingLimits; // least and most
+    glm::vec2 kneeLimits;
+
+    // true if the joints are within their limits with the foot at footFromHip
+    // (spider space, relative to the hip)
+    bool withinLimits(glm::vec3 footFromHip, float segLength1, float segLength2) const;
+};
+
+/**
+ * Everything Spider needs to build a body: how many legs, where they attach,
+ * how long their segments are, how far their joints turn and how they walk.
+ * Flat and fixed size (legs up to MAX_LEGS in place), so a rig is loaded once
+ * and shared by every spider built from it, and copying one is a memcpy.
+ *
+ * Rigs are read from either of two forms (load tells them apart by the magic):
+ *
+ * text, one setting per line, # to the end of a line is a comment:
+ *   name hexapod
+ *   body_height 0.2          height of the body above the feet
+ *   body_size 0.65 0.25 0.4  painted body's extent (x forward, y up, z right)
+ *   leg_diameter 0.05
+ *   segments 0.4 0.4         upper (at the hip) and lower segment lengths
+ *   gait tripod              tripod, ripple, wave, or settings for settings.gaitPattern
+ *   move_time 0.2            seconds a step takes
+ *   step_distance 0.5        how far a foot gets from its target before it has to step
+ *   overshoot 0.3            how far past the target steps land, as a fraction of the step
+ *   max_climb 0.4            highest above the hip a foot reaches onto obstacles
+ *   leg  hx hy hz  fx fz  tx tz     hip, planted foot and target. one line per
+ *                                   leg, back to front, alternating left and right
+ *        [s0 s1  k0 k1]             then optionally its swing and knee limits in
+ *                                   degrees (unlimited if left out)
+ *
+ * binary, written by writeBinary. every field is 4 bytes, little-endian whatever
+ * the host is (floats as their IEEE bits):
+ *   magic "ITSYRIG\0", version, numLegs, name (32 chars, nul padded),
+ *   bodyHeight, bodySize x y z, legDiameter, segLength1, segLength2, gaitPattern,
+ *   moveTime, stepDistance, overshoot, maxClimb,
+ *   then per leg: hip x y z, foot x z, target x z, swingLimits, kneeLimits
+ *
+ * A leg whose foot ends up outside its limits (the body turned or sank too far
+ * over it) steps as soon as the gait lets it, rather than waiting for its foot to
+ * drift its step distance.
+ *
+ * The legs are numbered in the order they're listed, which GaitScheduler relies
+ * on to tell neighbours and rows apart.
+ */
+struct Rig {
+    static constexpr int MAX_LEGS = 12;
+    static constexpr int GAIT_FROM_SETTINGS = -1;
+
+    char name[32];
+    int numLegs;
+    float bodyHeight;
+    glm::vec3 bodySize;
+    float legDiameter;
+    float segLength1; // at the hip
+    float segLength2; // at the foot
+    int gaitPattern; // a GaitPattern, or GAIT_FROM_SETTINGS
+    float moveTime;
+    float stepDistance;
+    float overshoot;
+    float maxClimb;
+    RigLeg legs[MAX_LEGS];
+
+    // the original six-legged spider
+    static Rig hexapod();
+
+    // reads a rig file in either form. false (with the reason on stderr) if it
+    // can't be read or isn't a valid rig
+    static bool load(const std::string& path, Rig& rig);
+    // reads the text form
+    static bool parse(const std::string& text, Rig& rig, std::string& error);
+    std::string toText() const;
+    bool writeText(const std::string& path) const;
+    bool writeBinary(const std::string& path) const;
+
+    // returns the rig at path, loaded once and shared by every caller asking for
+    // it. an empty path, or one that fails to load, gives the hexapod
+    static std::shared_ptr<const Rig> shared(const std::string& path);
+
+    // false (with the reason in error) if the rig can't be built
+    bool validate(std::string& error) const;
+
+    // radius of a sphere around the body's centre holding the body and every leg
+    // whose hip is within reach of its foot
+    float boundingRadius() const;
+};
+
+#endif // RIG_H
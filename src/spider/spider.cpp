@@ -1,62 +1,84 @@
 #include "spider.h"
+#include <algorithm>
 #include "glm/gtx/transform.hpp"
 #include "realtime.h"
+#include "settings.h"
+#include "utils/worker_pool.h"
 #include "ik_solver.cpp"
 
 Spider::Spider(GLuint phong_shader,
-               GLuint cylinderVAO, int cylinderBufferSize,
-               GLuint sphereVAO, int sphereBufferSize,
-               float segLength1, float segLength2,
-               float legDiameter, float spiderHeight)
+               const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere,
+               std::shared_ptr<const Rig> rig,
+               glm::vec3 startPos)
+{
+    // room for the legs of any rig, so respawning as another never reallocates
+    legs.reserve(Rig::MAX_LEGS);
+    footProbeOrigins.reserve(Rig::MAX_LEGS);
+    footProbeHits.reserve(Rig::MAX_LEGS);
+    // three shapes a leg, the body and four for the eyes
+    restDraws.reserve(3 * Rig::MAX_LEGS + 5);
+    bodyMesh = nullptr;
+    respawn(phong_shader, cylinder, sphere, rig, startPos);
+}
+
+void Spider::respawn(GLuint phong_shader,
+                     const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere,
+                     std::shared_ptr<const Rig> rig,
+                     glm::vec3 startPos)
 {
     this->m_phong_shader = phong_shader;
-    this->m_cylinderVAO = cylinderVAO;
-    this->m_cylinderBufferSize = cylinderBufferSize;
-    this->m_sphereVAO = sphereVAO;
-    this->m_sphereBufferSize = sphereBufferSize;
+    this->m_cylinder = cylinder;
+    this->m_sphere = sphere;
 
-    this->segLength1 = segLength1;
-    this->segLength2 = segLength2;
-    this->legDiameter = legDiameter;
-    this->spiderHeight = spiderHeight;
+    this->rig = std::move(rig);
+    this->segLength1 = this->rig->segLength1;
+    this->segLength2 = this->rig->segLength2;
+    this->legDiameter = this->rig->legDiameter;
+    this->spiderHeight = this->rig->bodyHeight;
+    this->boundingRadius = this->rig->boundingRadius();
 
-    this->pos = glm::vec3(0, spiderHeight, 0);
+    this->pos = startPos + glm::vec3(0, spiderHeight, 0);
     this->look = glm::vec3(1,0,0);
     this->up = glm::vec3(0,1,0);
+    this->navGoal = -1;
     this->spiderTranslation = glm::translate(pos);
     this->spiderRotation = glm::mat4(1);
+    this->spiderModel = this->spiderTranslation;
+
+    // the table and canned gait are for the old rig's legs. looked up again when needed
+    this->ikTable = nullptr;
+    this->cannedGait = nullptr;
+
+    // simulate every frame until a scheduler says otherwise
+    this->lod = AnimationLOD::LOD_NEAR;
+    this->solveThisFrame = true;
+    this->framesSinceSolve = 0;
+    this->solveInterval = 1;
+    this->gaitPhase = 0.0f;
+    this->impostorFade = 0.0f;
+
+    // awake until the legs settle
+    this->moved = false;
+    this->framesStill = 0;
+    this->terrainRevision = Realtime::getTerrainRevision();
+    this->resting = false;
+    this->restDraws.clear();
+    this->onScreen = true;
 
-    this->legs = std::vector<Leg>{};
-    // back left
-    legs.push_back(Leg(glm::vec3(-0.4f,-spiderHeight,-0.25f), glm::vec3(-0.2f,0,-0.1f), glm::vec3(0.0f,-spiderHeight,-0.25f),
-                       this->spiderTranslation,
-                       0.2f, segLength1, segLength2, legDiameter,
-                       phong_shader, cylinderVAO, cylinderBufferSize, sphereVAO, sphereBufferSize));
-    // back right
-    legs.push_back(Leg(glm::vec3(-0.4f,-spiderHeight,0.25f), glm::vec3(-0.2f,0,0.1f), glm::vec3(-0.3f,-spiderHeight,0.25f),
-                       this->spiderTranslation,
-                       0.2f, segLength1, segLength2, legDiameter,
-                       phong_shader, cylinderVAO, cylinderBufferSize, sphereVAO, sphereBufferSize));
-    // middle left
-    legs.push_back(Leg(glm::vec3(0,-spiderHeight,-0.4f), glm::vec3(0,0,-0.15f), glm::vec3(0.3f,-spiderHeight,-0.4f),
-                       this->spiderTranslation,
-                       0.2f, segLength1, segLength2, legDiameter,
-                       phong_shader, cylinderVAO, cylinderBufferSize, sphereVAO, sphereBufferSize));
-    // middle right
-    legs.push_back(Leg(glm::vec3(0,-spiderHeight,0.4f), glm::vec3(0,0,0.15f), glm::vec3(0.0f,-spiderHeight,0.4f),
-                       this->spiderTranslation,
-                       0.2f, segLength1, segLength2, legDiameter,
-                       phong_shader, cylinderVAO, cylinderBufferSize, sphereVAO, sphereBufferSize));
-    // front left
-    legs.push_back(Leg(glm::vec3(0.4f,-spiderHeight,-0.25f), glm::vec3(0.2f,0,-0.1f), glm::vec3(0.6f,-spiderHeight,-0.25f),
-                       this->spiderTranslation,
-                       0.2f, segLength1, segLength2, legDiameter,
-                       phong_shader, cylinderVAO, cylinderBufferSize, sphereVAO, sphereBufferSize));
-    // back right
-    legs.push_back(Leg(glm::vec3(0.4f,-spiderHeight,0.25f), glm::vec3(0.2f,0,0.1f), glm::vec3(0.3f,-spiderHeight,0.25f),
-                       this->spiderTranslation,
-                       0.2f, segLength1, segLength2, legDiameter,
-                       phong_shader, cylinderVAO, cylinderBufferSize, sphereVAO, sphereBufferSize));
+    // built in place, in the room kept from before
+    legs.clear();
+    for (int i = 0; i < this->rig->numLegs; i++) {
+        legs.emplace_back(*this->rig, i, this->spiderTranslation,
+                          phong_shader, cylinder, sphere);
+    }
+    footProbeOrigins.clear();
+    footProbeHits.clear();
+
+    this->gait.reset(gaitPattern(), legs);
+}
+
+GaitPattern Spider::gaitPattern() const {
+    return (GaitPattern)(rig->gaitPattern == Rig::GAIT_FROM_SETTINGS ? settings.gaitPattern : rig->gaitPattern);
 }
 
 /**
@@ -71,8 +93,11 @@ void Spider::move(float deltaTime, bool forward) {
     if (!forward) deltaVec = -deltaVec;
     // modify spider position
     pos += deltaVec;
+    moved = true;
     // modify spider model (translates body parts)
     spiderTranslation *= glm::translate(deltaVec);
+    // advance the canned gait by the distance travelled
+    gaitPhase = glm::fract(gaitPhase + (forward ? 1.0f : -1.0f) * deltaTime / CannedGait::STRIDE);
 }
 
 /**
@@ -89,31 +114,632 @@ void Spider::rotateLook(float deltaTime, bool right) {
     look = glm::rotate(theta, up) * glm::vec4(look, 0);
     // modify spider model for rotation
     spiderRotation *= glm::rotate(theta, up);
+    moved = true;
 }
 
 /**
- * @brief paints the entire spider!
+ * @brief turns the spider towards a direction over the ground and walks it forward,
+ *        at the rates rotateLook and move use for the arrow keys.
+ * @param dir - unit xz direction to head in. zero stands still
+ * @param deltaTime
  */
-void Spider::paintSpider() {
-    glm::mat4 spiderModel = spiderTranslation * spiderRotation;
+void Spider::steer(glm::vec2 dir, float deltaTime) {
+    if (dir == glm::vec2(0)) {
+        return;
+    }
+    glm::vec3 heading(dir.x, 0, dir.y);
+    glm::vec2 flatLook(look.x, look.z);
+    float angle = 0.0f;
+    // looking straight up or down a wall, any way over the ground is as good
+    if (glm::length(flatLook) > 1e-3f) {
+        angle = glm::acos(glm::clamp(glm::dot(glm::normalize(flatLook), dir), -1.0f, 1.0f));
+    }
+    // rotateLook turns 2 radians per unit of time, so don't turn past the heading
+    if (angle > 1e-3f) {
+        rotateLook(glm::min(angle / 2.0f, deltaTime), glm::dot(glm::cross(look, heading), up) > 0.0f);
+    }
+    // slow down for sharp turns, so the spider doesn't swing wide around corners
+    move(deltaTime * settings.navSpeed * glm::max(0.0f, glm::cos(angle)), true);
+}
 
-    float bodyHeight = 0.0f;
-    for (Leg& leg : legs) {
-        bodyHeight += leg.currFootPosWorld.y;
+/**
+ * @brief moves the spider's legs forward one frame: works out the spider model,
+ *        steps the legs and solves IK (or queues it for the IK scheduler), at the
+ *        rate the animation LOD allows. call before paintSpider.
+ */
+void Spider::animate() {
+    if (!beginAnimate()) {
+        return;
+    }
+    if (settings.footRaycast) {
+        probeFootTargets();
+    }
+    stepLegs();
+}
+
+// spiders with more than this many per thread are separated on several threads
+static const int SEPARATION_SPIDERS_PER_THREAD = 4096;
+
+// scratch for stepLegs and separateAll
+static std::vector<int> s_nearbySpiders;
+static std::vector<glm::vec3> s_separation;
+// neighbours found by each of separateAll's threads, kept between frames
+static std::vector<std::vector<int>> s_rangeNearby;
+static std::vector<std::vector<glm::vec3>> s_rangeNearbyPos;
+
+// every spider stepping this frame and their foot probes, for animateAll
+static std::vector<Spider*> s_probingSpiders;
+static std::vector<glm::vec3> s_probeOrigins;
+static std::vector<RayHit> s_probeHits;
+// legs whose stepping feet are placed together, for stepLegs and finishAll
+static std::vector<Leg*> s_swingLegs;
+// bounding spheres of every spider, a component per array, for cullAll
+static std::vector<float> s_boundX;
+static std::vector<float> s_boundY;
+static std::vector<float> s_boundZ;
+static std::vector<float> s_boundRadius;
+static std::vector<uint8_t> s_onScreen;
+
+/**
+ * @brief animates every spider, raycasting the foot probes of all the spiders that
+ *        step this frame together, in one batch per run of spiders sharing a down
+ *        vector and reach, instead of one small batch per spider. the feet of all
+ *        of them that are mid-step are placed on their swing curves in one batch too.
+ */
+void Spider::animateAll(std::span<Spider> spiders, const SpatialHash* neighbours) {
+    s_probingSpiders.clear();
+    for (Spider& spider : spiders) {
+        if (spider.beginAnimate()) {
+            s_probingSpiders.push_back(&spider);
+        }
+    }
+    if (!settings.footRaycast) {
+        for (Spider* spider : s_probingSpiders) {
+            spider->planSteps(spiders, neighbours);
+        }
+        finishAll();
+        return;
+    }
+
+    std::size_t first = 0;
+    while (first < s_probingSpiders.size()) {
+        // gather a run of spiders whose rays all go the same way and as far
+        Spider* lead = s_probingSpiders[first];
+        glm::vec3 dir = -glm::normalize(lead->up);
+        float maxDist = lead->aimFootProbes();
+        s_probeOrigins.assign(lead->footProbeOrigins.begin(), lead->footProbeOrigins.end());
+        std::size_t last = first + 1;
+        while (last < s_probingSpiders.size()) {
+            Spider* next = s_probingSpiders[last];
+            if (-glm::normalize(next->up) != dir) {
+                break;
+            }
+            float nextDist = next->aimFootProbes();
+            if (nextDist != maxDist) {
+                break;
+            }
+            s_probeOrigins.insert(s_probeOrigins.end(), next->footProbeOrigins.begin(), next->footProbeOrigins.end());
+            last++;
+        }
+
+        s_probeHits.resize(s_probeOrigins.size());
+        Realtime::raycastFloor(s_probeOrigins.data(), s_probeOrigins.size(), dir, maxDist, s_probeHits.data());
+
+        // hand the hits back out
+        std::size_t offset = 0;
+        for (std::size_t k = first; k < last; k++) {
+            Spider* spider = s_probingSpiders[k];
+            std::copy(s_probeHits.begin() + offset, s_probeHits.begin() + offset + spider->footProbeHits.size(),
+                      spider->footProbeHits.begin());
+            offset += spider->footProbeHits.size();
+            spider->landFootProbes();
+            spider->planSteps(spiders, neighbours);
+        }
+        first = last;
+    }
+    finishAll();
+}
+
+void Spider::finishAll() {
+    // every stepping foot of the spiders animated this frame, placed in one batch
+    s_swingLegs.clear();
+    for (Spider* spider : s_probingSpiders) {
+        for (Leg& leg : spider->legs) {
+            s_swingLegs.push_back(&leg);
+        }
+    }
+    Leg::swingFeet(s_swingLegs.data(), s_swingLegs.size());
+    for (Spider* spider : s_probingSpiders) {
+        spider->finishSteps();
+    }
+}
+
+bool Spider::beginAnimate() {
+    // only an impostor: placed for it, and nothing else until it's back in range.
+    // moved and terrainRevision are kept, so it wakes up then if it needs to
+    if (impostorFade >= 1.0f) {
+        if (!resting) {
+            spiderModel = cannedGaitModel();
+        }
+        return false;
+    }
+
+    // moving or a change to the floor within reach of the legs wakes the spider up
+    unsigned int currTerrainRevision = Realtime::getTerrainRevision();
+    float reach = segLength1 + segLength2 + spiderHeight;
+    glm::vec4 reachRect(pos.x - reach, pos.z - reach, pos.x + reach, pos.z + reach);
+    bool terrainChanged = Realtime::terrainChangedIn(reachRect, terrainRevision);
+    if (terrainChanged) {
+        // targets may have moved however still the spider stood
+        gait.checkAll();
+    }
+    if (moved || terrainChanged) {
+        wake();
+    } else {
+        framesStill++;
+    }
+    moved = false;
+    terrainRevision = currTerrainRevision;
+
+    // nothing to do at rest, paintSpider replays the recorded draws
+    if (resting) {
+        return false;
+    }
+
+    // far away: the canned gait is played back when painting
+    if (lod == AnimationLOD::LOD_FAR && cannedGait) {
+        spiderModel = cannedGaitModel();
+        resting = framesStill > 0;
+        return false;
     }
-    bodyHeight /= legs.size();
-    spiderModel = glm::translate(glm::vec3(0,bodyHeight,0)) * spiderModel;
 
+    if (surfaceWalking()) {
+        alignToContacts();
+    } else {
+        spiderModel = spiderTranslation * spiderRotation;
+
+        // calculate body height based on leg heights (average)
+        float bodyHeight = 0.0f;
+        for (Leg& leg : legs) {
+            bodyHeight += leg.currFootPosWorld.y;
+        }
+        bodyHeight /= legs.size();
+        spiderModel = glm::translate(glm::vec3(0,bodyHeight,0)) * spiderModel;
+    }
+
+    // point legs at the IK lookup table, or back to the analytic solver
+    if (settings.ikTable && !ikTable) {
+        ikTable = IKTable::shared(segLength1, segLength2, settings.ikTableResolution,
+                                  (std::size_t)settings.ikTableBudgetKB * 1024);
+    }
+    // and at the swing curve for the current settings
+    const std::shared_ptr<const SwingCurve>& currentSwing = SwingCurve::current();
+    if (swingCurve != currentSwing) {
+        swingCurve = currentSwing;
+    }
     for (Leg& leg : this->legs) {
+        leg.ikTable = settings.ikTable ? ikTable.get() : nullptr;
+        leg.swingCurve = swingCurve.get();
+    }
+
+    // legs are only simulated if the LOD scheduler picked this spider this frame
+    if (!solveThisFrame) {
+        // without time slicing the pose is final now. otherwise it's checked again
+        // next frame, once the IK scheduler has had its turn
+        resting = settled();
+        return false;
+    }
+
+    // which legs might step
+    if (gait.pattern != gaitPattern()) {
+        gait.reset(gaitPattern(), legs);
+    }
+    gait.advance(spiderModel, legs);
+    return true;
+}
+
+void Spider::stepLegs(std::span<const Spider> crowd, const SpatialHash* neighbours) {
+    planSteps(crowd, neighbours);
+    s_swingLegs.clear();
+    for (Leg& leg : legs) {
+        s_swingLegs.push_back(&leg);
+    }
+    Leg::swingFeet(s_swingLegs.data(), s_swingLegs.size());
+    finishSteps();
+}
+
+void Spider::planSteps(std::span<const Spider> crowd, const SpatialHash* neighbours) {
+    for (Leg& leg : legs) {
         leg.updateSpiderModel(spiderModel);
-        leg.paint();
     }
 
-    // calculate body height based on leg heights (average)
+    // legs that went past their joint limits are looked at next frame
+    for (int i = 0; i < (int)legs.size(); i++) {
+        if (legs[i].hitLimits && !legs[i].moveState) {
+            legs[i].hitLimits = false;
+            gait.defer(i);
+        }
+    }
+
+    // only the legs the gait has due are looked at. the rest stay planted
+    const std::vector<int>& due = gait.due();
+    if (due.empty()) {
+        return;
+    }
+
+    // spiders close enough for their feet to meet ours
+    s_nearbySpiders.clear();
+    if (!crowd.empty() && neighbours != nullptr && settings.footClearance > 0.0f) {
+        float reach = 2.0f * (segLength1 + segLength2) + settings.footClearance;
+        if (settings.footClearanceNeighbours > 0) {
+            neighbours->queryNearest(pos, settings.footClearanceNeighbours, reach, s_nearbySpiders, this - crowd.data());
+        } else {
+            neighbours->queryRadius(pos, reach, s_nearbySpiders, this - crowd.data());
+        }
+    }
+
+    for (int k = 0; k < (int)due.size(); k++) {
+        Leg& leg = legs[due[k]];
+        glm::vec3 target = settings.footRaycast ? footProbeHits[k].pos : leg.groundTarget(spiderModel);
+        glm::vec3 normal = settings.footRaycast ? footProbeHits[k].normal : glm::vec3(0,1,0);
+        for (int other : s_nearbySpiders) {
+            target = avoidFeet(crowd[other], leg, target, normal);
+        }
+        if (!leg.footTarget(target, normal)) {
+            gait.defer(due[k]);
+        } else if (gait.decide(due[k], glm::distance(leg.currFootPosWorld, target), legs)) {
+            leg.startStep(target, normal);
+        }
+    }
+}
+
+void Spider::finishSteps() {
+    // with time slicing the IK scheduler decides when each leg actually gets solved
+    for (Leg& leg : legs) {
+        if (settings.ikTimeSlicing) {
+            leg.solvePending = true;
+        } else {
+            leg.solve();
+        }
+    }
+
+    // without time slicing the pose is final now. otherwise it's checked again
+    // next frame, once the IK scheduler has had its turn
+    resting = settled();
+}
+
+/**
+ * @brief moves a leg's foot target along the surface so that where the foot
+ *        would land keeps off the feet of another spider.
+ */
+glm::vec3 Spider::avoidFeet(const Spider& other, const Leg& leg, glm::vec3 target, glm::vec3 normal) {
+    float clearance = settings.footClearance;
+    for (const Leg& otherLeg : other.legs) {
+        // where the other foot is, or is about to be
+        glm::vec3 otherFoot = otherLeg.moveState ? otherLeg.oldTargetPosWorld : otherLeg.currFootPosWorld;
+        glm::vec3 away = leg.landingFor(target, normal) - otherFoot;
+        away -= glm::dot(away, normal) * normal;
+        float dist = glm::length(away);
+        if (dist >= clearance) {
+            continue;
+        }
+        // right on top of it: step aside along our own forward direction
+        glm::vec3 dir = dist > 1e-4f ? away / dist : glm::normalize(look - glm::dot(look, normal) * normal);
+        // the landing moves 1 + overshoot times as far as the target
+        target += (clearance - dist) / (1.0f + leg.overshoot) * dir;
+    }
+    return target;
+}
+
+/**
+ * @brief steers spiders that are closer than settings.separationRadius apart
+ *        away from each other, harder the closer they are, each from at most its
+ *        settings.separationNeighbours nearest. neighbours come from the grid,
+ *        which should be built over the spiders' positions; spiders are split
+ *        over threads when there are many.
+ */
+void Spider::separateAll(std::span<Spider> spiders, const SpatialHash& neighbours, float deltaTime) {
+    float radius = settings.separationRadius;
+    if (radius <= 0.0f || spiders.size() < 2) {
+        return;
+    }
+    s_separation.assign(spiders.size(), glm::vec3(0));
+
+    // each thread fills in the pushes for a range of spiders, taken in grid order
+    const std::vector<int>& order = neighbours.order();
+    auto separateRange = [&](int thread, int first, int last) {
+        std::vector<int>& nearby = s_rangeNearby[thread];
+        std::vector<glm::vec3>& nearbyPos = s_rangeNearbyPos[thread];
+        for (int k = first; k < last; k++) {
+            int i = order[k];
+            const Spider& spider = spiders[i];
+            nearby.clear();
+            nearbyPos.clear();
+            if (settings.separationNeighbours > 0) {
+                neighbours.queryNearest(spider.pos, settings.separationNeighbours, radius, nearby, i);
+                for (int other : nearby) {
+                    nearbyPos.push_back(spiders[other].pos);
+                }
+            } else {
+                neighbours.queryRadius(spider.pos, radius, nearby, nearbyPos, i);
+            }
+            glm::vec3 push(0);
+            for (int n = 0; n < (int)nearby.size(); n++) {
+                glm::vec3 away = spider.pos - nearbyPos[n];
+                float dist = glm::length(away);
+                // on top of each other: the lower index goes +look
+                glm::vec3 dir = dist > 1e-4f ? away / dist : (i < nearby[n] ? spider.look : -spider.look);
+                push += (1.0f - dist / radius) * dir;
+            }
+            s_separation[i] = push * settings.separationSpeed * deltaTime;
+        }
+    };
+    int count = order.size();
+    WorkerPool& pool = WorkerPool::shared();
+    int threads = glm::clamp(count / SEPARATION_SPIDERS_PER_THREAD, 1, pool.threads());
+    if ((int)s_rangeNearby.size() < threads) {
+        s_rangeNearby.resize(threads);
+        s_rangeNearbyPos.resize(threads);
+    }
+    auto separateTask = [&](int t) {
+        separateRange(t, (long)count * t / threads, (long)count * (t + 1) / threads);
+    };
+    pool.run(threads, separateTask);
+
+    for (int i = 0; i < (int)spiders.size(); i++) {
+        if (s_separation[i] != glm::vec3(0)) {
+            spiders[i].shift(s_separation[i]);
+        }
+    }
+}
+
+/**
+ * @brief pushes the spider without turning it, keeping it on the surface it walks on.
+ */
+void Spider::shift(glm::vec3 delta) {
+    glm::vec3 worldUp = glm::normalize(up);
+    delta -= glm::dot(delta, worldUp) * worldUp;
+    pos += delta;
+    moved = true;
+    spiderTranslation *= glm::translate(delta);
+}
+
+/**
+ * @brief casts one ray per leg due a step down along the spider's up vector, from a hip
+ *        length above the hips over each foot target, so feet land on steps and
+ *        slopes the leg can actually reach rather than whatever is straight below.
+ */
+void Spider::probeFootTargets() {
+    float maxDist = aimFootProbes();
+    Realtime::raycastFloor(footProbeOrigins.data(), footProbeOrigins.size(), -glm::normalize(up), maxDist,
+                           footProbeHits.data());
+    landFootProbes();
+}
+
+float Spider::aimFootProbes() {
+    const std::vector<int>& due = gait.due();
+    footProbeOrigins.resize(due.size());
+    footProbeHits.resize(due.size());
+
+    // up is kept in world space
+    glm::vec3 worldUp = glm::normalize(up);
+    for (int k = 0; k < (int)due.size(); k++) {
+        glm::vec3 overTarget(legs[due[k]].targetPosSpider.x, 0, legs[due[k]].targetPosSpider.z);
+        footProbeOrigins[k] = glm::vec3(spiderModel * glm::vec4(overTarget, 1)) + rig->maxClimb * worldUp;
+    }
+    return rig->maxClimb + spiderHeight + segLength2;
+}
+
+void Spider::landFootProbes() {
+    glm::vec3 worldUp = glm::normalize(up);
+    float maxDist = rig->maxClimb + spiderHeight + segLength2;
+    const std::vector<int>& due = gait.due();
+    for (int i = 0; i < (int)due.size(); i++) {
+        const Leg& leg = legs[due[i]];
+        if (surfaceWalking()) {
+            // a wall (or the floor, walking down a wall) in the way: reach from the
+            // hip out to where the probe started. the probe would have started
+            // inside it and gone through
+            glm::vec3 hip = spiderModel * glm::vec4(leg.hipPosSpider, 1);
+            glm::vec3 reach = footProbeOrigins[i] - hip;
+            RayHit wallHit = Realtime::raycastFloor(hip, glm::normalize(reach), glm::length(reach));
+            if (wallHit.hit) {
+                footProbeHits[i] = wallHit;
+                continue;
+            }
+        }
+        if (footProbeHits[i].hit) {
+            continue;
+        }
+        if (surfaceWalking()) {
+            // a drop past an edge: reach back in under the body from where the probe ended
+            glm::vec3 end = footProbeOrigins[i] - maxDist * worldUp;
+            glm::vec3 under = glm::vec3(spiderModel * glm::vec4(0, 0, 0, 1)) - spiderHeight * worldUp;
+            footProbeHits[i] = Realtime::raycastFloor(end, glm::normalize(under - end), glm::length(under - end));
+            if (footProbeHits[i].hit) {
+                continue;
+            }
+        }
+        // nothing in reach: fall back to the floor straight below the target
+        glm::vec3 target = spiderModel * glm::vec4(leg.targetPosSpider, 1);
+        footProbeHits[i].pos = glm::vec3(target.x, Realtime::getFloorHeight(target.x, target.z), target.z);
+        footProbeHits[i].normal = Realtime::getFloorNormal(target.x, target.z);
+    }
+}
+
+bool Spider::surfaceWalking() {
+    return settings.surfaceWalking && settings.footRaycast;
+}
+
+/**
+ * @brief turns the body part of the way towards the average contact normal of
+ *        the feet and sets it spiderHeight off the feet along the new up. only
+ *        the feet's stored contacts are used, so this costs no queries; the probes
+ *        then go out along the new up.
+ */
+void Spider::alignToContacts() {
+    glm::vec3 contactUp(0);
+    glm::vec3 footCenter(0);
+    for (Leg& leg : legs) {
+        contactUp += leg.contactNormal;
+        footCenter += leg.currFootPosWorld;
+    }
+    footCenter /= legs.size();
+    if (glm::length(contactUp) > 1e-4f) {
+        glm::vec3 turned = glm::mix(up, glm::normalize(contactUp), settings.surfaceAlignRate);
+        if (glm::length(turned) > 1e-4f) {
+            up = glm::normalize(turned);
+        }
+    }
+
+    // keep look in the surface. if it ends up along up, any direction in the surface will do
+    look -= glm::dot(look, up) * up;
+    if (glm::length(look) < 1e-4f) {
+        look = glm::cross(up, glm::abs(up.x) < 0.9f ? glm::vec3(1,0,0) : glm::vec3(0,0,1));
+    }
+    look = glm::normalize(look);
+    spiderRotation = glm::mat4(glm::mat3(look, up, glm::cross(look, up)));
+
+    pos += (glm::dot(footCenter - pos, up) + spiderHeight) * up;
+    spiderTranslation = glm::translate(pos);
+    spiderModel = spiderTranslation * spiderRotation;
+}
+
+bool Spider::settled() {
+    if (framesSinceSolve >= framesStill || framesSinceSolve + 1 < solveInterval) {
+        return false;
+    }
+    for (Leg& leg : legs) {
+        if (leg.moveState || leg.solvePending) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Spider::wake() {
+    resting = false;
+    framesStill = 0;
+    restDraws.clear();
+}
 
+/**
+ * @brief culls every spider against the frustum in one pass, around the centre of
+ *        the body as animateAll last placed it, and sorts those on screen into
+ *        meshes and impostors. without a frustum every spider is on screen.
+ */
+int Spider::cullAll(std::span<Spider> spiders, const Frustum* frustum,
+                    std::vector<Spider*>& meshes, std::vector<Spider*>& impostors) {
+    int count = spiders.size();
+    int onScreen = count;
+    s_onScreen.assign(count, 1);
+    if (frustum != nullptr) {
+        s_boundX.resize(count);
+        s_boundY.resize(count);
+        s_boundZ.resize(count);
+        s_boundRadius.resize(count);
+        for (int i = 0; i < count; i++) {
+            const Spider& spider = spiders[i];
+            glm::vec3 center = spider.spiderModel[3];
+            s_boundX[i] = center.x;
+            s_boundY[i] = center.y;
+            s_boundZ[i] = center.z;
+            float radius = spider.boundingRadius;
+            if (spider.impostorFade < 1.0f && (spider.lod != AnimationLOD::LOD_FAR || !spider.cannedGait)) {
+                // a foot left further behind than its leg reaches (turning on the spot,
+                // or waiting on its neighbours to step) stretches the leg out to it.
+                // painted feet lie between the last two solves
+                for (const Leg& leg : spider.legs) {
+                    radius = glm::max(radius, glm::distance(leg.solvedFootPosWorld, center) + spider.legDiameter);
+                    radius = glm::max(radius, glm::distance(leg.prevFootPosWorld, center) + spider.legDiameter);
+                }
+            }
+            s_boundRadius[i] = radius;
+        }
+        onScreen = frustum->cullSpheres(s_boundX.data(), s_boundY.data(), s_boundZ.data(), s_boundRadius.data(),
+                                        count, s_onScreen.data());
+    }
+
+    meshes.clear();
+    impostors.clear();
+    for (int i = 0; i < count; i++) {
+        Spider& spider = spiders[i];
+        spider.onScreen = s_onScreen[i];
+        if (!spider.onScreen) {
+            continue;
+        }
+        if (spider.impostorFade < 1.0f) {
+            meshes.push_back(&spider);
+        }
+        if (spider.impostorFade > 0.0f) {
+            impostors.push_back(&spider);
+        }
+    }
+    return onScreen;
+}
+
+/**
+ * @brief paints the entire spider!
+ */
+void Spider::paintSpider(float fade) {
+    // bound once for every draw below. the legs and body share an arena
+    glUseProgram(m_phong_shader);
+    // the mesh leaves out the dither cells the impostor fills in
+    glUniform1f(glGetUniformLocation(m_phong_shader, "fade"), fade);
+
+    // at rest, replay the draws recorded on the first resting frame
+    if (resting && !restDraws.empty()) {
+        Realtime::paintShapes(m_phong_shader, restDraws);
+        return;
+    }
+    glBindVertexArray(m_cylinder.arena->vao());
+    if (resting) {
+        Realtime::recordShapes(&restDraws);
+    }
+
+    if (lod == AnimationLOD::LOD_FAR && cannedGait) {
+        paintCannedGait(spiderModel);
+    } else {
+        // mid-range spiders blend towards the latest solve over solveInterval frames
+        float blend = glm::min(1.0f, (float)(framesSinceSolve + 1) / (float)solveInterval);
+        for (Leg& leg : this->legs) {
+            leg.paint(blend);
+        }
+    }
 
     //----BODY----//
     paintBody(spiderModel);
+
+    Realtime::recordShapes(nullptr);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+// the body and eyes, laid out for the hexapod's body: where each sphere goes, how
+// it's stretched and whether it's black (0) or white (1)
+struct BodyPart {
+    glm::vec3 offset;
+    glm::vec3 scale;
+    int material;
+};
+static const BodyPart BODY_PARTS[] = {
+    {glm::vec3(0), glm::vec3(0.65f, 0.25f, 0.4f), 0}, // body
+    {glm::vec3(0.3f, 0.03f, -0.1f), glm::vec3(0.1f), 1}, // left eye
+    {glm::vec3(0.33f, 0.03f, -0.1f), glm::vec3(0.05f), 0}, // and pupil
+    {glm::vec3(0.3f, 0.03f, 0.1f), glm::vec3(0.1f), 1}, // right eye
+    {glm::vec3(0.33f, 0.03f, 0.1f), glm::vec3(0.05f), 0}, // and pupil
+};
+static const glm::vec3 HEXAPOD_BODY_SIZE(0.65f, 0.25f, 0.4f);
+
+static SceneMaterial bodyPartMaterial(int material) {
+    if (material == 0) {
+        return SceneMaterial(glm::vec3(0),
+                             glm::vec3(0.0f,0.0f,0.0f),
+                             glm::vec3(1,1,1), 5.0f);
+    }
+    return SceneMaterial(glm::vec3(0),
+                         glm::vec3(1.0f,1.0f,1.0f),
+                         glm::vec3(1,1,1), 10.0f);
 }
 
 /**
@@ -122,52 +748,84 @@ void Spider::paintSpider() {
  *                      to spider space.
  */
 void Spider::paintBody(glm::mat4 spiderModel) {
+    // the body and eyes are laid out for the hexapod's body, stretch them to the rig's
+    spiderModel = spiderModel * glm::scale(rig->bodySize / HEXAPOD_BODY_SIZE);
+
+    if (bodyMesh != nullptr) {
+        Realtime::paintMergedMesh(m_phong_shader, *bodyMesh, spiderModel);
+        return;
+    }
+    for (const BodyPart& part : BODY_PARTS) {
+        Realtime::paintShape(m_phong_shader,
+                             m_sphere,
+                             bodyPartMaterial(part.material),
+                             spiderModel * glm::translate(part.offset) * glm::scale(part.scale));
+    }
+}
+
+void Spider::buildBodyMesh(const std::vector<float>& sphereBuffer, MergedMesh& mesh, GeometryArena& arena) {
+    mesh.addMaterial(bodyPartMaterial(0));
+    mesh.addMaterial(bodyPartMaterial(1));
+    for (const BodyPart& part : BODY_PARTS) {
+        mesh.addShape(sphereBuffer, glm::translate(part.offset) * glm::scale(part.scale), part.material);
+    }
+    mesh.addTo(arena);
+}
+
+/**
+ * @brief spider model for canned gait playback. the legs aren't simulated, so the
+ *        body sits at its normal height above the floor right below it.
+ */
+glm::mat4 Spider::cannedGaitModel() {
+    // walking on surfaces the body is kept on them already (by alignToContacts)
+    if (surfaceWalking()) {
+        return spiderTranslation * spiderRotation;
+    }
+    float floorHeight = Realtime::getFloorHeight(pos.x, pos.z);
+    return glm::translate(glm::vec3(0,floorHeight,0)) * spiderTranslation * spiderRotation;
+}
+
+/**
+ * @brief paints the legs from the canned gait cycle, blending between the two
+ *        samples around the current gait phase.
+ * @param spiderModel - model matrix of spider
+ */
+void Spider::paintCannedGait(glm::mat4 spiderModel) {
+    // canned angles are relative to the spider's heading, which is a rotation about
+    // y in leg space (tilted so y is up)
+    glm::mat3 legFrame = Leg::tiltTo(glm::normalize(up));
+    glm::vec3 lookLeg = glm::transpose(legFrame) * look;
+    float heading = glm::atan(-lookLeg.z, lookLeg.x);
 
+    float sample = gaitPhase * CannedGait::SAMPLES;
+    int sample0 = (int)sample % CannedGait::SAMPLES;
+    int sample1 = (sample0 + 1) % CannedGait::SAMPLES;
+    float t = sample - glm::floor(sample);
 
-    // paint spider body
-    glm::mat4 bodyModel = spiderModel // move to world space with spider model matrix
-            * glm::scale(glm::vec3(0.65f, 0.25f, 0.4f)); // scale to correct size
-
-    SceneMaterial bodyMaterial(glm::vec3(0),
-                               glm::vec3(0.0f,0.0f,0.0f),
-                               glm::vec3(1,1,1), 5.0f);
-    Realtime::paintShape(m_phong_shader,
-                         m_sphereBufferSize, m_sphereVAO,
-                         bodyMaterial, bodyModel);
-
-    // paint eyes
-    SceneMaterial eyeMaterial(glm::vec3(0),
-                              glm::vec3(1.0f,1.0f,1.0f),
-                              glm::vec3(1,1,1), 10.0f);
-
-    glm::mat4 leftEyeModel = spiderModel
-            * glm::translate(glm::vec3(0.3f, 0.03f, -0.1f))
-            * glm::scale(glm::vec3(0.1f,0.1f,0.1f));
-    glm::mat4 leftPupilModel = spiderModel
-            * glm::translate(glm::vec3(0.33f, 0.03f, -0.1f))
-            * glm::scale(glm::vec3(0.05f,0.05f,0.05f));
-
-    Realtime::paintShape(m_phong_shader,
-                         m_sphereBufferSize, m_sphereVAO,
-                         eyeMaterial, leftEyeModel);
-    Realtime::paintShape(m_phong_shader,
-                         m_sphereBufferSize, m_sphereVAO,
-                         bodyMaterial, leftPupilModel);
-
-
-    glm::mat4 rightEyeModel = spiderModel
-            * glm::translate(glm::vec3(0.3f, 0.03f, 0.1f))
-            * glm::scale(glm::vec3(0.1f,0.1f,0.1f));
-    glm::mat4 rightPupilModel = spiderModel
-            * glm::translate(glm::vec3(0.33f, 0.03f, 0.1f))
-            * glm::scale(glm::vec3(0.05f,0.05f,0.05f));
-
-    Realtime::paintShape(m_phong_shader,
-                         m_sphereBufferSize, m_sphereVAO,
-                         eyeMaterial, rightEyeModel);
-    Realtime::paintShape(m_phong_shader,
-                         m_sphereBufferSize, m_sphereVAO,
-                         bodyMaterial, rightPupilModel);
+    for (int i = 0; i < (int)legs.size(); i++) {
+        int i0 = i * CannedGait::SAMPLES + sample0;
+        int i1 = i * CannedGait::SAMPLES + sample1;
+        glm::vec3 footPos = glm::mix(cannedGait->footPos[i0], cannedGait->footPos[i1], t);
+        glm::vec3 angles = glm::mix(IKSolver::unwrapAngles(cannedGait->angles[i0], cannedGait->angles[i1]),
+                                    cannedGait->angles[i1], t);
+        legs[i].legFrame = legFrame;
+        legs[i].paintPose(spiderModel * glm::vec4(footPos, 1), angles + glm::vec3(heading, 0, 0));
+    }
+}
+
+void Spider::leaveCannedGait() {
+    glm::mat4 spiderModel = cannedGaitModel();
+    int sample = (int)(gaitPhase * CannedGait::SAMPLES) % CannedGait::SAMPLES;
+    for (int i = 0; i < (int)legs.size(); i++) {
+        glm::vec3 footPos = cannedGait->footPos[i * CannedGait::SAMPLES + sample];
+        legs[i].resetFoot(spiderModel * glm::vec4(footPos.x, -spiderHeight, footPos.z, 1));
+        // solve right away, so there's no stale pose to blend from
+        legs[i].spiderModel = spiderModel;
+        legs[i].legFrame = Leg::tiltTo(glm::normalize(up));
+        legs[i].solve();
+        legs[i].prevAngles = legs[i].angles;
+    }
+    gait.checkAll();
 }
 
 glm::vec3 Spider::spiderLook() {
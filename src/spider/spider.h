@@ -3,54 +3,186 @@
 
 #include <glm/glm.hpp>
 #include <GL/glew.h>
+#include <memory>
+#include <span>
 #include <vector>
 #include "spider/leg.h"
+#include "spider/ik_table.h"
+#include "spider/animation_lod.h"
+#include "utils/shapedraw.h"
+#include "utils/merged_mesh.h"
+#include "utils/frustum.h"
+#include "terrain/height_pyramid.h"
+#include "scene/spatial_hash.h"
+#include "spider/gait_scheduler.h"
+#include "spider/rig.h"
 
 class Spider
 {
 public:
-    // constructor for spider class
+    // constructor for spider class, with the body and legs rig describes
     Spider(GLuint phong_shader,
-           GLuint cylinderVAO, int cylinderBufferSize,
-           GLuint sphereVAO, int sphereBufferSize,
-           float segLength1, float segLength2,
-           float legDiameter, float spiderHeight);
+           const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere,
+           std::shared_ptr<const Rig> rig,
+           glm::vec3 startPos = glm::vec3(0));
+    // starts the spider over as if it had just been built with these arguments,
+    // keeping its buffers. for Pool, which recycles despawned spiders
+    void respawn(GLuint phong_shader,
+                 const GeometryArena::Mesh& cylinder, const GeometryArena::Mesh& sphere,
+                 std::shared_ptr<const Rig> rig,
+                 glm::vec3 startPos = glm::vec3(0));
 
     //----FIELDS----//
     // GL-related fields (for painting to screen)
     GLuint m_phong_shader;
-    GLuint m_cylinderVAO;
-    int m_cylinderBufferSize;
-    GLuint m_sphereVAO;
-    int m_sphereBufferSize;
+    GeometryArena::Mesh m_cylinder;
+    GeometryArena::Mesh m_sphere;
+    // the body and eyes in one draw (buildBodyMesh), shared by every spider. if
+    // nullptr they're painted one by one
+    const MergedMesh* bodyMesh;
 
-    // Spider basic characteristic fields
+    // Spider basic characteristic fields. from the rig, shared with every spider
+    // built from it
+    std::shared_ptr<const Rig> rig;
     float segLength1; // length of first leg segment (closer to ground)
     float segLength2; // length of second leg segment (closer to body)
     float legDiameter; // diameter of all legs
     float spiderHeight; // height from ground to center of spider body
+    float boundingRadius; // around the body's centre, holding the body and legs that reach (Rig::boundingRadius)
 
     // Spider movement fields
     glm::vec3 pos; // spider position (center of body)
     glm::vec3 look; // vector that spider's looking in
-    glm::vec3 up; // up vector of spider
+    glm::vec3 up; // up vector of spider. stays (0,1,0) unless walking on surfaces
+    int navGoal; // index of the flow field the spider walks to, or -1 if it's steered by hand
 
     glm::mat4 spiderTranslation;
     glm::mat4 spiderRotation;
+    // spider to world model matrix for this frame. set by animate
+    glm::mat4 spiderModel;
 
     // Spider legs
     std::vector<Leg> legs;
 
+    // IK lookup table shared by all legs (and all spiders with the same segment
+    // lengths) when settings.ikTable is on. Realtime::initializeGL builds them
+    std::shared_ptr<const IKTable> ikTable;
+    // swing curve shared by all legs, for the swing settings
+    std::shared_ptr<const SwingCurve> swingCurve;
+
+    // Animation LOD fields, set each frame by AnimationLODScheduler
+    AnimationLOD lod;
+    bool solveThisFrame; // simulate legs and solve IK when painted this frame
+    int framesSinceSolve; // frames since legs were last simulated
+    int solveInterval; // frames between solves at the current LOD
+    float gaitPhase; // position in the canned gait cycle, [0,1)
+    // how far the spider has faded into its impostor (ImpostorRenderer::fade), 0
+    // without impostors. at 1 it's only placed, not animated or painted as a mesh
+    float impostorFade;
+    std::shared_ptr<const CannedGait> cannedGait; // built the first time the spider is far
+
+    // Rest detection fields. a spider that stays put with all feet planted on an
+    // unchanged floor stops animating, and paints by replaying its recorded draws
+    bool moved; // set by move and rotateLook, cleared by animate
+    int framesStill; // frames since the spider last moved or its floor changed
+    unsigned int terrainRevision; // floor revision seen by the last animate
+    bool resting;
+    std::vector<ShapeDraw> restDraws; // recorded on the first frame at rest
+
+    // false if cullAll found the spider off screen this frame, so it isn't painted
+    bool onScreen;
+
+    // decides which legs step when
+    GaitScheduler gait;
+    // the rig's gait, or the one in settings if it doesn't have its own
+    GaitPattern gaitPattern() const;
+
+    // Foot probe fields, for settings.footRaycast. one ray per leg due a step. with
+    // settings.surfaceWalking, legs also reach out from the hip to the probe's start
+    // to find walls in the way, and probes that miss reach back in under the body to
+    // find faces past edges
+    std::vector<glm::vec3> footProbeOrigins;
+    std::vector<RayHit> footProbeHits;
+
     //----METHODS----//
-    // paints spider to screen! main function, to be called in Realtime
-    void paintSpider();
+    // steps legs and solves IK for this frame. to be called in Realtime before painting
+    void animate();
+    // animate for every spider, with the foot probes of all of them raycast in batches.
+    // with neighbours (a grid over the spiders' positions) feet keep off each other
+    static void animateAll(std::span<Spider> spiders, const SpatialHash* neighbours = nullptr);
+    // places the stepping feet of all the spiders animateAll is stepping in one
+    // batch, then solves them
+    static void finishAll();
+    // steers spiders apart that are closer than settings.separationRadius
+    static void separateAll(std::span<Spider> spiders, const SpatialHash& neighbours, float deltaTime);
+    // sets onScreen for every spider, testing their bounding spheres against the
+    // camera's frustum all at once (all on screen if frustum is nullptr), and lists
+    // those on screen to paint as meshes (impostorFade < 1) and as impostors
+    // (impostorFade > 0). returns the number on screen
+    static int cullAll(std::span<Spider> spiders, const Frustum* frustum,
+                       std::vector<Spider*>& meshes, std::vector<Spider*>& impostors);
+    // paints spider to screen! main function, to be called in Realtime. fade is how
+    // far it has faded into its impostor (ImpostorRenderer::fade)
+    void paintSpider(float fade = 0.0f);
 
-    // paints body of spider
+    // paints body of spider. like paintCannedGait, expects the phong shader and the
+    // spider's arena VAO bound, as paintSpider does
     void paintBody(glm::mat4 spiderModel);
+    // merges the body and eyes, laid out for the hexapod's body, into mesh for
+    // bodyMesh, and adds it to arena. sphereBuffer is the sphere's vertices (Shapes::Sphere)
+    static void buildBodyMesh(const std::vector<float>& sphereBuffer, MergedMesh& mesh, GeometryArena& arena);
+
+    // raycasts the floor below the target of each leg the gait has due, along the
+    // spider's down vector, filling footProbeHits
+    void probeFootTargets();
+
+    // the parts of animate, so animateAll can batch the probes in between
+    // wake and rest handling and the spider model. false if there's nothing to step
+    bool beginAnimate();
+    // fills footProbeOrigins for probeFootTargets, returning how far the rays go
+    float aimFootProbes();
+    // checks for walls in the way, and falls back to the floor below the target for
+    // probes that hit nothing
+    void landFootProbes();
+    // steps the legs on to their targets and solves (or queues) IK. with crowd and
+    // neighbours, targets are kept off the feet of nearby spiders in crowd
+    void stepLegs(std::span<const Spider> crowd = {}, const SpatialHash* neighbours = nullptr);
+    // the parts of stepLegs, so animateAll can place the stepping feet of all
+    // spiders at once in between (Leg::swingFeet)
+    // ends finished steps, and picks targets for the legs the gait has due and starts their steps
+    void planSteps(std::span<const Spider> crowd, const SpatialHash* neighbours);
+    // solves (or queues) IK for the placed feet
+    void finishSteps();
+    // moves a leg's foot target so it lands off the feet of another spider
+    glm::vec3 avoidFeet(const Spider& other, const Leg& leg, glm::vec3 target, glm::vec3 normal);
+
+    // for surface walking
+    // true if settings have the spider follow surfaces rather than stay upright
+    static bool surfaceWalking();
+    // fits up to the feet's contact normals and places the body over the feet
+    void alignToContacts();
+
+    // for animation LOD
+    // spider model used while playing the canned gait
+    glm::mat4 cannedGaitModel();
+    // paints legs from the canned gait at the current gait phase
+    void paintCannedGait(glm::mat4 spiderModel);
+    // plants the feet where the canned gait has them, to resume simulating
+    void leaveCannedGait();
+
+    // for rest detection
+    // true once the last frame's pose is final: no legs stepping or waiting on IK,
+    // and the latest solve happened after the spider stopped and is fully blended in
+    bool settled();
+    // wakes a resting spider so it animates again
+    void wake();
 
     // for movement
     void move(float dist, bool forward);
+    void shift(glm::vec3 delta);
     void rotateLook(float deltaTime, bool right);
+    // turns towards an xz direction (like a flow field's) and walks forward
+    void steer(glm::vec2 dir, float deltaTime);
     glm::vec3 spiderLook();
 };
 
@@ -0,0 +1,140 @@
+#include "swing_curve.h"
+#include <cmath>
+#include <glm/glm.hpp>
+#include "settings.h"
+
+namespace {
+
+// cubic Hermite from 0 to 1 with zero start tangent and end tangent m
+float hermiteProgress(float t, float m) {
+    return (3.0f - m) * t * t + (m - 2.0f) * t * t * t;
+}
+
+// end tangent for hermiteProgress peaking at 1 + overshoot (found by bisection,
+// the peak only grows as the tangent goes more negative)
+float hermiteEndTangent(float overshoot) {
+    if (overshoot <= 0.0f) {
+        return 0.0f;
+    }
+    auto peak = [](float m) {
+        float highest = 0.0f;
+        for (int i = 0; i <= 256; i++) {
+            highest = glm::max(highest, hermiteProgress(i / 256.0f, m));
+        }
+        return highest;
+    };
+    float lo = -30.0f;
+    float hi = 0.0f;
+    for (int i = 0; i < 40; i++) {
+        float mid = 0.5f * (lo + hi);
+        if (peak(mid) > 1.0f + overshoot) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0.5f * (lo + hi);
+}
+
+// linearly interpolated table entries at count values of t. the outputs never
+// overlap the tables or t, and saying so (__restrict, which GCC, Clang and MSVC
+// all take) is what lets the loop vectorize
+void lerpTables(const float* __restrict t, int count, int samples,
+                const float* __restrict progressTable, const float* __restrict liftTable,
+                const float* __restrict clearTable,
+                float* __restrict progress, float* __restrict lift, float* __restrict clear) {
+    for (int i = 0; i < count; i++) {
+        float x = glm::clamp(t[i], 0.0f, 1.0f) * samples;
+        int k = glm::min((int)x, samples - 1);
+        float f = x - k;
+        progress[i] = progressTable[k] + f * (progressTable[k + 1] - progressTable[k]);
+        lift[i] = liftTable[k] + f * (liftTable[k + 1] - liftTable[k]);
+        clear[i] = clearTable[k] + f * (clearTable[k + 1] - clearTable[k]);
+    }
+}
+
+}
+
+SwingCurve::SwingCurve(const SwingCurveParams& params) {
+    this->params = params;
+    int samples = glm::max(params.samples, 2);
+    this->params.samples = samples;
+    m_endTangent = params.shape == SwingShape::HERMITE ? hermiteEndTangent(params.overshoot) : 0.0f;
+
+    m_progress.resize(samples + 1);
+    m_lift.resize(samples + 1);
+    m_clear.resize(samples + 1);
+    for (int i = 0; i <= samples; i++) {
+        float t = (float)i / samples;
+        curveAt(t, m_progress[i], m_lift[i]);
+        m_lift[i] *= params.liftHeight;
+        // all the way up for the middle 60%, smoothly there and back either side
+        m_clear[i] = glm::smoothstep(0.0f, 0.2f, t) * glm::smoothstep(1.0f, 0.8f, t);
+    }
+}
+
+void SwingCurve::curveAt(float t, float& progress, float& lift) const {
+    float s = 1.0f - t;
+    switch (params.shape) {
+    case SwingShape::BEZIER: {
+        // control points (-overshoot, 4/3) and (1 + overshoot, 4/3): the lift
+        // peaks at 1, and the foot comes back down onto the landing from past it
+        float o = params.overshoot;
+        progress = 3.0f * s * s * t * -o + 3.0f * s * t * t * (1.0f + o) + t * t * t;
+        lift = 4.0f * s * t;
+        break;
+    }
+    case SwingShape::HERMITE: {
+        progress = hermiteProgress(t, m_endTangent);
+        // tangents 4 and -4 put the peak at 1
+        lift = 4.0f * s * t;
+        break;
+    }
+    default:
+        progress = t;
+        lift = glm::sin(t * (float)M_PI);
+        break;
+    }
+}
+
+std::shared_ptr<const SwingCurve> SwingCurve::shared(const SwingCurveParams& params) {
+    // weak, so a curve goes once nothing uses it. expired ones are dropped as we look
+    static std::vector<std::weak_ptr<const SwingCurve>> cache;
+    std::shared_ptr<const SwingCurve> found;
+    for (std::size_t i = 0; i < cache.size(); ) {
+        std::shared_ptr<const SwingCurve> curve = cache[i].lock();
+        if (curve == nullptr) {
+            cache[i] = std::move(cache.back());
+            cache.pop_back();
+            continue;
+        }
+        if (curve->params.shape == params.shape && curve->params.liftHeight == params.liftHeight
+                && curve->params.overshoot == params.overshoot
+                && curve->params.samples == glm::max(params.samples, 2)) {
+            found = std::move(curve);
+        }
+        i++;
+    }
+    if (found == nullptr) {
+        found = std::make_shared<const SwingCurve>(params);
+        cache.push_back(found);
+    }
+    return found;
+}
+
+const std::shared_ptr<const SwingCurve>& SwingCurve::current() {
+    static std::shared_ptr<const SwingCurve> curve;
+    static SwingCurveParams resolved;
+    SwingCurveParams params = {(SwingShape)settings.swingShape, settings.swingLiftHeight, settings.swingOvershoot,
+                               settings.swingCurveSamples};
+    if (curve == nullptr || params.shape != resolved.shape || params.liftHeight != resolved.liftHeight
+            || params.overshoot != resolved.overshoot || params.samples != resolved.samples) {
+        curve = shared(params);
+        resolved = params;
+    }
+    return curve;
+}
+
+void SwingCurve::evaluate(const float* t, int count, float* progress, float* lift, float* clear) const {
+    lerpTables(t, count, params.samples, m_progress.data(), m_lift.data(), m_clear.data(), progress, lift, clear);
+}
@@ -0,0 +1,63 @@
+#ifndef SWING_CURVE_H
+#define SWING_CURVE_H
+
+#include <memory>
+#include <vector>
+
+enum class SwingShape {
+    SINE, // straight across, lifted by half a sine wave. the original step
+    BEZIER, // a cubic Bezier in (progress, lift), pulling back on lift-off and reaching past the landing
+    HERMITE // eased across with a cubic Hermite that overshoots the landing and settles back, parabolic lift
+};
+
+struct SwingCurveParams {
+    SwingShape shape;
+    float liftHeight; // highest the foot gets above the straight line between footholds
+    float overshoot; // how far past the landing the foot reaches, as a fraction of the step
+    int samples; // table entries per channel
+};
+
+/**
+ * The path a foot takes while stepping, baked into a table so a step costs a
+ * lerp instead of evaluating the curve. For t in [0, 1] (the fraction of the
+ * step's time gone) it has three channels:
+ *   progress, the fraction of the way from lift-off to landing
+ *   lift, how far above the straight line between them the foot is
+ *   clear, 0 to 1, how much of a step's clearance height to lift it by. it rises
+ *       early and falls late, so feet go up, over and down onto stairs and
+ *       obstacles rather than through their corners
+ * Leg::placeSwingFoot takes the higher of lift and clear times the clearance.
+ *
+ * evaluate takes a whole batch of t at once and has no branches, so the loop
+ * can vectorize. Only a Release build with the SIMD_AVX2 CMake option turns the
+ * table reads into gathers. Without it GCC keeps the loop scalar at -O2, and at
+ * -O3 vectorizes the arithmetic around scalar table loads.
+ */
+class SwingCurve
+{
+public:
+    SwingCurve(const SwingCurveParams& params);
+
+    // returns a curve shared by every caller asking for the same parameters, for
+    // as long as any of them holds on to it
+    static std::shared_ptr<const SwingCurve> shared(const SwingCurveParams& params);
+    // the shared curve for the swing settings. only looked up again when they
+    // change, so it's cheap to call every frame
+    static const std::shared_ptr<const SwingCurve>& current();
+
+    // channels at count values of t, clamped to [0, 1]
+    void evaluate(const float* t, int count, float* progress, float* lift, float* clear) const;
+
+    SwingCurveParams params;
+
+private:
+    // exact channels at t, for baking
+    void curveAt(float t, float& progress, float& lift) const;
+
+    float m_endTangent; // of the Hermite progress curve
+    std::vector<float> m_progress; // samples + 1 entries each, t = 0 to 1
+    std::vector<float> m_lift;
+    std::vector<float> m_clear;
+};
+
+#endif // SWING_CURVE_H
@@ -0,0 +1,287 @@
+#include "editable_terrain.h"
+#include "realtime.h"
+
+namespace {
+
+int floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a - 1) / b) - 1;
+}
+
+// 1 at the centre of a brush, easing to 0 at distance radius
+float falloff(float dist, float radius) {
+    if (dist >= radius) {
+        return 0.0f;
+    }
+    float s = 1.0f - (dist * dist) / (radius * radius);
+    return s * s;
+}
+
+}
+
+EditableTerrain::EditableTerrain(HeightSource* base, float cellSize, int chunkCells) {
+    m_base = base;
+    m_cellSize = cellSize;
+    m_chunkCells = glm::max(1, chunkCells);
+    m_sampleBaseOnWorker = base == nullptr || base->sampleGridIsThreadSafe();
+    m_lastChunk = nullptr;
+    m_lastKey = 0;
+    m_lastValid = false;
+    m_dirty = 0;
+    m_stop = false;
+    m_worker = std::thread(&EditableTerrain::workerLoop, this);
+}
+
+EditableTerrain::~EditableTerrain() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_worker.join();
+}
+
+uint64_t EditableTerrain::chunkKey(int cx, int cz) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cz;
+}
+
+float EditableTerrain::baseHeight(float x, float z) {
+    if (m_base != nullptr) {
+        return m_base->height(x, z);
+    }
+    return Realtime::getBuiltInFloorHeight(x, z);
+}
+
+const EditableTerrain::Chunk* EditableTerrain::lookup(float x, float z, int& index, float& tx, float& tz) {
+    int n = m_chunkCells;
+    float gx = x / m_cellSize;
+    float gz = z / m_cellSize;
+    float fx = glm::floor(gx);
+    float fz = glm::floor(gz);
+    int cx = floorDiv((int)fx, n);
+    int cz = floorDiv((int)fz, n);
+    uint64_t key = chunkKey(cx, cz);
+    if (!m_lastValid || key != m_lastKey) {
+        auto it = m_slots.find(key);
+        m_lastChunk = it == m_slots.end() ? nullptr : it->second.chunk.get();
+        m_lastKey = key;
+        m_lastValid = true;
+    }
+    if (m_lastChunk != nullptr) {
+        int i = (int)fx - cx * n;
+        int j = (int)fz - cz * n;
+        index = (j + 1) * (n + 3) + (i + 1);
+        tx = gx - fx;
+        tz = gz - fz;
+    }
+    return m_lastChunk;
+}
+
+float EditableTerrain::height(float x, float z) {
+    int index;
+    float tx, tz;
+    const Chunk* chunk = lookup(x, z, index, tx, tz);
+    if (chunk == nullptr) {
+        return baseHeight(x, z);
+    }
+    int stride = m_chunkCells + 3;
+    const float* h = &chunk->heights[index];
+    return glm::mix(glm::mix(h[0], h[1], tx), glm::mix(h[stride], h[stride + 1], tx), tz);
+}
+
+glm::vec3 EditableTerrain::normal(float x, float z) {
+    int index;
+    float tx, tz;
+    const Chunk* chunk = lookup(x, z, index, tx, tz);
+    if (chunk == nullptr) {
+        return m_base != nullptr ? m_base->normal(x, z) : HeightSource::normal(x, z);
+    }
+    // the normals skip the border, so shift the index back into the interior grid
+    int n = m_chunkCells;
+    int i = index % (n + 3) - 1;
+    int j = index / (n + 3) - 1;
+    const glm::vec3* nrm = &chunk->normals[(std::size_t)j * (n + 1) + i];
+    return glm::normalize(glm::mix(glm::mix(nrm[0], nrm[1], tx), glm::mix(nrm[n + 1], nrm[n + 2], tx), tz));
+}
+
+void EditableTerrain::prefetch(glm::vec2 center, float radius) {
+    collect();
+    if (m_base != nullptr) {
+        m_base->prefetch(center, radius);
+    }
+}
+
+void EditableTerrain::endFrame() {
+    collect();
+    if (m_base != nullptr) {
+        m_base->endFrame();
+    }
+}
+
+void EditableTerrain::raise(glm::vec2 center, float radius, float amount) {
+    stroke({Brush::RAISE, center, radius, amount, 0.0f});
+}
+
+void EditableTerrain::lower(glm::vec2 center, float radius, float amount) {
+    stroke({Brush::RAISE, center, radius, -amount, 0.0f});
+}
+
+void EditableTerrain::flatten(glm::vec2 center, float radius, float targetHeight, float strength) {
+    stroke({Brush::FLATTEN, center, radius, glm::clamp(strength, 0.0f, 1.0f), targetHeight});
+}
+
+std::shared_ptr<const EditableTerrain::Chunk> EditableTerrain::sampleBase(int cx, int cz) const {
+    int stride = m_chunkCells + 3;
+    auto chunk = std::make_shared<Chunk>();
+    chunk->heights.resize((std::size_t)stride * stride);
+    glm::vec2 origin = glm::vec2(cx, cz) * (float)m_chunkCells * m_cellSize - m_cellSize;
+    if (m_base != nullptr) {
+        m_base->sampleGrid(origin, m_cellSize, stride, stride, chunk->heights.data());
+        return chunk;
+    }
+    for (int j = 0; j < stride; j++) {
+        for (int i = 0; i < stride; i++) {
+            chunk->heights[(std::size_t)j * stride + i] = Realtime::getBuiltInFloorHeight(origin.x + i * m_cellSize,
+                                                                                          origin.y + j * m_cellSize);
+        }
+    }
+    return chunk;
+}
+
+void EditableTerrain::stroke(const Brush& brush) {
+    if (brush.radius <= 0.0f) {
+        return;
+    }
+    // every chunk with a sample (border included) inside the brush
+    float chunkSize = m_chunkCells * m_cellSize;
+    float reach = brush.radius + m_cellSize;
+    glm::ivec2 lo = glm::floor((brush.center - reach) / chunkSize);
+    glm::ivec2 hi = glm::floor((brush.center + reach) / chunkSize);
+    for (int cz = lo.y; cz <= hi.y; cz++) {
+        for (int cx = lo.x; cx <= hi.x; cx++) {
+            uint64_t key = chunkKey(cx, cz);
+            auto it = m_slots.find(key);
+            if (it == m_slots.end()) {
+                // the base is sampled here if it isn't safe to sample from the worker
+                std::shared_ptr<const Chunk> base = m_sampleBaseOnWorker ? nullptr : sampleBase(cx, cz);
+                it = m_slots.emplace(key, Slot{cx, cz, nullptr, std::move(base), {}, false}).first;
+            }
+            Slot& slot = it->second;
+            if (slot.queued.empty() && !slot.rebuilding) {
+                m_dirty++;
+            }
+            slot.queued.push_back(brush);
+            if (!slot.rebuilding) {
+                dispatch(key, slot);
+            }
+        }
+    }
+}
+
+void EditableTerrain::dispatch(uint64_t key, Slot& slot) {
+    Job job{key, slot.chunk != nullptr ? slot.chunk : slot.base, std::move(slot.queued)};
+    slot.queued.clear();
+    slot.rebuilding = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(job));
+    }
+    m_wake.notify_one();
+}
+
+std::shared_ptr<const EditableTerrain::Chunk> EditableTerrain::rebuild(const Job& job) const {
+    int n = m_chunkCells;
+    int stride = n + 3;
+    int cx = (int)(uint32_t)(job.key >> 32);
+    int cz = (int)(uint32_t)job.key;
+    glm::vec2 origin = glm::vec2(cx, cz) * (float)n * m_cellSize - m_cellSize;
+
+    auto chunk = std::make_shared<Chunk>();
+    chunk->heights = job.from != nullptr ? job.from->heights : sampleBase(cx, cz)->heights;
+    for (const Brush& brush : job.brushes) {
+        // only the samples under the brush
+        glm::ivec2 lo = glm::max(glm::ivec2(glm::ceil((brush.center - brush.radius - origin) / m_cellSize)),
+                                 glm::ivec2(0));
+        glm::ivec2 hi = glm::min(glm::ivec2(glm::floor((brush.center + brush.radius - origin) / m_cellSize)),
+                                 glm::ivec2(stride - 1));
+        for (int j = lo.y; j <= hi.y; j++) {
+            for (int i = lo.x; i <= hi.x; i++) {
+                glm::vec2 pos = origin + glm::vec2(i, j) * m_cellSize;
+                float weight = falloff(glm::distance(pos, brush.center), brush.radius);
+                float& h = chunk->heights[(std::size_t)j * stride + i];
+                if (brush.mode == Brush::RAISE) {
+                    h += brush.amount * weight;
+                } else {
+                    h = glm::mix(h, brush.target, brush.amount * weight);
+                }
+            }
+        }
+    }
+
+    // normals of the interior from central differences, as ProceduralTerrain bakes them
+    int samples = n + 1;
+    chunk->normals.resize((std::size_t)samples * samples);
+    for (int j = 0; j < samples; j++) {
+        for (int i = 0; i < samples; i++) {
+            const float* row = &chunk->heights[(std::size_t)(j + 1) * stride + (i + 1)];
+            float dx = row[1] - row[-1];
+            float dz = row[stride] - row[-stride];
+            chunk->normals[(std::size_t)j * samples + i] = glm::normalize(glm::vec3(-dx, 2.0f * m_cellSize, -dz));
+        }
+    }
+    return chunk;
+}
+
+void EditableTerrain::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_stop) {
+                return;
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        std::shared_ptr<const Chunk> rebuilt = rebuild(job);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.emplace_back(job.key, std::move(rebuilt));
+        }
+    }
+}
+
+void EditableTerrain::collect() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_done.empty()) {
+            return;
+        }
+        m_collected.swap(m_done);
+    }
+    float chunkSize = m_chunkCells * m_cellSize;
+    for (auto& [key, rebuilt] : m_collected) {
+        Slot& slot = m_slots.at(key);
+        slot.chunk = std::move(rebuilt);
+        slot.base.reset();
+        slot.rebuilding = false;
+        glm::vec2 lo = glm::vec2(slot.cx, slot.cz) * chunkSize;
+        Realtime::terrainChanged(glm::vec4(lo, lo + chunkSize));
+        // strokes that came in meanwhile go out on top of the new chunk
+        if (slot.queued.empty()) {
+            m_dirty--;
+        } else {
+            dispatch(key, slot);
+        }
+    }
+    m_collected.clear();
+    m_lastValid = false;
+}
+
+int EditableTerrain::editedChunks() const {
+    return m_slots.size();
+}
+
+int EditableTerrain::dirtyChunks() const {
+    return m_dirty;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "terrain/height_source.h"
+
+/**
+ * Runtime edits (craters, dug paths, raised obstacles) on top of another height
+ * source, or on top of the built-in floor if base is nullptr.
+ *
+ * The world is split into square chunks of chunkCells x chunkCells cells, and
+ * only chunks a brush has touched hold their own heights; everywhere else queries
+ * go straight to the base. A brush stroke marks the chunks under it dirty and
+ * hands them to a worker thread, which applies the stroke to a copy of the chunk
+ * and recomputes its normals. Finished chunks are swapped in on the main thread
+ * (in prefetch and endFrame), so a query always sees either the old chunk or the
+ * new one, and each swap is reported with Realtime::terrainChanged(rect) so only
+ * what lies over that chunk (floor texels, pyramid cells, resting spiders) is
+ * refreshed. Strokes that arrive while a chunk is being rebuilt wait for it and
+ * go out together in the next rebuild.
+ *
+ * A chunk's first rebuild starts from the base under it. The worker samples that
+ * itself if the base allows it (HeightSource::sampleGridIsThreadSafe, and the
+ * built-in floor); otherwise the stroke samples it on the main thread.
+ *
+ * Edited chunks are kept for good, since they are the edits. Queries are expected
+ * from the main thread only.
+ */
+class EditableTerrain : public HeightSource
+{
+public:
+    EditableTerrain(HeightSource* base, float cellSize, int chunkCells);
+    ~EditableTerrain();
+    EditableTerrain(const EditableTerrain&) = delete;
+    EditableTerrain& operator=(const EditableTerrain&) = delete;
+
+    float height(float x, float z) override;
+    glm::vec3 normal(float x, float z) override;
+    void prefetch(glm::vec2 center, float radius) override;
+    void endFrame() override;
+
+    // brushes. each moves the floor within radius of center (in xz), by the full
+    // amount at the centre and smoothly less towards the rim
+    void raise(glm::vec2 center, float radius, float amount);
+    void lower(glm::vec2 center, float radius, float amount);
+    // pulls the floor towards targetHeight, all the way at the centre if strength is 1
+    void flatten(glm::vec2 center, float radius, float targetHeight, float strength);
+
+    int editedChunks() const;
+    int dirtyChunks() const; // waiting for or being rebuilt
+
+private:
+    struct Brush {
+        enum Mode { RAISE, FLATTEN } mode;
+        glm::vec2 center;
+        float radius;
+        float amount; // height added at the centre, or for FLATTEN how far to pull in [0, 1]
+        float target; // FLATTEN only
+    };
+    struct Chunk {
+        // (chunkCells + 3)^2 samples with a 1 sample border for the normals, x fastest
+        std::vector<float> heights;
+        // (chunkCells + 1)^2 normals of the interior
+        std::vector<glm::vec3> normals;
+    };
+    struct Slot {
+        int cx;
+        int cz;
+        std::shared_ptr<const Chunk> chunk; // what queries see, nullptr until the first rebuild
+        // the base sampled at the first stroke, or nullptr if the worker samples it
+        std::shared_ptr<const Chunk> base;
+        std::vector<Brush> queued; // strokes not sent to the worker yet
+        bool rebuilding;
+    };
+    struct Job {
+        uint64_t key;
+        std::shared_ptr<const Chunk> from; // nullptr to start from the base
+        std::vector<Brush> brushes;
+    };
+
+    static uint64_t chunkKey(int cx, int cz);
+    float baseHeight(float x, float z);
+    // queues brush on every chunk it reaches
+    void stroke(const Brush& brush);
+    // samples the base over a chunk, border included. runs on the worker if
+    // m_sampleBaseOnWorker is set
+    std::shared_ptr<const Chunk> sampleBase(int cx, int cz) const;
+    // sends a slot's queued strokes to the worker
+    void dispatch(uint64_t key, Slot& slot);
+    // applies a job's strokes to a copy of its chunk. runs on the worker
+    std::shared_ptr<const Chunk> rebuild(const Job& job) const;
+    // swaps in chunks the worker has finished
+    void collect();
+    void workerLoop();
+    // edited chunk holding (x, z), or nullptr if it isn't edited. sets the index
+    // of the sample at the cell's corner (border included) and the position in the cell
+    const Chunk* lookup(float x, float z, int& index, float& tx, float& tz);
+
+    HeightSource* m_base;
+    float m_cellSize;
+    int m_chunkCells;
+    bool m_sampleBaseOnWorker;
+
+    // main thread state
+    std::unordered_map<uint64_t, Slot> m_slots;
+    const Chunk* m_lastChunk; // most recently looked up, nullptr if it wasn't edited
+    uint64_t m_lastKey;
+    bool m_lastValid;
+    int m_dirty;
+    std::vector<std::pair<uint64_t, std::shared_ptr<const Chunk>>> m_collected; // scratch
+
+    // shared with the worker
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<Job> m_queue;
+    std::vector<std::pair<uint64_t, std::shared_ptr<const Chunk>>> m_done; // rebuilt, not swapped in
+    bool m_stop;
+    std::thread m_worker;
+};
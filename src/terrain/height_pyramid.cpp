@@ -0,0 +1,343 @@
+#include "height_pyramid.h"
+#include <algorithm>
+#include <cmath>
+
+// march takes at most this many steps along a ray, sampling the height source,
+// before bisecting the crossing this many times. longer rays take longer steps
+static const int MAX_MARCH_STEPS = 256;
+static const int MARCH_BISECTIONS = 12;
+// fixed point steps for rays march treats as vertical
+static const int VERTICAL_REFINES = 3;
+
+HeightPyramid::HeightPyramid() {
+    m_origin = glm::vec2(0);
+    m_cellSize = 1.0f;
+    m_cells = 0;
+    m_levels = 0;
+}
+
+void HeightPyramid::build(glm::vec2 origin, float cellSize, int cells,
+                          const std::function<float(float, float)>& heightAt) {
+    m_origin = origin;
+    m_cellSize = cellSize;
+    m_cells = 1;
+    m_levels = 1;
+    while (m_cells < cells) {
+        m_cells *= 2;
+        m_levels++;
+    }
+
+    // sample the floor at every grid corner
+    int n = m_cells + 1;
+    m_heights.resize((std::size_t)n * n);
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            m_heights[(std::size_t)j * n + i] = heightAt(origin.x + i * cellSize, origin.y + j * cellSize);
+        }
+    }
+
+    m_minMax.resize(m_levels);
+    for (int level = 0; level < m_levels; level++) {
+        int size = m_cells >> level;
+        m_minMax[level].resize((std::size_t)size * size);
+        fitCells(level, glm::ivec2(0), glm::ivec2(size - 1));
+    }
+}
+
+void HeightPyramid::refresh(glm::vec4 rect, const std::function<float(float, float)>& heightAt) {
+    if (!isBuilt()) {
+        return;
+    }
+    // resample the grid corners inside rect
+    glm::ivec2 lo = glm::max(glm::ivec2(glm::ceil((glm::vec2(rect.x, rect.y) - m_origin) / m_cellSize)),
+                             glm::ivec2(0));
+    glm::ivec2 hi = glm::min(glm::ivec2(glm::floor((glm::vec2(rect.z, rect.w) - m_origin) / m_cellSize)),
+                             glm::ivec2(m_cells));
+    if (lo.x > hi.x || lo.y > hi.y) {
+        return;
+    }
+    int n = m_cells + 1;
+    for (int j = lo.y; j <= hi.y; j++) {
+        for (int i = lo.x; i <= hi.x; i++) {
+            m_heights[(std::size_t)j * n + i] = heightAt(m_origin.x + i * m_cellSize, m_origin.y + j * m_cellSize);
+        }
+    }
+
+    // refit the cells with one of those corners, and their ancestors
+    glm::ivec2 cellLo = glm::max(lo - 1, glm::ivec2(0));
+    glm::ivec2 cellHi = glm::min(hi, glm::ivec2(m_cells - 1));
+    for (int level = 0; level < m_levels; level++) {
+        fitCells(level, cellLo, cellHi);
+        cellLo /= 2;
+        cellHi /= 2;
+    }
+}
+
+void HeightPyramid::fitCells(int level, glm::ivec2 lo, glm::ivec2 hi) {
+    int size = m_cells >> level;
+    std::vector<glm::vec2>& dst = m_minMax[level];
+    if (level == 0) {
+        // a bilinear patch never leaves the range of its corners
+        for (int j = lo.y; j <= hi.y; j++) {
+            for (int i = lo.x; i <= hi.x; i++) {
+                float h00 = sample(i, j);
+                float h10 = sample(i + 1, j);
+                float h01 = sample(i, j + 1);
+                float h11 = sample(i + 1, j + 1);
+                dst[(std::size_t)j * size + i] =
+                        glm::vec2(std::min({h00, h10, h01, h11}), std::max({h00, h10, h01, h11}));
+            }
+        }
+        return;
+    }
+    // each level up covers 2x2 cells of the one below
+    int below = size * 2;
+    const std::vector<glm::vec2>& src = m_minMax[level - 1];
+    for (int j = lo.y; j <= hi.y; j++) {
+        for (int i = lo.x; i <= hi.x; i++) {
+            glm::vec2 a = src[(std::size_t)(2 * j) * below + 2 * i];
+            glm::vec2 b = src[(std::size_t)(2 * j) * below + 2 * i + 1];
+            glm::vec2 c = src[(std::size_t)(2 * j + 1) * below + 2 * i];
+            glm::vec2 d = src[(std::size_t)(2 * j + 1) * below + 2 * i + 1];
+            dst[(std::size_t)j * size + i] = glm::vec2(std::min({a.x, b.x, c.x, d.x}),
+                                                       std::max({a.y, b.y, c.y, d.y}));
+        }
+    }
+}
+
+bool HeightPyramid::isBuilt() const {
+    return m_levels > 0;
+}
+
+bool HeightPyramid::covers(float x, float z) const {
+    float size = extent();
+    return isBuilt() && x >= m_origin.x && x <= m_origin.x + size
+            && z >= m_origin.y && z <= m_origin.y + size;
+}
+
+glm::vec2 HeightPyramid::center() const {
+    return m_origin + 0.5f * extent();
+}
+
+float HeightPyramid::extent() const {
+    return m_cells * m_cellSize;
+}
+
+float HeightPyramid::sample(int i, int j) const {
+    return m_heights[(std::size_t)j * (m_cells + 1) + i];
+}
+
+RayHit HeightPyramid::raycast(glm::vec3 origin, glm::vec3 dir, float maxDist) const {
+    RayHit miss = {false, maxDist, origin + dir * maxDist, glm::vec3(0, 1, 0)};
+    if (!isBuilt()) {
+        return miss;
+    }
+
+    // clip the ray to the window, and to the slab between the lowest and highest point
+    float tNear = 0.0f;
+    float tFar = maxDist;
+    auto clip = [&tNear, &tFar](float o, float d, float lo, float hi) {
+        if (d == 0.0f) {
+            return o >= lo && o <= hi;
+        }
+        float ta = (lo - o) / d;
+        float tb = (hi - o) / d;
+        tNear = std::max(tNear, std::min(ta, tb));
+        tFar = std::min(tFar, std::max(ta, tb));
+        return tNear <= tFar;
+    };
+    float size = extent();
+    if (!clip(origin.x, dir.x, m_origin.x, m_origin.x + size)
+            || !clip(origin.z, dir.z, m_origin.y, m_origin.y + size)) {
+        return miss;
+    }
+    glm::vec2 range = m_minMax[m_levels - 1][0];
+    if (origin.y > range.y) {
+        if (dir.y >= 0.0f) {
+            return miss;
+        }
+        tNear = std::max(tNear, (range.y - origin.y) / dir.y);
+    }
+    if (dir.y < 0.0f) {
+        // below the lowest point the ray is underground, so it has hit by then
+        tFar = std::min(tFar, (range.x - origin.y) / dir.y + 1e-4f * m_cellSize);
+    }
+    if (tNear > tFar) {
+        return miss;
+    }
+
+    int level = m_levels - 1;
+    float t = tNear;
+    float step = 1e-4f * m_cellSize;
+    while (true) {
+        float cellSize = m_cellSize * (1 << level);
+        int cells = m_cells >> level;
+
+        // cell the ray is in just past t, and where the ray leaves it
+        glm::vec3 p = origin + dir * (t + step);
+        int i = glm::clamp((int)std::floor((p.x - m_origin.x) / cellSize), 0, cells - 1);
+        int j = glm::clamp((int)std::floor((p.z - m_origin.y) / cellSize), 0, cells - 1);
+        float tExit = tFar;
+        if (dir.x > 0.0f) {
+            tExit = std::min(tExit, (m_origin.x + (i + 1) * cellSize - origin.x) / dir.x);
+        } else if (dir.x < 0.0f) {
+            tExit = std::min(tExit, (m_origin.x + i * cellSize - origin.x) / dir.x);
+        }
+        if (dir.z > 0.0f) {
+            tExit = std::min(tExit, (m_origin.y + (j + 1) * cellSize - origin.z) / dir.z);
+        } else if (dir.z < 0.0f) {
+            tExit = std::min(tExit, (m_origin.y + j * cellSize - origin.z) / dir.z);
+        }
+        tExit = std::max(tExit, t + step);
+
+        glm::vec2 minMax = m_minMax[level][(std::size_t)j * cells + i];
+        float rayMin = origin.y + dir.y * (dir.y < 0.0f ? tExit : t);
+        if (rayMin <= minMax.y) {
+            // the ray dips into the cell's height range: look closer
+            if (level > 0) {
+                level--;
+                continue;
+            }
+            RayHit hit;
+            if (intersectCell(i, j, origin, dir, t, std::min(tExit, tFar), hit)) {
+                return hit;
+            }
+        }
+
+        // passed over the cell. move on, one level coarser
+        if (tExit >= tFar) {
+            return miss;
+        }
+        t = tExit;
+        level = std::min(level + 1, m_levels - 1);
+    }
+}
+
+bool HeightPyramid::intersectCell(int i, int j, glm::vec3 origin, glm::vec3 dir,
+                                  float t0, float t1, RayHit& hit) const {
+    float h00 = sample(i, j);
+    float h10 = sample(i + 1, j);
+    float h01 = sample(i, j + 1);
+    float h11 = sample(i + 1, j + 1);
+
+    // h(u, v) = h00 + ex*u + ez*v + k*u*v over the cell, with (u, v) in [0,1]^2.
+    // along the ray from t0, (u, v) moves linearly, so ray height minus floor
+    // height is a quadratic a*s^2 + b*s + c in s = t - t0
+    glm::vec3 p0 = origin + dir * t0;
+    float u0 = (p0.x - (m_origin.x + i * m_cellSize)) / m_cellSize;
+    float v0 = (p0.z - (m_origin.y + j * m_cellSize)) / m_cellSize;
+    float du = dir.x / m_cellSize;
+    float dv = dir.z / m_cellSize;
+    float ex = h10 - h00;
+    float ez = h01 - h00;
+    float k = h00 - h10 - h01 + h11;
+
+    float a = -k * du * dv;
+    float b = dir.y - (ex * du + ez * dv + k * (u0 * dv + v0 * du));
+    float c = p0.y - (h00 + ex * u0 + ez * v0 + k * u0 * v0);
+
+    // first s in [0, t1 - t0] where the ray is at or below the floor
+    float s = -1.0f;
+    if (c <= 0.0f) {
+        s = 0.0f;
+    } else if (std::abs(a) < 1e-8f) {
+        if (b < 0.0f) {
+            s = -c / b;
+        }
+    } else {
+        float disc = b * b - 4.0f * a * c;
+        if (disc >= 0.0f) {
+            // numerically stable roots
+            float q = -0.5f * (b + std::copysign(std::sqrt(disc), b));
+            float r0 = q / a;
+            float r1 = c / q;
+            if (r0 > r1) {
+                std::swap(r0, r1);
+            }
+            s = r0 >= 0.0f ? r0 : r1;
+        }
+    }
+    if (s < 0.0f || s > t1 - t0 + 1e-4f * m_cellSize) {
+        return false;
+    }
+
+    float u = glm::clamp(u0 + du * s, 0.0f, 1.0f);
+    float v = glm::clamp(v0 + dv * s, 0.0f, 1.0f);
+    float dhdu = ex + k * v;
+    float dhdv = ez + k * u;
+    hit.hit = true;
+    hit.t = t0 + s;
+    hit.pos = origin + dir * hit.t;
+    hit.normal = glm::normalize(glm::vec3(-dhdu / m_cellSize, 1.0f, -dhdv / m_cellSize));
+    return true;
+}
+
+void HeightPyramid::raycastBatch(const glm::vec3* origins, int count, glm::vec3 dir,
+                                 float maxDist, RayHit* hits) const {
+    for (int r = 0; r < count; r++) {
+        hits[r] = raycast(origins[r], dir, maxDist);
+    }
+}
+
+RayHit HeightPyramid::march(glm::vec3 origin, glm::vec3 dir, float maxDist, float step,
+                            const std::function<float(float, float)>& heightAt) {
+    RayHit hit = {false, maxDist, origin + dir * maxDist, glm::vec3(0, 1, 0)};
+    // height of the ray above the floor, t along it
+    auto clearance = [&](float t) {
+        glm::vec3 p = origin + dir * t;
+        return p.y - heightAt(p.x, p.z);
+    };
+
+    float t = -1.0f;
+    float across = glm::length(glm::vec2(dir.x, dir.z)) * maxDist;
+    if (across < step) {
+        // close to vertical: it can only meet the floor near the origin. start
+        // from the floor under the origin and move to the floor under where the
+        // ray meets that height, which converges as long as the ray is steeper
+        // than the floor
+        float floorHeight = heightAt(origin.x, origin.z);
+        if (origin.y <= floorHeight) {
+            t = 0.0f;
+        } else if (dir.y < 0.0f) {
+            float tFloor = (floorHeight - origin.y) / dir.y;
+            for (int i = 0; i < VERTICAL_REFINES && across > 0.0f; i++) {
+                glm::vec3 p = origin + dir * tFloor;
+                tFloor = std::max(0.0f, (heightAt(p.x, p.z) - origin.y) / dir.y);
+            }
+            if (tFloor <= maxDist) {
+                t = tFloor;
+            }
+        }
+    } else if (clearance(0.0f) <= 0.0f) {
+        t = 0.0f;
+    } else {
+        int steps = std::min((int)std::ceil(across / step), MAX_MARCH_STEPS);
+        float dt = maxDist / steps;
+        for (int s = 1; s <= steps; s++) {
+            float tStep = s == steps ? maxDist : s * dt;
+            if (clearance(tStep) > 0.0f) {
+                continue;
+            }
+            // crossed since the last step
+            float lo = tStep - dt;
+            float hi = tStep;
+            for (int b = 0; b < MARCH_BISECTIONS; b++) {
+                float mid = 0.5f * (lo + hi);
+                (clearance(mid) > 0.0f ? lo : hi) = mid;
+            }
+            t = hi;
+            break;
+        }
+    }
+    if (t < 0.0f) {
+        return hit;
+    }
+
+    hit.hit = true;
+    hit.t = t;
+    hit.pos = origin + dir * t;
+    float dx = heightAt(hit.pos.x + step, hit.pos.z) - heightAt(hit.pos.x - step, hit.pos.z);
+    float dz = heightAt(hit.pos.x, hit.pos.z + step) - heightAt(hit.pos.x, hit.pos.z - step);
+    hit.normal = glm::normalize(glm::vec3(-dx, 2.0f * step, -dz));
+    return hit;
+}
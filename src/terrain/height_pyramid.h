@@ -0,0 +1,77 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+// result of a ray-vs-floor query
+struct RayHit {
+    bool hit;
+    float t; // distance along the ray
+    glm::vec3 pos;
+    glm::vec3 normal;
+};
+
+/**
+ * A hierarchical min/max pyramid over a square window of the floor, for fast
+ * raycasts against it.
+ *
+ * The floor is sampled on a (cells + 1)^2 grid and each cell is treated as the
+ * bilinear patch through its 4 corners (the same surface TiledHeightmap::height
+ * gives). Level 0 stores the min and max height of every cell, and each level
+ * above stores the min and max of 2x2 cells of the level below, up to a single
+ * cell covering the whole window.
+ *
+ * A ray walks the pyramid from the top: if it stays above a cell's max it skips
+ * the whole cell and climbs back up a level, otherwise it descends, and only
+ * level 0 cells it actually dips into are intersected exactly (the ray against a
+ * bilinear patch is a quadratic). Open ground and vertical probes cost a handful
+ * of cell visits.
+ */
+class HeightPyramid
+{
+public:
+    HeightPyramid();
+
+    // samples heightAt over the window starting at origin. cells (per side) is
+    // rounded up to a power of two
+    void build(glm::vec2 origin, float cellSize, int cells,
+               const std::function<float(float, float)>& heightAt);
+    // resamples just the part of the window inside rect (min x, min z, max x, max z)
+    // and refits the cells above it, after the floor there has changed
+    void refresh(glm::vec4 rect, const std::function<float(float, float)>& heightAt);
+
+    bool isBuilt() const;
+    // true if (x, z) is inside the window
+    bool covers(float x, float z) const;
+    glm::vec2 center() const;
+    float extent() const; // side length of the window
+
+    // first point where the ray (dir normalized) meets the floor within maxDist
+    RayHit raycast(glm::vec3 origin, glm::vec3 dir, float maxDist) const;
+    // raycast for count rays in the same direction, e.g. the foot probes of every leg of a spider
+    void raycastBatch(const glm::vec3* origins, int count, glm::vec3 dir,
+                      float maxDist, RayHit* hits) const;
+    // raycast straight against heightAt, for rays outside any pyramid's window:
+    // steps along the ray about step apart horizontally and bisects the first
+    // crossing. rays that stay within a step of their origin are solved from the
+    // floor under it instead. the normal is from differences of heightAt a step apart
+    static RayHit march(glm::vec3 origin, glm::vec3 dir, float maxDist, float step,
+                        const std::function<float(float, float)>& heightAt);
+
+private:
+    // intersects the ray with level 0 cell (i, j) between t0 and t1
+    bool intersectCell(int i, int j, glm::vec3 origin, glm::vec3 dir,
+                       float t0, float t1, RayHit& hit) const;
+    float sample(int i, int j) const;
+    // recomputes the min and max of the cells from lo to hi (inclusive) of a level
+    void fitCells(int level, glm::ivec2 lo, glm::ivec2 hi);
+
+    glm::vec2 m_origin;
+    float m_cellSize;
+    int m_cells; // level 0 cells per side
+    int m_levels;
+    std::vector<float> m_heights; // (cells + 1)^2 samples, x fastest
+    // per level, (min, max) of each cell, x fastest. level L has cells >> L per side
+    std::vector<std::vector<glm::vec2>> m_minMax;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * Something Realtime::getFloorHeight can get floor heights from, in place of the
+ * built-in flat floor. Set with Realtime::setHeightSource.
+ */
+class HeightSource
+{
+public:
+    virtual ~HeightSource() = default;
+
+    // floor height at world position (x, z). called per leg per frame, so keep it cheap
+    virtual float height(float x, float z) = 0;
+
+    // upward unit normal of the floor at (x, z). the default takes central
+    // differences of height; sources that know better override it
+    virtual glm::vec3 normal(float x, float z) {
+        const float eps = 0.05f;
+        float dx = height(x + eps, z) - height(x - eps, z);
+        float dz = height(x, z + eps) - height(x, z - eps);
+        return glm::normalize(glm::vec3(-dx, 2.0f * eps, -dz));
+    }
+
+    // fills out with countX x countZ heights, spacing apart from origin in x and
+    // z, x fastest, the same as height would give for each
+    virtual void sampleGrid(glm::vec2 origin, float spacing, int countX, int countZ, float* out) {
+        for (int j = 0; j < countZ; j++) {
+            for (int i = 0; i < countX; i++) {
+                *out++ = height(origin.x + i * spacing, origin.y + j * spacing);
+            }
+        }
+    }
+
+    // true if sampleGrid may be called from another thread while the main thread
+    // queries the source. sources that fill caches as they're queried can't
+    virtual bool sampleGridIsThreadSafe() const {
+        return false;
+    }
+
+    // hint that heights within radius of center will be asked for soon. sources
+    // that stream data in use this to load ahead; the default does nothing
+    virtual void prefetch(glm::vec2 center, float radius) {}
+
+    // called once per frame after the prefetches, to drop data that's no longer needed
+    virtual void endFrame() {}
+};
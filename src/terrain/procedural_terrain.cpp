@@ -0,0 +1,516 @@
+#include "procedural_terrain.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static const char CHUNK_MAGIC[8] = {'I','T','S','Y','C','H','N','K'};
+// bump when the noise changes, so chunks cached on disk by older builds are ignored
+static const uint32_t NOISE_VERSION = 1;
+
+namespace {
+
+struct ChunkFileHeader {
+    char magic[8];
+    uint64_t paramsHash;
+    int32_t cx;
+    int32_t cz;
+};
+
+// integer hash of 4 lattice points at once. plain arithmetic instead of a
+// permutation table lookup, so it stays in vector registers
+glm::uvec4 hash4(glm::ivec4 i, glm::ivec4 j, uint32_t seed) {
+    glm::uvec4 h = glm::uvec4(i) * 0x8da6b343u + glm::uvec4(j) * 0xd8163841u + glm::uvec4(seed * 0xcb1ab31fu);
+    h ^= h >> 13u;
+    h *= 0x85ebca6bu;
+    h ^= h >> 16u;
+    return h;
+}
+
+// contribution of one simplex corner with hashed gradient h, at offset (x, z) from it.
+// the 8 gradients are (+-1, +-0.5) and (+-0.5, +-1)
+glm::vec4 corner4(glm::uvec4 h, glm::vec4 x, glm::vec4 z) {
+    glm::vec4 signX = 1.0f - 2.0f * glm::vec4(h & 1u);
+    glm::vec4 signZ = 1.0f - 2.0f * glm::vec4((h >> 1u) & 1u);
+    glm::vec4 swap = glm::vec4((h >> 2u) & 1u);
+    glm::vec4 gx = signX * (1.0f - 0.5f * swap);
+    glm::vec4 gz = signZ * (0.5f + 0.5f * swap);
+    glm::vec4 t = glm::max(0.5f - x * x - z * z, glm::vec4(0.0f));
+    t *= t;
+    return t * t * (gx * x + gz * z);
+}
+
+// 2D simplex noise at 4 points, roughly in [-1, 1]
+glm::vec4 simplex4(glm::vec4 x, glm::vec4 z, uint32_t seed) {
+    const float F2 = 0.366025404f; // (sqrt(3) - 1) / 2
+    const float G2 = 0.211324865f; // (3 - sqrt(3)) / 6
+
+    // skew to find the simplex cell, and offsets to its 3 corners
+    glm::vec4 s = (x + z) * F2;
+    glm::vec4 i = glm::floor(x + s);
+    glm::vec4 j = glm::floor(z + s);
+    glm::vec4 t = (i + j) * G2;
+    glm::vec4 x0 = x - (i - t);
+    glm::vec4 z0 = z - (j - t);
+    glm::vec4 i1 = glm::step(z0, x0); // lower or upper triangle
+    glm::vec4 j1 = 1.0f - i1;
+    glm::vec4 x1 = x0 - i1 + G2;
+    glm::vec4 z1 = z0 - j1 + G2;
+    glm::vec4 x2 = x0 - 1.0f + 2.0f * G2;
+    glm::vec4 z2 = z0 - 1.0f + 2.0f * G2;
+
+    glm::ivec4 ii(i);
+    glm::ivec4 jj(j);
+    glm::vec4 n = corner4(hash4(ii, jj, seed), x0, z0)
+            + corner4(hash4(ii + glm::ivec4(i1), jj + glm::ivec4(j1), seed), x1, z1)
+            + corner4(hash4(ii + 1, jj + 1, seed), x2, z2);
+    return 80.0f * n;
+}
+
+int floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a - 1) / b) - 1;
+}
+
+uint64_t fnv1a(uint64_t hash, const void* data, std::size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t b = 0; b < size; b++) {
+        hash = (hash ^ bytes[b]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+ProceduralTerrain::ProceduralTerrain(const Params& params) {
+    m_params = params;
+    m_params.octaves = glm::max(1, m_params.octaves);
+    m_params.chunkCells = glm::max(1, m_params.chunkCells);
+    m_params.maxChunks = glm::max(1, m_params.maxChunks);
+    m_lastChunk = nullptr;
+    m_lastKey = 0;
+    m_frame = 1;
+    m_bakedOnDemand = 0;
+    m_stop = false;
+
+    // everything that changes baked values goes into the hash
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, &NOISE_VERSION, sizeof(NOISE_VERSION));
+    hash = fnv1a(hash, &m_params.seed, sizeof(int));
+    hash = fnv1a(hash, &m_params.octaves, sizeof(int));
+    hash = fnv1a(hash, &m_params.frequency, sizeof(float));
+    hash = fnv1a(hash, &m_params.amplitude, sizeof(float));
+    hash = fnv1a(hash, &m_params.lacunarity, sizeof(float));
+    hash = fnv1a(hash, &m_params.gain, sizeof(float));
+    hash = fnv1a(hash, &m_params.chunkCells, sizeof(int));
+    hash = fnv1a(hash, &m_params.cellSize, sizeof(float));
+    m_paramsHash = hash;
+
+    if (!m_params.cacheDir.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(m_params.cacheDir, error);
+        if (error) {
+            std::cerr << "Failed to create terrain cache: " << m_params.cacheDir << std::endl;
+            m_params.cacheDir = "";
+        }
+    }
+
+    int workers = m_params.workers;
+    if (workers <= 0) {
+        workers = glm::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+    for (int w = 0; w < workers; w++) {
+        m_workers.emplace_back(&ProceduralTerrain::workerLoop, this);
+    }
+}
+
+ProceduralTerrain::~ProceduralTerrain() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+uint64_t ProceduralTerrain::chunkKey(int cx, int cz) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cz;
+}
+
+glm::vec4 ProceduralTerrain::fbm4(glm::vec4 x, glm::vec4 z) const {
+    glm::vec4 sum(0.0f);
+    float amplitude = m_params.amplitude;
+    float frequency = m_params.frequency;
+    for (int octave = 0; octave < m_params.octaves; octave++) {
+        sum += amplitude * simplex4(x * frequency, z * frequency, m_params.seed * 131u + octave);
+        amplitude *= m_params.gain;
+        frequency *= m_params.lacunarity;
+    }
+    return sum;
+}
+
+float ProceduralTerrain::noiseHeight(float x, float z) const {
+    return fbm4(glm::vec4(x), glm::vec4(z)).x;
+}
+
+std::unique_ptr<ProceduralTerrain::Chunk> ProceduralTerrain::bake(int cx, int cz) const {
+    auto chunk = std::make_unique<Chunk>();
+    chunk->lastUsed = 0;
+    chunk->loaded = !m_params.cacheDir.empty() && loadChunk(cx, cz, *chunk);
+    if (chunk->loaded) {
+        return chunk;
+    }
+
+    // evaluate the noise with a 1 sample border all round, for the normals.
+    // rows are padded to a multiple of 4 samples
+    int n = m_params.chunkCells;
+    float cellSize = m_params.cellSize;
+    int rowSamples = n + 3;
+    int rowStride = (rowSamples + 3) / 4 * 4;
+    std::vector<float> grid((std::size_t)rowStride * rowSamples);
+    glm::vec2 origin = glm::vec2(cx, cz) * (float)n * cellSize - cellSize;
+    for (int j = 0; j < rowSamples; j++) {
+        glm::vec4 z(origin.y + j * cellSize);
+        for (int i = 0; i < rowStride; i += 4) {
+            glm::vec4 x = origin.x + (glm::vec4(i) + glm::vec4(0, 1, 2, 3)) * cellSize;
+            glm::vec4 h = fbm4(x, z);
+            std::memcpy(&grid[(std::size_t)j * rowStride + i], &h, sizeof(glm::vec4));
+        }
+    }
+
+    // keep the interior, and take normals from central differences
+    int samples = n + 1;
+    chunk->heights.resize((std::size_t)samples * samples);
+    chunk->normals.resize((std::size_t)samples * samples);
+    for (int j = 0; j < samples; j++) {
+        for (int i = 0; i < samples; i++) {
+            const float* row = &grid[(std::size_t)(j + 1) * rowStride + (i + 1)];
+            float dx = row[1] - row[-1];
+            float dz = row[rowStride] - row[-rowStride];
+            chunk->heights[(std::size_t)j * samples + i] = row[0];
+            chunk->normals[(std::size_t)j * samples + i] = glm::normalize(glm::vec3(-dx, 2.0f * cellSize, -dz));
+        }
+    }
+    return chunk;
+}
+
+std::string ProceduralTerrain::cachePath(int cx, int cz) const {
+    std::ostringstream path;
+    path << m_params.cacheDir << "/" << std::hex << m_paramsHash << std::dec << "_" << cx << "_" << cz << ".chunk";
+    return path.str();
+}
+
+bool ProceduralTerrain::loadChunk(int cx, int cz, Chunk& chunk) const {
+    std::ifstream file(cachePath(cx, cz), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    ChunkFileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, CHUNK_MAGIC, 8) != 0 || header.paramsHash != m_paramsHash
+            || header.cx != cx || header.cz != cz) {
+        return false;
+    }
+    std::size_t samples = (std::size_t)(m_params.chunkCells + 1) * (m_params.chunkCells + 1);
+    chunk.heights.resize(samples);
+    chunk.normals.resize(samples);
+    file.read(reinterpret_cast<char*>(chunk.heights.data()), samples * sizeof(float));
+    file.read(reinterpret_cast<char*>(chunk.normals.data()), samples * sizeof(glm::vec3));
+    return (bool)file;
+}
+
+void ProceduralTerrain::saveChunk(int cx, int cz, const Chunk& chunk) const {
+    // write to a file of our own and rename it into place, since two workers can
+    // save the same chunk at once if it was evicted and baked again in between
+    std::string path = cachePath(cx, cz);
+    std::ostringstream tmpPath;
+    tmpPath << path << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+    {
+        std::ofstream file(tmpPath.str(), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        ChunkFileHeader header;
+        std::memcpy(header.magic, CHUNK_MAGIC, 8);
+        header.paramsHash = m_paramsHash;
+        header.cx = cx;
+        header.cz = cz;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(chunk.heights.data()), chunk.heights.size() * sizeof(float));
+        file.write(reinterpret_cast<const char*>(chunk.normals.data()), chunk.normals.size() * sizeof(glm::vec3));
+    }
+    std::error_code error;
+    std::filesystem::rename(tmpPath.str(), path, error);
+    if (error) {
+        std::filesystem::remove(tmpPath.str(), error);
+    }
+}
+
+void ProceduralTerrain::workerLoop() {
+    while (true) {
+        std::pair<int, int> job;
+        std::unique_ptr<Chunk> save;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stop || !m_queue.empty() || !m_saves.empty(); });
+            if (m_stop) {
+                return; // unsaved chunks just bake again next run
+            }
+            // bakes first, since a frame may be waiting on them
+            if (!m_queue.empty()) {
+                job = m_queue.front();
+                m_queue.pop_front();
+                m_baking.insert(chunkKey(job.first, job.second));
+            } else {
+                job = m_saves.front().first;
+                save = std::move(m_saves.front().second);
+                m_saves.pop_front();
+            }
+        }
+        if (save) {
+            saveChunk(job.first, job.second, *save);
+            continue;
+        }
+
+        std::unique_ptr<Chunk> baked = bake(job.first, job.second);
+        if (!baked->loaded && !m_params.cacheDir.empty()) {
+            saveChunk(job.first, job.second, *baked);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            uint64_t key = chunkKey(job.first, job.second);
+            m_baking.erase(key);
+            m_done.emplace_back(key, std::move(baked));
+        }
+        m_baked.notify_all();
+    }
+}
+
+void ProceduralTerrain::collect() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [key, baked] : m_done) {
+        m_pending.erase(key);
+        // the main thread may have needed it first
+        if (m_chunks.find(key) == m_chunks.end()) {
+            baked->lastUsed = m_frame;
+            m_chunks.emplace(key, std::move(baked));
+        }
+    }
+    m_done.clear();
+}
+
+ProceduralTerrain::Chunk* ProceduralTerrain::chunk(int cx, int cz) {
+    uint64_t key = chunkKey(cx, cz);
+    if (m_lastChunk != nullptr && key == m_lastKey) {
+        m_lastChunk->lastUsed = m_frame;
+        return m_lastChunk;
+    }
+
+    auto it = m_chunks.find(key);
+    if (it == m_chunks.end()) {
+        collect();
+        it = m_chunks.find(key);
+    }
+    if (it == m_chunks.end() && m_pending.find(key) != m_pending.end()) {
+        // prefetched but not ready. still queued, it's as quick to bake here as to
+        // wait, but a worker that's started on it will finish sooner than we would
+        bool queued = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto job = std::find(m_queue.begin(), m_queue.end(), std::make_pair(cx, cz));
+            if (job != m_queue.end()) {
+                m_queue.erase(job);
+                queued = true;
+            }
+            m_baked.wait(lock, [this, key] { return m_baking.find(key) == m_baking.end(); });
+        }
+        if (queued) {
+            m_pending.erase(key);
+        } else {
+            collect();
+            it = m_chunks.find(key);
+        }
+    }
+    if (it == m_chunks.end()) {
+        // not prefetched (or not ready): bake it here rather than guess a height,
+        // and leave saving it to the workers
+        std::unique_ptr<Chunk> baked = bake(cx, cz);
+        if (!baked->loaded && !m_params.cacheDir.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_saves.emplace_back(std::make_pair(cx, cz), std::make_unique<Chunk>(*baked));
+            }
+            m_wake.notify_one();
+        }
+        it = m_chunks.emplace(key, std::move(baked)).first;
+        m_bakedOnDemand++;
+    }
+    m_lastChunk = it->second.get();
+    m_lastKey = key;
+    m_lastChunk->lastUsed = m_frame;
+    return m_lastChunk;
+}
+
+float ProceduralTerrain::height(float x, float z) {
+    int n = m_params.chunkCells;
+    float gx = x / m_params.cellSize;
+    float gz = z / m_params.cellSize;
+    float fx = glm::floor(gx);
+    float fz = glm::floor(gz);
+    int cx = floorDiv((int)fx, n);
+    int cz = floorDiv((int)fz, n);
+    int i = (int)fx - cx * n;
+    int j = (int)fz - cz * n;
+    float tx = gx - fx;
+    float tz = gz - fz;
+
+    const float* h = &chunk(cx, cz)->heights[(std::size_t)j * (n + 1) + i];
+    return glm::mix(glm::mix(h[0], h[1], tx), glm::mix(h[n + 1], h[n + 2], tx), tz);
+}
+
+glm::vec3 ProceduralTerrain::normal(float x, float z) {
+    int n = m_params.chunkCells;
+    float gx = x / m_params.cellSize;
+    float gz = z / m_params.cellSize;
+    float fx = glm::floor(gx);
+    float fz = glm::floor(gz);
+    int cx = floorDiv((int)fx, n);
+    int cz = floorDiv((int)fz, n);
+    int i = (int)fx - cx * n;
+    int j = (int)fz - cz * n;
+    float tx = gx - fx;
+    float tz = gz - fz;
+
+    const glm::vec3* nrm = &chunk(cx, cz)->normals[(std::size_t)j * (n + 1) + i];
+    return glm::normalize(glm::mix(glm::mix(nrm[0], nrm[1], tx), glm::mix(nrm[n + 1], nrm[n + 2], tx), tz));
+}
+
+void ProceduralTerrain::sampleGrid(glm::vec2 origin, float spacing, int countX, int countZ, float* out) {
+    // the cell and chunk are found as height finds them, and the 4 corners
+    // placed as bake places them, one per lane, so the heights match bit for bit
+    int n = m_params.chunkCells;
+    float cellSize = m_params.cellSize;
+    for (int sj = 0; sj < countZ; sj++) {
+        for (int si = 0; si < countX; si++) {
+            float gx = (origin.x + si * spacing) / cellSize;
+            float gz = (origin.y + sj * spacing) / cellSize;
+            float fx = glm::floor(gx);
+            float fz = glm::floor(gz);
+            int cx = floorDiv((int)fx, n);
+            int cz = floorDiv((int)fz, n);
+            int i = (int)fx - cx * n;
+            int j = (int)fz - cz * n;
+            float tx = gx - fx;
+            float tz = gz - fz;
+
+            glm::vec2 chunkOrigin = glm::vec2(cx, cz) * (float)n * cellSize - cellSize;
+            glm::vec4 x = chunkOrigin.x + (glm::vec4(i + 1) + glm::vec4(0, 1, 0, 1)) * cellSize;
+            glm::vec4 z = chunkOrigin.y + (glm::vec4(j + 1) + glm::vec4(0, 0, 1, 1)) * cellSize;
+            glm::vec4 h = fbm4(x, z);
+            *out++ = glm::mix(glm::mix(h[0], h[1], tx), glm::mix(h[2], h[3], tx), tz);
+        }
+    }
+}
+
+bool ProceduralTerrain::sampleGridIsThreadSafe() const {
+    return true;
+}
+
+void ProceduralTerrain::prefetch(glm::vec2 center, float radius) {
+    collect();
+
+    float chunkSize = m_params.chunkCells * m_params.cellSize;
+    glm::ivec2 lo = glm::floor((center - radius) / chunkSize);
+    glm::ivec2 hi = glm::floor((center + radius) / chunkSize);
+
+    // keep what's already here, and queue the rest nearest first
+    m_requests.clear();
+    for (int cz = lo.y; cz <= hi.y; cz++) {
+        for (int cx = lo.x; cx <= hi.x; cx++) {
+            uint64_t key = chunkKey(cx, cz);
+            auto it = m_chunks.find(key);
+            if (it != m_chunks.end()) {
+                it->second->lastUsed = m_frame;
+            } else if (m_pending.find(key) == m_pending.end()) {
+                glm::vec2 chunkCenter = (glm::vec2(cx, cz) + 0.5f) * chunkSize;
+                m_requests.push_back({glm::distance(chunkCenter, center), cx, cz});
+            }
+        }
+    }
+    // endFrame drops what's queued outside every point prefetched around this frame
+    m_prefetchRects.push_back(glm::ivec4(lo, hi));
+    if (m_requests.empty()) {
+        return;
+    }
+    // new requests go behind what's already queued, which was asked for first
+    std::sort(m_requests.begin(), m_requests.end(),
+              [](const Request& a, const Request& b) { return a.dist < b.dist; });
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Request& request : m_requests) {
+            m_queue.emplace_back(request.cx, request.cz);
+            m_pending.insert(chunkKey(request.cx, request.cz));
+        }
+    }
+    m_wake.notify_all();
+}
+
+void ProceduralTerrain::endFrame() {
+    collect();
+
+    // chunks still queued that no prefetch this frame asked for are dropped, so the
+    // workers never fall behind baking where the camera or a spider used to be
+    if (!m_prefetchRects.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto wanted = [this](const std::pair<int, int>& job) {
+            for (const glm::ivec4& rect : m_prefetchRects) {
+                if (job.first >= rect.x && job.first <= rect.z && job.second >= rect.y && job.second <= rect.w) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        auto kept = m_queue.begin();
+        for (auto job = m_queue.begin(); job != m_queue.end(); ++job) {
+            if (wanted(*job)) {
+                *kept++ = *job;
+            } else {
+                m_pending.erase(chunkKey(job->first, job->second));
+            }
+        }
+        m_queue.erase(kept, m_queue.end());
+        m_prefetchRects.clear();
+    }
+
+    if ((int)m_chunks.size() > m_params.maxChunks) {
+        // drop the least recently used chunks, but never one used this frame
+        m_byAge.clear();
+        for (auto& [key, chunk] : m_chunks) {
+            m_byAge.push_back({chunk->lastUsed, key});
+        }
+        std::nth_element(m_byAge.begin(), m_byAge.begin() + m_params.maxChunks, m_byAge.end(),
+                         [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (std::size_t c = m_params.maxChunks; c < m_byAge.size(); c++) {
+            if (m_byAge[c].first != m_frame) {
+                m_chunks.erase(m_byAge[c].second);
+            }
+        }
+        m_lastChunk = nullptr;
+    }
+    m_frame++;
+}
+
+int ProceduralTerrain::residentChunks() const {
+    return m_chunks.size();
+}
+
+int ProceduralTerrain::pendingChunks() const {
+    return m_pending.size();
+}
+
+int ProceduralTerrain::chunksBakedOnDemand() const {
+    return m_bakedOnDemand;
+}
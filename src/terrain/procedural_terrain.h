@@ -0,0 +1,128 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "terrain/height_source.h"
+
+/**
+ * Endless floor made of fBm simplex noise. The world is split into square chunks
+ * of chunkCells x chunkCells cells, and each chunk is baked once into a grid of
+ * heights and normals which height queries interpolate bilinearly.
+ *
+ * prefetch queues the chunks around a point for worker threads to bake (or to
+ * load, if cacheDir holds them from an earlier run), nearest first, and may be
+ * called for several points a frame. endFrame drops queued chunks that none of
+ * the frame's points asked for. The results are picked up on the main thread. A query that hits a chunk nobody has baked yet bakes it
+ * right away, so heights never depend on timing, but waits for one a worker has
+ * already started rather than bake it twice, and leaves writing it to the disk
+ * cache to the workers. At most maxChunks baked chunks are kept, and endFrame
+ * drops the least recently used ones.
+ *
+ * Noise is evaluated 4 samples at a time along a row, with glm::vec4 lanes and an
+ * arithmetic hash in place of a permutation table so the loop has no gathers
+ * from memory and vectorizes.
+ *
+ * Queries are expected from the main thread only.
+ */
+class ProceduralTerrain : public HeightSource
+{
+public:
+    struct Params {
+        int seed = 1;
+        int octaves = 5;
+        float frequency = 0.05f; // of the first octave, per unit
+        float amplitude = 1.5f; // of the first octave
+        float lacunarity = 2.0f; // frequency multiplier per octave
+        float gain = 0.5f; // amplitude multiplier per octave
+        int chunkCells = 32; // cells per chunk side
+        float cellSize = 0.25f; // world distance between samples
+        int maxChunks = 256; // baked chunks kept in memory
+        int workers = 0; // baking threads, 0 for one less than the number of cores
+        std::string cacheDir = ""; // where baked chunks persist between runs, empty to not persist
+    };
+
+    ProceduralTerrain(const Params& params);
+    ~ProceduralTerrain();
+    ProceduralTerrain(const ProceduralTerrain&) = delete;
+    ProceduralTerrain& operator=(const ProceduralTerrain&) = delete;
+
+    float height(float x, float z) override;
+    glm::vec3 normal(float x, float z) override;
+    // straight from the noise at the corners of each sample's cell, so it gives
+    // what height does without touching the chunks, from any thread
+    void sampleGrid(glm::vec2 origin, float spacing, int countX, int countZ, float* out) override;
+    bool sampleGridIsThreadSafe() const override;
+    void prefetch(glm::vec2 center, float radius) override;
+    void endFrame() override;
+
+    // fBm height straight from the noise, without baking. for reference and testing
+    float noiseHeight(float x, float z) const;
+
+    int residentChunks() const;
+    int pendingChunks() const; // queued or being baked
+    int chunksBakedOnDemand() const; // misses baked on the main thread so far
+
+private:
+    struct Chunk {
+        // (chunkCells + 1)^2 samples, x fastest. edges are shared with the neighbours
+        std::vector<float> heights;
+        std::vector<glm::vec3> normals;
+        uint32_t lastUsed;
+        bool loaded; // from the disk cache, so there's no need to save it
+    };
+    struct Request {
+        float dist;
+        int cx;
+        int cz;
+    };
+
+    static uint64_t chunkKey(int cx, int cz);
+    // baked chunk at (cx, cz), baking it now if it isn't resident
+    Chunk* chunk(int cx, int cz);
+    // bakes a chunk from the noise, or loads it from the disk cache
+    std::unique_ptr<Chunk> bake(int cx, int cz) const;
+    // fBm for 4 points at once
+    glm::vec4 fbm4(glm::vec4 x, glm::vec4 z) const;
+    std::string cachePath(int cx, int cz) const;
+    bool loadChunk(int cx, int cz, Chunk& chunk) const;
+    void saveChunk(int cx, int cz, const Chunk& chunk) const;
+    // moves chunks the workers have finished into the cache
+    void collect();
+    void workerLoop();
+
+    Params m_params;
+    uint64_t m_paramsHash; // identifies chunks baked with these params on disk
+
+    // main thread state
+    std::unordered_map<uint64_t, std::unique_ptr<Chunk>> m_chunks;
+    std::unordered_set<uint64_t> m_pending; // queued and not collected yet
+    Chunk* m_lastChunk; // most recently queried, since legs query the same chunk in a row
+    uint64_t m_lastKey;
+    uint32_t m_frame;
+    int m_bakedOnDemand;
+    // scratch space, kept to avoid allocating every frame
+    std::vector<Request> m_requests;
+    std::vector<std::pair<uint32_t, uint64_t>> m_byAge;
+    // chunk rects (lo, hi) prefetched around this frame, for endFrame
+    std::vector<glm::ivec4> m_prefetchRects;
+
+    // shared with the workers
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_baked; // a worker finished a chunk
+    std::deque<std::pair<int, int>> m_queue; // chunks to bake
+    std::unordered_set<uint64_t> m_baking; // taken off the queue and not finished yet
+    std::vector<std::pair<uint64_t, std::unique_ptr<Chunk>>> m_done; // baked, not collected
+    // copies of chunks baked on the main thread, for the workers to write to the disk cache
+    std::deque<std::pair<std::pair<int, int>, std::unique_ptr<Chunk>>> m_saves;
+    bool m_stop;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,310 @@
+#include "terrain_renderer.h"
+#include "realtime.h"
+#include "utils/shaderloader.h"
+#include <string>
+
+// shader arrays are sized for this many levels
+static const int MAX_LOD_LEVELS = 8;
+// each layer's window spans this many node sizes of its level, enough for the
+// nodes out to range(level) plus their diagonal
+static const float LAYER_NODE_SPAN = 12.0f;
+
+TerrainRenderer::TerrainRenderer() {
+    m_shader = 0;
+    m_vbo = 0;
+    m_ibo = 0;
+    m_vao = 0;
+    m_heightTexture = 0;
+    m_indexCount = 0;
+    m_lodLevels = 0;
+    m_leafSize = 1.0f;
+    m_gridCells = 1;
+    m_textureSize = 1;
+    m_heightsValid = false;
+    m_terrainRevision = 0;
+    nodesLastFrame = 0;
+    trianglesLastFrame = 0;
+    texelsUpdatedLastFrame = 0;
+}
+
+void TerrainRenderer::initialize(int lodLevels, float leafSize, int gridCells, int textureSize) {
+    m_lodLevels = glm::clamp(lodLevels, 1, MAX_LOD_LEVELS);
+    m_leafSize = leafSize;
+    // even, so every odd vertex has an even neighbour to morph onto
+    m_gridCells = glm::max(2, gridCells + gridCells % 2);
+    m_textureSize = glm::max(8, textureSize);
+
+    m_shader = ShaderLoader::createShaderProgram(":/resources/shaders/terrain.vert",
+                                                 ":/resources/shaders/phong.frag");
+
+    // the shared node grid: (gridCells + 1)^2 vertices in grid coordinates
+    int n = m_gridCells;
+    std::vector<GLfloat> vertices;
+    vertices.reserve((n + 1) * (n + 1) * 2);
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            vertices.push_back(i);
+            vertices.push_back(j);
+        }
+    }
+    // counter-clockwise from above. ordered one quadrant after another, so a
+    // quarter of a node can be drawn on its own
+    std::vector<GLuint> indices;
+    indices.reserve(n * n * 6);
+    int half = n / 2;
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        int i0 = (quadrant % 2) * half;
+        int j0 = (quadrant / 2) * half;
+        for (int j = j0; j < j0 + half; j++) {
+            for (int i = i0; i < i0 + half; i++) {
+                GLuint v00 = j * (n + 1) + i;
+                GLuint v10 = v00 + 1;
+                GLuint v01 = v00 + (n + 1);
+                GLuint v11 = v01 + 1;
+                indices.insert(indices.end(), {v00, v01, v10, v10, v01, v11});
+            }
+        }
+    }
+    m_indexCount = indices.size();
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glGenBuffers(1, &m_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &m_ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), reinterpret_cast<void*>(0));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // one height layer per level. repeat wrapping does the toroidal addressing
+    glGenTextures(1, &m_heightTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_heightTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, m_textureSize, m_textureSize, m_lodLevels,
+                 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    m_layerTexelSize.resize(m_lodLevels);
+    m_layerOrigin.assign(m_lodLevels, glm::ivec2(0));
+    for (int layer = 0; layer < m_lodLevels; layer++) {
+        m_layerTexelSize[layer] = LAYER_NODE_SPAN * nodeSize(layer) / m_textureSize;
+    }
+    m_heightsValid = false;
+
+    // uniforms that never change
+    glUseProgram(m_shader);
+    glUniform1i(glGetUniformLocation(m_shader, "heights"), 0);
+    glUniform1i(glGetUniformLocation(m_shader, "numLayers"), m_lodLevels);
+    glUniform1f(glGetUniformLocation(m_shader, "textureSize"), m_textureSize);
+    glUniform1fv(glGetUniformLocation(m_shader, "layerTexelSize"), m_lodLevels, m_layerTexelSize.data());
+    glUseProgram(0);
+}
+
+void TerrainRenderer::finish() {
+    if (!isInitialized()) {
+        return;
+    }
+    glDeleteBuffers(1, &m_vbo);
+    glDeleteBuffers(1, &m_ibo);
+    glDeleteVertexArrays(1, &m_vao);
+    glDeleteTextures(1, &m_heightTexture);
+    glDeleteProgram(m_shader);
+    m_shader = 0;
+}
+
+bool TerrainRenderer::isInitialized() const {
+    return m_shader != 0;
+}
+
+GLuint TerrainRenderer::shader() const {
+    return m_shader;
+}
+
+float TerrainRenderer::nodeSize(int level) const {
+    return m_leafSize * (float)(1 << level);
+}
+
+float TerrainRenderer::range(int level) const {
+    return 4.0f * nodeSize(level);
+}
+
+/**
+ * @brief CDLOD node selection. a node in range of the next finer level is split
+ *        into its children; children out of their own range are covered by this
+ *        node's grid drawn over just that quadrant.
+ */
+bool TerrainRenderer::selectNode(glm::vec2 origin, int level, glm::vec2 cameraXZ) {
+    float size = nodeSize(level);
+    glm::vec2 closest = glm::clamp(cameraXZ, origin, origin + size);
+    float dist = glm::distance(closest, cameraXZ);
+    if (dist > range(level)) {
+        return false;
+    }
+    if (level == 0 || dist > range(level - 1)) {
+        m_nodes.push_back({origin, size, level, -1});
+        return true;
+    }
+    float half = size / 2.0f;
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        glm::vec2 childOrigin = origin + half * glm::vec2(quadrant % 2, quadrant / 2);
+        if (!selectNode(childOrigin, level - 1, cameraXZ)) {
+            m_nodes.push_back({origin, size, level, quadrant});
+        }
+    }
+    return true;
+}
+
+void TerrainRenderer::selectNodes(glm::vec2 cameraXZ) {
+    m_nodes.clear();
+
+    // the coarsest nodes tile the world. visit the ones within reach of the camera
+    int top = m_lodLevels - 1;
+    float rootSize = nodeSize(top);
+    glm::ivec2 lo = glm::floor((cameraXZ - range(top)) / rootSize);
+    glm::ivec2 hi = glm::floor((cameraXZ + range(top)) / rootSize);
+    for (int j = lo.y; j <= hi.y; j++) {
+        for (int i = lo.x; i <= hi.x; i++) {
+            selectNode(glm::vec2(i, j) * rootSize, top, cameraXZ);
+        }
+    }
+}
+
+void TerrainRenderer::fillTexels(int layer, glm::ivec2 first, glm::ivec2 count) {
+    if (count.x <= 0 || count.y <= 0) {
+        return;
+    }
+    float texelSize = m_layerTexelSize[layer];
+    m_scratch.resize((std::size_t)count.x * count.y);
+    for (int j = 0; j < count.y; j++) {
+        for (int i = 0; i < count.x; i++) {
+            m_scratch[(std::size_t)j * count.x + i] =
+                    Realtime::getFloorHeight((first.x + i) * texelSize, (first.y + j) * texelSize);
+        }
+    }
+    texelsUpdatedLastFrame += count.x * count.y;
+
+    // the block lands at first mod textureSize, split where it wraps
+    int t = m_textureSize;
+    glm::ivec2 start = ((first % t) + t) % t;
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, count.x);
+    for (int jPart = 0; jPart < count.y; ) {
+        int z = (start.y + jPart) % t;
+        int rows = glm::min(count.y - jPart, t - z);
+        for (int iPart = 0; iPart < count.x; ) {
+            int x = (start.x + iPart) % t;
+            int cols = glm::min(count.x - iPart, t - x);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, iPart);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, jPart);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, z, layer, cols, rows, 1,
+                            GL_RED, GL_FLOAT, m_scratch.data());
+            iPart += cols;
+        }
+        jPart += rows;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+}
+
+void TerrainRenderer::updateHeights(glm::vec2 cameraXZ) {
+    texelsUpdatedLastFrame = 0;
+    // a change to part of the floor only refills the texels over it
+    unsigned int revision = Realtime::getTerrainRevision();
+    bool refill = !m_heightsValid;
+    m_changedRects.clear();
+    if (revision != m_terrainRevision && !Realtime::getTerrainChanges(m_terrainRevision, m_changedRects)) {
+        refill = true;
+    }
+    m_heightsValid = true;
+    m_terrainRevision = revision;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_heightTexture);
+    int t = m_textureSize;
+    for (int layer = 0; layer < m_lodLevels; layer++) {
+        glm::ivec2 origin = glm::ivec2(glm::floor(cameraXZ / m_layerTexelSize[layer])) - t / 2;
+        glm::ivec2 old = m_layerOrigin[layer];
+        glm::ivec2 shift = origin - old;
+        m_layerOrigin[layer] = origin;
+
+        if (refill || glm::abs(shift.x) >= t || glm::abs(shift.y) >= t) {
+            fillTexels(layer, origin, glm::ivec2(t));
+            continue;
+        }
+        // columns that scrolled in, full height
+        if (shift.x > 0) {
+            fillTexels(layer, glm::ivec2(old.x + t, origin.y), glm::ivec2(shift.x, t));
+        } else if (shift.x < 0) {
+            fillTexels(layer, origin, glm::ivec2(-shift.x, t));
+        }
+        // rows that scrolled in, over the columns kept from before
+        int keptX = glm::max(origin.x, old.x);
+        int keptWidth = t - glm::abs(shift.x);
+        if (shift.y > 0) {
+            fillTexels(layer, glm::ivec2(keptX, old.y + t), glm::ivec2(keptWidth, shift.y));
+        } else if (shift.y < 0) {
+            fillTexels(layer, glm::ivec2(keptX, origin.y), glm::ivec2(keptWidth, -shift.y));
+        }
+        // texels inside the window that lie in a changed rect
+        float texelSize = m_layerTexelSize[layer];
+        for (const glm::vec4& rect : m_changedRects) {
+            glm::ivec2 lo = glm::max(glm::ivec2(glm::ceil(glm::vec2(rect.x, rect.y) / texelSize)), origin);
+            glm::ivec2 hi = glm::min(glm::ivec2(glm::floor(glm::vec2(rect.z, rect.w) / texelSize)), origin + t - 1);
+            fillTexels(layer, lo, hi - lo + 1);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TerrainRenderer::paint(Camera& camera) {
+    if (!isInitialized()) {
+        return;
+    }
+    glm::vec2 cameraXZ(camera.pos.x, camera.pos.z);
+    updateHeights(cameraXZ);
+    selectNodes(cameraXZ);
+
+    glUseProgram(m_shader);
+    Realtime::sendCameraDataToShader(m_shader, camera);
+    Realtime::sendMaterialToShader(m_shader, glm::vec4(0), glm::vec4(0.5f), glm::vec4(0.5f), 10.0f);
+    glm::vec2 layerOrigin[MAX_LOD_LEVELS];
+    for (int layer = 0; layer < m_lodLevels; layer++) {
+        layerOrigin[layer] = m_layerOrigin[layer];
+    }
+    glUniform2fv(glGetUniformLocation(m_shader, "layerOrigin"), m_lodLevels, &layerOrigin[0][0]);
+
+    GLint nodeOriginLoc = glGetUniformLocation(m_shader, "nodeOrigin");
+    GLint nodeCellSizeLoc = glGetUniformLocation(m_shader, "nodeCellSize");
+    GLint morphRangeLoc = glGetUniformLocation(m_shader, "morphRange");
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_heightTexture);
+    glBindVertexArray(m_vao);
+    int quadrantIndices = m_indexCount / 4;
+    trianglesLastFrame = 0;
+    for (const Node& node : m_nodes) {
+        glUniform2fv(nodeOriginLoc, 1, &node.origin[0]);
+        glUniform1f(nodeCellSizeLoc, node.size / m_gridCells);
+        glUniform2f(morphRangeLoc, 0.7f * range(node.level), range(node.level));
+        if (node.quadrant < 0) {
+            glDrawElements(GL_TRIANGLES, m_indexCount, GL_UNSIGNED_INT, reinterpret_cast<void*>(0));
+            trianglesLastFrame += m_indexCount / 3;
+        } else {
+            glDrawElements(GL_TRIANGLES, quadrantIndices, GL_UNSIGNED_INT,
+                           reinterpret_cast<void*>(node.quadrant * quadrantIndices * sizeof(GLuint)));
+            trianglesLastFrame += quadrantIndices / 3;
+        }
+    }
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glUseProgram(0);
+
+    nodesLastFrame = m_nodes.size();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "camera.h"
+
+/**
+ * Draws the floor (whatever Realtime::getFloorHeight returns) with continuous
+ * distance-dependent LOD, after CDLOD (Strugar, 2009).
+ *
+ * Every node is the same gridCells x gridCells grid, drawn from one shared vertex
+ * and index buffer and placed and scaled by uniforms. Nodes come from a quadtree
+ * around the camera: level 0 nodes are leafSize across and each level up doubles
+ * that, and level L is drawn out to range(L) = 4 * its node size. Where only some
+ * children of a node are in range, the node's own grid is drawn over the other
+ * quadrants (indices are grouped by quadrant for this). So the number of nodes,
+ * and the triangle count, stays about the same however large the world is, and
+ * each extra level of view distance only adds one more ring of nodes.
+ *
+ * terrain.vert displaces the grid by a stack of height textures, one layer per
+ * level, each a window of textureSize^2 samples centred on the camera with texels
+ * twice as far apart as the layer before. The windows scroll toroidally: when the
+ * camera moves only the newly uncovered rows and columns are sampled and uploaded,
+ * and when part of the floor is edited only the texels over it.
+ *
+ * Near the end of its range each level's odd vertices slide onto the grid of the
+ * next level, so they coincide exactly where two levels meet and there are no
+ * cracks or T-junctions to stitch. The morph starts at 0.7 * range(L), which with
+ * ranges at 4 node sizes keeps the coarser side unmorphed along every seam.
+ */
+class TerrainRenderer
+{
+public:
+    TerrainRenderer();
+
+    // creates the shader, grid and height textures. needs a current GL context
+    void initialize(int lodLevels, float leafSize, int gridCells, int textureSize);
+    // deletes GL objects
+    void finish();
+    bool isInitialized() const;
+
+    GLuint shader() const;
+
+    // selects nodes around the camera, refreshes heights and draws. expects the
+    // shader's light and global uniforms to be sent already
+    void paint(Camera& camera);
+
+    int nodesLastFrame;
+    int trianglesLastFrame;
+    int texelsUpdatedLastFrame;
+
+private:
+    struct Node {
+        glm::vec2 origin; // world xz of the corner
+        float size;
+        int level;
+        int quadrant; // only this quarter of the node is drawn, or -1 for all of it
+    };
+
+    // distance out to which level is drawn
+    float range(int level) const;
+    float nodeSize(int level) const;
+
+    // appends the nodes needed to cover a node of the given level, returning
+    // false if the node is out of range entirely
+    bool selectNode(glm::vec2 origin, int level, glm::vec2 cameraXZ);
+    void selectNodes(glm::vec2 cameraXZ);
+
+    // scrolls every layer's window to the camera, sampling what's newly in view
+    void updateHeights(glm::vec2 cameraXZ);
+    // samples a count.x x count.y block of world texels starting at first and
+    // uploads it, wrapping around the edges of the layer
+    void fillTexels(int layer, glm::ivec2 first, glm::ivec2 count);
+
+    GLuint m_shader;
+    GLuint m_vbo;
+    GLuint m_ibo;
+    GLuint m_vao;
+    GLuint m_heightTexture;
+    int m_indexCount;
+
+    int m_lodLevels;
+    float m_leafSize;
+    int m_gridCells;
+    int m_textureSize;
+
+    // per layer: distance between texels, and the world texel at the window's corner
+    std::vector<float> m_layerTexelSize;
+    std::vector<glm::ivec2> m_layerOrigin;
+    bool m_heightsValid;
+    unsigned int m_terrainRevision;
+    std::vector<glm::vec4> m_changedRects; // parts of the floor changed since the last frame
+
+    std::vector<Node> m_nodes; // selected this frame
+    std::vector<float> m_scratch; // samples waiting to be uploaded
+};
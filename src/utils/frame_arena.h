@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A bump allocator for data that only lives until the end of the frame: draw
+ * lists, job payloads, per-thread query results and the like. Each thread has
+ * its own (local()), so workers allocate without locking, and allocating is a
+ * pointer bump in one block.
+ *
+ * beginFrame, called once per frame by Realtime, resets every thread's arena (each
+ * one the next time it's used), so nothing allocated from an arena may be kept
+ * past the frame it was allocated in. Freeing only gives memory back if it was the
+ * last thing allocated (a vector growing in place, say); the rest is reclaimed all
+ * at once at the reset.
+ *
+ * A frame that needs more than the block holds spills into extra blocks from the
+ * heap, and the next reset swaps them all for one block big enough for that
+ * frame. Once the arena has seen its busiest frame it never touches the heap.
+ *
+ * An arena is made (one heap block) the first time a thread uses it, so it pays
+ * off on threads that live across frames. A worker started for one frame should
+ * use scratch its caller keeps instead.
+ *
+ * FrameAllocator plugs an arena into the standard containers (FrameVector,
+ * FrameString).
+ */
+class FrameArena
+{
+public:
+    static constexpr std::size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+    // the calling thread's arena
+    static FrameArena& local();
+    // starts a new frame, invalidating everything allocated from any arena
+    static void beginFrame();
+    // frames begun so far
+    static uint64_t frame();
+
+    void* allocate(std::size_t bytes, std::size_t alignment);
+    // gives the memory back if it's the latest allocation, otherwise leaves it to the reset
+    void deallocate(void* p, std::size_t bytes);
+
+    std::size_t used() const; // bytes handed out this frame
+    std::size_t highWater() const; // most bytes handed out in one frame
+
+private:
+    FrameArena();
+    // starts over in one block, as big as the busiest frame needed
+    void reset();
+
+    std::unique_ptr<char[]> m_block;
+    std::size_t m_blockSize;
+    char* m_start; // the block being allocated from: m_block, or the latest spill
+    char* m_top; // next free byte in it
+    char* m_end;
+    std::vector<std::unique_ptr<char[]>> m_spills; // extra blocks this frame
+    std::size_t m_spilledBytes; // handed out from full blocks this frame
+    std::size_t m_highWater;
+    uint64_t m_frame; // frame the arena was last reset for
+};
+
+// std allocator handing out memory from the calling thread's FrameArena
+template <class T>
+struct FrameAllocator {
+    using value_type = T;
+
+    FrameAllocator() = default;
+    template <class U>
+    FrameAllocator(const FrameAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(FrameArena::local().allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, std::size_t n) {
+        FrameArena::local().deallocate(p, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const FrameAllocator<U>&) const { return true; }
+};
+
+template <class T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+using FrameString = std::basic_string<char, std::char_traits<char>, FrameAllocator<char>>;
+
+/**
+ * Counts the heap allocations (operator new) the calling thread makes from
+ * construction to end(), and reports them on stderr once the first
+ * WARMUP_FRAMES frames (while scratch buffers grow to size) are over. Realtime
+ * wraps each tick and paint in one, so anything allocating every frame shows
+ * up. Only built with -DFRAME_ALLOC_CHECK (the CMake option of the same name),
+ * which replaces the global operator new; otherwise it does nothing.
+ */
+class FrameAllocCheck
+{
+public:
+    static constexpr uint64_t WARMUP_FRAMES = 120;
+
+#ifdef FRAME_ALLOC_CHECK
+    explicit FrameAllocCheck(const char* what);
+    ~FrameAllocCheck();
+    // stops counting and reports
+    void end();
+
+private:
+    const char* m_what;
+    bool m_ended;
+#else
+    explicit FrameAllocCheck(const char*) {}
+    void end() {}
+#endif
+};
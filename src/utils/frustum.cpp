@@ -0,0 +1,50 @@
+#include "frustum.h"
+
+Frustum Frustum::fromMatrix(const glm::mat4& projView) {
+    // glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    auto row = [&](int i) {
+        return glm::vec4(projView[0][i], projView[1][i], projView[2][i], projView[3][i]);
+    };
+    Frustum frustum;
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(3) + row(2);
+    frustum.planes[5] = row(3) - row(2);
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::containsSphere(glm::vec3 center, float radius) const {
+    for (const glm::vec4& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int Frustum::cullSpheres(const float* x, const float* y, const float* z, const float* r,
+                         int count, uint8_t* visible) const {
+    for (int i = 0; i < count; i++) {
+        visible[i] = 1;
+    }
+    // a plane at a time over every sphere, with no branches, so each pass vectorizes
+    for (const glm::vec4& plane : planes) {
+        float a = plane.x;
+        float b = plane.y;
+        float c = plane.z;
+        float d = plane.w;
+        for (int i = 0; i < count; i++) {
+            visible[i] &= (uint8_t)(a * x[i] + b * y[i] + c * z[i] + d >= -r[i]);
+        }
+    }
+    int inside = 0;
+    for (int i = 0; i < count; i++) {
+        inside += visible[i];
+    }
+    return inside;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/**
+ * The six planes bounding what a camera sees, for throwing away things that
+ * can't be on screen before building their draws.
+ *
+ * The planes come straight out of projection * view (Gribb & Hartmann, 2001):
+ * each is the last row of the matrix plus or minus one of the others, so they're
+ * in world space and no inverse is needed. They're normalized, pointing in, so
+ * dot(plane, (p, 1)) is the signed distance of p inside the plane.
+ *
+ * Tests are conservative: a sphere crossing a corner outside two planes but
+ * inside each is kept. cullSpheres tests a whole array of spheres, laid out a
+ * component per array so the loop over them vectorizes (4 or 8 spheres a plane
+ * at a time, with SSE or AVX enabled); checking one at a time with
+ * containsSphere is the same test.
+ */
+struct Frustum {
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    // the frustum of projView = camera.projMatrix() * camera.viewMatrix()
+    static Frustum fromMatrix(const glm::mat4& projView);
+
+    bool containsSphere(glm::vec3 center, float radius) const;
+    // sets visible[i] to 1 if sphere i (centre (x, y, z)[i], radius r[i]) is at
+    // least partly inside, 0 if it's all outside. returns the number inside
+    int cullSpheres(const float* x, const float* y, const float* z, const float* r,
+                    int count, uint8_t* visible) const;
+};
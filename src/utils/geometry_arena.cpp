@@ -0,0 +1,240 @@
+#include "geometry_arena.h"
+#include "mesh_optimizer.h"
+#include "glm/gtx/transform.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+GeometryArena::GeometryArena() {
+    m_vertexCount = 0;
+    m_indexCount = 0;
+    m_cacheMissesAdded = 0;
+    m_cacheMisses = 0;
+    m_packed = false;
+    m_vbo = 0;
+    m_ibo = 0;
+    m_vao = 0;
+}
+
+// a float in [-1, 1] as a snorm16
+static GLshort toSnorm16(float value) {
+    return (GLshort)std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f);
+}
+
+// a unit vector folded onto the octahedron |x| + |y| + |z| = 1 and flattened
+// into the square [-1, 1]^2, the lower half unfolded into the corners.
+// phong.vert's octahedralDecode undoes it
+static glm::vec2 octahedralEncode(glm::vec3 normal) {
+    float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (sum == 0.0f) {
+        return glm::vec2(0.0f);
+    }
+    normal /= sum;
+    if (normal.z >= 0.0f) {
+        return glm::vec2(normal.x, normal.y);
+    }
+    glm::vec2 sign(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+    return (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) * sign;
+}
+
+int GeometryArena::newGroup() {
+    m_groupMin.push_back(glm::vec3(std::numeric_limits<float>::max()));
+    m_groupMax.push_back(glm::vec3(-std::numeric_limits<float>::max()));
+    return m_groupMin.size() - 1;
+}
+
+GeometryArena::Mesh GeometryArena::add(const std::vector<float>& triangles, int floatsPerVertex, int group) {
+    if (group < 0) {
+        group = newGroup();
+    }
+    Mesh mesh = {this, m_vertexCount, m_indexCount, 0, group};
+    // welded by the bytes of the vertex, so only corners that are exactly the same merge
+    std::unordered_map<std::string_view, GLuint> welded;
+    std::size_t first = m_vertices.size();
+    std::size_t firstIndex = m_indices.size();
+    std::size_t corners = triangles.size() / floatsPerVertex;
+    welded.reserve(corners);
+    for (std::size_t c = 0; c < corners; c++) {
+        float vertex[VERTEX_FLOATS] = {0, 0, 0, 0, 0, 0, 0};
+        std::memcpy(vertex, &triangles[c * floatsPerVertex], floatsPerVertex * sizeof(float));
+        // keys point into triangles, which outlives the map
+        std::string_view key(reinterpret_cast<const char*>(&triangles[c * floatsPerVertex]),
+                             floatsPerVertex * sizeof(float));
+        auto [it, added] = welded.try_emplace(key, (GLuint)((m_vertices.size() - first) / VERTEX_FLOATS));
+        if (added) {
+            m_vertices.insert(m_vertices.end(), vertex, vertex + VERTEX_FLOATS);
+            m_vertexGroups.push_back(group);
+            glm::vec3 position(vertex[0], vertex[1], vertex[2]);
+            m_groupMin[group] = glm::min(m_groupMin[group], position);
+            m_groupMax[group] = glm::max(m_groupMax[group], position);
+        }
+        m_indices.push_back(it->second);
+    }
+
+    // reorder for the vertex cache, overdraw and fetches. the vertices all share
+    // a group, so m_vertexGroups doesn't need reordering with them
+    std::size_t vertexCount = (m_vertices.size() - first) / VERTEX_FLOATS;
+    GLuint* indices = &m_indices[firstIndex];
+    m_cacheMissesAdded += MeshOptimizer::cacheMisses(indices, corners, vertexCount);
+    MeshOptimizer::optimizeVertexCache(indices, corners, vertexCount);
+    MeshOptimizer::optimizeOverdraw(indices, corners, &m_vertices[first], vertexCount, VERTEX_FLOATS);
+    MeshOptimizer::optimizeVertexFetch(indices, corners, &m_vertices[first], vertexCount, VERTEX_FLOATS);
+    m_cacheMisses += MeshOptimizer::cacheMisses(indices, corners, vertexCount);
+
+    mesh.indexCount = corners;
+    m_vertexCount += vertexCount;
+    m_indexCount += corners;
+    return mesh;
+}
+
+void GeometryArena::upload(bool packed) {
+    m_packed = packed;
+    if (m_vao == 0) {
+        glGenBuffers(1, &m_vbo);
+        glGenBuffers(1, &m_ibo);
+        glGenVertexArrays(1, &m_vao);
+    }
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    if (packed) {
+        // each group's box, from the corner at -1 to the one at 1
+        m_dequantization.assign(m_groupMin.size(), glm::mat4(1.0f));
+        std::vector<glm::vec3> centers(m_groupMin.size(), glm::vec3(0.0f));
+        std::vector<glm::vec3> halfExtents(m_groupMin.size(), glm::vec3(1.0f));
+        for (std::size_t g = 0; g < m_groupMin.size(); g++) {
+            if (m_groupMin[g].x > m_groupMax[g].x) {
+                continue; // no vertices
+            }
+            centers[g] = 0.5f * (m_groupMin[g] + m_groupMax[g]);
+            // flat boxes keep some thickness, so positions can be divided by it
+            halfExtents[g] = glm::max(0.5f * (m_groupMax[g] - m_groupMin[g]), glm::vec3(1e-6f));
+            m_dequantization[g] = glm::translate(centers[g]) * glm::scale(halfExtents[g]);
+        }
+
+        std::vector<PackedVertex> vertices(m_vertices.size() / VERTEX_FLOATS);
+        for (std::size_t v = 0; v < vertices.size(); v++) {
+            const float* vertex = &m_vertices[v * VERTEX_FLOATS];
+            int group = m_vertexGroups[v];
+            glm::vec3 position = (glm::vec3(vertex[0], vertex[1], vertex[2]) - centers[group]) / halfExtents[group];
+            glm::vec2 normal = octahedralEncode(glm::vec3(vertex[3], vertex[4], vertex[5]));
+            vertices[v].position[0] = toSnorm16(position.x);
+            vertices[v].position[1] = toSnorm16(position.y);
+            vertices[v].position[2] = toSnorm16(position.z);
+            // in steps of 1/8, so it rounds back the same under either of GL's
+            // snorm conversions (c / 32767, or (2c + 1) / 65535 before GL 4.2)
+            vertices[v].position[3] = (GLshort)(std::lround(vertex[6]) * 4096);
+            vertices[v].normal[0] = toSnorm16(normal.x);
+            vertices[v].normal[1] = toSnorm16(normal.y);
+        }
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_STATIC_DRAW);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(GLfloat), m_vertices.data(), GL_STATIC_DRAW);
+    }
+    // the element buffer binding is part of the VAO's state
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(GLuint), m_indices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0); // position (and material index, packed)
+    glEnableVertexAttribArray(1); // normal
+    if (packed) {
+        glDisableVertexAttribArray(2);
+        glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                              reinterpret_cast<void*>(offsetof(PackedVertex, position)));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                              reinterpret_cast<void*>(offsetof(PackedVertex, normal)));
+    } else {
+        glEnableVertexAttribArray(2); // material index
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(GLfloat),
+                              reinterpret_cast<void*>(0));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(GLfloat),
+                              reinterpret_cast<void*>(3 * sizeof(GLfloat)));
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(GLfloat),
+                              reinterpret_cast<void*>(6 * sizeof(GLfloat)));
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    std::vector<float>().swap(m_vertices);
+    std::vector<GLuint>().swap(m_indices);
+    std::vector<int>().swap(m_vertexGroups);
+}
+
+void GeometryArena::finish() {
+    if (isInitialized()) {
+        glDeleteBuffers(1, &m_vbo);
+        glDeleteBuffers(1, &m_ibo);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+    m_vbo = 0;
+    m_ibo = 0;
+    m_vao = 0;
+    std::vector<float>().swap(m_vertices);
+    std::vector<GLuint>().swap(m_indices);
+    std::vector<int>().swap(m_vertexGroups);
+    m_groupMin.clear();
+    m_groupMax.clear();
+    m_dequantization.clear();
+    m_vertexCount = 0;
+    m_indexCount = 0;
+    m_cacheMissesAdded = 0;
+    m_cacheMisses = 0;
+    m_packed = false;
+}
+
+bool GeometryArena::isInitialized() const {
+    return m_vao != 0;
+}
+
+GLuint GeometryArena::vao() const {
+    return m_vao;
+}
+
+int GeometryArena::vertexCount() const {
+    return m_vertexCount;
+}
+
+int GeometryArena::indexCount() const {
+    return m_indexCount;
+}
+
+std::size_t GeometryArena::cacheMissesAdded() const {
+    return m_cacheMissesAdded;
+}
+
+std::size_t GeometryArena::cacheMisses() const {
+    return m_cacheMisses;
+}
+
+bool GeometryArena::packed() const {
+    return m_packed;
+}
+
+std::size_t GeometryArena::vertexBytes() const {
+    return m_vertexCount * (m_packed ? sizeof(PackedVertex) : VERTEX_FLOATS * sizeof(GLfloat));
+}
+
+const glm::mat4& GeometryArena::dequantization(const Mesh& mesh) const {
+    static const glm::mat4 identity(1.0f);
+    return m_packed ? m_dequantization[mesh.group] : identity;
+}
+
+void GeometryArena::draw(const Mesh& mesh) {
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT,
+                             reinterpret_cast<void*>(mesh.firstIndex * sizeof(GLuint)), mesh.baseVertex);
+}
+
+void GeometryArena::drawMany(const Mesh* meshes, int count) const {
+    m_counts.resize(count);
+    m_offsets.resize(count);
+    m_baseVertices.resize(count);
+    for (int i = 0; i < count; i++) {
+        m_counts[i] = meshes[i].indexCount;
+        m_offsets[i] = reinterpret_cast<const void*>(meshes[i].firstIndex * sizeof(GLuint));
+        m_baseVertices[i] = meshes[i].baseVertex;
+    }
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_counts.data(), GL_UNSIGNED_INT,
+                                  m_offsets.data(), count, m_baseVertices.data());
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * One vertex buffer, one index buffer and one VAO holding every mesh the phong
+ * shader draws: the primitive shapes, merged meshes (utils/merged_mesh.h) and
+ * the props baked into world space. Switching meshes is then only a change of
+ * offsets, never of VAO, and meshes drawn with the same uniforms go out in a
+ * single glMultiDrawElementsBaseVertex.
+ *
+ * Meshes are added as triangle soups (as the Shapes:: functions and MergedMesh
+ * build them) and welded: corners with the same position, normal and material
+ * index become one vertex. Each mesh's indices count from its own first vertex,
+ * which the draw adds back as the base vertex. Welded meshes are reordered for
+ * the vertex cache, overdraw and vertex fetches (utils/mesh_optimizer.h).
+ *
+ * Everything is added first and uploaded once; meshes added before upload can
+ * be handed around straight away, since they only hold offsets.
+ *
+ * Uploaded packed, a vertex takes 12 bytes instead of 28: the position as
+ * three snorm16s, quantized to a box around its mesh, with the material index
+ * in a fourth, and the normal octahedral-encoded in two more snorm16s.
+ * phong.vert decodes them when its packedVertices uniform is set. Positions
+ * come out in [-1, 1] across the box; dequantization(mesh) maps them back, and
+ * goes into the model matrix, so the box costs nothing to undo. Meshes drawn
+ * together by drawMany share one model matrix, so they have to be added to the
+ * same group (newGroup), whose box is around all of them.
+ */
+class GeometryArena
+{
+public:
+    // position, normal and material index (see MergedMesh)
+    static constexpr int VERTEX_FLOATS = 7;
+
+    // where a mesh is in the arena
+    struct Mesh {
+        const GeometryArena* arena;
+        GLint baseVertex;
+        GLsizei firstIndex;
+        GLsizei indexCount;
+        int group; // quantization box (see newGroup)
+    };
+
+    GeometryArena();
+
+    // adds triangles whose vertices are floatsPerVertex floats each: 6 (position
+    // and normal, as Shapes:: fills buffers), which get material 0, or VERTEX_FLOATS.
+    // quantized to a box of their own unless a group is given
+    Mesh add(const std::vector<float>& triangles, int floatsPerVertex = 6, int group = -1);
+    // a quantization box to add meshes to that are drawn with the same model matrix
+    int newGroup();
+
+    // uploads what's been added so far and frees it, packed or as floats. needs a
+    // current GL context
+    void upload(bool packed);
+    // deletes GL objects and forgets every mesh
+    void finish();
+    bool isInitialized() const;
+
+    GLuint vao() const;
+    int vertexCount() const;
+    int indexCount() const;
+    // post-transform cache misses drawing every mesh added, in the order they
+    // came and in the order they were reordered to (see MeshOptimizer::cacheMisses)
+    std::size_t cacheMissesAdded() const;
+    std::size_t cacheMisses() const;
+    bool packed() const;
+    // bytes of vertex data uploaded
+    std::size_t vertexBytes() const;
+    // to multiply a mesh's model matrix by: maps its quantized positions back to
+    // where they were added. identity unless packed
+    const glm::mat4& dequantization(const Mesh& mesh) const;
+
+    // draws a mesh. expects the arena's VAO and the shader to be bound
+    static void draw(const Mesh& mesh);
+    // draws meshes of this arena in one call, all with the uniforms already sent.
+    // expects the VAO and the shader to be bound
+    void drawMany(const Mesh* meshes, int count) const;
+
+private:
+    // a packed vertex: position and material index, then the octahedral normal
+    struct PackedVertex {
+        GLshort position[4];
+        GLshort normal[2];
+    };
+
+    std::vector<float> m_vertices; // until uploaded
+    std::vector<GLuint> m_indices;
+    std::vector<int> m_vertexGroups; // group of each vertex, until uploaded
+    std::vector<glm::vec3> m_groupMin; // box around each group's vertices
+    std::vector<glm::vec3> m_groupMax;
+    std::vector<glm::mat4> m_dequantization; // per group, once uploaded packed
+    int m_vertexCount;
+    int m_indexCount;
+    std::size_t m_cacheMissesAdded;
+    std::size_t m_cacheMisses;
+    bool m_packed;
+
+    // scratch for drawMany
+    mutable std::vector<GLsizei> m_counts;
+    mutable std::vector<const void*> m_offsets;
+    mutable std::vector<GLint> m_baseVertices;
+
+    GLuint m_vbo;
+    GLuint m_ibo;
+    GLuint m_vao;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * Reading and writing the fixed-width fields of the binary files (rigs, tiled
+ * heightmaps) one byte at a time, little-endian whatever the host is, so a file
+ * reads the same everywhere. Floats go as their IEEE bits. The get functions
+ * advance in past the field they read.
+ */
+namespace LittleEndian {
+    inline void putU16(std::string& out, uint16_t value) {
+        out.push_back((char)value);
+        out.push_back((char)(value >> 8));
+    }
+
+    inline void putU32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            out.push_back((char)(value >> (8 * i)));
+        }
+    }
+
+    inline void putU64(std::string& out, uint64_t value) {
+        putU32(out, (uint32_t)value);
+        putU32(out, (uint32_t)(value >> 32));
+    }
+
+    inline void putF32(std::string& out, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, 4);
+        putU32(out, bits);
+    }
+
+    // no advance, for reading samples in place
+    inline uint16_t readU16(const unsigned char* in) {
+        return (uint16_t)(in[0] | (in[1] << 8));
+    }
+
+    inline uint32_t getU32(const char*& in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++) {
+            value |= (uint32_t)(uint8_t)in[i] << (8 * i);
+        }
+        in += 4;
+        return value;
+    }
+
+    inline uint64_t getU64(const char*& in) {
+        uint64_t low = getU32(in);
+        return low | (uint64_t)getU32(in) << 32;
+    }
+
+    inline float getF32(const char*& in) {
+        uint32_t bits = getU32(in);
+        float value;
+        std::memcpy(&value, &bits, 4);
+        return value;
+    }
+}
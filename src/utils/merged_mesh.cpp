@@ -0,0 +1,71 @@
+#include "merged_mesh.h"
+#include <limits>
+
+// floats a vertex: position, normal and material index
+static const int VERTEX_FLOATS = GeometryArena::VERTEX_FLOATS;
+
+MergedMesh::MergedMesh() {
+    clear();
+}
+
+int MergedMesh::addMaterial(const SceneMaterial& material) {
+    if ((int)m_materials.size() == MAX_MATERIALS) {
+        return -1;
+    }
+    m_materials.push_back({material.cAmbient, material.cDiffuse, material.cSpecular, material.shininess});
+    return m_materials.size() - 1;
+}
+
+void MergedMesh::addVertex(glm::vec3 position, glm::vec3 normal, int material) {
+    m_vertices.insert(m_vertices.end(), {position.x, position.y, position.z,
+                                         normal.x, normal.y, normal.z, (float)material});
+    m_min = glm::min(m_min, position);
+    m_max = glm::max(m_max, position);
+}
+
+void MergedMesh::addShape(const std::vector<float>& buffer, const glm::mat4& model, int material) {
+    glm::mat3 normModel = glm::inverse(glm::transpose(glm::mat3(model)));
+    for (std::size_t i = 0; i + 5 < buffer.size(); i += 6) {
+        glm::vec3 position(buffer[i], buffer[i + 1], buffer[i + 2]);
+        glm::vec3 normal(buffer[i + 3], buffer[i + 4], buffer[i + 5]);
+        addVertex(glm::vec3(model * glm::vec4(position, 1.0f)), glm::normalize(normModel * normal), material);
+    }
+}
+
+void MergedMesh::addTriangles(const std::vector<glm::vec3>& corners, int material) {
+    for (std::size_t c = 0; c + 2 < corners.size(); c += 3) {
+        glm::vec3 normal = glm::normalize(glm::cross(corners[c + 1] - corners[c], corners[c + 2] - corners[c]));
+        for (int k = 0; k < 3; k++) {
+            addVertex(corners[c + k], normal, material);
+        }
+    }
+}
+
+void MergedMesh::addTo(GeometryArena& arena, int group) {
+    m_mesh = arena.add(m_vertices, VERTEX_FLOATS, group);
+    std::vector<float>().swap(m_vertices);
+}
+
+void MergedMesh::clear() {
+    std::vector<float>().swap(m_vertices);
+    m_materials.clear();
+    m_min = glm::vec3(std::numeric_limits<float>::max());
+    m_max = glm::vec3(-std::numeric_limits<float>::max());
+    m_mesh = {nullptr, 0, 0, 0, 0};
+}
+
+const GeometryArena::Mesh& MergedMesh::mesh() const {
+    return m_mesh;
+}
+
+const std::vector<MergedMesh::Material>& MergedMesh::materials() const {
+    return m_materials;
+}
+
+glm::vec3 MergedMesh::boundsCenter() const {
+    return 0.5f * (m_min + m_max);
+}
+
+float MergedMesh::boundsRadius() const {
+    return m_max.x >= m_min.x ? 0.5f * glm::length(m_max - m_min) : 0.0f;
+}
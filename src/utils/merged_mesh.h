@@ -0,0 +1,70 @@
+#pragma once
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "utils/scenedata.h"
+#include "utils/geometry_arena.h"
+
+/**
+ * Shapes that never move relative to each other, baked into one mesh of the
+ * geometry arena so they take a single draw (Realtime::paintMergedMesh) instead
+ * of one each.
+ *
+ * Parts are added with their model matrix, which is applied to their vertices
+ * and normals there and then, and the index of their material. Vertices keep the
+ * shapes' position and normal and gain the material index, which phong.vert
+ * passes on to pick from the objMaterials uniform array in phong.frag. The
+ * arena gives shapes painted on their own material 0.
+ *
+ * Used for the spider body and eyes (Spider::buildBodyMesh) and the static
+ * scenery: the flat floor, the bump and the ramp onto it.
+ */
+class MergedMesh
+{
+public:
+    static constexpr int MAX_MATERIALS = 8; // size of objMaterials in phong.frag
+
+    struct Material {
+        glm::vec4 cAmbient;
+        glm::vec4 cDiffuse;
+        glm::vec4 cSpecular;
+        float shininess;
+    };
+
+    MergedMesh();
+
+    // returns the index to add parts with, or -1 past MAX_MATERIALS
+    int addMaterial(const SceneMaterial& material);
+    // adds a shape's triangles (6 floats a vertex, as Shapes:: fills buffers),
+    // transformed by model
+    void addShape(const std::vector<float>& buffer, const glm::mat4& model, int material);
+    // adds triangles, three corners each, with flat normals
+    void addTriangles(const std::vector<glm::vec3>& corners, int material);
+
+    // adds the parts to arena as one mesh and frees them. quantized with the
+    // group's other meshes if one is given (see GeometryArena::newGroup)
+    void addTo(GeometryArena& arena, int group = -1);
+    // forgets parts, materials and the mesh
+    void clear();
+
+    // where addTo put the parts. empty (indexCount 0) until then
+    const GeometryArena::Mesh& mesh() const;
+    const std::vector<Material>& materials() const;
+    // sphere around every part, in the space they were added in
+    glm::vec3 boundsCenter() const;
+    float boundsRadius() const;
+
+private:
+    void addVertex(glm::vec3 position, glm::vec3 normal, int material);
+
+    std::vector<float> m_vertices; // as the arena lays them out, until added to it
+    std::vector<Material> m_materials;
+    glm::vec3 m_min;
+    glm::vec3 m_max;
+    GeometryArena::Mesh m_mesh;
+};
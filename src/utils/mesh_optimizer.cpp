@@ -0,0 +1,311 @@
+#include "mesh_optimizer.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Forsyth's scoring, with the constants from his write-up: a modelled LRU cache
+// of 32, the last triangle's vertices scored a little lower than the ones just
+// before them (they were just used, so they'll still be cached after the next
+// one), and a boost for vertices with few triangles left
+const int CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// clusters for optimizeOverdraw are at least this many triangles
+const std::size_t MIN_CLUSTER_TRIANGLES = 8;
+
+float vertexScore(int cachePosition, unsigned remaining) {
+    if (remaining == 0) {
+        return -1.0f; // nothing left to draw with it
+    }
+    float score = 0.0f;
+    if (cachePosition >= 3) {
+        float fade = 1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3);
+        score = std::pow(fade, CACHE_DECAY_POWER);
+    } else if (cachePosition >= 0) {
+        score = LAST_TRIANGLE_SCORE;
+    }
+    return score + VALENCE_BOOST_SCALE * std::pow((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+// a FIFO cache kept as the time each vertex went in: a vertex is cached while
+// fewer than FIFO_SIZE others have gone in since. moving time on by more than
+// that empties it
+struct FifoCache {
+    std::vector<std::size_t> timestamps;
+    std::size_t time;
+
+    explicit FifoCache(std::size_t vertexCount)
+        : timestamps(vertexCount, 0), time(MeshOptimizer::FIFO_SIZE + 1) {}
+
+    // whether drawing with the vertex missed, which puts it in
+    bool miss(GLuint vertex) {
+        if (time - timestamps[vertex] <= (std::size_t)MeshOptimizer::FIFO_SIZE) {
+            return false;
+        }
+        timestamps[vertex] = time++;
+        return true;
+    }
+
+    void clear() {
+        time += MeshOptimizer::FIFO_SIZE + 1;
+    }
+};
+
+int triangleMisses(FifoCache& cache, const GLuint* triangle) {
+    return cache.miss(triangle[0]) + cache.miss(triangle[1]) + cache.miss(triangle[2]);
+}
+
+}
+
+void MeshOptimizer::optimizeVertexCache(GLuint* indices, std::size_t indexCount, std::size_t vertexCount) {
+    std::size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // the triangles left to draw with each vertex: remaining[v] of them, from
+    // adjacency[firstAdjacent[v]]. drawn triangles are swapped out of the range
+    std::vector<unsigned> remaining(vertexCount, 0);
+    for (std::size_t i = 0; i < triangleCount * 3; i++) {
+        remaining[indices[i]]++;
+    }
+    std::vector<std::size_t> firstAdjacent(vertexCount + 1, 0);
+    for (std::size_t v = 0; v < vertexCount; v++) {
+        firstAdjacent[v + 1] = firstAdjacent[v] + remaining[v];
+    }
+    std::vector<unsigned> adjacency(triangleCount * 3);
+    std::vector<std::size_t> filled(firstAdjacent.begin(), firstAdjacent.end() - 1);
+    for (std::size_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[filled[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (std::size_t v = 0; v < vertexCount; v++) {
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    for (std::size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+    }
+
+    std::vector<char> drawn(triangleCount, 0);
+    std::vector<GLuint> ordered;
+    ordered.reserve(triangleCount * 3);
+    int cache[CACHE_SIZE + 3];
+    int cached = 0;
+    std::size_t nextUndrawn = 0;
+    long bestTriangle = -1;
+    while (ordered.size() < triangleCount * 3) {
+        if (bestTriangle < 0) {
+            // nothing in the cache has triangles left: start again from the
+            // first undrawn triangle, as the mesh came
+            while (drawn[nextUndrawn]) {
+                nextUndrawn++;
+            }
+            bestTriangle = nextUndrawn;
+        }
+
+        const GLuint* triangle = &indices[3 * bestTriangle];
+        drawn[bestTriangle] = 1;
+        ordered.insert(ordered.end(), triangle, triangle + 3);
+        for (int k = 0; k < 3; k++) {
+            GLuint v = triangle[k];
+            std::size_t first = firstAdjacent[v];
+            std::size_t last = first + remaining[v] - 1;
+            for (std::size_t a = first; a <= last; a++) {
+                if (adjacency[a] == (unsigned)bestTriangle) {
+                    std::swap(adjacency[a], adjacency[last]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // the triangle's vertices go to the front of the cache, pushing the rest back
+        int newCache[CACHE_SIZE + 3];
+        int newCached = 0;
+        for (int k = 0; k < 3; k++) {
+            newCache[newCached++] = triangle[k];
+        }
+        for (int i = 0; i < cached; i++) {
+            if (cache[i] != (int)triangle[0] && cache[i] != (int)triangle[1] && cache[i] != (int)triangle[2]) {
+                newCache[newCached++] = cache[i];
+            }
+        }
+
+        // rescore what moved, including what fell out the back
+        for (int i = 0; i < newCached; i++) {
+            GLuint v = newCache[i];
+            cachePosition[v] = i < CACHE_SIZE ? i : -1;
+            float newScore = vertexScore(cachePosition[v], remaining[v]);
+            float change = newScore - score[v];
+            score[v] = newScore;
+            for (std::size_t a = firstAdjacent[v]; a < firstAdjacent[v] + remaining[v]; a++) {
+                triangleScore[adjacency[a]] += change;
+            }
+        }
+        cached = std::min(newCached, CACHE_SIZE);
+        std::copy(newCache, newCache + cached, cache);
+
+        // next is the best triangle of a cached vertex
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (int i = 0; i < cached; i++) {
+            GLuint v = cache[i];
+            for (std::size_t a = firstAdjacent[v]; a < firstAdjacent[v] + remaining[v]; a++) {
+                if (triangleScore[adjacency[a]] > bestScore) {
+                    bestScore = triangleScore[adjacency[a]];
+                    bestTriangle = adjacency[a];
+                }
+            }
+        }
+    }
+    std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+void MeshOptimizer::optimizeOverdraw(GLuint* indices, std::size_t indexCount,
+                                     const float* vertices, std::size_t vertexCount, int stride,
+                                     float threshold) {
+    std::size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2 * MIN_CLUSTER_TRIANGLES) {
+        return;
+    }
+
+    // the misses drawing the mesh as it came, up to each triangle
+    std::vector<std::size_t> missesBefore(triangleCount + 1, 0);
+    FifoCache cache(vertexCount);
+    for (std::size_t t = 0; t < triangleCount; t++) {
+        missesBefore[t + 1] = missesBefore[t] + triangleMisses(cache, &indices[3 * t]);
+    }
+    std::size_t budget = (std::size_t)(threshold * missesBefore[triangleCount]);
+
+    // cut where the clusters so far, each started with a cold cache, miss no more
+    // than threshold times as often as the same triangles did in one run
+    std::vector<std::size_t> clusterStarts = {0};
+    cache.clear();
+    std::size_t closedMisses = 0;
+    std::size_t misses = 0;
+    for (std::size_t t = 0; t < triangleCount; t++) {
+        misses += triangleMisses(cache, &indices[3 * t]);
+        std::size_t size = t + 1 - clusterStarts.back();
+        if (size >= MIN_CLUSTER_TRIANGLES && t + 1 < triangleCount
+                && closedMisses + misses <= threshold * missesBefore[t + 1]) {
+            clusterStarts.push_back(t + 1);
+            cache.clear();
+            closedMisses += misses;
+            misses = 0;
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+    if (clusterStarts.size() < 3) {
+        return;
+    }
+
+    // area weighted centre and normal of each cluster, and the mesh's centre
+    std::size_t clusterCount = clusterStarts.size() - 1;
+    auto position = [&](GLuint v) {
+        return glm::vec3(vertices[v * stride], vertices[v * stride + 1], vertices[v * stride + 2]);
+    };
+    std::vector<glm::vec3> clusterCenter(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    for (std::size_t c = 0; c < clusterCount; c++) {
+        for (std::size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            glm::vec3 a = position(indices[3 * t]);
+            glm::vec3 b = position(indices[3 * t + 1]);
+            glm::vec3 d = position(indices[3 * t + 2]);
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+            clusterCenter[c] += area * (a + b + d) / 3.0f;
+            clusterNormal[c] += normal;
+            clusterArea[c] += area;
+        }
+        meshCenter += clusterCenter[c];
+        meshArea += clusterArea[c];
+    }
+    if (meshArea <= 0.0f) {
+        return;
+    }
+    meshCenter /= meshArea;
+
+    // clusters facing out from the centre go first: they're the ones most likely
+    // to be in front of the others. the last cluster was never held to the
+    // threshold, so while the order misses more than allowed, it takes in the
+    // one before it
+    std::vector<GLuint> sorted;
+    sorted.reserve(triangleCount * 3);
+    std::vector<std::size_t> order;
+    for (; clusterCount >= 2; clusterCount--) {
+        std::vector<float> facing(clusterCount, 0.0f);
+        for (std::size_t c = 0; c < clusterCount; c++) {
+            if (clusterArea[c] > 0.0f && glm::length(clusterNormal[c]) > 0.0f) {
+                glm::vec3 center = clusterCenter[c] / clusterArea[c];
+                facing[c] = glm::dot(center - meshCenter, glm::normalize(clusterNormal[c]));
+            }
+        }
+        order.resize(clusterCount);
+        for (std::size_t c = 0; c < clusterCount; c++) {
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return facing[a] > facing[b];
+        });
+
+        sorted.clear();
+        for (std::size_t c : order) {
+            sorted.insert(sorted.end(), indices + 3 * clusterStarts[c], indices + 3 * clusterStarts[c + 1]);
+        }
+        if (cacheMisses(sorted.data(), sorted.size(), vertexCount) <= budget) {
+            std::copy(sorted.begin(), sorted.end(), indices);
+            return;
+        }
+
+        std::size_t last = clusterCount - 1;
+        clusterCenter[last - 1] += clusterCenter[last];
+        clusterNormal[last - 1] += clusterNormal[last];
+        clusterArea[last - 1] += clusterArea[last];
+        clusterStarts.erase(clusterStarts.begin() + last);
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(GLuint* indices, std::size_t indexCount,
+                                        float* vertices, std::size_t vertexCount, int stride) {
+    const GLuint UNUSED = ~0u;
+    std::vector<GLuint> remap(vertexCount, UNUSED);
+    GLuint next = 0;
+    for (std::size_t i = 0; i < indexCount; i++) {
+        if (remap[indices[i]] == UNUSED) {
+            remap[indices[i]] = next++;
+        }
+        indices[i] = remap[indices[i]];
+    }
+    for (std::size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] == UNUSED) {
+            remap[v] = next++;
+        }
+    }
+
+    std::vector<float> reordered(vertexCount * stride);
+    for (std::size_t v = 0; v < vertexCount; v++) {
+        std::copy(vertices + v * stride, vertices + (v + 1) * stride, &reordered[remap[v] * stride]);
+    }
+    std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+std::size_t MeshOptimizer::cacheMisses(const GLuint* indices, std::size_t indexCount, std::size_t vertexCount) {
+    FifoCache cache(vertexCount);
+    std::size_t misses = 0;
+    for (std::size_t t = 0; t + 2 < indexCount; t += 3) {
+        misses += triangleMisses(cache, &indices[t]);
+    }
+    return misses;
+}
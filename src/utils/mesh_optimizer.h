@@ -0,0 +1,53 @@
+#pragma once
+
+// Defined before including GLEW to suppress deprecation messages on macOS
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#include <GL/glew.h>
+#include <cstddef>
+
+/**
+ * Reorders an indexed triangle list so the GPU does less work drawing it, without
+ * changing what's drawn. The Shapes:: generators emit triangles wedge by wedge
+ * and tile by tile, which revisits vertices long after the post-transform cache
+ * has forgotten them. GeometryArena runs each mesh through all three passes, in
+ * this order, as it's added:
+ *
+ *   optimizeVertexCache  Forsyth's linear-speed greedy ordering: each next
+ *                        triangle is the best scored one using vertices still
+ *                        in a modelled LRU cache, favouring vertices with few
+ *                        triangles left so none get stranded
+ *   optimizeOverdraw     cuts that order into clusters where the cache starts
+ *                        cold again at little cost, then draws the clusters
+ *                        facing out from the mesh's centre first (Sander et al.,
+ *                        "Fast Triangle Reordering for Vertex Locality and
+ *                        Reduced Overdraw"), so they hide what's behind them
+ *   optimizeVertexFetch  renumbers vertices in the order the triangles first use
+ *                        them, so fetches walk the vertex buffer forwards
+ *
+ * Cache efficiency is measured as ACMR (cache misses per triangle, 0.5 at best
+ * for a large grid, 3 at worst) and ATVR (misses per vertex, 1 at best), against
+ * a FIFO cache of FIFO_SIZE vertices like the ones most GPUs have had.
+ */
+namespace MeshOptimizer {
+    constexpr int FIFO_SIZE = 16;
+
+    // reorders triangles for the post-transform vertex cache
+    void optimizeVertexCache(GLuint* indices, std::size_t indexCount, std::size_t vertexCount);
+
+    // reorders clusters of triangles from optimizeVertexCache for less overdraw,
+    // giving up at most threshold times its cache misses. vertices are positions
+    // first, stride floats apart
+    void optimizeOverdraw(GLuint* indices, std::size_t indexCount,
+                          const float* vertices, std::size_t vertexCount, int stride,
+                          float threshold = 1.05f);
+
+    // renumbers vertices in order of first use and moves their stride floats to
+    // match. any vertex no triangle uses goes last
+    void optimizeVertexFetch(GLuint* indices, std::size_t indexCount,
+                             float* vertices, std::size_t vertexCount, int stride);
+
+    // misses a FIFO cache of FIFO_SIZE has drawing the triangles in order
+    std::size_t cacheMisses(const GLuint* indices, std::size_t indexCount, std::size_t vertexCount);
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+// counts a Pool keeps, for seeing how big it needs to be
+struct PoolStats {
+    int live; // objects spawned and not despawned
+    int capacity; // objects constructed, live or waiting to be respawned
+    int highWater; // most objects live at once
+    int reserved; // objects there's room for before the storage reallocates
+    long spawns;
+    long despawns;
+    long constructions; // spawns that had to construct a new object rather than respawn an old one
+    long reallocations; // times the storage grew past what was reserved
+};
+
+/**
+ * Storage for objects that are spawned and despawned often, with generational
+ * handles that stay valid (and stop matching once the object is despawned) however
+ * the others come and go.
+ *
+ * The live objects are packed at the front of one array, so they can be walked
+ * (or handed to code taking a std::span) like a vector. Despawning one swaps the
+ * last live object into its place and keeps the despawned one constructed behind
+ * the live ones, and the next spawn calls its respawn with the spawn's arguments
+ * instead of constructing a new T. A T that keeps its buffers through respawn
+ * (clearing rather than freeing) is spawned and despawned without touching the
+ * heap once the pool has seen as many objects at once as it will need.
+ *
+ * Objects move when another is despawned (or the pool grows past reserve), so
+ * hold on to handles between frames rather than pointers or indices. What an
+ * object owns on the heap doesn't move with it. Anything built over the live
+ * objects' indices can check revision to tell if it's still good.
+ *
+ * T needs to be movable, and to have a respawn taking the same arguments as one
+ * of its constructors.
+ */
+template <class T>
+class Pool
+{
+public:
+    struct Handle {
+        uint32_t slot = UINT32_MAX;
+        uint32_t generation = 0;
+        bool operator==(const Handle&) const = default;
+    };
+
+    // makes room for capacity objects, so the storage doesn't move until there are more
+    void reserve(int capacity) {
+        if (capacity > (int)m_items.capacity()) {
+            m_items.reserve(capacity);
+            m_slots.reserve(capacity);
+            m_denseToSlot.reserve(capacity);
+        }
+    }
+
+    // a live object built from args: a despawned one respawned, or a new one
+    template <class... Args>
+    Handle spawn(Args&&... args) {
+        if (m_live < (int)m_items.size()) {
+            m_items[m_live].respawn(std::forward<Args>(args)...);
+        } else {
+            if (m_items.size() == m_items.capacity()) {
+                m_reallocations++;
+            }
+            m_items.emplace_back(std::forward<Args>(args)...);
+            m_slots.push_back({(uint32_t)m_live, 0});
+            m_denseToSlot.push_back(m_slots.size() - 1);
+            m_constructions++;
+        }
+        m_spawns++;
+        m_revision++;
+        uint32_t slot = m_denseToSlot[m_live];
+        m_live++;
+        m_highWater = std::max(m_highWater, m_live);
+        return {slot, m_slots[slot].generation};
+    }
+
+    // despawns the object, moving the last live one into its place. false if the
+    // handle doesn't match a live object
+    bool despawn(Handle handle) {
+        int index = indexOf(handle);
+        if (index < 0) {
+            return false;
+        }
+        int last = m_live - 1;
+        if (index != last) {
+            std::swap(m_items[index], m_items[last]);
+            std::swap(m_denseToSlot[index], m_denseToSlot[last]);
+            m_slots[m_denseToSlot[index]].dense = index;
+            m_slots[m_denseToSlot[last]].dense = last;
+        }
+        // every handle to it stops matching
+        m_slots[handle.slot].generation++;
+        m_live--;
+        m_despawns++;
+        m_revision++;
+        return true;
+    }
+
+    // despawns everything, keeping the objects to respawn
+    void clear() {
+        while (m_live > 0) {
+            despawn(handleAt(m_live - 1));
+        }
+    }
+
+    // the live object a handle is for, or nullptr if it's been despawned
+    T* get(Handle handle) {
+        int index = indexOf(handle);
+        return index < 0 ? nullptr : &m_items[index];
+    }
+    const T* get(Handle handle) const {
+        int index = indexOf(handle);
+        return index < 0 ? nullptr : &m_items[index];
+    }
+    // where a live object is among the live objects, or -1
+    int indexOf(Handle handle) const {
+        if (handle.slot >= m_slots.size() || m_slots[handle.slot].generation != handle.generation) {
+            return -1;
+        }
+        int index = m_slots[handle.slot].dense;
+        return index < m_live ? index : -1;
+    }
+    // the handle of the live object at index
+    Handle handleAt(int index) const {
+        uint32_t slot = m_denseToSlot[index];
+        return {slot, m_slots[slot].generation};
+    }
+
+    // changes with every spawn and despawn, so whatever live object is at an index
+    // (and how many there are) is the same as long as it doesn't
+    uint64_t revision() const { return m_revision; }
+
+    // the live objects, in no particular order
+    int size() const { return m_live; }
+    bool empty() const { return m_live == 0; }
+    T& operator[](int index) { return m_items[index]; }
+    const T& operator[](int index) const { return m_items[index]; }
+    T* begin() { return m_items.data(); }
+    T* end() { return m_items.data() + m_live; }
+    const T* begin() const { return m_items.data(); }
+    const T* end() const { return m_items.data() + m_live; }
+    std::span<T> live() { return {m_items.data(), (std::size_t)m_live}; }
+    std::span<const T> live() const { return {m_items.data(), (std::size_t)m_live}; }
+
+    PoolStats stats() const {
+        return {m_live, (int)m_items.size(), m_highWater, (int)m_items.capacity(),
+                m_spawns, m_despawns, m_constructions, m_reallocations};
+    }
+
+private:
+    struct Slot {
+        uint32_t dense; // where its object is in m_items
+        uint32_t generation; // bumped when its object is despawned
+    };
+
+    std::vector<T> m_items; // live objects first, then despawned ones waiting to be respawned
+    std::vector<Slot> m_slots; // indexed by handle
+    std::vector<uint32_t> m_denseToSlot; // the slot of each object in m_items
+    int m_live = 0;
+    int m_highWater = 0;
+    long m_spawns = 0;
+    long m_despawns = 0;
+    long m_constructions = 0;
+    long m_reallocations = 0;
+    uint64_t m_revision = 0;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "utils/geometry_arena.h"
+
+class MergedMesh;
+
+// A recorded Realtime::paintShape (or paintMergedMesh) call, so a shape that
+// hasn't moved can be drawn again without recomputing its matrices
+struct ShapeDraw {
+    GeometryArena::Mesh mesh;
+    glm::vec4 cAmbient;
+    glm::vec4 cDiffuse;
+    glm::vec4 cSpecular;
+    float shininess;
+    glm::mat4 model;
+    glm::mat3 normModel;
+    const MergedMesh* merged = nullptr; // a merged mesh's materials, instead of the one above
+};
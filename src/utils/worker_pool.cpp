@@ -0,0 +1,102 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(int workers) {
+    m_call = nullptr;
+    m_task = nullptr;
+    m_tasks = 0;
+    m_next = 0;
+    m_joined = 0;
+    m_generation = 0;
+    m_stop = false;
+    for (int w = 0; w < workers; w++) {
+        m_workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+WorkerPool& WorkerPool::shared() {
+    static WorkerPool pool(std::max(1, (int)std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+int WorkerPool::threads() const {
+    return m_workers.size() + 1;
+}
+
+void WorkerPool::work(void (*call)(void*, int), void* task, int tasks) {
+    for (int t = m_next++; t < tasks; t = m_next++) {
+        call(task, t);
+    }
+}
+
+void WorkerPool::runTasks(int tasks, void (*call)(void*, int), void* task) {
+    if (tasks <= 0) {
+        return;
+    }
+    if (tasks == 1 || m_workers.empty()) {
+        for (int t = 0; t < tasks; t++) {
+            call(task, t);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> runLock(m_runMutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_call = call;
+        m_task = task;
+        m_tasks = tasks;
+        m_next = 0;
+        m_generation++;
+    }
+    m_wake.notify_all();
+    work(call, task, tasks);
+
+    // every task has been taken once the caller runs out, so it's done when the
+    // workers that took them are. a worker that wakes later finds no tasks
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_finished.wait(lock, [this] { return m_joined == 0; });
+    m_call = nullptr;
+    m_task = nullptr;
+    m_tasks = 0;
+}
+
+void WorkerPool::workerLoop() {
+    uint64_t seen = 0;
+    while (true) {
+        void (*call)(void*, int);
+        void* task;
+        int tasks;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this, seen] { return m_stop || m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+            call = m_call;
+            task = m_task;
+            tasks = m_tasks;
+            m_joined++;
+        }
+        if (tasks > 0) {
+            work(call, task, tasks);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_joined--;
+        }
+        m_finished.notify_one();
+    }
+}
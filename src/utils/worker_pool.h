@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads kept for the life of the program that split a loop with the calling
+ * thread, for work that's parallel within a frame (separating spiders, sweeping
+ * flow field tiles). Starting threads for every such loop costs as much as a
+ * small loop does, and each new thread makes its own FrameArena; these start
+ * once.
+ *
+ * run(tasks, task) calls task(t) for every t in [0, tasks), spread over the
+ * workers and the caller, and returns when they've all finished. Runs from
+ * different threads take turns, and a task mustn't call run itself.
+ */
+class WorkerPool
+{
+public:
+    // workers threads of its own, besides the caller
+    explicit WorkerPool(int workers);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // one less worker than there are cores, since the caller takes a share
+    static WorkerPool& shared();
+
+    // threads a run is spread over, the caller included
+    int threads() const;
+
+    template <typename Task>
+    void run(int tasks, Task& task) {
+        runTasks(tasks, [](void* task, int t) { (*static_cast<Task*>(task))(t); }, &task);
+    }
+
+private:
+    void runTasks(int tasks, void (*call)(void*, int), void* task);
+    // takes tasks from the current run until there are none left
+    void work(void (*call)(void*, int), void* task, int tasks);
+    void workerLoop();
+
+    std::mutex m_runMutex; // held for a whole run, so runs take turns
+
+    // the current run, shared with the workers
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished;
+    void (*m_call)(void*, int);
+    void* m_task;
+    int m_tasks;
+    std::atomic<int> m_next; // next task to take
+    int m_joined; // workers taking tasks from the current run
+    uint64_t m_generation; // runs started so far
+    bool m_stop;
+    std::vector<std::thread> m_workers;
+};
@@ -0,0 +1,59 @@
+// Sweeps each FastMath function over its domain and checks it against double
+// precision libm, within the error bounds documented in utils/fastmath.h
+#undef NDEBUG
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <initializer_list>
+#include "utils/fastmath.h"
+
+// samples per sweep
+static const int STEPS = 1 << 22;
+
+// largest error of f against reference over count evenly spaced x in [lo, hi]
+template <typename F, typename R>
+static double sweep(float lo, float hi, int count, F f, R reference) {
+    double worst = 0.0;
+    for (int i = 0; i <= count; i++) {
+        float x = lo + (hi - lo) * ((double)i / count);
+        worst = std::fmax(worst, std::fabs((double)f(x) - reference((double)x)));
+    }
+    return worst;
+}
+
+int main() {
+    double acosError = sweep(-1.0f, 1.0f, STEPS, FastMath::acos, [](double x) { return std::acos(x); });
+    double asinError = sweep(-1.0f, 1.0f, STEPS, FastMath::asin, [](double x) { return std::asin(x); });
+    std::printf("acos %.2e, asin %.2e\n", acosError, asinError);
+    assert(acosError <= 4.1e-7);
+    assert(asinError <= 4.1e-7);
+
+    // acos clamps inputs outside [-1, 1]
+    assert(FastMath::acos(1.5f) == FastMath::acos(1.0f));
+    assert(FastMath::acos(-1.5f) == FastMath::acos(-1.0f));
+
+    // atan2 around circles of a few radii, covering every octant, and the origin
+    double atan2Error = 0.0;
+    for (float radius : {1e-3f, 1.0f, 1e3f}) {
+        atan2Error = std::fmax(atan2Error, sweep(-FastMath::PI, FastMath::PI, STEPS,
+            [radius](float a) { return FastMath::atan2(radius * std::sin(a), radius * std::cos(a)); },
+            [radius](double a) {
+                return std::atan2((double)(radius * std::sin((float)a)), (double)(radius * std::cos((float)a)));
+            }));
+    }
+    std::printf("atan2 %.2e\n", atan2Error);
+    assert(atan2Error <= 2.0e-6);
+    assert(FastMath::atan2(0.0f, 0.0f) == 0.0f);
+
+    double sinPiError = sweep(-20.0f, 20.0f, STEPS, FastMath::sinPi,
+                              [](double t) { return std::sin(t * M_PI); });
+    double sinError = sweep(-2.0f * FastMath::PI, 2.0f * FastMath::PI, STEPS,
+                            [](float x) { return FastMath::sin(x); }, [](double x) { return std::sin(x); });
+    double cosError = sweep(-2.0f * FastMath::PI, 2.0f * FastMath::PI, STEPS,
+                            [](float x) { return FastMath::cos(x); }, [](double x) { return std::cos(x); });
+    std::printf("sinPi %.2e, sin %.2e, cos %.2e\n", sinPiError, sinError, cosError);
+    assert(sinPiError <= 1.7e-7);
+    assert(sinError <= 7.6e-7);
+    assert(cosError <= 7.6e-7);
+    return 0;
+}
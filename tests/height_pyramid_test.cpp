@@ -0,0 +1,157 @@
+// Checks HeightPyramid raycasts against a dense march over the same bilinear
+// surface, for random rays over rolling ground, before and after a refresh
+#undef NDEBUG
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <initializer_list>
+#include <random>
+#include "terrain/height_pyramid.h"
+
+static const glm::vec2 ORIGIN(-3.0f, -2.0f);
+static const float CELL_SIZE = 0.05f;
+static const int CELLS = 128;
+static const int RAYS = 20000;
+
+static float s_bumpHeight = 0.0f; // raised by the refresh test
+
+static float rollingHeight(float x, float z) {
+    float h = 0.3f * std::sin(1.7f * x) * std::cos(1.3f * z) + 0.05f * std::sin(9.0f * x + 4.0f * z);
+    float d2 = (x - 1.0f) * (x - 1.0f) + (z - 1.0f) * (z - 1.0f);
+    return h + s_bumpHeight * std::exp(-4.0f * d2);
+}
+
+// the surface the pyramid describes: rollingHeight at the grid corners, bilinear between
+static float bilinearHeight(float x, float z) {
+    glm::vec2 g = glm::clamp((glm::vec2(x, z) - ORIGIN) / CELL_SIZE, glm::vec2(0.0f), glm::vec2(CELLS - 1e-4f));
+    glm::ivec2 c(g);
+    glm::vec2 f = g - glm::vec2(c);
+    auto corner = [](int i, int j) { return rollingHeight(ORIGIN.x + i * CELL_SIZE, ORIGIN.y + j * CELL_SIZE); };
+    float h0 = glm::mix(corner(c.x, c.y), corner(c.x + 1, c.y), f.x);
+    float h1 = glm::mix(corner(c.x, c.y + 1), corner(c.x + 1, c.y + 1), f.x);
+    return glm::mix(h0, h1, f.y);
+}
+
+// first t where the ray is at or under the surface, stepping a small fraction of
+// a cell and bisecting the crossing. -1 for none within maxDist
+static float march(glm::vec3 origin, glm::vec3 dir, float maxDist, float extent) {
+    auto below = [&](float t) {
+        glm::vec3 p = origin + dir * t;
+        return p.y <= bilinearHeight(p.x, p.z);
+    };
+    // up to where the ray leaves the window, edge included, or maxDist
+    float tEnd = maxDist;
+    for (int axis : {0, 2}) {
+        float lo = axis == 0 ? ORIGIN.x : ORIGIN.y;
+        if (dir[axis] > 0.0f) {
+            tEnd = std::min(tEnd, (lo + extent - origin[axis]) / dir[axis]);
+        } else if (dir[axis] < 0.0f) {
+            tEnd = std::min(tEnd, (lo - origin[axis]) / dir[axis]);
+        }
+    }
+    float step = CELL_SIZE / 64.0f;
+    int steps = (int)std::ceil(tEnd / step);
+    for (int i = 0; i <= steps; i++) {
+        float t = std::min(i * step, tEnd);
+        if (below(t)) {
+            float lo = std::max(0.0f, t - step);
+            float hi = t;
+            if (below(lo)) {
+                return lo;
+            }
+            for (int k = 0; k < 30; k++) {
+                float mid = 0.5f * (lo + hi);
+                (below(mid) ? hi : lo) = mid;
+            }
+            return hi;
+        }
+    }
+    return -1.0f;
+}
+
+// raycasts random rays through the pyramid and the march and checks they agree
+static void compare(const HeightPyramid& pyramid, std::mt19937& rng) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float extent = pyramid.extent();
+    int hits = 0;
+    float worst = 0.0f;
+    for (int r = 0; r < RAYS; r++) {
+        glm::vec3 origin(ORIGIN.x + extent * unit(rng), 0.0f, ORIGIN.y + extent * unit(rng));
+        origin.y = bilinearHeight(origin.x, origin.z) + 0.01f + 1.5f * unit(rng);
+        // mostly down, from straight down to 70 degrees off vertical, and some up
+        float angle = 6.2831853f * unit(rng);
+        float tilt = r % 8 == 0 ? 0.0f : 1.2f * unit(rng);
+        glm::vec3 dir(std::sin(tilt) * std::cos(angle), -std::cos(tilt), std::sin(tilt) * std::sin(angle));
+        if (r % 16 == 1) {
+            dir.y = -dir.y;
+        }
+        float maxDist = 3.0f;
+
+        RayHit hit = pyramid.raycast(origin, dir, maxDist);
+        float expected = march(origin, dir, maxDist, extent);
+        assert(hit.hit == (expected >= 0.0f));
+        if (!hit.hit) {
+            continue;
+        }
+        hits++;
+        worst = std::max(worst, std::abs(hit.t - expected));
+        assert(std::abs(hit.t - expected) <= 1e-3f);
+        assert(std::abs(hit.pos.y - bilinearHeight(hit.pos.x, hit.pos.z)) <= 1e-3f);
+        assert(std::abs(glm::length(hit.normal) - 1.0f) <= 1e-4f && hit.normal.y > 0.0f);
+
+        // the batch of one answers the same
+        RayHit batched;
+        pyramid.raycastBatch(&origin, 1, dir, maxDist, &batched);
+        assert(batched.hit && batched.t == hit.t);
+    }
+    std::printf("%d of %d rays hit, worst t error %.2e\n", hits, RAYS, worst);
+    assert(hits > RAYS / 2);
+}
+
+// marching the bilinear surface directly, as rays outside the window do, has to
+// find the same hits. rays are at most 30 degrees off vertical, steeper than the
+// ground, so they cross it once and stepping can't skip over a crossing
+static void compareMarch(const HeightPyramid& pyramid, std::mt19937& rng) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float extent = pyramid.extent();
+    float worst = 0.0f;
+    for (int r = 0; r < RAYS; r++) {
+        glm::vec3 origin(ORIGIN.x + 1.0f + (extent - 2.0f) * unit(rng), 0.0f,
+                         ORIGIN.y + 1.0f + (extent - 2.0f) * unit(rng));
+        origin.y = bilinearHeight(origin.x, origin.z) + 0.01f + 0.8f * unit(rng);
+        float angle = 6.2831853f * unit(rng);
+        float tilt = r % 8 == 0 ? 0.0f : 0.52f * unit(rng);
+        glm::vec3 dir(std::sin(tilt) * std::cos(angle), -std::cos(tilt), std::sin(tilt) * std::sin(angle));
+        float maxDist = 1.0f;
+
+        RayHit expected = pyramid.raycast(origin, dir, maxDist);
+        RayHit hit = HeightPyramid::march(origin, dir, maxDist, CELL_SIZE, bilinearHeight);
+        assert(hit.hit == expected.hit);
+        if (!hit.hit) {
+            continue;
+        }
+        worst = std::max(worst, std::abs(hit.t - expected.t));
+        assert(std::abs(hit.t - expected.t) <= 1e-3f);
+        assert(glm::dot(hit.normal, expected.normal) > 0.99f);
+    }
+    std::printf("march: worst t error %.2e\n", worst);
+}
+
+int main() {
+    std::mt19937 rng(7);
+    HeightPyramid pyramid;
+    assert(!pyramid.isBuilt());
+    pyramid.build(ORIGIN, CELL_SIZE, CELLS, rollingHeight);
+    assert(pyramid.isBuilt());
+    assert(pyramid.covers(ORIGIN.x, ORIGIN.y) && !pyramid.covers(ORIGIN.x - 0.1f, ORIGIN.y));
+    compare(pyramid, rng);
+    compareMarch(pyramid, rng);
+
+    // a bump rises around (1, 1). refreshing just that corner of the window has to
+    // match the new floor everywhere
+    s_bumpHeight = 0.8f;
+    pyramid.refresh(glm::vec4(-1.5f, -1.5f, 3.5f, 3.5f), rollingHeight);
+    compare(pyramid, rng);
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Runs the sphere and cylinder the app draws, and a random mesh, through the
+// MeshOptimizer passes in the order GeometryArena does, and checks each pass
+// draws the same triangles (as a multiset, each with its winding) while the
+// cache misses don't go up
+#undef NDEBUG
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+#include "utils/mesh_optimizer.h"
+#include "shapes/Cylinder.cpp"
+#include "shapes/Sphere.cpp"
+
+// position and normal, as the Shapes generators lay them out
+static const int STRIDE = 6;
+
+struct Mesh {
+    std::vector<float> vertices;
+    std::vector<GLuint> indices;
+    std::size_t vertexCount() const { return vertices.size() / STRIDE; }
+};
+
+// welds a triangle soup's identical vertices together, as GeometryArena::add does
+static Mesh weld(const std::vector<float>& soup) {
+    Mesh mesh;
+    std::map<std::array<float, STRIDE>, GLuint> welded;
+    for (std::size_t c = 0; c < soup.size() / STRIDE; c++) {
+        std::array<float, STRIDE> vertex;
+        std::memcpy(vertex.data(), &soup[c * STRIDE], sizeof(vertex));
+        auto [it, added] = welded.try_emplace(vertex, (GLuint)mesh.vertexCount());
+        if (added) {
+            mesh.vertices.insert(mesh.vertices.end(), vertex.begin(), vertex.end());
+        }
+        mesh.indices.push_back(it->second);
+    }
+    return mesh;
+}
+
+// the triangles by their vertices' contents, each turned to start at its least
+// vertex so the winding is kept, sorted
+using Triangle = std::array<std::array<float, STRIDE>, 3>;
+static std::vector<Triangle> triangleSet(const Mesh& mesh) {
+    std::vector<Triangle> triangles;
+    for (std::size_t t = 0; t < mesh.indices.size(); t += 3) {
+        Triangle triangle;
+        for (int c = 0; c < 3; c++) {
+            std::memcpy(triangle[c].data(), &mesh.vertices[mesh.indices[t + c] * STRIDE], sizeof(triangle[c]));
+        }
+        int first = std::min_element(triangle.begin(), triangle.end()) - triangle.begin();
+        std::rotate(triangle.begin(), triangle.begin() + first, triangle.end());
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+static float acmr(const Mesh& mesh) {
+    std::size_t misses = MeshOptimizer::cacheMisses(mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+    return 3.0f * misses / mesh.indices.size();
+}
+
+static void check(const char* name, Mesh mesh, bool expectFewerMisses) {
+    std::vector<Triangle> triangles = triangleSet(mesh);
+    std::size_t indexCount = mesh.indices.size();
+    float original = acmr(mesh);
+
+    MeshOptimizer::optimizeVertexCache(mesh.indices.data(), indexCount, mesh.vertexCount());
+    assert(triangleSet(mesh) == triangles);
+    float cached = acmr(mesh);
+
+    MeshOptimizer::optimizeOverdraw(mesh.indices.data(), indexCount, mesh.vertices.data(),
+                                    mesh.vertexCount(), STRIDE);
+    assert(triangleSet(mesh) == triangles);
+    float overdrawn = acmr(mesh);
+
+    MeshOptimizer::optimizeVertexFetch(mesh.indices.data(), indexCount, mesh.vertices.data(),
+                                       mesh.vertexCount(), STRIDE);
+    assert(triangleSet(mesh) == triangles);
+    float fetched = acmr(mesh);
+
+    std::printf("%s: %zu triangles, ACMR %.3f -> %.3f (cache) -> %.3f (overdraw) -> %.3f (fetch)\n",
+                name, indexCount / 3, original, cached, overdrawn, fetched);
+    // overdraw gives up at most its threshold of misses, and renumbering none
+    assert(cached <= original);
+    assert(overdrawn <= cached * 1.05f + 1e-6f);
+    assert(fetched == overdrawn);
+    assert(fetched <= original);
+    if (expectFewerMisses) {
+        assert(fetched < original);
+    }
+
+    // vertices are numbered in the order the triangles first use them
+    GLuint next = 0;
+    for (GLuint index : mesh.indices) {
+        assert(index <= next);
+        if (index == next) {
+            next++;
+        }
+    }
+}
+
+int main() {
+    std::vector<float> soup;
+    Shapes::Sphere::makeSphere(25, 25, soup);
+    check("sphere", weld(soup), true);
+    soup.clear();
+    Shapes::Cylinder::makeCylinder(25, 25, soup);
+    check("cylinder", weld(soup), true);
+    soup.clear();
+    Shapes::Cylinder::makeCylinder(1, 25, soup);
+    check("prop cylinder", weld(soup), false);
+
+    // random triangles over a handful of vertices, some used twice and some never
+    std::mt19937 rng(3);
+    Mesh random;
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    for (int v = 0; v < 300; v++) {
+        for (int f = 0; f < STRIDE; f++) {
+            random.vertices.push_back(unit(rng));
+        }
+    }
+    std::uniform_int_distribution<GLuint> vertex(0, 249);
+    for (int t = 0; t < 600; t++) {
+        GLuint a = vertex(rng);
+        GLuint b = vertex(rng);
+        GLuint c = vertex(rng);
+        if (a == b || b == c || a == c) {
+            continue;
+        }
+        random.indices.insert(random.indices.end(), {a, b, c});
+        if (t % 50 == 0) {
+            random.indices.insert(random.indices.end(), {a, b, c});
+        }
+    }
+    check("random", random, false);
+
+    std::printf("mesh optimizer ok\n");
+    return 0;
+}
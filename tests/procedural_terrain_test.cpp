@@ -0,0 +1,50 @@
+// Prefetches around two points a frame, as paintGL does for the camera and a
+// spider, and checks the workers bake the chunks around both, so neither point's
+// heights end up baked on demand
+#undef NDEBUG
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "terrain/procedural_terrain.h"
+
+static const glm::vec2 CAMERA(0.0f, 0.0f);
+static const glm::vec2 SPIDER(60.0f, -40.0f);
+static const float CAMERA_RADIUS = 16.0f;
+static const float SPIDER_RADIUS = 2.0f;
+
+int main() {
+    ProceduralTerrain::Params params;
+    params.maxChunks = 1024;
+    params.workers = 2;
+    ProceduralTerrain terrain(params);
+
+    // one frame's prefetches, then frames without any until the workers catch up
+    terrain.prefetch(CAMERA, CAMERA_RADIUS);
+    terrain.prefetch(SPIDER, SPIDER_RADIUS);
+    terrain.endFrame();
+    bool caughtUp = false;
+    for (int frame = 0; frame < 20000 && !caughtUp; frame++) {
+        terrain.endFrame();
+        caughtUp = terrain.pendingChunks() == 0;
+        if (!caughtUp) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    assert(caughtUp);
+
+    // every chunk within either radius is resident
+    float chunkSize = params.chunkCells * params.cellSize;
+    for (auto [center, radius] : {std::make_pair(CAMERA, CAMERA_RADIUS), std::make_pair(SPIDER, SPIDER_RADIUS)}) {
+        for (float z = center.y - radius; z <= center.y + radius; z += 0.5f * chunkSize) {
+            for (float x = center.x - radius; x <= center.x + radius; x += 0.5f * chunkSize) {
+                terrain.height(x, z);
+            }
+        }
+    }
+    std::printf("%d chunks resident, %d baked on demand\n", terrain.residentChunks(), terrain.chunksBakedOnDemand());
+    assert(terrain.chunksBakedOnDemand() == 0);
+
+    std::printf("procedural terrain ok\n");
+    return 0;
+}
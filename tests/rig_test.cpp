@@ -0,0 +1,155 @@
+// Round-trips rigs through both forms: the shipped rig files parse and validate,
+// text -> Rig -> text and Rig -> binary -> Rig give back the same rig, joint
+// limits included, and a version 1 binary (no limits) still loads unlimited.
+// Rigs with a foot outside its limits, or cut short, don't load
+#undef NDEBUG
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <glm/gtc/constants.hpp>
+#include "spider/rig.h"
+
+// same rig, to within tolerance (text has 6 significant digits, binary is exact)
+static bool sameRig(const Rig& a, const Rig& b, float tolerance) {
+    auto near = [tolerance](float x, float y) { return std::fabs(x - y) <= tolerance * std::fmax(1.0f, std::fabs(x)); };
+    auto near2 = [&](glm::vec2 x, glm::vec2 y) { return near(x.x, y.x) && near(x.y, y.y); };
+    auto near3 = [&](glm::vec3 x, glm::vec3 y) { return near(x.x, y.x) && near(x.y, y.y) && near(x.z, y.z); };
+    if (std::strcmp(a.name, b.name) != 0 || a.numLegs != b.numLegs || a.gaitPattern != b.gaitPattern
+            || !near(a.bodyHeight, b.bodyHeight) || !near3(a.bodySize, b.bodySize)
+            || !near(a.legDiameter, b.legDiameter) || !near(a.segLength1, b.segLength1)
+            || !near(a.segLength2, b.segLength2) || !near(a.moveTime, b.moveTime)
+            || !near(a.stepDistance, b.stepDistance) || !near(a.overshoot, b.overshoot)
+            || !near(a.maxClimb, b.maxClimb)) {
+        return false;
+    }
+    for (int i = 0; i < a.numLegs; i++) {
+        const RigLeg& x = a.legs[i];
+        const RigLeg& y = b.legs[i];
+        if (!near3(x.hip, y.hip) || !near2(x.foot, y.foot) || !near2(x.target, y.target)
+                || !near2(x.swingLimits, y.swingLimits) || !near2(x.kneeLimits, y.kneeLimits)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+static void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((char)(value >> (8 * i)));
+    }
+}
+
+static void putF32(std::string& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    putU32(out, bits);
+}
+
+int main() {
+    std::string binaryPath = "rig_test.bin";
+    std::string error;
+
+    // every shipped rig, and one with limits on every leg
+    Rig quadruped;
+    for (const char* name : {"hexapod", "octopod", "quadruped"}) {
+        Rig rig;
+        assert(Rig::load(std::string(RIGS_DIR) + "/" + name + ".rig", rig));
+        assert(std::strcmp(rig.name, name) == 0);
+        // the file is the built-in hexapod written out
+        if (std::strcmp(name, "hexapod") == 0) {
+            assert(sameRig(rig, Rig::hexapod(), 1e-6f));
+        }
+        if (std::strcmp(name, "quadruped") == 0) {
+            quadruped = rig;
+        }
+    }
+    assert(quadruped.numLegs == 4);
+    for (int i = 0; i < quadruped.numLegs; i++) {
+        assert(quadruped.legs[i].kneeLimits.x > 0.0f && quadruped.legs[i].kneeLimits.y < glm::pi<float>());
+        assert(quadruped.legs[i].swingLimits.y - quadruped.legs[i].swingLimits.x < glm::pi<float>());
+    }
+    assert(std::fabs(quadruped.legs[0].swingLimits.x - glm::radians(-170.0f)) < 1e-6f);
+
+    // text -> Rig -> text -> Rig, with a swing range that wraps past 180 degrees
+    std::string text =
+        "name wrapped\n"
+        "body_height 0.2\n"
+        "segments 0.4 0.4\n"
+        "gait ripple\n"
+        "leg -0.2 0 0   -0.4 0    -0.3 0    150 210  10 175   # straight back\n"
+        "leg 0.2 0 0    0.4 0     0.3 0\n";
+    Rig parsed;
+    assert(Rig::parse(text, parsed, error));
+    assert(parsed.numLegs == 2 && parsed.gaitPattern == 1);
+    assert(parsed.legs[1].swingLimits == glm::vec2(-glm::pi<float>(), glm::pi<float>()));
+    Rig reparsed;
+    assert(Rig::parse(parsed.toText(), reparsed, error));
+    assert(sameRig(parsed, reparsed, 1e-5f));
+
+    // the wrapped swing range takes in straight back, and not off to the side
+    const RigLeg& wrapped = parsed.legs[0];
+    assert(wrapped.withinLimits(glm::vec3(-0.3f, -0.2f, 0.05f), 0.4f, 0.4f));
+    assert(!wrapped.withinLimits(glm::vec3(-0.1f, -0.2f, 0.3f), 0.4f, 0.4f));
+    // and the knee can't fold up tight
+    assert(!wrapped.withinLimits(glm::vec3(-0.02f, 0.0f, 0.0f), 0.4f, 0.4f));
+
+    // Rig -> binary -> Rig, exactly
+    for (const Rig& rig : {parsed, quadruped}) {
+        assert(rig.writeBinary(binaryPath));
+        Rig loaded;
+        assert(Rig::load(binaryPath, loaded));
+        assert(sameRig(rig, loaded, 0.0f));
+    }
+
+    // a version 1 binary, written by hand: legs have no limits
+    std::string v1("ITSYRIG\0", 8);
+    putU32(v1, 1);
+    putU32(v1, 2);
+    char name[32] = "old";
+    v1.append(name, sizeof(name));
+    for (float value : {0.2f, 0.65f, 0.25f, 0.4f, 0.05f, 0.4f, 0.4f}) {
+        putF32(v1, value);
+    }
+    putU32(v1, 0); // tripod
+    for (float value : {0.2f, 0.5f, 0.3f, 0.4f}) {
+        putF32(v1, value);
+    }
+    for (float value : {-0.2f, 0.0f, 0.0f, -0.4f, 0.0f, -0.3f, 0.0f,
+                        0.2f, 0.0f, 0.0f, 0.4f, 0.0f, 0.3f, 0.0f}) {
+        putF32(v1, value);
+    }
+    writeFile(binaryPath, v1);
+    Rig old;
+    assert(Rig::load(binaryPath, old));
+    assert(std::strcmp(old.name, "old") == 0 && old.numLegs == 2 && old.gaitPattern == 0);
+    assert(old.bodySize == glm::vec3(0.65f, 0.25f, 0.4f) && old.maxClimb == 0.4f);
+    assert(old.legs[1].hip == glm::vec3(0.2f, 0.0f, 0.0f) && old.legs[1].target == glm::vec2(0.3f, 0.0f));
+    for (int i = 0; i < old.numLegs; i++) {
+        assert(old.legs[i].swingLimits == glm::vec2(-glm::pi<float>(), glm::pi<float>()));
+        assert(old.legs[i].kneeLimits == glm::vec2(0.0f, glm::pi<float>()));
+    }
+
+    // cut short, four bytes missing from the last leg
+    writeFile(binaryPath, v1.substr(0, v1.size() - 4));
+    assert(!Rig::load(binaryPath, old));
+
+    // a back leg with its planted foot outside a forward swing range, limits out of
+    // order, or only half of them, next to a leg that's fine
+    std::string front = "leg 0.2 0 0   0.4 0    0.3 0\n";
+    assert(Rig::parse(front + "leg -0.2 0 0   -0.4 0    -0.3 0    135 225  0 180\n", parsed, error));
+    assert(!Rig::parse(front + "leg -0.2 0 0   -0.4 0    -0.3 0    -45 45  0 180\n", parsed, error));
+    assert(!Rig::parse(front + "leg -0.2 0 0   -0.4 0    -0.3 0    225 135  0 180\n", parsed, error));
+    assert(!Rig::parse(front + "leg -0.2 0 0   -0.4 0    -0.3 0    135 225\n", parsed, error));
+
+    std::remove(binaryPath.c_str());
+    std::printf("rig ok\n");
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Checks SpatialHash radius and k nearest queries against a brute-force search
+// over the same points: a tight crowd, a sparse spread around it, and queries
+// from inside, around and far outside both, with infinite search radii too
+#undef NDEBUG
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+#include "scene/spatial_hash.h"
+
+static const int CROWD = 3000;
+static const int SPREAD = 1000;
+static const int QUERIES = 3000;
+
+static float distance2(glm::vec3 a, glm::vec3 b) {
+    glm::vec3 d = a - b;
+    return glm::dot(d, d);
+}
+
+int main() {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 3.0f);
+
+    std::vector<glm::vec3> points;
+    for (int i = 0; i < CROWD; i++) {
+        points.push_back(glm::vec3(normal(rng), 0.2f * unit(rng), normal(rng)));
+    }
+    for (int i = 0; i < SPREAD; i++) {
+        points.push_back(glm::vec3(400.0f * unit(rng) - 200.0f, 2.0f * unit(rng), 400.0f * unit(rng) - 200.0f));
+    }
+    SpatialHash grid;
+    grid.build(points.data(), points.size(), 1.2f);
+    assert(grid.size() == (int)points.size());
+
+    const float INF = std::numeric_limits<float>::infinity();
+    std::vector<int> found;
+    std::vector<int> expected;
+    std::vector<float> foundDist;
+    std::vector<float> expectedDist;
+    for (int q = 0; q < QUERIES; q++) {
+        glm::vec3 p = q % 3 == 0 ? glm::vec3(normal(rng), 0.0f, normal(rng))
+                    : q % 3 == 1 ? glm::vec3(500.0f * unit(rng) - 250.0f, unit(rng), 500.0f * unit(rng) - 250.0f)
+                    : glm::vec3(1e4f * unit(rng), 0.0f, -1e4f * unit(rng));
+        int skip = q % 2 == 0 ? (int)(unit(rng) * points.size()) : -1;
+        float radius = q % 5 == 0 ? 40.0f * unit(rng) : 2.0f * unit(rng);
+
+        // radius: the same set
+        found.clear();
+        grid.queryRadius(p, radius, found, skip);
+        expected.clear();
+        for (int i = 0; i < (int)points.size(); i++) {
+            if (i != skip && distance2(points[i], p) <= radius * radius) {
+                expected.push_back(i);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        assert(found == expected);
+
+        // k nearest: the same distances, nearest first, whether or not the radius is bounded
+        int k = 1 + (int)(unit(rng) * 12.0f);
+        float maxRadius = q % 4 == 0 ? INF : radius;
+        grid.queryNearest(p, k, maxRadius, found, skip);
+        expectedDist.clear();
+        for (int i = 0; i < (int)points.size(); i++) {
+            float d2 = distance2(points[i], p);
+            if (i != skip && d2 <= maxRadius * maxRadius) {
+                expectedDist.push_back(d2);
+            }
+        }
+        std::sort(expectedDist.begin(), expectedDist.end());
+        expectedDist.resize(std::min((int)expectedDist.size(), k));
+        foundDist.clear();
+        for (int i : found) {
+            assert(i != skip);
+            foundDist.push_back(distance2(points[i], p));
+        }
+        assert(std::is_sorted(foundDist.begin(), foundDist.end()));
+        assert(foundDist == expectedDist);
+    }
+
+    // more neighbours asked for than there are points
+    grid.queryNearest(glm::vec3(0), points.size() + 10, INF, found, 0);
+    assert((int)found.size() == (int)points.size() - 1);
+
+    // an empty grid finds nothing, however far it looks
+    SpatialHash empty;
+    empty.build(nullptr, 0, 1.0f);
+    empty.queryNearest(glm::vec3(1, 2, 3), 4, INF, found);
+    assert(found.empty());
+
+    std::printf("spatial hash ok\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Checks StaticScene's hierarchy against a linear scan over its primitives: every
+// query is repeated on one single-primitive scene per obstacle and the nearest
+// answer kept. Also builds a lopsided scene, with outliers peeled off level by level
+#undef NDEBUG
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+#include "glm/gtx/transform.hpp"
+#include "scene/static_scene.h"
+
+static const int QUERIES = 5000;
+
+// distance closestPoint measured: points inside an obstacle (behind the surface
+// point it returns) are at 0
+static float surfaceDistance(glm::vec3 p, glm::vec3 point, glm::vec3 normal) {
+    return glm::dot(p - point, normal) > 0.0f ? glm::distance(p, point) : 0.0f;
+}
+
+// a scene and the same obstacles one per scene
+struct TestScene {
+    StaticScene scene;
+    std::vector<std::unique_ptr<StaticScene>> singles;
+    std::vector<int> singleBox; // box index in scene, or -1
+    std::vector<int> singleCylinder; // cylinder index in scene, or -1
+
+    void addBox(glm::vec3 center, glm::vec3 halfExtents, glm::mat3 rotation) {
+        int index = scene.addBox(center, halfExtents, rotation);
+        singles.push_back(std::make_unique<StaticScene>());
+        singles.back()->addBox(center, halfExtents, rotation);
+        singleBox.push_back(index);
+        singleCylinder.push_back(-1);
+    }
+    void addCylinder(glm::vec3 center, float radius, float halfHeight, glm::mat3 rotation) {
+        int index = scene.addCylinder(center, radius, halfHeight, rotation);
+        singles.push_back(std::make_unique<StaticScene>());
+        singles.back()->addCylinder(center, radius, halfHeight, rotation);
+        singleBox.push_back(-1);
+        singleCylinder.push_back(index);
+    }
+    void addTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+        scene.addMesh({a, b, c}, {glm::uvec3(0, 1, 2)});
+        singles.push_back(std::make_unique<StaticScene>());
+        singles.back()->addMesh({a, b, c}, {glm::uvec3(0, 1, 2)});
+        singleBox.push_back(-1);
+        singleCylinder.push_back(-1);
+    }
+    void build() {
+        scene.build();
+        for (auto& single : singles) {
+            single->build();
+        }
+    }
+
+    RayHit linearRaycast(glm::vec3 origin, glm::vec3 dir, float maxDist) const {
+        RayHit best = {false, maxDist, origin + maxDist * dir, glm::vec3(0.0f)};
+        for (const auto& single : singles) {
+            RayHit hit = single->raycast(origin, dir, best.t);
+            if (hit.hit && hit.t <= best.t) {
+                best = hit;
+            }
+        }
+        return best;
+    }
+    float linearClosest(glm::vec3 p, float maxDist) const {
+        float best = -1.0f;
+        for (const auto& single : singles) {
+            glm::vec3 point, normal;
+            if (single->closestPoint(p, maxDist, point, normal)) {
+                float dist = surfaceDistance(p, point, normal);
+                best = best < 0.0f ? dist : std::min(best, dist);
+            }
+        }
+        return best;
+    }
+};
+
+static glm::mat3 randomRotation(std::mt19937& rng) {
+    std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+    glm::vec3 axis = glm::normalize(glm::vec3(std::cos(angle(rng)), std::sin(angle(rng)), std::cos(angle(rng)) + 0.1f));
+    return glm::mat3(glm::rotate(angle(rng), axis));
+}
+
+// runs random queries against the hierarchy and the linear scan
+static void compare(const TestScene& test, glm::vec3 lo, glm::vec3 hi, std::mt19937& rng) {
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomPoint = [&]() { return lo + (hi - lo) * glm::vec3(unit(rng), unit(rng), unit(rng)); };
+    float maxDist = glm::length(hi - lo);
+    int hits = 0;
+    for (int q = 0; q < QUERIES; q++) {
+        glm::vec3 origin = randomPoint();
+        glm::vec3 dir = glm::normalize(randomPoint() - origin);
+
+        RayHit hit = test.scene.raycast(origin, dir, maxDist);
+        RayHit expected = test.linearRaycast(origin, dir, maxDist);
+        assert(hit.hit == expected.hit);
+        if (hit.hit) {
+            hits++;
+            assert(std::abs(hit.t - expected.t) <= 1e-4f * maxDist);
+        }
+
+        // a batch of rays in the same direction from around the origin
+        glm::vec3 origins[8];
+        RayHit batch[8];
+        for (int r = 0; r < 8; r++) {
+            origins[r] = origin + 0.3f * glm::vec3(unit(rng), unit(rng), unit(rng));
+        }
+        test.scene.raycastBatch(origins, 8, dir, maxDist, batch);
+        for (int r = 0; r < 8; r++) {
+            RayHit single = test.scene.raycast(origins[r], dir, maxDist);
+            assert(batch[r].hit == single.hit);
+            assert(!single.hit || std::abs(batch[r].t - single.t) <= 1e-5f * maxDist);
+        }
+
+        glm::vec3 p = randomPoint();
+        glm::vec3 point, normal;
+        float reach = 0.25f * maxDist;
+        bool found = test.scene.closestPoint(p, reach, point, normal);
+        float expectedDist = test.linearClosest(p, reach);
+        assert(found == (expectedDist >= 0.0f));
+        if (found) {
+            assert(std::abs(surfaceDistance(p, point, normal) - expectedDist) <= 1e-4f * maxDist);
+        }
+
+        glm::vec3 boxLo = randomPoint();
+        glm::vec3 boxHi = boxLo + 0.2f * (hi - lo) * unit(rng);
+        std::vector<int> boxes, cylinders;
+        test.scene.overlapping(boxLo, boxHi, boxes, cylinders);
+        std::vector<int> expectedBoxes, expectedCylinders;
+        for (std::size_t s = 0; s < test.singles.size(); s++) {
+            std::vector<int> singleBoxes, singleCylinders;
+            test.singles[s]->overlapping(boxLo, boxHi, singleBoxes, singleCylinders);
+            if (!singleBoxes.empty()) {
+                expectedBoxes.push_back(test.singleBox[s]);
+            }
+            if (!singleCylinders.empty()) {
+                expectedCylinders.push_back(test.singleCylinder[s]);
+            }
+        }
+        std::sort(boxes.begin(), boxes.end());
+        std::sort(cylinders.begin(), cylinders.end());
+        assert(boxes == expectedBoxes);
+        assert(cylinders == expectedCylinders);
+    }
+    std::printf("%zu obstacles, %d nodes: %d of %d rays hit\n",
+                test.singles.size(), test.scene.nodeCount(), hits, QUERIES);
+    assert(hits > 0);
+}
+
+int main() {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // boxes, cylinders and a bumpy mesh, scattered and rotated
+    TestScene scattered;
+    glm::vec3 lo(-20.0f, -2.0f, -20.0f), hi(20.0f, 6.0f, 20.0f);
+    for (int i = 0; i < 150; i++) {
+        glm::vec3 center(-18.0f + 36.0f * unit(rng), 4.0f * unit(rng), -18.0f + 36.0f * unit(rng));
+        if (i % 2 == 0) {
+            scattered.addBox(center, glm::vec3(0.2f) + glm::vec3(unit(rng), unit(rng), unit(rng)), randomRotation(rng));
+        } else {
+            scattered.addCylinder(center, 0.2f + unit(rng), 0.2f + unit(rng), randomRotation(rng));
+        }
+    }
+    for (int j = 0; j < 12; j++) {
+        for (int i = 0; i < 12; i++) {
+            auto corner = [](int i, int j) {
+                return glm::vec3(-6.0f + i, 0.5f * std::sin(0.9f * i) * std::cos(0.7f * j), -6.0f + j);
+            };
+            scattered.addTriangle(corner(i, j), corner(i + 1, j), corner(i, j + 1));
+            scattered.addTriangle(corner(i + 1, j), corner(i + 1, j + 1), corner(i, j + 1));
+        }
+    }
+    scattered.build();
+    compare(scattered, lo, hi, rng);
+
+    // every box a quarter further out than the last, so splits peel a few
+    // outliers off at a time and the hierarchy is lopsided and deep (about 30
+    // levels). queries still have to agree
+    TestScene skewed;
+    for (int i = 0; i < 300; i++) {
+        skewed.addBox(glm::vec3(std::pow(1.25f, (float)i), 0.0f, 0.0f), glm::vec3(0.5f), glm::mat3(1.0f));
+    }
+    skewed.build();
+    compare(skewed, glm::vec3(-2.0f), glm::vec3(40.0f, 2.0f, 2.0f), rng);
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Writes a tiled heightmap, opens it again and checks heights come back within a
+// sample step of what was written, that the header is laid out little-endian,
+// and that files with a tile index pointing outside or between pages don't open
+#undef NDEBUG
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include "terrain/tiled_heightmap.h"
+
+static const glm::vec2 ORIGIN(-5.0f, 3.0f);
+static const float CELL_SIZE = 0.25f;
+static const int TILE_SIZE = 16;
+static const int TILES_X = 3;
+static const int TILES_Z = 2;
+static const float MIN_HEIGHT = -2.0f;
+static const float MAX_HEIGHT = 2.0f;
+
+static float rollingHeight(float x, float z) {
+    return 1.5f * std::sin(0.7f * x) * std::cos(0.4f * z);
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), data.size());
+}
+
+static uint32_t littleEndianU32(const std::string& data, std::size_t at) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t)(uint8_t)data[at + i] << (8 * i);
+    }
+    return value;
+}
+
+int main() {
+    std::string path = "tiled_heightmap_test.hmap";
+    bool written = TiledHeightmap::write(path, TILE_SIZE, TILES_X, TILES_Z, ORIGIN, CELL_SIZE,
+                                         MIN_HEIGHT, MAX_HEIGHT, rollingHeight);
+    assert(written);
+
+    // the header's fields, whatever the host's byte order
+    std::string data = readFile(path);
+    assert(data.compare(0, 8, "ITSYHMAP") == 0);
+    assert(littleEndianU32(data, 8) == 1);
+    assert(littleEndianU32(data, 12) == TILE_SIZE);
+    assert(littleEndianU32(data, 16) == TILES_X);
+    assert(littleEndianU32(data, 20) == TILES_Z);
+    uint32_t firstTile = littleEndianU32(data, 48);
+    assert(firstTile % 4096 == 0 && littleEndianU32(data, 52) == 0);
+
+    {
+        TiledHeightmap heightmap(path, TILES_X * TILES_Z);
+        assert(heightmap.isOpen());
+        const TiledHeightmap::Header& header = heightmap.header();
+        assert(header.tileSize == TILE_SIZE && header.tilesX == TILES_X && header.tilesZ == TILES_Z);
+        assert(header.originX == ORIGIN.x && header.originZ == ORIGIN.y && header.cellSize == CELL_SIZE);
+        assert(header.minHeight == MIN_HEIGHT);
+
+        // on the samples the height is the written one, quantized
+        float worst = 0.0f;
+        for (int j = 0; j < TILES_Z * TILE_SIZE; j++) {
+            for (int i = 0; i < TILES_X * TILE_SIZE; i++) {
+                float x = ORIGIN.x + i * CELL_SIZE;
+                float z = ORIGIN.y + j * CELL_SIZE;
+                worst = std::fmax(worst, std::fabs(heightmap.height(x, z) - rollingHeight(x, z)));
+            }
+        }
+        std::printf("worst error on samples %g (step %g)\n", worst, header.heightScale);
+        assert(worst <= header.heightScale);
+
+        // between them it's bilinear, so on a tile seam it's the mean of its neighbours
+        float x = ORIGIN.x + (TILE_SIZE - 0.5f) * CELL_SIZE;
+        float z = ORIGIN.y + 3 * CELL_SIZE;
+        float mean = 0.5f * (heightmap.height(x - 0.5f * CELL_SIZE, z) + heightmap.height(x + 0.5f * CELL_SIZE, z));
+        assert(std::fabs(heightmap.height(x, z) - mean) < 1e-4f);
+        assert(heightmap.residentTiles() == TILES_X * TILES_Z);
+    }
+
+    // with room for two tiles, the ones used this frame stay however many there are,
+    // and the oldest go once they weren't used in the frame just ended
+    {
+        TiledHeightmap heightmap(path, 2);
+        heightmap.height(ORIGIN.x, ORIGIN.y);
+        heightmap.endFrame();
+        heightmap.prefetch(ORIGIN + glm::vec2(TILE_SIZE * CELL_SIZE * 1.5f, 0.0f), 0.1f);
+        heightmap.height(ORIGIN.x + TILE_SIZE * CELL_SIZE * 2.5f, ORIGIN.y);
+        heightmap.height(ORIGIN.x, ORIGIN.y + TILE_SIZE * CELL_SIZE * 1.5f);
+        heightmap.endFrame();
+        assert(heightmap.residentTiles() == 3);
+        heightmap.height(ORIGIN.x, ORIGIN.y + TILE_SIZE * CELL_SIZE * 1.5f);
+        heightmap.endFrame();
+        assert(heightmap.residentTiles() == 2);
+    }
+
+    // a tile that starts between pages, one that runs past the end of the file, and
+    // one so far out that its end wraps around
+    for (uint64_t offset : {(uint64_t)firstTile + 2, (uint64_t)data.size(),
+                            ~(uint64_t)0 - 4095}) {
+        std::string corrupt = data;
+        for (int i = 0; i < 8; i++) {
+            corrupt[48 + 8 + i] = (char)(offset >> (8 * i));
+        }
+        writeFile(path, corrupt);
+        TiledHeightmap heightmap(path, TILES_X * TILES_Z);
+        assert(!heightmap.isOpen());
+    }
+
+    std::remove(path.c_str());
+    std::printf("tiled heightmap ok\n");
+    return 0;
+}